@@ -33,10 +33,15 @@
 // accelerators/bvh.cpp*
 #include "stdafx.h"
 #include "accelerators/bvh.h"
+#include "intersection.h"
 #include "probes.h"
 #include "paramset.h"
+#include "parallel.h"
+#include "stats.h"
+#include "shapes/trianglemesh.h"
 
 // BVHAccel Local Declarations
+static StatsMemory bvhBytes("Memory", "BVH accelerator");
 struct BVHPrimitiveInfo {
     BVHPrimitiveInfo() { }
     BVHPrimitiveInfo(int pn, const BBox &b)
@@ -49,6 +54,58 @@ struct BVHPrimitiveInfo {
 };
 
 
+struct InitPrimitiveInfoFunc {
+    InitPrimitiveInfoFunc(const vector<BVHLeafItem> &bi,
+                          const vector<Reference<Primitive> > &p,
+                          const vector<BVHMesh> &m,
+                          vector<BVHPrimitiveInfo> &bd)
+        : buildItems(bi), primitives(p), meshes(m), buildData(bd) { }
+    void operator()(int i) const {
+        const BVHLeafItem &item = buildItems[i];
+        if (item.mesh == BVH_PRIMITIVE_ITEM)
+            buildData[i] = BVHPrimitiveInfo(i,
+                primitives[item.index]->WorldBound());
+        else
+            buildData[i] = BVHPrimitiveInfo(i,
+                meshes[item.mesh].mesh->TriangleWorldBound(item.index));
+    }
+    const vector<BVHLeafItem> &buildItems;
+    const vector<Reference<Primitive> > &primitives;
+    const vector<BVHMesh> &meshes;
+    vector<BVHPrimitiveInfo> &buildData;
+};
+
+
+struct InitTrianglesFunc {
+    InitTrianglesFunc(const BVHLeafItem *i, const vector<BVHMesh> &m,
+                      BVHTriangle *t)
+        : items(i), meshes(m), triangles(t) { }
+    void operator()(int i) const {
+        if (items[i].mesh == BVH_PRIMITIVE_ITEM) return;
+        meshes[items[i].mesh].mesh->GetTriangleEdges(items[i].index,
+            &triangles[i].p1, &triangles[i].e1, &triangles[i].e2);
+    }
+    const BVHLeafItem *items;
+    const vector<BVHMesh> &meshes;
+    BVHTriangle *triangles;
+};
+
+
+struct BVHTriangleHit {
+    BVHTriangleHit() : slot(BVH_PRIMITIVE_ITEM) { }
+    uint32_t slot;
+    float t, b1, b2;
+};
+
+
+static const TriangleMesh *CompactTriangleMesh(const Primitive *prim) {
+    const GeometricPrimitive *gp =
+        dynamic_cast<const GeometricPrimitive *>(prim);
+    if (!gp) return NULL;
+    return dynamic_cast<const TriangleMesh *>(gp->GetShape());
+}
+
+
 struct BVHBuildNode {
     // BVHBuildNode Public Methods
     BVHBuildNode() { children[0] = children[1] = NULL; }
@@ -110,16 +167,287 @@ bool CompareToBucket::operator()(const BVHPrimitiveInfo &p) const {
 }
 
 
-struct LinearBVHNode {
+struct CompareNodeToBucket {
+    CompareNodeToBucket(int split, int num, int d, const BBox &b)
+        : centroidBounds(b)
+    { splitBucket = split; nBuckets = num; dim = d; }
+    bool operator()(const BVHBuildNode *node) const {
+        float centroid = .5f * (node->bounds.pMin[dim] + node->bounds.pMax[dim]);
+        int b = nBuckets * ((centroid - centroidBounds.pMin[dim]) /
+                (centroidBounds.pMax[dim] - centroidBounds.pMin[dim]));
+        if (b == nBuckets) b = nBuckets-1;
+        Assert(b >= 0 && b < nBuckets);
+        return b <= splitBucket;
+    }
+
+    int splitBucket, nBuckets, dim;
+    const BBox &centroidBounds;
+};
+
+
+struct BucketInfo {
+    BucketInfo() { count = 0; }
+    int count;
     BBox bounds;
-    union {
-        uint32_t primitivesOffset;    // leaf
-        uint32_t secondChildOffset;   // interior
-    };
-
-    uint8_t nPrimitives;  // 0 -> interior node
-    uint8_t axis;         // interior node: xyz
-    uint8_t pad[2];       // ensure 32 byte total size
+};
+
+
+// Nodes with at least this many primitives build their children in
+// parallel; at least _BVH_PARALLEL_BINNING_PRIMS_ primitives also compute
+// bounds and SAH buckets in parallel, in chunks of _BVH_BINNING_CHUNK_SIZE_.
+static const uint32_t BVH_PARALLEL_SUBTREE_PRIMS = 16384;
+static const uint32_t BVH_PARALLEL_BINNING_PRIMS = 131072;
+static const uint32_t BVH_BINNING_CHUNK_SIZE = 16384;
+struct BVHBuildState {
+    BVHBuildState(vector<BVHPrimitiveInfo> &bd, bool p)
+        : buildData(bd), parallel(p) {
+        totalNodes = 0;
+        orderedPrims.resize(bd.size());
+        tasksMutex = Mutex::Create();
+    }
+    ~BVHBuildState() {
+        for (uint32_t i = 0; i < tasks.size(); ++i)
+            delete tasks[i];
+        Mutex::Destroy(tasksMutex);
+    }
+    vector<BVHPrimitiveInfo> &buildData;
+    bool parallel;
+    AtomicInt32 totalNodes;
+    vector<uint32_t> orderedPrims;
+    // Build tasks are kept until the tree is flattened, since their
+    // _MemoryArena_s hold the _BVHBuildNode_s they created
+    Mutex *tasksMutex;
+    vector<Task *> tasks;
+};
+
+
+struct BVHBuildTask : public Task {
+    BVHBuildTask(BVHAccel *b, BVHBuildState &s, uint32_t st, uint32_t e,
+                 BVHBuildNode **n)
+        : bvh(b), state(s), start(st), end(e), node(n) { }
+    void Run() {
+        *node = bvh->recursiveBuild(arena, state, start, end);
+    }
+    BVHAccel *bvh;
+    BVHBuildState &state;
+    uint32_t start, end;
+    BVHBuildNode **node;
+    MemoryArena arena;
+};
+
+
+struct ComputeBoundsFunc {
+    ComputeBoundsFunc(const vector<BVHPrimitiveInfo> &bd, uint32_t s,
+                      uint32_t e, BBox *b, BBox *cb)
+        : buildData(bd), start(s), end(e), bounds(b), centroidBounds(cb) { }
+    void operator()(int chunk) const {
+        uint32_t chunkStart = start + chunk * BVH_BINNING_CHUNK_SIZE;
+        uint32_t chunkEnd = min(chunkStart + BVH_BINNING_CHUNK_SIZE, end);
+        for (uint32_t i = chunkStart; i < chunkEnd; ++i) {
+            bounds[chunk] = Union(bounds[chunk], buildData[i].bounds);
+            centroidBounds[chunk] = Union(centroidBounds[chunk],
+                                          buildData[i].centroid);
+        }
+    }
+    const vector<BVHPrimitiveInfo> &buildData;
+    uint32_t start, end;
+    BBox *bounds, *centroidBounds;
+};
+
+
+struct ComputeBucketsFunc {
+    ComputeBucketsFunc(const vector<BVHPrimitiveInfo> &bd, uint32_t s,
+                       uint32_t e, int d, const BBox &cb, int nb,
+                       BucketInfo *b)
+        : buildData(bd), start(s), end(e), dim(d), centroidBounds(cb),
+          nBuckets(nb), buckets(b) { }
+    void operator()(int chunk) const {
+        uint32_t chunkStart = start + chunk * BVH_BINNING_CHUNK_SIZE;
+        uint32_t chunkEnd = min(chunkStart + BVH_BINNING_CHUNK_SIZE, end);
+        BucketInfo *chunkBuckets = &buckets[chunk * nBuckets];
+        for (uint32_t i = chunkStart; i < chunkEnd; ++i) {
+            int b = nBuckets *
+                ((buildData[i].centroid[dim] - centroidBounds.pMin[dim]) /
+                 (centroidBounds.pMax[dim] - centroidBounds.pMin[dim]));
+            if (b == nBuckets) b = nBuckets-1;
+            Assert(b >= 0 && b < nBuckets);
+            chunkBuckets[b].count++;
+            chunkBuckets[b].bounds = Union(chunkBuckets[b].bounds, buildData[i].bounds);
+        }
+    }
+    const vector<BVHPrimitiveInfo> &buildData;
+    uint32_t start, end;
+    int dim;
+    const BBox &centroidBounds;
+    int nBuckets;
+    BucketInfo *buckets;
+};
+
+
+static void ComputeBounds(const BVHBuildState &state, uint32_t start,
+        uint32_t end, BBox *bbox, BBox *centroidBounds) {
+    const vector<BVHPrimitiveInfo> &buildData = state.buildData;
+    if (state.parallel && end - start >= BVH_PARALLEL_BINNING_PRIMS) {
+        // Compute bounds for chunks of primitives in parallel and merge them
+        int nChunks = (end - start + BVH_BINNING_CHUNK_SIZE - 1) /
+                      BVH_BINNING_CHUNK_SIZE;
+        vector<BBox> bounds(nChunks), cBounds(nChunks);
+        ParallelFor(0, nChunks, 1, ComputeBoundsFunc(buildData, start, end,
+                                                     &bounds[0], &cBounds[0]));
+        for (int i = 0; i < nChunks; ++i) {
+            *bbox = Union(*bbox, bounds[i]);
+            *centroidBounds = Union(*centroidBounds, cBounds[i]);
+        }
+    }
+    else {
+        for (uint32_t i = start; i < end; ++i) {
+            *bbox = Union(*bbox, buildData[i].bounds);
+            *centroidBounds = Union(*centroidBounds, buildData[i].centroid);
+        }
+    }
+}
+
+
+static void ComputeBuckets(const BVHBuildState &state, uint32_t start,
+        uint32_t end, int dim, const BBox &centroidBounds, int nBuckets,
+        BucketInfo *buckets) {
+    const vector<BVHPrimitiveInfo> &buildData = state.buildData;
+    if (state.parallel && end - start >= BVH_PARALLEL_BINNING_PRIMS) {
+        // Fill per-chunk buckets in parallel and merge them
+        int nChunks = (end - start + BVH_BINNING_CHUNK_SIZE - 1) /
+                      BVH_BINNING_CHUNK_SIZE;
+        vector<BucketInfo> chunkBuckets(nChunks * nBuckets);
+        ParallelFor(0, nChunks, 1, ComputeBucketsFunc(buildData, start, end,
+                        dim, centroidBounds, nBuckets, &chunkBuckets[0]));
+        for (int i = 0; i < nChunks; ++i)
+            for (int b = 0; b < nBuckets; ++b) {
+                buckets[b].count += chunkBuckets[i*nBuckets+b].count;
+                buckets[b].bounds = Union(buckets[b].bounds,
+                                          chunkBuckets[i*nBuckets+b].bounds);
+            }
+    }
+    else {
+        for (uint32_t i = start; i < end; ++i) {
+            int b = nBuckets *
+                ((buildData[i].centroid[dim] - centroidBounds.pMin[dim]) /
+                 (centroidBounds.pMax[dim] - centroidBounds.pMin[dim]));
+            if (b == nBuckets) b = nBuckets-1;
+            Assert(b >= 0 && b < nBuckets);
+            buckets[b].count++;
+            buckets[b].bounds = Union(buckets[b].bounds, buildData[i].bounds);
+        }
+    }
+}
+
+
+struct MortonPrimitive {
+    uint32_t primitiveIndex;
+    uint32_t mortonCode;
+};
+
+
+struct LBVHTreelet {
+    uint32_t start, nPrimitives;
+    BVHBuildNode *buildNodes;
+};
+
+
+static inline uint32_t LeftShift3(uint32_t x) {
+    // Spread the low 10 bits of _x_ out to every third bit
+    Assert(x <= (1 << 10));
+    if (x == (1 << 10)) --x;
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x <<  8)) & 0x0300f00f;
+    x = (x | (x <<  4)) & 0x030c30c3;
+    x = (x | (x <<  2)) & 0x09249249;
+    return x;
+}
+
+
+static inline uint32_t EncodeMorton3(const Vector &v) {
+    Assert(v.x >= 0 && v.y >= 0 && v.z >= 0);
+    return (LeftShift3(uint32_t(v.z)) << 2) | (LeftShift3(uint32_t(v.y)) << 1) |
+            LeftShift3(uint32_t(v.x));
+}
+
+
+static void RadixSort(vector<MortonPrimitive> *v) {
+    vector<MortonPrimitive> tempVector(v->size());
+    const int bitsPerPass = 6;
+    const int nBits = 30;
+    const int nPasses = nBits / bitsPerPass;
+    for (int pass = 0; pass < nPasses; ++pass) {
+        // Perform one pass of radix sort, sorting _bitsPerPass_ bits
+        int lowBit = pass * bitsPerPass;
+
+        // Set in and out vector pointers for radix sort pass
+        vector<MortonPrimitive> &in = (pass & 1) ? tempVector : *v;
+        vector<MortonPrimitive> &out = (pass & 1) ? *v : tempVector;
+
+        // Count number of zero bits in array for current radix sort bit
+        const int nBuckets = 1 << bitsPerPass;
+        uint32_t bucketCount[nBuckets] = { 0 };
+        const uint32_t bitMask = (1 << bitsPerPass) - 1;
+        for (uint32_t i = 0; i < in.size(); ++i) {
+            int bucket = (in[i].mortonCode >> lowBit) & bitMask;
+            ++bucketCount[bucket];
+        }
+
+        // Compute starting index in output array for each bucket
+        uint32_t outIndex[nBuckets];
+        outIndex[0] = 0;
+        for (int i = 1; i < nBuckets; ++i)
+            outIndex[i] = outIndex[i - 1] + bucketCount[i - 1];
+
+        // Store sorted values in output array
+        for (uint32_t i = 0; i < in.size(); ++i) {
+            int bucket = (in[i].mortonCode >> lowBit) & bitMask;
+            out[outIndex[bucket]++] = in[i];
+        }
+    }
+    // Copy final result from _tempVector_, if needed
+    if (nPasses & 1) v->swap(tempVector);
+}
+
+
+struct ComputeMortonFunc {
+    ComputeMortonFunc(const vector<BVHPrimitiveInfo> &bd, const BBox &cb,
+                      vector<MortonPrimitive> &mp)
+        : buildData(bd), centroidBounds(cb), mortonPrims(mp) { }
+    void operator()(int i) const {
+        // Quantize primitive centroid to $2^{10}$ steps along each axis
+        const float mortonScale = 1 << 10;
+        mortonPrims[i].primitiveIndex = i;
+        Vector centroidOffset = buildData[i].centroid - centroidBounds.pMin;
+        for (int axis = 0; axis < 3; ++axis) {
+            float extent = centroidBounds.pMax[axis] - centroidBounds.pMin[axis];
+            if (extent > 0.f) centroidOffset[axis] /= extent;
+        }
+        mortonPrims[i].mortonCode = EncodeMorton3(centroidOffset * mortonScale);
+    }
+    const vector<BVHPrimitiveInfo> &buildData;
+    const BBox &centroidBounds;
+    vector<MortonPrimitive> &mortonPrims;
+};
+
+
+struct EmitTreeletFunc {
+    EmitTreeletFunc(const BVHAccel *b, BVHBuildState &s,
+                    const vector<MortonPrimitive> &mp,
+                    vector<LBVHTreelet> &t, int bi)
+        : bvh(b), state(s), mortonPrims(mp), treelets(t), bitIndex(bi) { }
+    void operator()(int i) const {
+        // Generate _i_th LBVH treelet
+        LBVHTreelet &tr = treelets[i];
+        BVHBuildNode *buildNodes = tr.buildNodes;
+        tr.buildNodes = bvh->emitLBVH(buildNodes, state, &mortonPrims[0],
+                                      tr.start, tr.nPrimitives, bitIndex);
+    }
+    const BVHAccel *bvh;
+    BVHBuildState &state;
+    const vector<MortonPrimitive> &mortonPrims;
+    vector<LBVHTreelet> &treelets;
+    int bitIndex;
 };
 
 
@@ -151,45 +479,113 @@ static inline bool IntersectP(const BBox &bounds, const Ray &ray,
 
 // BVHAccel Method Definitions
 BVHAccel::BVHAccel(const vector<Reference<Primitive> > &p,
-                   uint32_t mp, const string &sm) {
+                   uint32_t mp, const string &sm, bool parallelBuild,
+                   bool compactTriangles, bool packTriangles) {
     maxPrimsInNode = min(255u, mp);
-    for (uint32_t i = 0; i < p.size(); ++i)
-        p[i]->FullyRefine(primitives);
     if (sm == "sah")         splitMethod = SPLIT_SAH;
     else if (sm == "middle") splitMethod = SPLIT_MIDDLE;
     else if (sm == "equal")  splitMethod = SPLIT_EQUAL_COUNTS;
+    else if (sm == "lbvh")   splitMethod = SPLIT_LBVH;
+    else if (sm == "hlbvh")  splitMethod = SPLIT_HLBVH;
     else {
         Warning("BVH split method \"%s\" unknown.  Using \"sah\".",
                 sm.c_str());
         splitMethod = SPLIT_SAH;
     }
+    nodes = NULL;
+    items = NULL;
+    triangles = NULL;
 
-    if (primitives.size() == 0) {
-        nodes = NULL;
-        return;
+    // Fully refine primitives, keeping triangle meshes unrefined if requested
+    vector<Reference<Primitive> > prims;
+    vector<BVHLeafItem> buildItems;
+    for (uint32_t i = 0; i < p.size(); ++i) {
+        vector<Reference<Primitive> > todo;
+        todo.push_back(p[i]);
+        while (todo.size()) {
+            Reference<Primitive> prim = todo.back();
+            todo.pop_back();
+            const TriangleMesh *mesh =
+                compactTriangles ? CompactTriangleMesh(prim.GetPtr()) : NULL;
+            if (mesh) {
+                // Add leaf items for _mesh_'s triangles, in the same order
+                // that _Primitive::FullyRefine()_ would have produced them
+                // and with the ids its _Triangle_s and their primitives
+                // would have had
+                BVHLeafItem item = { uint32_t(meshes.size()), 0 };
+                int32_t nTris = mesh->NumTriangles();
+                uint32_t shapeIdBase =
+                    AtomicAdd(&Shape::nextshapeId, nTris) - nTris;
+                uint32_t primitiveIdBase =
+                    AtomicAdd(&Primitive::nextprimitiveId, nTris) - nTris;
+                meshes.push_back(BVHMesh(mesh, prim, shapeIdBase,
+                                         primitiveIdBase));
+                for (int face = mesh->NumTriangles() - 1; face >= 0; --face) {
+                    item.index = face;
+                    buildItems.push_back(item);
+                }
+            }
+            else if (prim->CanIntersect()) {
+                BVHLeafItem item = { BVH_PRIMITIVE_ITEM, uint32_t(prims.size()) };
+                buildItems.push_back(item);
+                prims.push_back(prim);
+            }
+            else
+                prim->Refine(todo);
+        }
     }
-    // Build BVH from _primitives_
-    PBRT_BVH_STARTED_CONSTRUCTION(this, primitives.size());
+    if (buildItems.size() == 0)
+        return;
+    // Build BVH from _buildItems_
+    PBRT_BVH_STARTED_CONSTRUCTION(this, buildItems.size());
 
     // Initialize _buildData_ array for primitives
-    vector<BVHPrimitiveInfo> buildData;
-    buildData.reserve(primitives.size());
-    for (uint32_t i = 0; i < primitives.size(); ++i) {
-        BBox bbox = primitives[i]->WorldBound();
-        buildData.push_back(BVHPrimitiveInfo(i, bbox));
-    }
+    vector<BVHPrimitiveInfo> buildData(buildItems.size());
+    ParallelFor(0, buildItems.size(), 4096,
+                InitPrimitiveInfoFunc(buildItems, prims, meshes, buildData));
 
     // Recursively build BVH tree for primitives
     MemoryArena buildArena;
-    uint32_t totalNodes = 0;
-    vector<Reference<Primitive> > orderedPrims;
-    orderedPrims.reserve(primitives.size());
-    BVHBuildNode *root = recursiveBuild(buildArena, buildData, 0,
-                                        primitives.size(), &totalNodes,
-                                        orderedPrims);
-    primitives.swap(orderedPrims);
-        Info("BVH created with %d nodes for %d primitives (%.2f MB)", totalNodes,
-             (int)primitives.size(), float(totalNodes * sizeof(LinearBVHNode))/(1024.f*1024.f));
+    BVHBuildState state(buildData, parallelBuild);
+    BVHBuildNode *root;
+    if (splitMethod == SPLIT_LBVH || splitMethod == SPLIT_HLBVH)
+        root = HLBVHBuild(buildArena, state);
+    else if (parallelBuild) {
+        // Run the build as a task so that subtree tasks it spawns nest
+        BVHBuildTask *rootTask = new BVHBuildTask(this, state, 0,
+                                                  buildItems.size(), &root);
+        state.tasks.push_back(rootTask);
+        vector<Task *> tasks(1, rootTask);
+        EnqueueTasks(tasks);
+        WaitForAllTasks();
+    }
+    else
+        root = recursiveBuild(buildArena, state, 0, buildItems.size());
+    uint32_t totalNodes = state.totalNodes;
+
+    // Store leaf items in BVH order, with _primitives_ in the same order
+    uint32_t nItems = buildItems.size();
+    items = AllocAligned<BVHLeafItem>(nItems);
+    primitives.reserve(prims.size());
+    for (uint32_t i = 0; i < nItems; ++i) {
+        items[i] = buildItems[state.orderedPrims[i]];
+        if (items[i].mesh == BVH_PRIMITIVE_ITEM) {
+            primitives.push_back(prims[items[i].index]);
+            items[i].index = primitives.size() - 1;
+        }
+    }
+    if (packTriangles && meshes.size() > 0) {
+        triangles = AllocAligned<BVHTriangle>(nItems);
+        ParallelFor(0, nItems, 4096,
+                    InitTrianglesFunc(items, meshes, triangles));
+    }
+    uint32_t nBytes = totalNodes * sizeof(LinearBVHNode) +
+        nItems * sizeof(BVHLeafItem) +
+        (triangles ? nItems * sizeof(BVHTriangle) : 0);
+    bvhBytes += nBytes;
+    Info("BVH created with %d nodes for %d primitives and %d mesh triangles (%.2f MB)",
+             totalNodes, (int)primitives.size(), int(nItems - primitives.size()),
+             float(nBytes)/(1024.f*1024.f));
 
     // Compute representation of depth-first traversal of BVH tree
     nodes = AllocAligned<LinearBVHNode>(totalNodes);
@@ -208,31 +604,25 @@ BBox BVHAccel::WorldBound() const {
 
 
 BVHBuildNode *BVHAccel::recursiveBuild(MemoryArena &buildArena,
-        vector<BVHPrimitiveInfo> &buildData, uint32_t start,
-        uint32_t end, uint32_t *totalNodes,
-        vector<Reference<Primitive> > &orderedPrims) {
+        BVHBuildState &state, uint32_t start, uint32_t end) {
     Assert(start != end);
-    (*totalNodes)++;
+    AtomicAdd(&state.totalNodes, 1);
     BVHBuildNode *node = buildArena.Alloc<BVHBuildNode>();
-    // Compute bounds of all primitives in BVH node
-    BBox bbox;
-    for (uint32_t i = start; i < end; ++i)
-        bbox = Union(bbox, buildData[i].bounds);
+    vector<BVHPrimitiveInfo> &buildData = state.buildData;
+    // Compute bounds of all primitives and primitive centroids in BVH node
+    BBox bbox, centroidBounds;
+    ComputeBounds(state, start, end, &bbox, &centroidBounds);
     uint32_t nPrimitives = end - start;
     if (nPrimitives == 1) {
         // Create leaf _BVHBuildNode_
-        uint32_t firstPrimOffset = orderedPrims.size();
         for (uint32_t i = start; i < end; ++i) {
             uint32_t primNum = buildData[i].primitiveNumber;
-            orderedPrims.push_back(primitives[primNum]);
+            state.orderedPrims[i] = primNum;
         }
-        node->InitLeaf(firstPrimOffset, nPrimitives, bbox);
+        node->InitLeaf(start, nPrimitives, bbox);
     }
     else {
-        // Compute bound of primitive centroids, choose split dimension _dim_
-        BBox centroidBounds;
-        for (uint32_t i = start; i < end; ++i)
-            centroidBounds = Union(centroidBounds, buildData[i].centroid);
+        // Choose split dimension _dim_
         int dim = centroidBounds.MaximumExtent();
 
         // Partition primitives into two sets and build children
@@ -242,23 +632,18 @@ BVHBuildNode *BVHAccel::recursiveBuild(MemoryArena &buildArena,
             // then all the nodes can be stored in a compact bvh node.
             if (nPrimitives <= maxPrimsInNode) {
                 // Create leaf _BVHBuildNode_
-                uint32_t firstPrimOffset = orderedPrims.size();
                 for (uint32_t i = start; i < end; ++i) {
                     uint32_t primNum = buildData[i].primitiveNumber;
-                    orderedPrims.push_back(primitives[primNum]);
+                    state.orderedPrims[i] = primNum;
                 }
-                node->InitLeaf(firstPrimOffset, nPrimitives, bbox);
+                node->InitLeaf(start, nPrimitives, bbox);
                 return node;
             }
             else {
                 // else if nPrimitives is greater than maxPrimsInNode, we
                 // need to split it further to guarantee each node contains
                 // no more than maxPrimsInNode primitives.
-                node->InitInterior(dim,
-                                   recursiveBuild(buildArena, buildData, start, mid,
-                                                  totalNodes, orderedPrims),
-                                   recursiveBuild(buildArena, buildData, mid, end,
-                                                  totalNodes, orderedPrims));
+                buildInterior(buildArena, state, node, dim, start, mid, end);
                 return node;
             }
         }
@@ -296,23 +681,11 @@ BVHBuildNode *BVHAccel::recursiveBuild(MemoryArena &buildArena,
             else {
                 // Allocate _BucketInfo_ for SAH partition buckets
                 const int nBuckets = 12;
-                struct BucketInfo {
-                    BucketInfo() { count = 0; }
-                    int count;
-                    BBox bounds;
-                };
                 BucketInfo buckets[nBuckets];
 
                 // Initialize _BucketInfo_ for SAH partition buckets
-                for (uint32_t i = start; i < end; ++i) {
-                    int b = nBuckets *
-                        ((buildData[i].centroid[dim] - centroidBounds.pMin[dim]) /
-                         (centroidBounds.pMax[dim] - centroidBounds.pMin[dim]));
-                    if (b == nBuckets) b = nBuckets-1;
-                    Assert(b >= 0 && b < nBuckets);
-                    buckets[b].count++;
-                    buckets[b].bounds = Union(buckets[b].bounds, buildData[i].bounds);
-                }
+                ComputeBuckets(state, start, end, dim, centroidBounds,
+                               nBuckets, buckets);
 
                 // Compute costs for splitting after each bucket
                 float cost[nBuckets-1];
@@ -352,24 +725,250 @@ BVHBuildNode *BVHAccel::recursiveBuild(MemoryArena &buildArena,
                 
                 else {
                     // Create leaf _BVHBuildNode_
-                    uint32_t firstPrimOffset = orderedPrims.size();
                     for (uint32_t i = start; i < end; ++i) {
                         uint32_t primNum = buildData[i].primitiveNumber;
-                        orderedPrims.push_back(primitives[primNum]);
+                        state.orderedPrims[i] = primNum;
                     }
-                    node->InitLeaf(firstPrimOffset, nPrimitives, bbox);
+                    node->InitLeaf(start, nPrimitives, bbox);
                     return node;
                 }
             }
             break;
         }
         }
-        node->InitInterior(dim,
-                           recursiveBuild(buildArena, buildData, start, mid,
-                                          totalNodes, orderedPrims),
-                           recursiveBuild(buildArena, buildData, mid, end,
-                                          totalNodes, orderedPrims));
+        buildInterior(buildArena, state, node, dim, start, mid, end);
+    }
+    return node;
+}
+
+
+void BVHAccel::buildInterior(MemoryArena &buildArena, BVHBuildState &state,
+        BVHBuildNode *node, uint32_t dim, uint32_t start, uint32_t mid,
+        uint32_t end) {
+    BVHBuildNode *children[2];
+    if (state.parallel && end - start >= BVH_PARALLEL_SUBTREE_PRIMS) {
+        // Build first child in a new task while this thread builds the second
+        BVHBuildTask *task = new BVHBuildTask(this, state, start, mid,
+                                              &children[0]);
+        { MutexLock lock(*state.tasksMutex);
+        state.tasks.push_back(task);
+        }
+        vector<Task *> tasks(1, task);
+        EnqueueTasks(tasks);
+        children[1] = recursiveBuild(buildArena, state, mid, end);
+        WaitForAllTasks();
+    }
+    else {
+        children[0] = recursiveBuild(buildArena, state, start, mid);
+        children[1] = recursiveBuild(buildArena, state, mid, end);
+    }
+    node->InitInterior(dim, children[0], children[1]);
+}
+
+
+BVHBuildNode *BVHAccel::HLBVHBuild(MemoryArena &buildArena,
+        BVHBuildState &state) const {
+    // Compute bounding box of all primitive centroids
+    BBox bounds, centroidBounds;
+    ComputeBounds(state, 0, state.buildData.size(), &bounds, &centroidBounds);
+
+    // Compute Morton indices of primitives
+    vector<MortonPrimitive> mortonPrims(state.buildData.size());
+    if (state.parallel)
+        ParallelFor(0, mortonPrims.size(), 4096,
+                    ComputeMortonFunc(state.buildData, centroidBounds,
+                                      mortonPrims));
+    else {
+        ComputeMortonFunc computeMorton(state.buildData, centroidBounds,
+                                        mortonPrims);
+        for (uint32_t i = 0; i < mortonPrims.size(); ++i)
+            computeMorton(i);
+    }
+
+    // Radix sort primitive Morton indices
+    RadixSort(&mortonPrims);
+
+    // Create LBVH treelets at bottom of BVH
+    vector<LBVHTreelet> treeletsToBuild;
+    int firstBitIndex = 29;
+    if (splitMethod == SPLIT_HLBVH) {
+        // Find intervals of primitives for each treelet
+        const uint32_t mask = 0x3ffc0000;
+        firstBitIndex -= 12;
+        for (uint32_t start = 0, end = 1; end <= mortonPrims.size(); ++end) {
+            if (end == mortonPrims.size() ||
+                ((mortonPrims[start].mortonCode & mask) !=
+                 (mortonPrims[end].mortonCode & mask))) {
+                LBVHTreelet treelet = { start, end - start, NULL };
+                treeletsToBuild.push_back(treelet);
+                start = end;
+            }
+        }
+    }
+    else {
+        LBVHTreelet treelet = { 0, uint32_t(mortonPrims.size()), NULL };
+        treeletsToBuild.push_back(treelet);
     }
+
+    // Allocate nodes for treelets and create them, in parallel if possible
+    for (uint32_t i = 0; i < treeletsToBuild.size(); ++i) {
+        uint32_t maxNodes = 2 * treeletsToBuild[i].nPrimitives - 1;
+        treeletsToBuild[i].buildNodes = buildArena.Alloc<BVHBuildNode>(maxNodes);
+    }
+    EmitTreeletFunc emitTreelet(this, state, mortonPrims, treeletsToBuild,
+                                firstBitIndex);
+    if (state.parallel)
+        ParallelFor(0, treeletsToBuild.size(), 1, emitTreelet);
+    else
+        for (uint32_t i = 0; i < treeletsToBuild.size(); ++i)
+            emitTreelet(i);
+
+    // Create and return SAH BVH from LBVH treelets
+    vector<BVHBuildNode *> treeletRoots;
+    for (uint32_t i = 0; i < treeletsToBuild.size(); ++i)
+        treeletRoots.push_back(treeletsToBuild[i].buildNodes);
+    return buildUpperSAH(buildArena, state, treeletRoots, 0,
+                         treeletRoots.size());
+}
+
+
+BVHBuildNode *BVHAccel::emitLBVH(BVHBuildNode *&buildNodes,
+        BVHBuildState &state, const MortonPrimitive *mortonPrims,
+        uint32_t start, uint32_t nPrimitives, int bitIndex) const {
+    Assert(nPrimitives > 0);
+    if (nPrimitives <= maxPrimsInNode) {
+        // Create and return leaf node of LBVH treelet
+        AtomicAdd(&state.totalNodes, 1);
+        BVHBuildNode *node = buildNodes++;
+        BBox bounds;
+        for (uint32_t i = start; i < start + nPrimitives; ++i) {
+            uint32_t primNum = mortonPrims[i].primitiveIndex;
+            state.orderedPrims[i] = primNum;
+            bounds = Union(bounds, state.buildData[primNum].bounds);
+        }
+        node->InitLeaf(start, nPrimitives, bounds);
+        return node;
+    }
+    uint32_t splitOffset, axis;
+    if (bitIndex == -1) {
+        // Split primitives with identical Morton codes at the middle
+        splitOffset = nPrimitives / 2;
+        axis = 0;
+    }
+    else {
+        int mask = 1 << bitIndex;
+        // Advance to next subtree level if there's no LBVH split for this bit
+        if ((mortonPrims[start].mortonCode & mask) ==
+            (mortonPrims[start + nPrimitives - 1].mortonCode & mask))
+            return emitLBVH(buildNodes, state, mortonPrims, start,
+                            nPrimitives, bitIndex - 1);
+
+        // Find LBVH split point for this dimension
+        uint32_t searchStart = 0, searchEnd = nPrimitives - 1;
+        while (searchStart + 1 != searchEnd) {
+            Assert(searchStart != searchEnd);
+            uint32_t mid = (searchStart + searchEnd) / 2;
+            if ((mortonPrims[start + searchStart].mortonCode & mask) ==
+                (mortonPrims[start + mid].mortonCode & mask))
+                searchStart = mid;
+            else {
+                Assert((mortonPrims[start + mid].mortonCode & mask) ==
+                       (mortonPrims[start + searchEnd].mortonCode & mask));
+                searchEnd = mid;
+            }
+        }
+        splitOffset = searchEnd;
+        axis = bitIndex % 3;
+    }
+    Assert(splitOffset > 0 && splitOffset < nPrimitives);
+
+    // Create and return interior LBVH node
+    AtomicAdd(&state.totalNodes, 1);
+    BVHBuildNode *node = buildNodes++;
+    BVHBuildNode *c0 = emitLBVH(buildNodes, state, mortonPrims, start,
+                                splitOffset, bitIndex - 1);
+    BVHBuildNode *c1 = emitLBVH(buildNodes, state, mortonPrims,
+                                start + splitOffset, nPrimitives - splitOffset,
+                                bitIndex - 1);
+    node->InitInterior(axis, c0, c1);
+    return node;
+}
+
+
+BVHBuildNode *BVHAccel::buildUpperSAH(MemoryArena &buildArena,
+        BVHBuildState &state, vector<BVHBuildNode *> &treeletRoots,
+        uint32_t start, uint32_t end) const {
+    Assert(start < end);
+    uint32_t nNodes = end - start;
+    if (nNodes == 1) return treeletRoots[start];
+    AtomicAdd(&state.totalNodes, 1);
+    BVHBuildNode *node = buildArena.Alloc<BVHBuildNode>();
+
+    // Compute bounds of all nodes and node centroids under this HLBVH node
+    BBox bbox, centroidBounds;
+    for (uint32_t i = start; i < end; ++i) {
+        bbox = Union(bbox, treeletRoots[i]->bounds);
+        Point centroid = .5f * treeletRoots[i]->bounds.pMin +
+                         .5f * treeletRoots[i]->bounds.pMax;
+        centroidBounds = Union(centroidBounds, centroid);
+    }
+    int dim = centroidBounds.MaximumExtent();
+    uint32_t mid = (start + end) / 2;
+    if (centroidBounds.pMax[dim] != centroidBounds.pMin[dim]) {
+        // Allocate _BucketInfo_ for SAH partition buckets
+        const int nBuckets = 12;
+        BucketInfo buckets[nBuckets];
+
+        // Initialize _BucketInfo_ for HLBVH SAH partition buckets
+        for (uint32_t i = start; i < end; ++i) {
+            float centroid = .5f * (treeletRoots[i]->bounds.pMin[dim] +
+                                    treeletRoots[i]->bounds.pMax[dim]);
+            int b = nBuckets * ((centroid - centroidBounds.pMin[dim]) /
+                                (centroidBounds.pMax[dim] - centroidBounds.pMin[dim]));
+            if (b == nBuckets) b = nBuckets - 1;
+            Assert(b >= 0 && b < nBuckets);
+            buckets[b].count++;
+            buckets[b].bounds = Union(buckets[b].bounds, treeletRoots[i]->bounds);
+        }
+
+        // Compute costs for splitting after each bucket
+        float cost[nBuckets - 1];
+        for (int i = 0; i < nBuckets - 1; ++i) {
+            BBox b0, b1;
+            int count0 = 0, count1 = 0;
+            for (int j = 0; j <= i; ++j) {
+                b0 = Union(b0, buckets[j].bounds);
+                count0 += buckets[j].count;
+            }
+            for (int j = i + 1; j < nBuckets; ++j) {
+                b1 = Union(b1, buckets[j].bounds);
+                count1 += buckets[j].count;
+            }
+            cost[i] = .125f + (count0 * b0.SurfaceArea() +
+                               count1 * b1.SurfaceArea()) / bbox.SurfaceArea();
+        }
+
+        // Find bucket to split at that minimizes SAH metric
+        float minCost = cost[0];
+        int minCostSplitBucket = 0;
+        for (int i = 1; i < nBuckets - 1; ++i) {
+            if (cost[i] < minCost) {
+                minCost = cost[i];
+                minCostSplitBucket = i;
+            }
+        }
+
+        // Split nodes and create interior HLBVH SAH node
+        BVHBuildNode **pmid = std::partition(&treeletRoots[start],
+            &treeletRoots[end - 1] + 1,
+            CompareNodeToBucket(minCostSplitBucket, nBuckets, dim,
+                                centroidBounds));
+        mid = pmid - &treeletRoots[0];
+    }
+    Assert(mid > start && mid < end);
+    node->InitInterior(dim,
+        buildUpperSAH(buildArena, state, treeletRoots, start, mid),
+        buildUpperSAH(buildArena, state, treeletRoots, mid, end));
     return node;
 }
 
@@ -397,6 +996,96 @@ uint32_t BVHAccel::flattenBVHTree(BVHBuildNode *node, uint32_t *offset) {
 
 BVHAccel::~BVHAccel() {
     FreeAligned(nodes);
+    FreeAligned(items);
+    FreeAligned(triangles);
+}
+
+
+bool BVHAccel::intersectItem(uint32_t slot, const Ray &ray,
+        Intersection *isect, BVHTriangleHit *triHit) const {
+    const BVHLeafItem &item = items[slot];
+    if (item.mesh == BVH_PRIMITIVE_ITEM) {
+        if (!primitives[item.index]->Intersect(ray, isect))
+            return false;
+        triHit->slot = BVH_PRIMITIVE_ITEM;
+        return true;
+    }
+    // Intersect ray with mesh triangle for leaf item
+    const BVHMesh &m = meshes[item.mesh];
+    float t, b1, b2;
+    bool hit;
+    if (triangles)
+        hit = IntersectTriangle(ray, triangles[slot].p1, triangles[slot].e1,
+                                triangles[slot].e2, &t, &b1, &b2);
+    else {
+        Point p1;
+        Vector e1, e2;
+        m.mesh->GetTriangleEdges(item.index, &p1, &e1, &e2);
+        hit = IntersectTriangle(ray, p1, e1, e2, &t, &b1, &b2);
+    }
+    if (!hit) return false;
+
+    // Record triangle hit, deferring _Intersection_ setup if possible
+    BVHTriangleHit h;
+    h.slot = slot;
+    h.t = t;
+    h.b1 = b1;
+    h.b2 = b2;
+    if (m.mesh->HasAlphaTexture()) {
+        // Alpha-tested triangles may reject the hit, so finish it now
+        if (!m.mesh->ComputeTriangleHit(item.index, ray, t, b1, b2, m.mesh,
+                                        &isect->dg))
+            return false;
+        finishTriangleHit(h, ray, isect);
+        triHit->slot = BVH_PRIMITIVE_ITEM;
+    }
+    else
+        *triHit = h;
+    ray.maxt = t;
+    return true;
+}
+
+
+bool BVHAccel::intersectItemP(uint32_t slot, const Ray &ray) const {
+    const BVHLeafItem &item = items[slot];
+    if (item.mesh == BVH_PRIMITIVE_ITEM)
+        return primitives[item.index]->IntersectP(ray);
+    // Test shadow ray against mesh triangle for leaf item
+    const BVHMesh &m = meshes[item.mesh];
+    float t, b1, b2;
+    bool hit;
+    if (triangles)
+        hit = IntersectTriangle(ray, triangles[slot].p1, triangles[slot].e1,
+                                triangles[slot].e2, &t, &b1, &b2);
+    else {
+        Point p1;
+        Vector e1, e2;
+        m.mesh->GetTriangleEdges(item.index, &p1, &e1, &e2);
+        hit = IntersectTriangle(ray, p1, e1, e2, &t, &b1, &b2);
+    }
+    if (!hit) return false;
+    if (ray.depth != -1 && m.mesh->HasAlphaTexture()) {
+        DifferentialGeometry dg;
+        return m.mesh->ComputeTriangleHit(item.index, ray, t, b1, b2, m.mesh,
+                                          &dg);
+    }
+    return true;
+}
+
+
+void BVHAccel::finishTriangleHit(const BVHTriangleHit &triHit,
+        const Ray &ray, Intersection *isect) const {
+    const BVHLeafItem &item = items[triHit.slot];
+    const BVHMesh &m = meshes[item.mesh];
+    if (!m.mesh->HasAlphaTexture())
+        m.mesh->ComputeTriangleHit(item.index, ray, triHit.t, triHit.b1,
+                                   triHit.b2, m.mesh, &isect->dg);
+    isect->primitive = m.primitive.GetPtr();
+    isect->WorldToObject = m.mesh->WorldToObject->ToTransform();
+    isect->ObjectToWorld = m.mesh->ObjectToWorld->ToTransform();
+    isect->shapeId = m.shapeIdBase + item.index;
+    isect->primitiveId = m.primitiveIdBase + item.index;
+    isect->rayEpsilon = 1e-3f * triHit.t;
 }
 
 
@@ -404,6 +1093,7 @@ bool BVHAccel::Intersect(const Ray &ray, Intersection *isect) const {
     if (!nodes) return false;
     PBRT_BVH_INTERSECTION_STARTED(const_cast<BVHAccel *>(this), const_cast<Ray *>(&ray));
     bool hit = false;
+    BVHTriangleHit triHit;
     Vector invDir(1.f / ray.d.x, 1.f / ray.d.y, 1.f / ray.d.z);
     uint32_t dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
     // Follow ray through BVH nodes to find primitive intersections
@@ -418,14 +1108,14 @@ bool BVHAccel::Intersect(const Ray &ray, Intersection *isect) const {
                 PBRT_BVH_INTERSECTION_TRAVERSED_LEAF_NODE(const_cast<LinearBVHNode *>(node));
                 for (uint32_t i = 0; i < node->nPrimitives; ++i)
                 {
-                    PBRT_BVH_INTERSECTION_PRIMITIVE_TEST(const_cast<Primitive *>(primitives[node->primitivesOffset+i].GetPtr()));
-                    if (primitives[node->primitivesOffset+i]->Intersect(ray, isect))
+                    PBRT_BVH_INTERSECTION_PRIMITIVE_TEST(const_cast<Primitive *>(itemPrimitive(node->primitivesOffset+i)));
+                    if (intersectItem(node->primitivesOffset+i, ray, isect, &triHit))
                     {
-                        PBRT_BVH_INTERSECTION_PRIMITIVE_HIT(const_cast<Primitive *>(primitives[node->primitivesOffset+i].GetPtr()));
+                        PBRT_BVH_INTERSECTION_PRIMITIVE_HIT(const_cast<Primitive *>(itemPrimitive(node->primitivesOffset+i)));
                         hit = true;
                     }
                     else {
-                        PBRT_BVH_INTERSECTION_PRIMITIVE_MISSED(const_cast<Primitive *>(primitives[node->primitivesOffset+i].GetPtr()));
+                        PBRT_BVH_INTERSECTION_PRIMITIVE_MISSED(const_cast<Primitive *>(itemPrimitive(node->primitivesOffset+i)));
                    }
                 }
                 if (todoOffset == 0) break;
@@ -449,6 +1139,8 @@ bool BVHAccel::Intersect(const Ray &ray, Intersection *isect) const {
             nodeNum = todo[--todoOffset];
         }
     }
+    if (triHit.slot != BVH_PRIMITIVE_ITEM)
+        finishTriangleHit(triHit, ray, isect);
     PBRT_BVH_INTERSECTION_FINISHED();
     return hit;
 }
@@ -468,13 +1160,13 @@ bool BVHAccel::IntersectP(const Ray &ray) const {
             if (node->nPrimitives > 0) {
                 PBRT_BVH_INTERSECTIONP_TRAVERSED_LEAF_NODE(const_cast<LinearBVHNode *>(node));
                   for (uint32_t i = 0; i < node->nPrimitives; ++i) {
-                    PBRT_BVH_INTERSECTIONP_PRIMITIVE_TEST(const_cast<Primitive *>(primitives[node->primitivesOffset + i].GetPtr()));
-                    if (primitives[node->primitivesOffset+i]->IntersectP(ray)) {
-                        PBRT_BVH_INTERSECTIONP_PRIMITIVE_HIT(const_cast<Primitive *>(primitives[node->primitivesOffset+i].GetPtr()));
+                    PBRT_BVH_INTERSECTIONP_PRIMITIVE_TEST(const_cast<Primitive *>(itemPrimitive(node->primitivesOffset + i)));
+                    if (intersectItemP(node->primitivesOffset+i, ray)) {
+                        PBRT_BVH_INTERSECTIONP_PRIMITIVE_HIT(const_cast<Primitive *>(itemPrimitive(node->primitivesOffset+i)));
                         return true;
                     }
                 else {
-                        PBRT_BVH_INTERSECTIONP_PRIMITIVE_MISSED(const_cast<Primitive *>(primitives[node->primitivesOffset + i].GetPtr()));
+                        PBRT_BVH_INTERSECTIONP_PRIMITIVE_MISSED(const_cast<Primitive *>(itemPrimitive(node->primitivesOffset + i)));
                     }
                 }
                 if (todoOffset == 0) break;
@@ -503,11 +1195,130 @@ bool BVHAccel::IntersectP(const Ray &ray) const {
 }
 
 
+void BVHAccel::IntersectPacket(const Ray *const *rays, int nRays,
+        Intersection *isects, bool *hits) const {
+    for (int i = 0; i < nRays; i += PBRT_PACKET_SIZE)
+        intersectPacket(rays + i, min(nRays - i, PBRT_PACKET_SIZE),
+                        isects + i, hits + i, NULL);
+}
+
+
+void BVHAccel::IntersectPPacket(const Ray *const *rays, int nRays,
+        bool *occluded) const {
+    for (int i = 0; i < nRays; i += PBRT_PACKET_SIZE)
+        intersectPacket(rays + i, min(nRays - i, PBRT_PACKET_SIZE),
+                        NULL, NULL, occluded + i);
+}
+
+
+void BVHAccel::intersectPacket(const Ray *const *rays, int nRays,
+        Intersection *isects, bool *hits, bool *occluded) const {
+    // Initialize per-ray traversal state for packet
+    Vector invDir[PBRT_PACKET_SIZE];
+    uint32_t dirIsNeg[PBRT_PACKET_SIZE][3];
+    for (int i = 0; i < nRays; ++i) {
+        const Ray &ray = *rays[i];
+        invDir[i] = Vector(1.f / ray.d.x, 1.f / ray.d.y, 1.f / ray.d.z);
+        dirIsNeg[i][0] = invDir[i].x < 0;
+        dirIsNeg[i][1] = invDir[i].y < 0;
+        dirIsNeg[i][2] = invDir[i].z < 0;
+        if (hits) hits[i] = false;
+        if (occluded) occluded[i] = false;
+    }
+    if (!nodes) return;
+    uint32_t active = (nRays == 32) ? ~0u : ((1u << nRays) - 1);
+    BVHTriangleHit triHits[PBRT_PACKET_SIZE];
+
+    // Follow packet through BVH nodes, carrying the mask of rays that
+    // intersected each node's parent
+    uint32_t todoNode[64], todoMask[64];
+    uint32_t todoOffset = 0, nodeNum = 0, mask = active;
+    while (true) {
+        const LinearBVHNode *node = &nodes[nodeNum];
+        // Find rays in packet that intersect BVH node
+        uint32_t nodeMask = 0;
+        mask &= active;
+        for (int i = 0; i < nRays; ++i)
+            if ((mask & (1u << i)) &&
+                ::IntersectP(node->bounds, *rays[i], invDir[i], dirIsNeg[i]))
+                nodeMask |= (1u << i);
+        if (nodeMask != 0) {
+            if (node->nPrimitives > 0) {
+                if (occluded) {
+                    PBRT_BVH_INTERSECTIONP_TRAVERSED_LEAF_NODE(const_cast<LinearBVHNode *>(node));
+                }
+                else {
+                    PBRT_BVH_INTERSECTION_TRAVERSED_LEAF_NODE(const_cast<LinearBVHNode *>(node));
+                }
+                // Intersect active rays with primitives in leaf BVH node
+                for (uint32_t p = 0; p < node->nPrimitives; ++p) {
+                    uint32_t slot = node->primitivesOffset + p;
+                    for (int i = 0; i < nRays; ++i) {
+                        if (!(nodeMask & (1u << i))) continue;
+                        if (occluded) {
+                            if (intersectItemP(slot, *rays[i])) {
+                                occluded[i] = true;
+                                nodeMask &= ~(1u << i);
+                                active &= ~(1u << i);
+                            }
+                        }
+                        else if (intersectItem(slot, *rays[i], &isects[i],
+                                               &triHits[i]))
+                            hits[i] = true;
+                    }
+                }
+                if (active == 0 || todoOffset == 0) break;
+                --todoOffset;
+                nodeNum = todoNode[todoOffset];
+                mask = todoMask[todoOffset];
+            }
+            else {
+                if (occluded) {
+                    PBRT_BVH_INTERSECTIONP_TRAVERSED_INTERIOR_NODE(const_cast<LinearBVHNode *>(node));
+                }
+                else {
+                    PBRT_BVH_INTERSECTION_TRAVERSED_INTERIOR_NODE(const_cast<LinearBVHNode *>(node));
+                }
+                // Order children using the first active ray's direction
+                int first = 0;
+                while (!(nodeMask & (1u << first))) ++first;
+                todoMask[todoOffset] = nodeMask;
+                if (dirIsNeg[first][node->axis]) {
+                   todoNode[todoOffset++] = nodeNum + 1;
+                   nodeNum = node->secondChildOffset;
+                }
+                else {
+                   todoNode[todoOffset++] = node->secondChildOffset;
+                   nodeNum = nodeNum + 1;
+                }
+                mask = nodeMask;
+            }
+        }
+        else {
+            if (todoOffset == 0) break;
+            --todoOffset;
+            nodeNum = todoNode[todoOffset];
+            mask = todoMask[todoOffset];
+        }
+    }
+
+    // Compute _Intersection_s for rays whose closest hit was a triangle
+    if (!occluded)
+        for (int i = 0; i < nRays; ++i)
+            if (triHits[i].slot != BVH_PRIMITIVE_ITEM)
+                finishTriangleHit(triHits[i], *rays[i], &isects[i]);
+}
+
+
 BVHAccel *CreateBVHAccelerator(const vector<Reference<Primitive> > &prims,
         const ParamSet &ps) {
     string splitMethod = ps.FindOneString("splitmethod", "sah");
     uint32_t maxPrimsInNode = ps.FindOneInt("maxnodeprims", 4);
-    return new BVHAccel(prims, maxPrimsInNode, splitMethod);
+    bool parallelBuild = ps.FindOneBool("parallelbuild", true);
+    bool compactTriangles = ps.FindOneBool("compacttriangles", true);
+    bool packTriangles = ps.FindOneBool("packtriangles", false);
+    return new BVHAccel(prims, maxPrimsInNode, splitMethod, parallelBuild,
+                        compactTriangles, packTriangles);
 }
 
 
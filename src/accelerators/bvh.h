@@ -43,31 +43,108 @@ struct BVHBuildNode;
 
 // BVHAccel Forward Declarations
 struct BVHPrimitiveInfo;
-struct LinearBVHNode;
+struct BVHBuildState;
+struct MortonPrimitive;
+struct BVHTriangleHit;
+class TriangleMesh;
+struct LinearBVHNode {
+    BBox bounds;
+    union {
+        uint32_t primitivesOffset;    // leaf
+        uint32_t secondChildOffset;   // interior
+    };
+
+    uint8_t nPrimitives;  // 0 -> interior node
+    uint8_t axis;         // interior node: xyz
+    uint8_t pad[2];       // ensure 32 byte total size
+};
+
+
+// Leaf entries that refer to _BVHAccel::primitives_ rather than to a
+// triangle of one of the accelerator's meshes use this _mesh_ value
+#define BVH_PRIMITIVE_ITEM 0xffffffffu
+struct BVHLeafItem {
+    uint32_t mesh;    // index into _meshes_ or _BVH_PRIMITIVE_ITEM_
+    uint32_t index;   // triangle of _mesh_ or index into _primitives_
+};
+
+
+struct BVHMesh {
+    BVHMesh(const TriangleMesh *m, const Reference<Primitive> &p,
+            uint32_t shapeId, uint32_t primId)
+        : mesh(m), primitive(p), shapeIdBase(shapeId), primitiveIdBase(primId) { }
+    const TriangleMesh *mesh;
+    Reference<Primitive> primitive;
+    // Ids of the mesh's first triangle; its others follow in order
+    uint32_t shapeIdBase, primitiveIdBase;
+};
+
+
+struct BVHTriangle {
+    Point p1;
+    Vector e1, e2;
+};
+
 
 // BVHAccel Declarations
 class BVHAccel : public Aggregate {
 public:
     // BVHAccel Public Methods
     BVHAccel(const vector<Reference<Primitive> > &p, uint32_t maxPrims = 1,
-             const string &sm = "sah");
+             const string &sm = "sah", bool parallelBuild = true,
+             bool compactTriangles = true, bool packTriangles = false);
     BBox WorldBound() const;
     bool CanIntersect() const { return true; }
     ~BVHAccel();
     bool Intersect(const Ray &ray, Intersection *isect) const;
     bool IntersectP(const Ray &ray) const;
+    void IntersectPacket(const Ray *const *rays, int nRays,
+                         Intersection *isects, bool *hits) const;
+    void IntersectPPacket(const Ray *const *rays, int nRays,
+                          bool *occluded) const;
 private:
     // BVHAccel Private Methods
+    const Primitive *itemPrimitive(uint32_t slot) const {
+        const BVHLeafItem &item = items[slot];
+        return item.mesh == BVH_PRIMITIVE_ITEM ?
+            primitives[item.index].GetPtr() :
+            meshes[item.mesh].primitive.GetPtr();
+    }
+    bool intersectItem(uint32_t slot, const Ray &ray, Intersection *isect,
+                       BVHTriangleHit *triHit) const;
+    bool intersectItemP(uint32_t slot, const Ray &ray) const;
+    void finishTriangleHit(const BVHTriangleHit &triHit, const Ray &ray,
+                           Intersection *isect) const;
+    void intersectPacket(const Ray *const *rays, int nRays,
+                         Intersection *isects, bool *hits,
+                         bool *occluded) const;
+    friend struct BVHBuildTask;
+    friend class QBVHAccel;
     BVHBuildNode *recursiveBuild(MemoryArena &buildArena,
-        vector<BVHPrimitiveInfo> &buildData, uint32_t start, uint32_t end,
-        uint32_t *totalNodes, vector<Reference<Primitive> > &orderedPrims);
+        BVHBuildState &state, uint32_t start, uint32_t end);
+    void buildInterior(MemoryArena &buildArena, BVHBuildState &state,
+        BVHBuildNode *node, uint32_t dim, uint32_t start, uint32_t mid,
+        uint32_t end);
+    friend struct EmitTreeletFunc;
+    BVHBuildNode *HLBVHBuild(MemoryArena &buildArena,
+        BVHBuildState &state) const;
+    BVHBuildNode *emitLBVH(BVHBuildNode *&buildNodes, BVHBuildState &state,
+        const MortonPrimitive *mortonPrims, uint32_t start,
+        uint32_t nPrimitives, int bitIndex) const;
+    BVHBuildNode *buildUpperSAH(MemoryArena &buildArena,
+        BVHBuildState &state, vector<BVHBuildNode *> &treeletRoots,
+        uint32_t start, uint32_t end) const;
     uint32_t flattenBVHTree(BVHBuildNode *node, uint32_t *offset);
 
     // BVHAccel Private Data
     uint32_t maxPrimsInNode;
-    enum SplitMethod { SPLIT_MIDDLE, SPLIT_EQUAL_COUNTS, SPLIT_SAH };
+    enum SplitMethod { SPLIT_MIDDLE, SPLIT_EQUAL_COUNTS, SPLIT_SAH,
+                       SPLIT_LBVH, SPLIT_HLBVH };
     SplitMethod splitMethod;
     vector<Reference<Primitive> > primitives;
+    vector<BVHMesh> meshes;
+    BVHLeafItem *items;
+    BVHTriangle *triangles;
     LinearBVHNode *nodes;
 };
 
@@ -35,10 +35,23 @@
 #include "accelerators/grid.h"
 #include "probes.h"
 #include "paramset.h"
+#include "parallel.h"
+#include "stats.h"
+
+// GridAccel Local Declarations
+static StatsMemory gridBytes("Memory", "Grid accelerator");
+struct RefineVoxelFunc {
+    RefineVoxelFunc(Voxel **v) : voxels(v) { }
+    void operator()(int i) const {
+        if (voxels[i]) voxels[i]->Refine(true);
+    }
+    Voxel **voxels;
+};
+
 
 // GridAccel Method Definitions
 GridAccel::GridAccel(const vector<Reference<Primitive> > &p,
-                     bool refineImmediately) {
+                     bool refineImmediately, bool refineVoxels) {
     PBRT_GRID_STARTED_CONSTRUCTION(this, p.size());
     // Initialize _primitives_ with primitives for grid
     if (refineImmediately)
@@ -74,6 +87,7 @@ GridAccel::GridAccel(const vector<Reference<Primitive> > &p,
     memset(voxels, 0, nv * sizeof(Voxel *));
 
     // Add primitives to grid voxels
+    size_t nBytes = nv * sizeof(Voxel *);
     for (uint32_t i = 0; i < primitives.size(); ++i) {
         // Find voxel extent of primitive
         BBox pb = primitives[i]->WorldBound();
@@ -93,20 +107,35 @@ GridAccel::GridAccel(const vector<Reference<Primitive> > &p,
                         // Allocate new voxel and store primitive in it
                         voxels[o] = voxelArena.Alloc<Voxel>();
                         *voxels[o] = Voxel(primitives[i]);
+                        nBytes += sizeof(Voxel);
                     }
                     else {
                         // Add primitive to already-allocated voxel
                         voxels[o]->AddPrimitive(primitives[i]);
                     }
+                    nBytes += sizeof(Reference<Primitive>);
                 }
     }
+    gridBytes += nBytes;
 
-    // Create reader-writer mutex for grid
-    rwMutex = RWMutex::Create();
+    // Refine voxels before rendering starts, if requested
+    if (refineVoxels)
+        refineAllVoxels(true);
     PBRT_GRID_FINISHED_CONSTRUCTION(this);
 }
 
 
+void GridAccel::refineAllVoxels(bool parallel) {
+    int nv = nVoxels[0] * nVoxels[1] * nVoxels[2];
+    RefineVoxelFunc func(voxels);
+    if (parallel)
+        ParallelFor(0, nv, 64, func);
+    else
+        for (int i = 0; i < nv; ++i)
+            func(i);
+}
+
+
 BBox GridAccel::WorldBound() const {
     return bounds;
 }
@@ -116,7 +145,6 @@ GridAccel::~GridAccel() {
     for (int i = 0; i < nVoxels[0]*nVoxels[1]*nVoxels[2]; ++i)
         if (voxels[i]) voxels[i]->~Voxel();
     FreeAligned(voxels);
-    RWMutex::Destroy(rwMutex);
 }
 
 
@@ -158,14 +186,13 @@ bool GridAccel::Intersect(const Ray &ray, Intersection *isect) const {
     }
 
     // Walk ray through voxel grid
-    RWMutexLock lock(*rwMutex, READ);
     bool hitSomething = false;
     for (;;) {
         // Check for intersection in current voxel and advance to next
         Voxel *voxel = voxels[offset(Pos[0], Pos[1], Pos[2])];
         PBRT_GRID_RAY_TRAVERSED_VOXEL(Pos, voxel ? voxel->size() : 0);
         if (voxel != NULL)
-            hitSomething |= voxel->Intersect(ray, isect, lock);
+            hitSomething |= voxel->Intersect(ray, isect);
 
         // Advance to next voxel
 
@@ -186,32 +213,48 @@ bool GridAccel::Intersect(const Ray &ray, Intersection *isect) const {
 }
 
 
-bool Voxel::Intersect(const Ray &ray, Intersection *isect,
-                      RWMutexLock &lock) {
-    // Refine primitives in voxel if needed
-    if (!allCanIntersect) {
-        lock.UpgradeToWrite();
-        for (uint32_t i = 0; i < primitives.size(); ++i) {
-            Reference<Primitive> &prim = primitives[i];
-            // Refine primitive _prim_ if it's not intersectable
-            if (!prim->CanIntersect()) {
-                vector<Reference<Primitive> > p;
-                prim->FullyRefine(p);
-                Assert(p.size() > 0);
-                if (p.size() == 1)
-                    primitives[i] = p[0];
-                else
-                    primitives[i] = new GridAccel(p, false);
+void Voxel::Refine(bool refineChildren) {
+    if (allCanIntersect || refineState == VOXEL_REFINED) return;
+    // Claim voxel for refinement or wait for the thread that claimed it
+    if (AtomicCompareAndSwap(&refineState, VOXEL_REFINING,
+                             VOXEL_UNREFINED) != VOXEL_UNREFINED) {
+        while (refineState != VOXEL_REFINED)
+            YieldThread();
+        return;
+    }
+
+    // Build refined copy of voxel's primitives
+    vector<Reference<Primitive> > *r =
+        new vector<Reference<Primitive> >(primitives);
+    for (uint32_t i = 0; i < r->size(); ++i) {
+        Reference<Primitive> &prim = (*r)[i];
+        // Refine primitive _prim_ if it's not intersectable
+        if (!prim->CanIntersect()) {
+            vector<Reference<Primitive> > p;
+            prim->FullyRefine(p);
+            Assert(p.size() > 0);
+            if (p.size() == 1)
+                prim = p[0];
+            else {
+                GridAccel *grid = new GridAccel(p, false);
+                if (refineChildren) grid->refineAllVoxels(false);
+                prim = grid;
             }
         }
-        allCanIntersect = true;
-        lock.DowngradeToRead();
     }
 
+    // Publish refined primitives to other threads
+    refined = r;
+    AtomicAdd(&refineState, 1);
+}
+
+
+bool Voxel::Intersect(const Ray &ray, Intersection *isect) {
     // Loop over primitives in voxel and find intersections
+    const vector<Reference<Primitive> > &prims = intersectablePrimitives();
     bool hitSomething = false;
-    for (uint32_t i = 0; i < primitives.size(); ++i) {
-        Reference<Primitive> &prim = primitives[i];
+    for (uint32_t i = 0; i < prims.size(); ++i) {
+        const Reference<Primitive> &prim = prims[i];
         PBRT_GRID_RAY_PRIMITIVE_INTERSECTION_TEST(const_cast<Primitive *>(prim.GetPtr()));
         if (prim->Intersect(ray, isect))
         {
@@ -225,7 +268,6 @@ bool Voxel::Intersect(const Ray &ray, Intersection *isect,
 
 bool GridAccel::IntersectP(const Ray &ray) const {
     PBRT_GRID_INTERSECTIONP_TEST(const_cast<GridAccel *>(this), const_cast<Ray *>(&ray));
-    RWMutexLock lock(*rwMutex, READ);
     // Check ray against overall grid bounds
     float rayT;
     if (bounds.Inside(ray(ray.mint)))
@@ -266,7 +308,7 @@ bool GridAccel::IntersectP(const Ray &ray) const {
         int o = offset(Pos[0], Pos[1], Pos[2]);
         Voxel *voxel = voxels[o];
         PBRT_GRID_RAY_TRAVERSED_VOXEL(Pos, voxel ? voxel->size() : 0);
-        if (voxel && voxel->IntersectP(ray, lock))
+        if (voxel && voxel->IntersectP(ray))
             return true;
         // Advance to next voxel
 
@@ -287,28 +329,10 @@ bool GridAccel::IntersectP(const Ray &ray) const {
 }
 
 
-bool Voxel::IntersectP(const Ray &ray, RWMutexLock &lock) {
-    // Refine primitives in voxel if needed
-    if (!allCanIntersect) {
-        lock.UpgradeToWrite();
-        for (uint32_t i = 0; i < primitives.size(); ++i) {
-            Reference<Primitive> &prim = primitives[i];
-            // Refine primitive _prim_ if it's not intersectable
-            if (!prim->CanIntersect()) {
-                vector<Reference<Primitive> > p;
-                prim->FullyRefine(p);
-                Assert(p.size() > 0);
-                if (p.size() == 1)
-                    primitives[i] = p[0];
-                else
-                    primitives[i] = new GridAccel(p, false);
-            }
-        }
-        allCanIntersect = true;
-        lock.DowngradeToRead();
-    }
-    for (uint32_t i = 0; i < primitives.size(); ++i) {
-        Reference<Primitive> &prim = primitives[i];
+bool Voxel::IntersectP(const Ray &ray) {
+    const vector<Reference<Primitive> > &prims = intersectablePrimitives();
+    for (uint32_t i = 0; i < prims.size(); ++i) {
+        const Reference<Primitive> &prim = prims[i];
         PBRT_GRID_RAY_PRIMITIVE_INTERSECTIONP_TEST(const_cast<Primitive *>(prim.GetPtr()));
         if (prim->IntersectP(ray)) {
             PBRT_GRID_RAY_PRIMITIVE_HIT(const_cast<Primitive *>(prim.GetPtr()));
@@ -322,7 +346,8 @@ bool Voxel::IntersectP(const Ray &ray, RWMutexLock &lock) {
 GridAccel *CreateGridAccelerator(const vector<Reference<Primitive> > &prims,
         const ParamSet &ps) {
     bool refineImmediately = ps.FindOneBool("refineimmediately", false);
-    return new GridAccel(prims, refineImmediately);
+    bool refineVoxels = ps.FindOneBool("refinevoxels", false);
+    return new GridAccel(prims, refineImmediately, refineVoxels);
 }
 
 
@@ -47,19 +47,33 @@ struct Voxel;
 struct Voxel {
     // Voxel Public Methods
     uint32_t size() const { return primitives.size(); }
-    Voxel() { }
-    Voxel(Reference<Primitive> op) {
-        allCanIntersect = false;
-        primitives.push_back(op);
+    Voxel() : allCanIntersect(true), refineState(VOXEL_UNREFINED), refined(NULL) { }
+    Voxel(Reference<Primitive> op)
+        : allCanIntersect(true), refineState(VOXEL_UNREFINED), refined(NULL) {
+        AddPrimitive(op);
     }
+    ~Voxel() { delete refined; }
     void AddPrimitive(Reference<Primitive> prim) {
+        allCanIntersect &= prim->CanIntersect();
         primitives.push_back(prim);
     }
-    bool Intersect(const Ray &ray, Intersection *isect, RWMutexLock &lock);
-    bool IntersectP(const Ray &ray, RWMutexLock &lock);
+    void Refine(bool refineChildren);
+    bool Intersect(const Ray &ray, Intersection *isect);
+    bool IntersectP(const Ray &ray);
 private:
+    // Voxel Private Methods
+    const vector<Reference<Primitive> > &intersectablePrimitives() {
+        if (allCanIntersect) return primitives;
+        if (refineState != VOXEL_REFINED) Refine(false);
+        return *refined;
+    }
+
+    // Voxel Private Data
+    enum { VOXEL_UNREFINED, VOXEL_REFINING, VOXEL_REFINED };
     vector<Reference<Primitive> > primitives;
     bool allCanIntersect;
+    AtomicInt32 refineState;
+    vector<Reference<Primitive> > *refined;
 };
 
 
@@ -68,7 +82,8 @@ private:
 class GridAccel : public Aggregate {
 public:
     // GridAccel Public Methods
-    GridAccel(const vector<Reference<Primitive> > &p, bool refineImmediately);
+    GridAccel(const vector<Reference<Primitive> > &p, bool refineImmediately,
+              bool refineVoxels = false);
     BBox WorldBound() const;
     bool CanIntersect() const { return true; }
     ~GridAccel();
@@ -76,6 +91,8 @@ public:
     bool IntersectP(const Ray &ray) const;
 private:
     // GridAccel Private Methods
+    friend struct Voxel;
+    void refineAllVoxels(bool parallel);
     int posToVoxel(const Point &P, int axis) const {
         int v = Float2Int((P[axis] - bounds.pMin[axis]) *
                           invWidth[axis]);
@@ -95,7 +112,6 @@ private:
     Vector width, invWidth;
     Voxel **voxels;
     MemoryArena voxelArena;
-    mutable RWMutex *rwMutex;
 };
 
 
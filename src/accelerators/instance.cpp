@@ -0,0 +1,411 @@
+
+/*
+    pbrt source code Copyright(c) 1998-2012 Matt Pharr and Greg Humphreys.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+
+// accelerators/instance.cpp*
+#include "stdafx.h"
+#include "accelerators/instance.h"
+#include "accelerators/bvh.h"
+#include "intersection.h"
+#include "stats.h"
+
+// InstanceAccel Local Declarations
+static StatsMemory instanceBytes("Memory", "Instance accelerator");
+static StatsCounter instancesMade("Scene", "Object instances");
+struct InstanceBuildInfo {
+    InstanceBuildInfo(uint32_t n, const BBox &b)
+        : instanceNumber(n), bounds(b) {
+        centroid = .5f * b.pMin + .5f * b.pMax;
+    }
+    uint32_t instanceNumber;
+    Point centroid;
+    BBox bounds;
+};
+
+
+struct CompareInstanceCentroids {
+    CompareInstanceCentroids(int d) { dim = d; }
+    int dim;
+    bool operator()(const InstanceBuildInfo &a,
+                    const InstanceBuildInfo &b) const {
+        return a.centroid[dim] < b.centroid[dim];
+    }
+};
+
+
+struct CompareInstanceToBucket {
+    CompareInstanceToBucket(int split, int num, int d, const BBox &b)
+        : centroidBounds(b)
+    { splitBucket = split; nBuckets = num; dim = d; }
+    bool operator()(const InstanceBuildInfo &p) const {
+        int b = nBuckets * ((p.centroid[dim] - centroidBounds.pMin[dim]) /
+                (centroidBounds.pMax[dim] - centroidBounds.pMin[dim]));
+        if (b == nBuckets) b = nBuckets-1;
+        Assert(b >= 0 && b < nBuckets);
+        return b <= splitBucket;
+    }
+
+    int splitBucket, nBuckets, dim;
+    const BBox &centroidBounds;
+};
+
+
+static inline Point TransformPoint(const float m[3][4], const Point &p) {
+    return Point(m[0][0]*p.x + m[0][1]*p.y + m[0][2]*p.z + m[0][3],
+                 m[1][0]*p.x + m[1][1]*p.y + m[1][2]*p.z + m[1][3],
+                 m[2][0]*p.x + m[2][1]*p.y + m[2][2]*p.z + m[2][3]);
+}
+
+
+static inline Vector TransformVector(const float m[3][4], const Vector &v) {
+    return Vector(m[0][0]*v.x + m[0][1]*v.y + m[0][2]*v.z,
+                  m[1][0]*v.x + m[1][1]*v.y + m[1][2]*v.z,
+                  m[2][0]*v.x + m[2][1]*v.y + m[2][2]*v.z);
+}
+
+
+static Transform ItemTransform(const ObjectInstanceItem &item) {
+    const float (*w)[4] = item.worldToInstance, (*i)[4] = item.instanceToWorld;
+    Matrix4x4 m(w[0][0], w[0][1], w[0][2], w[0][3],
+                w[1][0], w[1][1], w[1][2], w[1][3],
+                w[2][0], w[2][1], w[2][2], w[2][3],
+                0.f, 0.f, 0.f, 1.f);
+    Matrix4x4 mInv(i[0][0], i[0][1], i[0][2], i[0][3],
+                   i[1][0], i[1][1], i[1][2], i[1][3],
+                   i[2][0], i[2][1], i[2][2], i[2][3],
+                   0.f, 0.f, 0.f, 1.f);
+    return Transform(m, mInv);
+}
+
+
+static inline bool IntersectP(const BBox &bounds, const Ray &ray,
+        const Vector &invDir, const uint32_t dirIsNeg[3]) {
+    // Check for ray intersection against $x$ and $y$ slabs
+    float tmin =  (bounds[  dirIsNeg[0]].x - ray.o.x) * invDir.x;
+    float tmax =  (bounds[1-dirIsNeg[0]].x - ray.o.x) * invDir.x;
+    float tymin = (bounds[  dirIsNeg[1]].y - ray.o.y) * invDir.y;
+    float tymax = (bounds[1-dirIsNeg[1]].y - ray.o.y) * invDir.y;
+    if ((tmin > tymax) || (tymin > tmax))
+        return false;
+    if (tymin > tmin) tmin = tymin;
+    if (tymax < tmax) tmax = tymax;
+
+    // Check for ray intersection against $z$ slab
+    float tzmin = (bounds[  dirIsNeg[2]].z - ray.o.z) * invDir.z;
+    float tzmax = (bounds[1-dirIsNeg[2]].z - ray.o.z) * invDir.z;
+    if ((tmin > tzmax) || (tzmin > tmax))
+        return false;
+    if (tzmin > tmin)
+        tmin = tzmin;
+    if (tzmax < tmax)
+        tmax = tzmax;
+    return (tmin < ray.maxt) && (tmax > ray.mint);
+}
+
+
+
+// InstanceAccel Utility Functions
+bool MakeObjectInstanceItem(const Transform &worldToInstance,
+        uint32_t prototype, ObjectInstanceItem *item) {
+    // Only affine transformations can be stored in the compact form
+    const Matrix4x4 &m = worldToInstance.GetMatrix();
+    const Matrix4x4 &mInv = worldToInstance.GetInverseMatrix();
+    if (m.m[3][0] != 0.f || m.m[3][1] != 0.f || m.m[3][2] != 0.f ||
+        m.m[3][3] != 1.f || mInv.m[3][0] != 0.f || mInv.m[3][1] != 0.f ||
+        mInv.m[3][2] != 0.f || mInv.m[3][3] != 1.f)
+        return false;
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 4; ++j) {
+            item->worldToInstance[i][j] = m.m[i][j];
+            item->instanceToWorld[i][j] = mInv.m[i][j];
+        }
+    item->prototype = prototype;
+    return true;
+}
+
+
+
+// InstanceAccel Method Definitions
+InstanceAccel::InstanceAccel(const vector<Reference<Primitive> > &protos,
+        const vector<ObjectInstanceItem> &items, uint32_t maxInstances)
+    : prototypes(protos) {
+    maxInstancesInNode = min(255u, maxInstances);
+    nInstances = items.size();
+    instances = NULL;
+    nodes = NULL;
+    nNodes = 0;
+    // Reserve a contiguous range of primitive ids for the instances
+    firstInstanceId = AtomicAdd(&nextprimitiveId, (int32_t)nInstances) -
+                      nInstances;
+    instancesMade += nInstances;
+    if (nInstances == 0) return;
+
+    // Compute world space bounds of each instance
+    vector<BBox> prototypeBounds(prototypes.size());
+    for (uint32_t i = 0; i < prototypes.size(); ++i)
+        prototypeBounds[i] = prototypes[i]->WorldBound();
+    vector<InstanceBuildInfo> buildData;
+    buildData.reserve(nInstances);
+    for (uint32_t i = 0; i < nInstances; ++i) {
+        Transform w2i = ItemTransform(items[i]);
+        buildData.push_back(InstanceBuildInfo(i,
+            Inverse(w2i)(prototypeBounds[items[i].prototype])));
+    }
+
+    // Build BVH over instance bounds and store instances in leaf order
+    vector<LinearBVHNode> buildNodes;
+    buildNodes.reserve(2 * nInstances);
+    vector<uint32_t> orderedInstances;
+    orderedInstances.reserve(nInstances);
+    recursiveBuild(buildData, 0, nInstances, buildNodes, orderedInstances);
+    nNodes = buildNodes.size();
+    nodes = AllocAligned<LinearBVHNode>(nNodes);
+    memcpy(nodes, &buildNodes[0], nNodes * sizeof(LinearBVHNode));
+    instances = AllocAligned<ObjectInstanceItem>(nInstances);
+    for (uint32_t i = 0; i < nInstances; ++i)
+        instances[i] = items[orderedInstances[i]];
+    instanceBytes += nNodes * sizeof(LinearBVHNode) +
+                     nInstances * sizeof(ObjectInstanceItem);
+}
+
+
+InstanceAccel::~InstanceAccel() {
+    FreeAligned(nodes);
+    FreeAligned(instances);
+}
+
+
+uint32_t InstanceAccel::recursiveBuild(vector<InstanceBuildInfo> &buildData,
+        uint32_t start, uint32_t end, vector<LinearBVHNode> &buildNodes,
+        vector<uint32_t> &orderedInstances) const {
+    Assert(start != end);
+    uint32_t nodeNum = buildNodes.size();
+    buildNodes.push_back(LinearBVHNode());
+    // Compute bounds of instances and instance centroids in node
+    BBox bbox, centroidBounds;
+    for (uint32_t i = start; i < end; ++i) {
+        bbox = Union(bbox, buildData[i].bounds);
+        centroidBounds = Union(centroidBounds, buildData[i].centroid);
+    }
+    uint32_t n = end - start;
+    int dim = centroidBounds.MaximumExtent();
+    uint32_t mid = (start + end) / 2;
+    bool makeLeaf = (n == 1);
+    if (!makeLeaf && centroidBounds.pMax[dim] == centroidBounds.pMin[dim])
+        makeLeaf = (n <= maxInstancesInNode);
+    else if (!makeLeaf && n <= 4)
+        std::nth_element(&buildData[start], &buildData[mid],
+                         &buildData[end-1]+1, CompareInstanceCentroids(dim));
+    else if (!makeLeaf) {
+        // Partition instances using approximate SAH
+        const int nBuckets = 12;
+        int counts[nBuckets];
+        BBox bounds[nBuckets];
+        for (int i = 0; i < nBuckets; ++i) counts[i] = 0;
+        for (uint32_t i = start; i < end; ++i) {
+            int b = nBuckets *
+                ((buildData[i].centroid[dim] - centroidBounds.pMin[dim]) /
+                 (centroidBounds.pMax[dim] - centroidBounds.pMin[dim]));
+            if (b == nBuckets) b = nBuckets-1;
+            ++counts[b];
+            bounds[b] = Union(bounds[b], buildData[i].bounds);
+        }
+        float minCost = INFINITY;
+        int minCostSplit = 0;
+        for (int i = 0; i < nBuckets-1; ++i) {
+            BBox b0, b1;
+            int count0 = 0, count1 = 0;
+            for (int j = 0; j <= i; ++j) {
+                b0 = Union(b0, bounds[j]);
+                count0 += counts[j];
+            }
+            for (int j = i+1; j < nBuckets; ++j) {
+                b1 = Union(b1, bounds[j]);
+                count1 += counts[j];
+            }
+            float cost = .125f + (count0*b0.SurfaceArea() +
+                                  count1*b1.SurfaceArea()) / bbox.SurfaceArea();
+            if (cost < minCost) {
+                minCost = cost;
+                minCostSplit = i;
+            }
+        }
+        if (n > maxInstancesInNode || minCost < n) {
+            InstanceBuildInfo *pmid = std::partition(&buildData[start],
+                &buildData[end-1]+1,
+                CompareInstanceToBucket(minCostSplit, nBuckets, dim,
+                                        centroidBounds));
+            mid = pmid - &buildData[0];
+            if (mid == start || mid == end) {
+                mid = (start + end) / 2;
+                std::nth_element(&buildData[start], &buildData[mid],
+                    &buildData[end-1]+1, CompareInstanceCentroids(dim));
+            }
+        }
+        else
+            makeLeaf = true;
+    }
+
+    if (makeLeaf) {
+        // Create leaf node for instances _start_ to _end_
+        LinearBVHNode &node = buildNodes[nodeNum];
+        node.bounds = bbox;
+        node.primitivesOffset = orderedInstances.size();
+        node.nPrimitives = n;
+        for (uint32_t i = start; i < end; ++i)
+            orderedInstances.push_back(buildData[i].instanceNumber);
+        return nodeNum;
+    }
+    // Create interior node with children built depth first
+    recursiveBuild(buildData, start, mid, buildNodes, orderedInstances);
+    uint32_t second = recursiveBuild(buildData, mid, end, buildNodes,
+                                     orderedInstances);
+    LinearBVHNode &node = buildNodes[nodeNum];
+    node.bounds = bbox;
+    node.secondChildOffset = second;
+    node.nPrimitives = 0;
+    node.axis = dim;
+    return nodeNum;
+}
+
+
+BBox InstanceAccel::WorldBound() const {
+    return nodes ? nodes[0].bounds : BBox();
+}
+
+
+bool InstanceAccel::Intersect(const Ray &ray, Intersection *isect) const {
+    if (!nodes) return false;
+    Vector invDir(1.f / ray.d.x, 1.f / ray.d.y, 1.f / ray.d.z);
+    uint32_t dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+    // Follow ray through instance BVH nodes to find instance intersections
+    uint32_t todoOffset = 0, nodeNum = 0;
+    uint32_t todo[64];
+    uint32_t hitInstance = nInstances;
+    while (true) {
+        const LinearBVHNode *node = &nodes[nodeNum];
+        if (::IntersectP(node->bounds, ray, invDir, dirIsNeg)) {
+            if (node->nPrimitives > 0) {
+                // Intersect instance space ray with instances in leaf
+                for (uint32_t i = 0; i < node->nPrimitives; ++i) {
+                    uint32_t index = node->primitivesOffset + i;
+                    const ObjectInstanceItem &item = instances[index];
+                    Ray r = ray;
+                    r.o = TransformPoint(item.worldToInstance, ray.o);
+                    r.d = TransformVector(item.worldToInstance, ray.d);
+                    if (prototypes[item.prototype]->Intersect(r, isect)) {
+                        ray.maxt = r.maxt;
+                        hitInstance = index;
+                    }
+                }
+                if (todoOffset == 0) break;
+                nodeNum = todo[--todoOffset];
+            }
+            else {
+                // Put far BVH node on _todo_ stack, advance to near node
+                if (dirIsNeg[node->axis]) {
+                   todo[todoOffset++] = nodeNum + 1;
+                   nodeNum = node->secondChildOffset;
+                }
+                else {
+                   todo[todoOffset++] = node->secondChildOffset;
+                   nodeNum = nodeNum + 1;
+                }
+            }
+        }
+        else {
+            if (todoOffset == 0) break;
+            nodeNum = todo[--todoOffset];
+        }
+    }
+    if (hitInstance == nInstances) return false;
+
+    // Transform closest instance hit to world space
+    isect->primitiveId = firstInstanceId + hitInstance;
+    Transform w2i = ItemTransform(instances[hitInstance]);
+    if (!w2i.IsIdentity()) {
+        isect->WorldToObject = isect->WorldToObject * w2i;
+        isect->ObjectToWorld = Inverse(isect->WorldToObject);
+        Transform InstanceToWorld = Inverse(w2i);
+        isect->dg.p = InstanceToWorld(isect->dg.p);
+        isect->dg.nn = Normalize(InstanceToWorld(isect->dg.nn));
+        isect->dg.dpdu = InstanceToWorld(isect->dg.dpdu);
+        isect->dg.dpdv = InstanceToWorld(isect->dg.dpdv);
+        isect->dg.dndu = InstanceToWorld(isect->dg.dndu);
+        isect->dg.dndv = InstanceToWorld(isect->dg.dndv);
+    }
+    return true;
+}
+
+
+bool InstanceAccel::IntersectP(const Ray &ray) const {
+    if (!nodes) return false;
+    Vector invDir(1.f / ray.d.x, 1.f / ray.d.y, 1.f / ray.d.z);
+    uint32_t dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+    uint32_t todo[64];
+    uint32_t todoOffset = 0, nodeNum = 0;
+    while (true) {
+        const LinearBVHNode *node = &nodes[nodeNum];
+        if (::IntersectP(node->bounds, ray, invDir, dirIsNeg)) {
+            if (node->nPrimitives > 0) {
+                for (uint32_t i = 0; i < node->nPrimitives; ++i) {
+                    const ObjectInstanceItem &item =
+                        instances[node->primitivesOffset + i];
+                    Ray r = ray;
+                    r.o = TransformPoint(item.worldToInstance, ray.o);
+                    r.d = TransformVector(item.worldToInstance, ray.d);
+                    if (prototypes[item.prototype]->IntersectP(r))
+                        return true;
+                }
+                if (todoOffset == 0) break;
+                nodeNum = todo[--todoOffset];
+            }
+            else {
+                if (dirIsNeg[node->axis]) {
+                   todo[todoOffset++] = nodeNum + 1;
+                   nodeNum = node->secondChildOffset;
+                }
+                else {
+                   todo[todoOffset++] = node->secondChildOffset;
+                   nodeNum = nodeNum + 1;
+                }
+            }
+        }
+        else {
+            if (todoOffset == 0) break;
+            nodeNum = todo[--todoOffset];
+        }
+    }
+    return false;
+}
+
+
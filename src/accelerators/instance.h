@@ -0,0 +1,87 @@
+
+/*
+    pbrt source code Copyright(c) 1998-2012 Matt Pharr and Greg Humphreys.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef PBRT_ACCELERATORS_INSTANCE_H
+#define PBRT_ACCELERATORS_INSTANCE_H
+
+// accelerators/instance.h*
+#include "pbrt.h"
+#include "primitive.h"
+struct LinearBVHNode;
+struct InstanceBuildInfo;
+
+// InstanceAccel Declarations
+
+// An object instance with a static affine transformation; only the top
+// three rows of each matrix are stored, and _prototype_ indexes the
+// shared aggregates passed to _InstanceAccel_
+struct ObjectInstanceItem {
+    float worldToInstance[3][4];
+    float instanceToWorld[3][4];
+    uint32_t prototype;
+};
+
+
+bool MakeObjectInstanceItem(const Transform &worldToInstance,
+    uint32_t prototype, ObjectInstanceItem *item);
+class InstanceAccel : public Aggregate {
+public:
+    // InstanceAccel Public Methods
+    InstanceAccel(const vector<Reference<Primitive> > &prototypes,
+                  const vector<ObjectInstanceItem> &instances,
+                  uint32_t maxInstances = 4);
+    ~InstanceAccel();
+    BBox WorldBound() const;
+    bool CanIntersect() const { return true; }
+    bool Intersect(const Ray &ray, Intersection *isect) const;
+    bool IntersectP(const Ray &ray) const;
+private:
+    // InstanceAccel Private Methods
+    uint32_t recursiveBuild(vector<InstanceBuildInfo> &buildData,
+        uint32_t start, uint32_t end, vector<LinearBVHNode> &buildNodes,
+        vector<uint32_t> &orderedInstances) const;
+
+    // InstanceAccel Private Data
+    uint32_t maxInstancesInNode;
+    vector<Reference<Primitive> > prototypes;
+    ObjectInstanceItem *instances;
+    LinearBVHNode *nodes;
+    uint32_t nInstances, nNodes;
+    uint32_t firstInstanceId;
+};
+
+
+#endif // PBRT_ACCELERATORS_INSTANCE_H
@@ -33,9 +33,13 @@
 // accelerators/kdtreeaccel.cpp*
 #include "stdafx.h"
 #include "accelerators/kdtreeaccel.h"
+#include "intersection.h"
 #include "paramset.h"
+#include "parallel.h"
+#include "stats.h"
 
 // KdTreeAccel Local Declarations
+static StatsMemory kdTreeBytes("Memory", "Kd-tree accelerator");
 struct KdAccelNode {
     // KdAccelNode Methods
     void initLeaf(uint32_t *primNums, int np, MemoryArena &arena);
@@ -73,8 +77,11 @@ struct BoundEdge {
         type = starting ? START : END;
     }
     bool operator<(const BoundEdge &e) const {
-        if (t == e.t)
+        // Break ties by primitive number so that edges are totally ordered
+        if (t == e.t) {
+            if (type == e.type) return primNum < e.primNum;
             return (int)type < (int)e.type;
+        }
         else return t < e.t;
     }
     float t;
@@ -83,11 +90,104 @@ struct BoundEdge {
 };
 
 
+struct KdBuildNode {
+    // KdBuildNode Public Methods
+    void InitLeaf(uint32_t *p, int np) {
+        children[0] = children[1] = NULL;
+        primNums = p;
+        nPrimitives = np;
+    }
+    void InitInterior(uint32_t a, float s, KdBuildNode *c0, KdBuildNode *c1) {
+        axis = a;
+        split = s;
+        children[0] = c0;
+        children[1] = c1;
+    }
+    KdBuildNode *children[2];
+    uint32_t axis;
+    float split;
+    uint32_t *primNums;
+    int nPrimitives;
+};
+
+
+// Nodes with at least _KD_PARALLEL_SUBTREE_PRIMS_ primitives build their
+// children in parallel
+static const int KD_PARALLEL_SUBTREE_PRIMS = 8192;
+struct KdBuildState {
+    KdBuildState(const vector<BBox> &pb, bool p)
+        : primBounds(pb), parallel(p) {
+        totalNodes = 0;
+        tasksMutex = Mutex::Create();
+    }
+    ~KdBuildState() {
+        for (uint32_t i = 0; i < tasks.size(); ++i)
+            delete tasks[i];
+        Mutex::Destroy(tasksMutex);
+    }
+    const vector<BBox> &primBounds;
+    bool parallel;
+    AtomicInt32 totalNodes;
+    // Build tasks are kept until the tree is flattened, since their
+    // _MemoryArena_s hold the _KdBuildNode_s they created
+    Mutex *tasksMutex;
+    vector<Task *> tasks;
+};
+
+
+struct KdBuildTask : public Task {
+    KdBuildTask(KdTreeAccel *k, KdBuildState &s, const BBox &b,
+                const BoundEdge *e, int np, int d, int br, KdBuildNode **n)
+        : kd(k), state(s), bounds(b), edges(e, e + 6*np), nPrimitives(np),
+          depth(d), badRefines(br), node(n) { }
+    void Run() {
+        *node = kd->buildTree(arena, state, edges, bounds, 0, nPrimitives,
+                              depth, badRefines);
+    }
+    KdTreeAccel *kd;
+    KdBuildState &state;
+    BBox bounds;
+    vector<BoundEdge> edges;
+    int nPrimitives, depth, badRefines;
+    KdBuildNode **node;
+    MemoryArena arena;
+};
+
+
+struct InitEdgesFunc {
+    InitEdgesFunc(const vector<BBox> &pb, vector<BoundEdge> &e)
+        : primBounds(pb), edges(e) { }
+    void operator()(int axis) const {
+        // Create and sort bounding box edges of all primitives for _axis_
+        BoundEdge *ae = &edges[2 * primBounds.size() * axis];
+        for (uint32_t i = 0; i < primBounds.size(); ++i) {
+            ae[2*i] =   BoundEdge(primBounds[i].pMin[axis], i, true);
+            ae[2*i+1] = BoundEdge(primBounds[i].pMax[axis], i, false);
+        }
+        sort(ae, ae + 2 * primBounds.size());
+    }
+    const vector<BBox> &primBounds;
+    vector<BoundEdge> &edges;
+};
+
+
+struct InitPrimBoundsFunc {
+    InitPrimBoundsFunc(const vector<Reference<Primitive> > &p,
+                       vector<BBox> &pb)
+        : primitives(p), primBounds(pb) { }
+    void operator()(int i) const {
+        primBounds[i] = primitives[i]->WorldBound();
+    }
+    const vector<Reference<Primitive> > &primitives;
+    vector<BBox> &primBounds;
+};
+
+
 
 // KdTreeAccel Method Definitions
 KdTreeAccel::KdTreeAccel(const vector<Reference<Primitive> > &p,
                          int icost, int tcost, float ebonus, int maxp,
-                         int md)
+                         int md, bool parallelBuild)
     : isectCost(icost), traversalCost(tcost), maxPrims(maxp), maxDepth(md),
       emptyBonus(ebonus) {
     PBRT_KDTREE_STARTED_CONSTRUCTION(this, p.size());
@@ -99,36 +199,41 @@ KdTreeAccel::KdTreeAccel(const vector<Reference<Primitive> > &p,
         maxDepth = Round2Int(8 + 1.3f * Log2Int(float(primitives.size())));
 
     // Compute bounds for kd-tree construction
-    vector<BBox> primBounds;
-    primBounds.reserve(primitives.size());
-    for (uint32_t i = 0; i < primitives.size(); ++i) {
-        BBox b = primitives[i]->WorldBound();
-        bounds = Union(bounds, b);
-        primBounds.push_back(b);
-    }
-
-    // Allocate working memory for kd-tree construction
-    BoundEdge *edges[3];
-    for (int i = 0; i < 3; ++i)
-        edges[i] = new BoundEdge[2*primitives.size()];
-    uint32_t *prims0 = new uint32_t[primitives.size()];
-    uint32_t *prims1 = new uint32_t[(maxDepth+1) * primitives.size()];
-
-    // Initialize _primNums_ for kd-tree construction
-    uint32_t *primNums = new uint32_t[primitives.size()];
+    vector<BBox> primBounds(primitives.size());
+    ParallelFor(0, primitives.size(), 4096,
+                InitPrimBoundsFunc(primitives, primBounds));
     for (uint32_t i = 0; i < primitives.size(); ++i)
-        primNums[i] = i;
+        bounds = Union(bounds, primBounds[i]);
+
+    // Create sorted bounding box edges for all three axes
+    vector<BoundEdge> edges(6 * primitives.size());
+    ParallelFor(0, 3, 1, InitEdgesFunc(primBounds, edges));
 
     // Start recursive construction of kd-tree
-    buildTree(0, bounds, primBounds, primNums, primitives.size(),
-              maxDepth, edges, prims0, prims1);
-
-    // Free working memory for kd-tree construction
-    delete[] primNums;
-    for (int i = 0; i < 3; ++i)
-        delete[] edges[i];
-    delete[] prims0;
-    delete[] prims1;
+    MemoryArena buildArena;
+    KdBuildState state(primBounds, parallelBuild);
+    KdBuildNode *root;
+    if (parallelBuild) {
+        // Run the build as a task so that subtree tasks it spawns nest
+        KdBuildTask *rootTask = new KdBuildTask(this, state, bounds,
+            edges.empty() ? NULL : &edges[0], primitives.size(), maxDepth, 0,
+            &root);
+        vector<BoundEdge>().swap(edges);
+        state.tasks.push_back(rootTask);
+        vector<Task *> tasks(1, rootTask);
+        EnqueueTasks(tasks);
+        WaitForAllTasks();
+    }
+    else
+        root = buildTree(buildArena, state, edges, bounds, 0,
+                         primitives.size(), maxDepth, 0);
+
+    // Compute depth-first representation of kd-tree
+    nAllocedNodes = state.totalNodes;
+    nodes = AllocAligned<KdAccelNode>(nAllocedNodes);
+    kdTreeBytes += nAllocedNodes * sizeof(KdAccelNode);
+    flattenTree(root);
+    Assert(nextFreeNode == nAllocedNodes);
     PBRT_KDTREE_FINISHED_CONSTRUCTION(this);
 }
 
@@ -144,6 +249,7 @@ void KdAccelNode::initLeaf(uint32_t *primNums, int np,
         onePrimitive = primNums[0];
     else {
         primitives = arena.Alloc<uint32_t>(np);
+        kdTreeBytes += np * sizeof(uint32_t);
         for (int i = 0; i < np; ++i)
             primitives[i] = primNums[i];
     }
@@ -155,29 +261,18 @@ KdTreeAccel::~KdTreeAccel() {
 }
 
 
-void KdTreeAccel::buildTree(int nodeNum, const BBox &nodeBounds,
-        const vector<BBox> &allPrimBounds, uint32_t *primNums,
-        int nPrimitives, int depth, BoundEdge *edges[3],
-        uint32_t *prims0, uint32_t *prims1, int badRefines) {
-    Assert(nodeNum == nextFreeNode);
-    // Get next free node from _nodes_ array
-    if (nextFreeNode == nAllocedNodes) {
-        int nAlloc = max(2 * nAllocedNodes, 512);
-        KdAccelNode *n = AllocAligned<KdAccelNode>(nAlloc);
-        if (nAllocedNodes > 0) {
-            memcpy(n, nodes, nAllocedNodes * sizeof(KdAccelNode));
-            FreeAligned(nodes);
-        }
-        nodes = n;
-        nAllocedNodes = nAlloc;
-    }
-    ++nextFreeNode;
+KdBuildNode *KdTreeAccel::buildTree(MemoryArena &buildArena,
+        KdBuildState &state, vector<BoundEdge> &edgePool,
+        const BBox &nodeBounds, uint32_t edgeOffset, int nPrimitives,
+        int depth, int badRefines) {
+    AtomicAdd(&state.totalNodes, 1);
+    KdBuildNode *node = buildArena.Alloc<KdBuildNode>();
 
     // Initialize leaf node if termination criteria met
     if (nPrimitives <= maxPrims || depth == 0) {
         PBRT_KDTREE_CREATED_LEAF(nPrimitives, maxDepth-depth);
-        nodes[nodeNum].initLeaf(primNums, nPrimitives, arena);
-        return;
+        initBuildLeaf(buildArena, node, edgePool, edgeOffset, nPrimitives);
+        return node;
     }
 
     // Initialize interior node and continue recursion
@@ -195,20 +290,12 @@ void KdTreeAccel::buildTree(int nodeNum, const BBox &nodeBounds,
     int retries = 0;
     retrySplit:
 
-    // Initialize edges for _axis_
-    for (int i = 0; i < nPrimitives; ++i) {
-        int pn = primNums[i];
-        const BBox &bbox = allPrimBounds[pn];
-        edges[axis][2*i] =   BoundEdge(bbox.pMin[axis], pn, true);
-        edges[axis][2*i+1] = BoundEdge(bbox.pMax[axis], pn, false);
-    }
-    sort(&edges[axis][0], &edges[axis][2*nPrimitives]);
-
     // Compute cost of all splits for _axis_ to find best
+    const BoundEdge *axisEdges = &edgePool[edgeOffset + 2*nPrimitives*axis];
     int nBelow = 0, nAbove = nPrimitives;
     for (int i = 0; i < 2*nPrimitives; ++i) {
-        if (edges[axis][i].type == BoundEdge::END) --nAbove;
-        float edget = edges[axis][i].t;
+        if (axisEdges[i].type == BoundEdge::END) --nAbove;
+        float edget = axisEdges[i].t;
         if (edget > nodeBounds.pMin[axis] &&
             edget < nodeBounds.pMax[axis]) {
             // Compute cost for split at _i_th edge
@@ -232,7 +319,7 @@ void KdTreeAccel::buildTree(int nodeNum, const BBox &nodeBounds,
                 bestOffset = i;
             }
         }
-        if (edges[axis][i].type == BoundEdge::START) ++nBelow;
+        if (axisEdges[i].type == BoundEdge::START) ++nBelow;
     }
     Assert(nBelow == nPrimitives && nAbove == 0);
 
@@ -246,31 +333,93 @@ void KdTreeAccel::buildTree(int nodeNum, const BBox &nodeBounds,
     if ((bestCost > 4.f * oldCost && nPrimitives < 16) ||
         bestAxis == -1 || badRefines == 3) {
         PBRT_KDTREE_CREATED_LEAF(nPrimitives, maxDepth-depth);
-        nodes[nodeNum].initLeaf(primNums, nPrimitives, arena);
-        return;
+        initBuildLeaf(buildArena, node, edgePool, edgeOffset, nPrimitives);
+        return node;
     }
 
     // Classify primitives with respect to split
+    const BoundEdge *splitEdges = &edgePool[edgeOffset + 2*nPrimitives*bestAxis];
+    const BoundEdge splitEdge = splitEdges[bestOffset];
     int n0 = 0, n1 = 0;
     for (int i = 0; i < bestOffset; ++i)
-        if (edges[bestAxis][i].type == BoundEdge::START)
-            prims0[n0++] = edges[bestAxis][i].primNum;
+        if (splitEdges[i].type == BoundEdge::START) ++n0;
     for (int i = bestOffset+1; i < 2*nPrimitives; ++i)
-        if (edges[bestAxis][i].type == BoundEdge::END)
-            prims1[n1++] = edges[bestAxis][i].primNum;
+        if (splitEdges[i].type == BoundEdge::END) ++n1;
+
+    // Distribute sorted edges of all axes to children, preserving order;
+    // children's edges are pushed onto the end of _edgePool_
+    uint32_t offset0 = edgePool.size(), offset1 = offset0 + 6*n0;
+    edgePool.resize(offset1 + 6*n1);
+    BoundEdge *edges = &edgePool[edgeOffset];
+    BoundEdge *edges0 = &edgePool[offset0], *edges1 = &edgePool[offset1];
+    for (int a = 0; a < 3; ++a) {
+        for (int i = 0; i < 2*nPrimitives; ++i) {
+            const BoundEdge &e = edges[2*nPrimitives*a + i];
+            // A primitive is below the split if its starting edge precedes
+            // _splitEdge_ and above it if its ending edge follows it
+            const BBox &b = state.primBounds[e.primNum];
+            if (BoundEdge(b.pMin[bestAxis], e.primNum, true) < splitEdge)
+                *edges0++ = e;
+            if (splitEdge < BoundEdge(b.pMax[bestAxis], e.primNum, false))
+                *edges1++ = e;
+        }
+    }
 
     // Recursively initialize children nodes
-    float tsplit = edges[bestAxis][bestOffset].t;
+    float tsplit = splitEdge.t;
     PBRT_KDTREE_CREATED_INTERIOR_NODE(bestAxis, tsplit);
     BBox bounds0 = nodeBounds, bounds1 = nodeBounds;
     bounds0.pMax[bestAxis] = bounds1.pMin[bestAxis] = tsplit;
-    buildTree(nodeNum+1, bounds0,
-              allPrimBounds, prims0, n0, depth-1, edges,
-              prims0, prims1 + nPrimitives, badRefines);
-    uint32_t aboveChild = nextFreeNode;
-    nodes[nodeNum].initInterior(bestAxis, aboveChild, tsplit);
-    buildTree(aboveChild, bounds1, allPrimBounds, prims1, n1,
-              depth-1, edges, prims0, prims1 + nPrimitives, badRefines);
+    KdBuildNode *children[2];
+    if (state.parallel && nPrimitives >= KD_PARALLEL_SUBTREE_PRIMS) {
+        // Build below child in a new task while this thread builds above
+        KdBuildTask *task = new KdBuildTask(this, state, bounds0,
+            &edgePool[offset0], n0, depth-1, badRefines, &children[0]);
+        { MutexLock lock(*state.tasksMutex);
+        state.tasks.push_back(task);
+        }
+        vector<Task *> tasks(1, task);
+        EnqueueTasks(tasks);
+        children[1] = buildTree(buildArena, state, edgePool, bounds1, offset1,
+                                n1, depth-1, badRefines);
+        WaitForAllTasks();
+    }
+    else {
+        children[0] = buildTree(buildArena, state, edgePool, bounds0, offset0,
+                                n0, depth-1, badRefines);
+        children[1] = buildTree(buildArena, state, edgePool, bounds1, offset1,
+                                n1, depth-1, badRefines);
+    }
+    edgePool.resize(offset0);
+    node->InitInterior(bestAxis, tsplit, children[0], children[1]);
+    return node;
+}
+
+
+void KdTreeAccel::initBuildLeaf(MemoryArena &buildArena, KdBuildNode *node,
+        const vector<BoundEdge> &edgePool, uint32_t edgeOffset,
+        int nPrimitives) const {
+    // Collect primitive numbers from starting edges along the $x$ axis
+    uint32_t *primNums = buildArena.Alloc<uint32_t>(nPrimitives);
+    int np = 0;
+    for (int i = 0; i < 2*nPrimitives; ++i)
+        if (edgePool[edgeOffset + i].type == BoundEdge::START)
+            primNums[np++] = edgePool[edgeOffset + i].primNum;
+    Assert(np == nPrimitives);
+    node->InitLeaf(primNums, nPrimitives);
+}
+
+
+void KdTreeAccel::flattenTree(const KdBuildNode *node) {
+    uint32_t nodeNum = nextFreeNode++;
+    if (!node->children[0])
+        nodes[nodeNum].initLeaf(node->primNums, node->nPrimitives, arena);
+    else {
+        // Place below child next to _node_ and record above child's offset
+        flattenTree(node->children[0]);
+        nodes[nodeNum].initInterior(node->axis, nextFreeNode, node->split);
+        flattenTree(node->children[1]);
+    }
 }
 
 
@@ -470,6 +619,154 @@ bool KdTreeAccel::IntersectP(const Ray &ray) const {
 }
 
 
+struct KdPacketToDo {
+    const KdAccelNode *node;
+    uint32_t mask;
+    float tmin[PBRT_PACKET_SIZE], tmax[PBRT_PACKET_SIZE];
+};
+
+
+void KdTreeAccel::IntersectPacket(const Ray *const *rays, int nRays,
+        Intersection *isects, bool *hits) const {
+    for (int i = 0; i < nRays; i += PBRT_PACKET_SIZE)
+        intersectPacket(rays + i, min(nRays - i, PBRT_PACKET_SIZE),
+                        isects + i, hits + i, NULL);
+}
+
+
+void KdTreeAccel::IntersectPPacket(const Ray *const *rays, int nRays,
+        bool *occluded) const {
+    for (int i = 0; i < nRays; i += PBRT_PACKET_SIZE)
+        intersectPacket(rays + i, min(nRays - i, PBRT_PACKET_SIZE),
+                        NULL, NULL, occluded + i);
+}
+
+
+void KdTreeAccel::intersectPacket(const Ray *const *rays, int nRays,
+        Intersection *isects, bool *hits, bool *occluded) const {
+    // Compute initial parametric ranges of packet rays inside kd-tree extent
+    float tmin[PBRT_PACKET_SIZE], tmax[PBRT_PACKET_SIZE];
+    Vector invDir[PBRT_PACKET_SIZE];
+    uint32_t mask = 0;
+    for (int i = 0; i < nRays; ++i) {
+        const Ray &ray = *rays[i];
+        if (hits) hits[i] = false;
+        if (occluded) occluded[i] = false;
+        if (bounds.IntersectP(ray, &tmin[i], &tmax[i]))
+            mask |= (1u << i);
+        invDir[i] = Vector(1.f/ray.d.x, 1.f/ray.d.y, 1.f/ray.d.z);
+    }
+
+    // Traverse kd-tree nodes with the rays in _mask_; _active_ holds the
+    // rays that haven't yet been found to be occluded
+    uint32_t active = mask;
+#define MAX_PACKET_TODO 64
+    KdPacketToDo todo[MAX_PACKET_TODO];
+    int todoPos = 0;
+    const KdAccelNode *node = &nodes[0];
+    while (true) {
+        // Remove rays that found a hit closer than the current node
+        for (int i = 0; i < nRays; ++i)
+            if ((mask & (1u << i)) && rays[i]->maxt < tmin[i])
+                mask &= ~(1u << i);
+        if (mask != 0 && !node->IsLeaf()) {
+            if (occluded) {
+                PBRT_KDTREE_INTERSECTIONP_TRAVERSED_INTERIOR_NODE(const_cast<KdAccelNode *>(node));
+            }
+            else {
+                PBRT_KDTREE_INTERSECTION_TRAVERSED_INTERIOR_NODE(const_cast<KdAccelNode *>(node));
+            }
+            // Classify packet rays against interior node's split plane
+            int axis = node->SplitAxis();
+            float split = node->SplitPos();
+            uint32_t childMask[2] = { 0, 0 };
+            float childTMin[2][PBRT_PACKET_SIZE], childTMax[2][PBRT_PACKET_SIZE];
+            int nearChild = -1;
+            for (int i = 0; i < nRays; ++i) {
+                if (!(mask & (1u << i))) continue;
+                const Ray &ray = *rays[i];
+                float tplane = (split - ray.o[axis]) * invDir[i][axis];
+                int belowFirst = (ray.o[axis] <  split) ||
+                                 (ray.o[axis] == split && ray.d[axis] <= 0);
+                int first = belowFirst ? 0 : 1, second = 1 - first;
+                if (nearChild == -1) nearChild = first;
+                if (tplane > tmax[i] || tplane <= 0) {
+                    childMask[first] |= (1u << i);
+                    childTMin[first][i] = tmin[i];
+                    childTMax[first][i] = tmax[i];
+                }
+                else if (tplane < tmin[i]) {
+                    childMask[second] |= (1u << i);
+                    childTMin[second][i] = tmin[i];
+                    childTMax[second][i] = tmax[i];
+                }
+                else {
+                    childMask[first] |= (1u << i);
+                    childTMin[first][i] = tmin[i];
+                    childTMax[first][i] = tplane;
+                    childMask[second] |= (1u << i);
+                    childTMin[second][i] = tplane;
+                    childTMax[second][i] = tmax[i];
+                }
+            }
+            const KdAccelNode *children[2] = { node + 1,
+                                               &nodes[node->AboveChild()] };
+
+            // Enqueue far child in todo list and advance to near child
+            int farChild = 1 - nearChild;
+            if (childMask[nearChild] == 0) nearChild = farChild;
+            else if (childMask[farChild] != 0) {
+                KdPacketToDo &entry = todo[todoPos++];
+                entry.node = children[farChild];
+                entry.mask = childMask[farChild];
+                memcpy(entry.tmin, childTMin[farChild], nRays * sizeof(float));
+                memcpy(entry.tmax, childTMax[farChild], nRays * sizeof(float));
+            }
+            node = children[nearChild];
+            mask = childMask[nearChild];
+            memcpy(tmin, childTMin[nearChild], nRays * sizeof(float));
+            memcpy(tmax, childTMax[nearChild], nRays * sizeof(float));
+            continue;
+        }
+        if (mask != 0) {
+            // Check for intersections of packet rays inside leaf node
+            uint32_t nPrimitives = node->nPrimitives();
+            if (occluded) {
+                PBRT_KDTREE_INTERSECTIONP_TRAVERSED_LEAF_NODE(const_cast<KdAccelNode *>(node), nPrimitives);
+            }
+            else {
+                PBRT_KDTREE_INTERSECTION_TRAVERSED_LEAF_NODE(const_cast<KdAccelNode *>(node), nPrimitives);
+            }
+            for (uint32_t p = 0; p < nPrimitives; ++p) {
+                const Primitive *prim = (nPrimitives == 1) ?
+                    primitives[node->onePrimitive].GetPtr() :
+                    primitives[node->primitives[p]].GetPtr();
+                for (int i = 0; i < nRays; ++i) {
+                    if (!(mask & (1u << i))) continue;
+                    if (occluded) {
+                        if (prim->IntersectP(*rays[i])) {
+                            occluded[i] = true;
+                            mask &= ~(1u << i);
+                            active &= ~(1u << i);
+                        }
+                    }
+                    else if (prim->Intersect(*rays[i], &isects[i]))
+                        hits[i] = true;
+                }
+            }
+        }
+
+        // Grab next node to process from todo list
+        if (todoPos == 0 || active == 0) break;
+        --todoPos;
+        node = todo[todoPos].node;
+        mask = todo[todoPos].mask & active;
+        memcpy(tmin, todo[todoPos].tmin, nRays * sizeof(float));
+        memcpy(tmax, todo[todoPos].tmax, nRays * sizeof(float));
+    }
+}
+
+
 KdTreeAccel *CreateKdTreeAccelerator(const vector<Reference<Primitive> > &prims,
         const ParamSet &ps) {
     int isectCost = ps.FindOneInt("intersectcost", 80);
@@ -477,8 +774,9 @@ KdTreeAccel *CreateKdTreeAccelerator(const vector<Reference<Primitive> > &prims,
     float emptyBonus = ps.FindOneFloat("emptybonus", 0.5f);
     int maxPrims = ps.FindOneInt("maxprims", 1);
     int maxDepth = ps.FindOneInt("maxdepth", -1);
+    bool parallelBuild = ps.FindOneBool("parallelbuild", true);
     return new KdTreeAccel(prims, isectCost, travCost,
-        emptyBonus, maxPrims, maxDepth);
+        emptyBonus, maxPrims, maxDepth, parallelBuild);
 }
 
 
@@ -43,22 +43,36 @@
 // KdTreeAccel Declarations
 struct KdAccelNode;
 struct BoundEdge;
+struct KdBuildNode;
+struct KdBuildState;
 class KdTreeAccel : public Aggregate {
 public:
     // KdTreeAccel Public Methods
     KdTreeAccel(const vector<Reference<Primitive> > &p,
                 int icost = 80, int scost = 1,  float ebonus = 0.5f, int maxp = 1,
-                int maxDepth = -1);
+                int maxDepth = -1, bool parallelBuild = true);
     BBox WorldBound() const { return bounds; }
     bool CanIntersect() const { return true; }
     ~KdTreeAccel();
     bool Intersect(const Ray &ray, Intersection *isect) const;
     bool IntersectP(const Ray &ray) const;
+    void IntersectPacket(const Ray *const *rays, int nRays,
+                         Intersection *isects, bool *hits) const;
+    void IntersectPPacket(const Ray *const *rays, int nRays,
+                          bool *occluded) const;
 private:
     // KdTreeAccel Private Methods
-    void buildTree(int nodeNum, const BBox &bounds,
-        const vector<BBox> &primBounds, uint32_t *primNums, int nprims, int depth,
-        BoundEdge *edges[3], uint32_t *prims0, uint32_t *prims1, int badRefines = 0);
+    void intersectPacket(const Ray *const *rays, int nRays,
+                         Intersection *isects, bool *hits,
+                         bool *occluded) const;
+    friend struct KdBuildTask;
+    KdBuildNode *buildTree(MemoryArena &buildArena, KdBuildState &state,
+        vector<BoundEdge> &edgePool, const BBox &bounds, uint32_t edgeOffset,
+        int nprims, int depth, int badRefines);
+    void initBuildLeaf(MemoryArena &buildArena, KdBuildNode *node,
+        const vector<BoundEdge> &edgePool, uint32_t edgeOffset,
+        int nprims) const;
+    void flattenTree(const KdBuildNode *node);
 
     // KdTreeAccel Private Data
     int isectCost, traversalCost, maxPrims, maxDepth;
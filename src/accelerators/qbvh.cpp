@@ -0,0 +1,487 @@
+
+/*
+    pbrt source code Copyright(c) 1998-2012 Matt Pharr and Greg Humphreys.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+// accelerators/qbvh.cpp*
+#include "stdafx.h"
+#include "accelerators/qbvh.h"
+#include "accelerators/bvh.h"
+#include "shapes/trianglemesh.h"
+#include "paramset.h"
+#include "stats.h"
+#ifdef PBRT_HAS_SSE
+#include <xmmintrin.h>
+#endif
+
+// QBVHAccel Local Declarations
+static StatsMemory qbvhBytes("Memory", "QBVH accelerator");
+#ifdef PBRT_HAS_SSE
+typedef __m128 QFloat;
+static inline QFloat QLoad(const float *p) { return _mm_load_ps(p); }
+static inline QFloat QSet1(float f) { return _mm_set1_ps(f); }
+static inline void QStore(float *p, QFloat a) { _mm_storeu_ps(p, a); }
+static inline QFloat QAdd(QFloat a, QFloat b) { return _mm_add_ps(a, b); }
+static inline QFloat QSub(QFloat a, QFloat b) { return _mm_sub_ps(a, b); }
+static inline QFloat QMul(QFloat a, QFloat b) { return _mm_mul_ps(a, b); }
+static inline QFloat QDiv(QFloat a, QFloat b) { return _mm_div_ps(a, b); }
+static inline QFloat QMin(QFloat a, QFloat b) { return _mm_min_ps(a, b); }
+static inline QFloat QMax(QFloat a, QFloat b) { return _mm_max_ps(a, b); }
+static inline QFloat QAbs(QFloat a) {
+    return _mm_andnot_ps(_mm_set1_ps(-0.f), a);
+}
+static inline QFloat QCmpLT(QFloat a, QFloat b) { return _mm_cmplt_ps(a, b); }
+static inline QFloat QCmpLE(QFloat a, QFloat b) { return _mm_cmple_ps(a, b); }
+static inline QFloat QCmpEQ(QFloat a, QFloat b) { return _mm_cmpeq_ps(a, b); }
+static inline QFloat QOr(QFloat a, QFloat b) { return _mm_or_ps(a, b); }
+static inline int QMask(QFloat a) { return _mm_movemask_ps(a); }
+#else
+// Portable four-wide fallback; comparisons return 0 or 1 per lane and
+// _QMin()_/_QMax()_ match the operand ordering of the SSE instructions
+struct QFloat { float v[4]; };
+static inline QFloat QLoad(const float *p) {
+    QFloat r; for (int i = 0; i < 4; ++i) r.v[i] = p[i]; return r;
+}
+static inline QFloat QSet1(float f) {
+    QFloat r; for (int i = 0; i < 4; ++i) r.v[i] = f; return r;
+}
+static inline void QStore(float *p, QFloat a) {
+    for (int i = 0; i < 4; ++i) p[i] = a.v[i];
+}
+#define QFLOAT_BINARY_OP(NAME, EXPR) \
+    static inline QFloat NAME(QFloat a, QFloat b) { \
+        QFloat r; \
+        for (int i = 0; i < 4; ++i) { float x = a.v[i], y = b.v[i]; r.v[i] = (EXPR); } \
+        return r; \
+    }
+QFLOAT_BINARY_OP(QAdd, x + y)
+QFLOAT_BINARY_OP(QSub, x - y)
+QFLOAT_BINARY_OP(QMul, x * y)
+QFLOAT_BINARY_OP(QDiv, x / y)
+QFLOAT_BINARY_OP(QMin, x < y ? x : y)
+QFLOAT_BINARY_OP(QMax, x > y ? x : y)
+QFLOAT_BINARY_OP(QCmpLT, x < y ? 1.f : 0.f)
+QFLOAT_BINARY_OP(QCmpLE, x <= y ? 1.f : 0.f)
+QFLOAT_BINARY_OP(QCmpEQ, x == y ? 1.f : 0.f)
+QFLOAT_BINARY_OP(QOr, (x != 0.f || y != 0.f) ? 1.f : 0.f)
+#undef QFLOAT_BINARY_OP
+static inline QFloat QAbs(QFloat a) {
+    QFloat r; for (int i = 0; i < 4; ++i) r.v[i] = fabsf(a.v[i]); return r;
+}
+static inline int QMask(QFloat a) {
+    int m = 0;
+    for (int i = 0; i < 4; ++i) if (a.v[i] != 0.f) m |= (1 << i);
+    return m;
+}
+#endif // PBRT_HAS_SSE
+
+// Children of a _QBVHNode_ are node indices when non-negative and encoded
+// leaf indices otherwise; unused child slots have empty bounds
+#define QBVH_LEAF_CHILD(i) (-(int32_t)(i) - 1)
+#define QBVH_CHILD_LEAF(c) ((uint32_t)(-((c) + 1)))
+#define QBVH_MAX_TODO 256
+
+struct QBVHNode {
+    // Child bounds in SoA layout, indexed by [min/max][axis][child]
+    float bounds[2][3][4];
+    int32_t children[4];
+    int32_t pad[4];       // ensure 128 byte total size
+};
+
+
+struct QBVHLeaf {
+    uint32_t primitivesOffset, nPrimitives;
+    // The first _nTriangles_ primitives of the leaf are triangles, packed
+    // four at a time into consecutive _QBVHTriangles_ starting at
+    // _trianglesOffset_
+    uint32_t trianglesOffset, nTriangles;
+};
+
+
+struct QBVHTriangles {
+    // Vertex $p_1$ and edges $e_1$, $e_2$ of four triangles, [axis][triangle]
+    float p1[3][4], e1[3][4], e2[3][4];
+};
+
+
+static bool GetTriangleVertices(const Primitive *prim, Point p[3]) {
+    const GeometricPrimitive *gp =
+        dynamic_cast<const GeometricPrimitive *>(prim);
+    if (!gp) return false;
+    const Triangle *tri = dynamic_cast<const Triangle *>(gp->GetShape());
+    if (!tri) return false;
+    tri->GetVertices(p);
+    return true;
+}
+
+
+static inline int IntersectNode(const QBVHNode &node, const QFloat o[3],
+        const QFloat invDir[3], const int dirIsNeg[3], float mint,
+        float maxt, float tNear[4]) {
+    // Intersect ray with all four child bounds using slab tests
+    QFloat tMin = QSet1(mint), tMax = QSet1(maxt);
+    for (int axis = 0; axis < 3; ++axis) {
+        QFloat t0 = QMul(QSub(QLoad(node.bounds[dirIsNeg[axis]][axis]),
+                              o[axis]), invDir[axis]);
+        QFloat t1 = QMul(QSub(QLoad(node.bounds[1-dirIsNeg[axis]][axis]),
+                              o[axis]), invDir[axis]);
+        // Ignore NaN slab distances from rays lying in a slab plane
+        tMin = QMax(t0, tMin);
+        tMax = QMin(t1, tMax);
+    }
+    QStore(tNear, tMin);
+    return QMask(QCmpLE(tMin, tMax));
+}
+
+
+static inline int TriangleCandidates(const QBVHTriangles &tris,
+        const Ray &ray, int nValid) {
+    // Compute Moller-Trumbore terms for four triangles
+    QFloat dx = QSet1(ray.d.x), dy = QSet1(ray.d.y), dz = QSet1(ray.d.z);
+    QFloat e1x = QLoad(tris.e1[0]), e1y = QLoad(tris.e1[1]), e1z = QLoad(tris.e1[2]);
+    QFloat e2x = QLoad(tris.e2[0]), e2y = QLoad(tris.e2[1]), e2z = QLoad(tris.e2[2]);
+    QFloat s1x = QSub(QMul(dy, e2z), QMul(dz, e2y));
+    QFloat s1y = QSub(QMul(dz, e2x), QMul(dx, e2z));
+    QFloat s1z = QSub(QMul(dx, e2y), QMul(dy, e2x));
+    QFloat divisor = QAdd(QAdd(QMul(s1x, e1x), QMul(s1y, e1y)), QMul(s1z, e1z));
+    QFloat invDivisor = QDiv(QSet1(1.f), divisor);
+    QFloat ox = QSub(QSet1(ray.o.x), QLoad(tris.p1[0]));
+    QFloat oy = QSub(QSet1(ray.o.y), QLoad(tris.p1[1]));
+    QFloat oz = QSub(QSet1(ray.o.z), QLoad(tris.p1[2]));
+    QFloat b1 = QMul(QAdd(QAdd(QMul(ox, s1x), QMul(oy, s1y)), QMul(oz, s1z)),
+                     invDivisor);
+    QFloat s2x = QSub(QMul(oy, e1z), QMul(oz, e1y));
+    QFloat s2y = QSub(QMul(oz, e1x), QMul(ox, e1z));
+    QFloat s2z = QSub(QMul(ox, e1y), QMul(oy, e1x));
+    QFloat b2 = QMul(QAdd(QAdd(QMul(dx, s2x), QMul(dy, s2y)), QMul(dz, s2z)),
+                     invDivisor);
+    QFloat t = QMul(QAdd(QAdd(QMul(e2x, s2x), QMul(e2y, s2y)), QMul(e2z, s2z)),
+                    invDivisor);
+
+    // Reject triangles that are clearly missed, allowing some slack
+    // since _Triangle::Intersect()_'s scalar code may round differently
+    // (e.g., fused multiply-adds); lanes with a zero divisor are always
+    // left to the exact test
+    const float baryEps = 1e-4f, tEps = 1e-3f;
+    QFloat lo = QSet1(-baryEps), hi = QSet1(1.f + baryEps);
+    QFloat tSlack = QMul(QAbs(t), QSet1(tEps));
+    QFloat miss = QOr(QOr(QCmpLT(b1, lo), QCmpLT(hi, b1)),
+                      QOr(QCmpLT(b2, lo), QCmpLT(hi, QAdd(b1, b2))));
+    miss = QOr(miss, QOr(QCmpLT(QAdd(t, tSlack), QSet1(ray.mint)),
+                         QCmpLT(QSet1(ray.maxt), QSub(t, tSlack))));
+    int candidates = ~QMask(miss) | QMask(QCmpEQ(divisor, QSet1(0.f)));
+    return candidates & ((1 << nValid) - 1);
+}
+
+
+
+// QBVHAccel Method Definitions
+QBVHAccel::QBVHAccel(const vector<Reference<Primitive> > &p,
+                     const string &sm, bool parallelBuild) {
+    nodes = NULL;
+    leaves = NULL;
+    triangles = NULL;
+    nNodes = nLeaves = nTriangleGroups = 0;
+
+    // Build binary BVH with up to four primitives per leaf, leaving mesh
+    // triangles as primitives so that they can be packed below
+    BVHAccel bvh(p, 4, sm, parallelBuild, false);
+    primitives.swap(bvh.primitives);
+    if (!bvh.nodes) return;
+    bounds = bvh.nodes[0].bounds;
+
+    // Collapse binary BVH into four-wide nodes
+    vector<QBVHNode> qnodes;
+    vector<QBVHLeaf> qleaves;
+    vector<QBVHTriangles> qtris;
+    if (bvh.nodes[0].nPrimitives > 0) {
+        // Create root node with the single leaf as its only child
+        QBVHNode root;
+        for (int axis = 0; axis < 3; ++axis) {
+            root.bounds[0][axis][0] = bounds.pMin[axis];
+            root.bounds[1][axis][0] = bounds.pMax[axis];
+            for (int c = 1; c < 4; ++c) {
+                root.bounds[0][axis][c] = INFINITY;
+                root.bounds[1][axis][c] = -INFINITY;
+            }
+        }
+        for (int c = 0; c < 4; ++c) root.children[c] = 0;
+        qnodes.push_back(root);
+        qnodes[0].children[0] = makeLeaf(bvh.nodes[0], qleaves, qtris);
+    }
+    else
+        collapse(bvh.nodes, 0, qnodes, qleaves, qtris);
+
+    // Copy QBVH data into aligned storage
+    nNodes = qnodes.size();
+    nLeaves = qleaves.size();
+    nTriangleGroups = qtris.size();
+    nodes = AllocAligned<QBVHNode>(nNodes);
+    memcpy(nodes, &qnodes[0], nNodes * sizeof(QBVHNode));
+    leaves = AllocAligned<QBVHLeaf>(nLeaves);
+    memcpy(leaves, &qleaves[0], nLeaves * sizeof(QBVHLeaf));
+    if (nTriangleGroups > 0) {
+        triangles = AllocAligned<QBVHTriangles>(nTriangleGroups);
+        memcpy(triangles, &qtris[0], nTriangleGroups * sizeof(QBVHTriangles));
+    }
+    size_t nBytes = nNodes * sizeof(QBVHNode) + nLeaves * sizeof(QBVHLeaf) +
+        nTriangleGroups * sizeof(QBVHTriangles);
+    qbvhBytes += nBytes;
+    Info("QBVH created with %d nodes and %d leaves for %d primitives (%.2f MB)",
+         (int)nNodes, (int)nLeaves, (int)primitives.size(),
+         float(nBytes) / (1024.f*1024.f));
+}
+
+
+QBVHAccel::~QBVHAccel() {
+    FreeAligned(nodes);
+    FreeAligned(leaves);
+    FreeAligned(triangles);
+}
+
+
+int32_t QBVHAccel::collapse(const LinearBVHNode *bvhNodes, uint32_t nodeNum,
+        vector<QBVHNode> &qnodes, vector<QBVHLeaf> &qleaves,
+        vector<QBVHTriangles> &qtris) {
+    if (bvhNodes[nodeNum].nPrimitives > 0)
+        return makeLeaf(bvhNodes[nodeNum], qleaves, qtris);
+
+    // Gather up to four descendants of binary interior node
+    uint32_t children[4];
+    int nChildren = 2;
+    children[0] = nodeNum + 1;
+    children[1] = bvhNodes[nodeNum].secondChildOffset;
+    while (nChildren < 4) {
+        // Open the interior child with the largest surface area
+        int best = -1;
+        float bestArea = -1.f;
+        for (int i = 0; i < nChildren; ++i) {
+            const LinearBVHNode &c = bvhNodes[children[i]];
+            if (c.nPrimitives == 0 && c.bounds.SurfaceArea() > bestArea) {
+                best = i;
+                bestArea = c.bounds.SurfaceArea();
+            }
+        }
+        if (best == -1) break;
+        uint32_t opened = children[best];
+        children[best] = opened + 1;
+        children[nChildren++] = bvhNodes[opened].secondChildOffset;
+    }
+
+    // Initialize _QBVHNode_ and recursively collapse its children
+    uint32_t qnodeNum = qnodes.size();
+    qnodes.push_back(QBVHNode());
+    for (int c = 0; c < 4; ++c) {
+        int32_t child = 0;
+        if (c < nChildren)
+            child = collapse(bvhNodes, children[c], qnodes, qleaves, qtris);
+        QBVHNode &qnode = qnodes[qnodeNum];
+        qnode.children[c] = child;
+        for (int axis = 0; axis < 3; ++axis) {
+            if (c < nChildren) {
+                const BBox &b = bvhNodes[children[c]].bounds;
+                qnode.bounds[0][axis][c] = b.pMin[axis];
+                qnode.bounds[1][axis][c] = b.pMax[axis];
+            }
+            else {
+                qnode.bounds[0][axis][c] = INFINITY;
+                qnode.bounds[1][axis][c] = -INFINITY;
+            }
+        }
+    }
+    return (int32_t)qnodeNum;
+}
+
+
+int32_t QBVHAccel::makeLeaf(const LinearBVHNode &node,
+        vector<QBVHLeaf> &qleaves, vector<QBVHTriangles> &qtris) {
+    // Reorder leaf primitives so that triangles come first
+    uint32_t offset = node.primitivesOffset, nPrims = node.nPrimitives;
+    vector<Reference<Primitive> > tris, others;
+    vector<Point> verts;
+    for (uint32_t i = 0; i < nPrims; ++i) {
+        const Reference<Primitive> &prim = primitives[offset + i];
+        Point p[3];
+        if (GetTriangleVertices(prim.GetPtr(), p)) {
+            tris.push_back(prim);
+            verts.insert(verts.end(), p, p + 3);
+        }
+        else
+            others.push_back(prim);
+    }
+    for (uint32_t i = 0; i < tris.size(); ++i)
+        primitives[offset + i] = tris[i];
+    for (uint32_t i = 0; i < others.size(); ++i)
+        primitives[offset + tris.size() + i] = others[i];
+
+    // Pack triangle vertices into _QBVHTriangles_
+    QBVHLeaf leaf;
+    leaf.primitivesOffset = offset;
+    leaf.nPrimitives = nPrims;
+    leaf.trianglesOffset = qtris.size();
+    leaf.nTriangles = tris.size();
+    for (uint32_t i = 0; i < tris.size(); i += 4) {
+        QBVHTriangles group;
+        memset(&group, 0, sizeof(group));
+        for (uint32_t j = 0; j < 4 && i + j < tris.size(); ++j) {
+            const Point *p = &verts[3 * (i + j)];
+            Vector e1 = p[1] - p[0], e2 = p[2] - p[0];
+            for (int axis = 0; axis < 3; ++axis) {
+                group.p1[axis][j] = p[0][axis];
+                group.e1[axis][j] = e1[axis];
+                group.e2[axis][j] = e2[axis];
+            }
+        }
+        qtris.push_back(group);
+    }
+    qleaves.push_back(leaf);
+    return QBVH_LEAF_CHILD(qleaves.size() - 1);
+}
+
+
+bool QBVHAccel::intersectLeaf(const QBVHLeaf &leaf, const Ray &ray,
+                              Intersection *isect) const {
+    bool hit = false;
+    const Reference<Primitive> *prims = &primitives[leaf.primitivesOffset];
+    // Test candidate triangles found by four-wide intersection test
+    for (uint32_t i = 0; i < leaf.nTriangles; i += 4) {
+        int nValid = min(4u, leaf.nTriangles - i);
+        int candidates = TriangleCandidates(
+            triangles[leaf.trianglesOffset + i / 4], ray, nValid);
+        for (int j = 0; j < nValid; ++j)
+            if ((candidates & (1 << j)) && prims[i + j]->Intersect(ray, isect))
+                hit = true;
+    }
+
+    // Intersect ray with remaining non-triangle primitives
+    for (uint32_t i = leaf.nTriangles; i < leaf.nPrimitives; ++i)
+        if (prims[i]->Intersect(ray, isect))
+            hit = true;
+    return hit;
+}
+
+
+bool QBVHAccel::intersectPLeaf(const QBVHLeaf &leaf, const Ray &ray) const {
+    const Reference<Primitive> *prims = &primitives[leaf.primitivesOffset];
+    for (uint32_t i = 0; i < leaf.nTriangles; i += 4) {
+        int nValid = min(4u, leaf.nTriangles - i);
+        int candidates = TriangleCandidates(
+            triangles[leaf.trianglesOffset + i / 4], ray, nValid);
+        for (int j = 0; j < nValid; ++j)
+            if ((candidates & (1 << j)) && prims[i + j]->IntersectP(ray))
+                return true;
+    }
+    for (uint32_t i = leaf.nTriangles; i < leaf.nPrimitives; ++i)
+        if (prims[i]->IntersectP(ray))
+            return true;
+    return false;
+}
+
+
+bool QBVHAccel::Intersect(const Ray &ray, Intersection *isect) const {
+    if (!nodes) return false;
+    bool hit = false;
+    // Compute four-wide ray origin and inverse direction
+    Vector invDir(1.f / ray.d.x, 1.f / ray.d.y, 1.f / ray.d.z);
+    int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+    QFloat o[3] = { QSet1(ray.o.x), QSet1(ray.o.y), QSet1(ray.o.z) };
+    QFloat qInvDir[3] = { QSet1(invDir.x), QSet1(invDir.y), QSet1(invDir.z) };
+
+    // Follow ray through QBVH nodes, visiting nearer children first
+    int32_t todo[QBVH_MAX_TODO];
+    float todoTMin[QBVH_MAX_TODO];
+    int todoOffset = 0;
+    todo[todoOffset] = 0;
+    todoTMin[todoOffset++] = ray.mint;
+    while (todoOffset > 0) {
+        --todoOffset;
+        if (todoTMin[todoOffset] > ray.maxt) continue;
+        int32_t child = todo[todoOffset];
+        if (child < 0) {
+            if (intersectLeaf(leaves[QBVH_CHILD_LEAF(child)], ray, isect))
+                hit = true;
+            continue;
+        }
+        float tNear[4];
+        int hits = IntersectNode(nodes[child], o, qInvDir, dirIsNeg,
+                                 ray.mint, ray.maxt, tNear);
+        // Push intersected children so that the nearest is on top of stack
+        int start = todoOffset;
+        for (int c = 0; c < 4; ++c) {
+            if (!(hits & (1 << c))) continue;
+            int i = todoOffset++;
+            while (i > start && todoTMin[i-1] < tNear[c]) {
+                todo[i] = todo[i-1];
+                todoTMin[i] = todoTMin[i-1];
+                --i;
+            }
+            todo[i] = nodes[child].children[c];
+            todoTMin[i] = tNear[c];
+        }
+    }
+    return hit;
+}
+
+
+bool QBVHAccel::IntersectP(const Ray &ray) const {
+    if (!nodes) return false;
+    Vector invDir(1.f / ray.d.x, 1.f / ray.d.y, 1.f / ray.d.z);
+    int dirIsNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+    QFloat o[3] = { QSet1(ray.o.x), QSet1(ray.o.y), QSet1(ray.o.z) };
+    QFloat qInvDir[3] = { QSet1(invDir.x), QSet1(invDir.y), QSet1(invDir.z) };
+    int32_t todo[QBVH_MAX_TODO];
+    int todoOffset = 0;
+    todo[todoOffset++] = 0;
+    while (todoOffset > 0) {
+        int32_t child = todo[--todoOffset];
+        if (child < 0) {
+            if (intersectPLeaf(leaves[QBVH_CHILD_LEAF(child)], ray))
+                return true;
+            continue;
+        }
+        float tNear[4];
+        int hits = IntersectNode(nodes[child], o, qInvDir, dirIsNeg,
+                                 ray.mint, ray.maxt, tNear);
+        for (int c = 0; c < 4; ++c)
+            if (hits & (1 << c))
+                todo[todoOffset++] = nodes[child].children[c];
+    }
+    return false;
+}
+
+
+QBVHAccel *CreateQBVHAccelerator(const vector<Reference<Primitive> > &prims,
+        const ParamSet &ps) {
+    string splitMethod = ps.FindOneString("splitmethod", "sah");
+    bool parallelBuild = ps.FindOneBool("parallelbuild", true);
+    return new QBVHAccel(prims, splitMethod, parallelBuild);
+}
+
+
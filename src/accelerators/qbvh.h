@@ -0,0 +1,84 @@
+
+/*
+    pbrt source code Copyright(c) 1998-2012 Matt Pharr and Greg Humphreys.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef PBRT_ACCELERATORS_QBVH_H
+#define PBRT_ACCELERATORS_QBVH_H
+
+// accelerators/qbvh.h*
+#include "pbrt.h"
+#include "primitive.h"
+
+// QBVHAccel Forward Declarations
+struct QBVHNode;
+struct QBVHLeaf;
+struct QBVHTriangles;
+struct LinearBVHNode;
+
+// QBVHAccel Declarations
+class QBVHAccel : public Aggregate {
+public:
+    // QBVHAccel Public Methods
+    QBVHAccel(const vector<Reference<Primitive> > &p,
+              const string &sm = "sah", bool parallelBuild = true);
+    BBox WorldBound() const { return bounds; }
+    bool CanIntersect() const { return true; }
+    ~QBVHAccel();
+    bool Intersect(const Ray &ray, Intersection *isect) const;
+    bool IntersectP(const Ray &ray) const;
+private:
+    // QBVHAccel Private Methods
+    int32_t collapse(const LinearBVHNode *bvhNodes, uint32_t nodeNum,
+        vector<QBVHNode> &qnodes, vector<QBVHLeaf> &qleaves,
+        vector<QBVHTriangles> &qtris);
+    int32_t makeLeaf(const LinearBVHNode &node, vector<QBVHLeaf> &qleaves,
+        vector<QBVHTriangles> &qtris);
+    bool intersectLeaf(const QBVHLeaf &leaf, const Ray &ray,
+                       Intersection *isect) const;
+    bool intersectPLeaf(const QBVHLeaf &leaf, const Ray &ray) const;
+
+    // QBVHAccel Private Data
+    BBox bounds;
+    vector<Reference<Primitive> > primitives;
+    QBVHNode *nodes;
+    QBVHLeaf *leaves;
+    QBVHTriangles *triangles;
+    uint32_t nNodes, nLeaves, nTriangleGroups;
+};
+
+
+QBVHAccel *CreateQBVHAccelerator(const vector<Reference<Primitive> > &prims,
+        const ParamSet &ps);
+
+#endif // PBRT_ACCELERATORS_QBVH_H
@@ -41,11 +41,14 @@
 #include "film.h"
 #include "volume.h"
 #include "probes.h"
+#include "stats.h"
 
 // API Additional Headers
 #include "accelerators/bvh.h"
 #include "accelerators/grid.h"
+#include "accelerators/instance.h"
 #include "accelerators/kdtreeaccel.h"
+#include "accelerators/qbvh.h"
 #include "cameras/environment.h"
 #include "cameras/orthographic.h"
 #include "cameras/perspective.h"
@@ -109,6 +112,7 @@
 #include "shapes/paraboloid.h"
 #include "shapes/sphere.h"
 #include "shapes/trianglemesh.h"
+#include "shapes/binarymesh.h"
 #include "textures/bilerp.h"
 #include "textures/checkerboard.h"
 #include "textures/constant.h"
@@ -190,7 +194,9 @@ struct RenderOptions {
     vector<Reference<Primitive> > primitives;
     mutable vector<VolumeRegion *> volumeRegions;
     map<string, vector<Reference<Primitive> > > instances;
-    vector<Reference<Primitive> > *currentInstance;
+    vector<Reference<Primitive> > instancePrototypes;
+    map<const Primitive *, uint32_t> instancePrototypeIndices;
+    vector<ObjectInstanceItem> instanceItems;
 };
 
 
@@ -206,14 +212,14 @@ RenderOptions::RenderOptions() {
     SurfIntegratorName = "directlighting";
     VolIntegratorName = "emission";
     CameraName = "perspective";
-    currentInstance = NULL;
 }
 
 
 struct GraphicsState {
     // Graphics State Methods
     GraphicsState();
-    Reference<Material> CreateMaterial(const ParamSet &params);
+    Reference<Material> CreateMaterial(const ParamSet &params,
+                                       const Transform &mtl2world);
 
     // Graphics State
     map<string, Reference<Texture<float> > > floatTextures;
@@ -235,35 +241,36 @@ GraphicsState::GraphicsState() {
 }
 
 
-class TransformCache {
-public:
-    // TransformCache Public Methods
-    void Lookup(const Transform &t, Transform **tCached,
-            Transform **tCachedInverse) {
-        map<Transform, std::pair<Transform *, Transform *> >::iterator iter;
-        iter = cache.find(t);
-        if (iter == cache.end()) {
-            Transform *tr = arena.Alloc<Transform>();
-            *tr = t;
-            Transform *tinv = arena.Alloc<Transform>();
-            *tinv = Transform(Inverse(t));
-            cache[t] = std::make_pair(tr, tinv);
-            iter = cache.find(t);
-            PBRT_ALLOCATED_CACHED_TRANSFORM();
-        }
-        else
-            PBRT_FOUND_CACHED_TRANSFORM();
-        if (tCached) *tCached = iter->second.first;
-        if (tCachedInverse) *tCachedInverse = iter->second.second;
+struct GraphicsContext {
+    // GraphicsContext Public Methods
+    GraphicsContext() {
+        activeTransformBits = ALL_TRANSFORMS_BITS;
+        currentInstance = NULL;
+        include = NULL;
     }
-    void Clear() {
-        arena.FreeAll();
-        cache.erase(cache.begin(), cache.end());
-    }
-private:
-    // TransformCache Private Data
-    map<Transform, std::pair<Transform *, Transform *> > cache;
-    MemoryArena arena;
+
+    // GraphicsContext Public Data
+    TransformSet curTransform;
+    int activeTransformBits;
+    GraphicsState graphicsState;
+    vector<GraphicsState> pushedGraphicsStates;
+    vector<TransformSet> pushedTransforms;
+    vector<uint32_t> pushedActiveTransformBits;
+    vector<Reference<Primitive> > *currentInstance;
+    DeferredInclude *include;
+};
+
+
+struct DeferredInclude {
+    // DeferredInclude Public Data
+    GraphicsContext start, context;
+    GraphicsContext *savedContext;
+    bool independent, replaying;
+    vector<Reference<Primitive> > primitives;
+    vector<Light *> lights;
+    vector<VolumeRegion *> volumeRegions;
+    vector<Reference<Primitive> > *target;
+    size_t primitivesOffset, lightsOffset, volumeRegionsOffset;
 };
 
 
@@ -273,15 +280,11 @@ private:
 #define STATE_OPTIONS_BLOCK  1
 #define STATE_WORLD_BLOCK    2
 static int currentApiState = STATE_UNINITIALIZED;
-static TransformSet curTransform;
-static int activeTransformBits = ALL_TRANSFORMS_BITS;
 static map<string, TransformSet> namedCoordinateSystems;
 static RenderOptions *renderOptions = NULL;
-static GraphicsState graphicsState;
-static vector<GraphicsState> pushedGraphicsStates;
-static vector<TransformSet> pushedTransforms;
-static vector<uint32_t> pushedActiveTransformBits;
-static TransformCache transformCache;
+static TransformStore transformStore;
+static GraphicsContext mainContext;
+static PBRT_THREAD_LOCAL GraphicsContext *context = &mainContext;
 
 // API Macros
 #define VERIFY_INITIALIZED(func) \
@@ -290,8 +293,20 @@ if (currentApiState == STATE_UNINITIALIZED) { \
           "Ignoring.", func); \
     return; \
 } else /* swallow trailing semicolon */
+#define VERIFY_SERIAL(func) \
+if (context->include && !context->include->replaying) { \
+    context->include->independent = false; \
+    return; \
+} else /* swallow trailing semicolon */
+#define VERIFY_SCOPED(stack) \
+if (context->include && !context->include->replaying && \
+    context->stack.empty()) { \
+    context->include->independent = false; \
+    return; \
+} else /* swallow trailing semicolon */
 #define VERIFY_OPTIONS(func) \
 VERIFY_INITIALIZED(func); \
+VERIFY_SERIAL(func); \
 if (currentApiState == STATE_WORLD_BLOCK) { \
     Error("Options cannot be set inside world block; " \
           "\"%s\" not allowed.  Ignoring.", func); \
@@ -306,16 +321,17 @@ if (currentApiState == STATE_OPTIONS_BLOCK) { \
 } else /* swallow trailing semicolon */
 #define FOR_ACTIVE_TRANSFORMS(expr) \
     for (int i = 0; i < MAX_TRANSFORMS; ++i) \
-        if (activeTransformBits & (1 << i)) { expr }
+        if (context->activeTransformBits & (1 << i)) { expr }
 #define WARN_IF_ANIMATED_TRANSFORM(func) \
-do { if (curTransform.IsAnimated()) \
+do { if (context->curTransform.IsAnimated()) \
          Warning("Animated transformations set; ignoring for \"%s\"" \
                  "and using the start transform only", func); \
 } while (false)
 
 // Object Creation Function Definitions
 Reference<Shape> MakeShape(const string &name,
-        const Transform *object2world, const Transform *world2object,
+        const AffineTransform *object2world,
+        const AffineTransform *world2object,
         bool reverseOrientation, const ParamSet &paramSet) {
     Shape *s = NULL;
 
@@ -340,7 +356,10 @@ Reference<Shape> MakeShape(const string &name,
                                    paramSet);
     else if (name == "trianglemesh")
         s = CreateTriangleMeshShape(object2world, world2object, reverseOrientation,
-                                    paramSet, &graphicsState.floatTextures);
+                                    paramSet, &context->graphicsState.floatTextures);
+    else if (name == "binarymesh")
+        s = CreateBinaryMeshShape(object2world, world2object, reverseOrientation,
+                                  paramSet, &context->graphicsState.floatTextures);
     else if (name == "heightfield")
         s = CreateHeightfieldShape(object2world, world2object, reverseOrientation,
                                    paramSet);
@@ -374,17 +393,17 @@ Reference<Material> MakeMaterial(const string &name,
     else if (name == "mix") {
         string m1 = mp.FindString("namedmaterial1", "");
         string m2 = mp.FindString("namedmaterial2", "");
-        Reference<Material> mat1 = graphicsState.namedMaterials[m1];
-        Reference<Material> mat2 = graphicsState.namedMaterials[m2];
+        Reference<Material> mat1 = context->graphicsState.namedMaterials[m1];
+        Reference<Material> mat2 = context->graphicsState.namedMaterials[m2];
         if (!mat1) {
             Error("Named material \"%s\" undefined.  Using \"matte\"",
                   m1.c_str());
-            mat1 = MakeMaterial("matte", curTransform[0], mp);
+            mat1 = MakeMaterial("matte", context->curTransform[0], mp);
         }
         if (!mat2) {
             Error("Named material \"%s\" undefined.  Using \"matte\"",
                   m2.c_str());
-            mat2 = MakeMaterial("matte", curTransform[0], mp);
+            mat2 = MakeMaterial("matte", context->curTransform[0], mp);
         }
 
         material = CreateMixMaterial(mtl2world, mp, mat1, mat2);
@@ -587,6 +606,8 @@ Primitive *MakeAccelerator(const string &name,
         accel = CreateGridAccelerator(prims, paramSet);
     else if (name == "kdtree")
         accel = CreateKdTreeAccelerator(prims, paramSet);
+    else if (name == "qbvh")
+        accel = CreateQBVHAccelerator(prims, paramSet);
     else
         Warning("Accelerator \"%s\" unknown.", name.c_str());
     paramSet.ReportUnused();
@@ -600,9 +621,9 @@ Camera *MakeCamera(const string &name,
         float transformEnd, Film *film) {
     Camera *camera = NULL;
     Assert(MAX_TRANSFORMS == 2);
-    Transform *cam2world[2];
-    transformCache.Lookup(cam2worldSet[0], &cam2world[0], NULL);
-    transformCache.Lookup(cam2worldSet[1], &cam2world[1], NULL);
+    const AffineTransform *cam2world[2];
+    cam2world[0] = transformStore.Lookup(cam2worldSet[0], false);
+    cam2world[1] = transformStore.Lookup(cam2worldSet[1], false);
     AnimatedTransform animatedCam2World(cam2world[0], transformStart,
         cam2world[1], transformEnd);
     if (name == "perspective")
@@ -673,6 +694,20 @@ Film *MakeFilm(const string &name,
 
 
 
+// API Local Function Definitions
+static void AddPrimitive(const Reference<Primitive> &prim) {
+    if (context->include) context->include->primitives.push_back(prim);
+    else renderOptions->primitives.push_back(prim);
+}
+
+
+static void AddLight(Light *light) {
+    if (context->include) context->include->lights.push_back(light);
+    else renderOptions->lights.push_back(light);
+}
+
+
+
 // API Function Definitions
 void pbrtInit(const Options &opt) {
     PbrtOptions = opt;
@@ -681,13 +716,12 @@ void pbrtInit(const Options &opt) {
         Error("pbrtInit() has already been called.");
     currentApiState = STATE_OPTIONS_BLOCK;
     renderOptions = new RenderOptions;
-    graphicsState = GraphicsState();
+    mainContext = GraphicsContext();
     SampledSpectrum::Init();
 }
 
 
 void pbrtCleanup() {
-    ProbesCleanup();
     // API Cleanup
     if (currentApiState == STATE_UNINITIALIZED)
         Error("pbrtCleanup() called without pbrtInit().");
@@ -701,20 +735,23 @@ void pbrtCleanup() {
 
 void pbrtIdentity() {
     VERIFY_INITIALIZED("Identity");
-    FOR_ACTIVE_TRANSFORMS(curTransform[i] = Transform();)
+    VERIFY_SCOPED(pushedTransforms);
+    FOR_ACTIVE_TRANSFORMS(context->curTransform[i] = Transform();)
 }
 
 
 void pbrtTranslate(float dx, float dy, float dz) {
     VERIFY_INITIALIZED("Translate");
-    FOR_ACTIVE_TRANSFORMS(curTransform[i] =
-        curTransform[i] * Translate(Vector(dx, dy, dz));)
+    VERIFY_SCOPED(pushedTransforms);
+    FOR_ACTIVE_TRANSFORMS(context->curTransform[i] =
+        context->curTransform[i] * Translate(Vector(dx, dy, dz));)
 }
 
 
 void pbrtTransform(float tr[16]) {
     VERIFY_INITIALIZED("Transform");
-    FOR_ACTIVE_TRANSFORMS(curTransform[i] = Transform(Matrix4x4(
+    VERIFY_SCOPED(pushedTransforms);
+    FOR_ACTIVE_TRANSFORMS(context->curTransform[i] = Transform(Matrix4x4(
         tr[0], tr[4], tr[8], tr[12],
         tr[1], tr[5], tr[9], tr[13],
         tr[2], tr[6], tr[10], tr[14],
@@ -724,7 +761,8 @@ void pbrtTransform(float tr[16]) {
 
 void pbrtConcatTransform(float tr[16]) {
     VERIFY_INITIALIZED("ConcatTransform");
-    FOR_ACTIVE_TRANSFORMS(curTransform[i] = curTransform[i] * Transform(
+    VERIFY_SCOPED(pushedTransforms);
+    FOR_ACTIVE_TRANSFORMS(context->curTransform[i] = context->curTransform[i] * Transform(
                 Matrix4x4(tr[0], tr[4], tr[8], tr[12],
                           tr[1], tr[5], tr[9], tr[13],
                           tr[2], tr[6], tr[10], tr[14],
@@ -734,38 +772,43 @@ void pbrtConcatTransform(float tr[16]) {
 
 void pbrtRotate(float angle, float dx, float dy, float dz) {
     VERIFY_INITIALIZED("Rotate");
-    FOR_ACTIVE_TRANSFORMS(curTransform[i] = curTransform[i] * Rotate(angle, Vector(dx, dy, dz));)
+    VERIFY_SCOPED(pushedTransforms);
+    FOR_ACTIVE_TRANSFORMS(context->curTransform[i] = context->curTransform[i] * Rotate(angle, Vector(dx, dy, dz));)
 }
 
 
 void pbrtScale(float sx, float sy, float sz) {
     VERIFY_INITIALIZED("Scale");
-    FOR_ACTIVE_TRANSFORMS(curTransform[i] = curTransform[i] * Scale(sx, sy, sz);)
+    VERIFY_SCOPED(pushedTransforms);
+    FOR_ACTIVE_TRANSFORMS(context->curTransform[i] = context->curTransform[i] * Scale(sx, sy, sz);)
 }
 
 
 void pbrtLookAt(float ex, float ey, float ez, float lx, float ly,
         float lz, float ux, float uy, float uz) {
     VERIFY_INITIALIZED("LookAt");
+    VERIFY_SCOPED(pushedTransforms);
     FOR_ACTIVE_TRANSFORMS({ Warning("This version of pbrt fixes a bug in the LookAt transformation.\n"
                                     "If your rendered images unexpectedly change, add a \"Scale -1 1 1\"\n"
                                     "to the start of your scene file."); break; })
-    FOR_ACTIVE_TRANSFORMS(curTransform[i] =
-        curTransform[i] * LookAt(Point(ex, ey, ez), Point(lx, ly, lz), Vector(ux, uy, uz));)
+    FOR_ACTIVE_TRANSFORMS(context->curTransform[i] =
+        context->curTransform[i] * LookAt(Point(ex, ey, ez), Point(lx, ly, lz), Vector(ux, uy, uz));)
 }
 
 
 void pbrtCoordinateSystem(const string &name) {
     VERIFY_INITIALIZED("CoordinateSystem");
-    namedCoordinateSystems[name] = curTransform;
+    VERIFY_SERIAL("CoordinateSystem");
+    namedCoordinateSystems[name] = context->curTransform;
 }
 
 
 void pbrtCoordSysTransform(const string &name) {
     VERIFY_INITIALIZED("CoordSysTransform");
+    VERIFY_SERIAL("CoordSysTransform");
     if (namedCoordinateSystems.find(name) !=
         namedCoordinateSystems.end())
-        curTransform = namedCoordinateSystems[name];
+        context->curTransform = namedCoordinateSystems[name];
     else
         Warning("Couldn't find named coordinate system \"%s\"",
                 name.c_str());
@@ -773,17 +816,20 @@ void pbrtCoordSysTransform(const string &name) {
 
 
 void pbrtActiveTransformAll() {
-    activeTransformBits = ALL_TRANSFORMS_BITS;
+    VERIFY_SCOPED(pushedTransforms);
+    context->activeTransformBits = ALL_TRANSFORMS_BITS;
 }
 
 
 void pbrtActiveTransformEndTime() {
-    activeTransformBits = END_TRANSFORM_BITS;
+    VERIFY_SCOPED(pushedTransforms);
+    context->activeTransformBits = END_TRANSFORM_BITS;
 }
 
 
 void pbrtActiveTransformStartTime() {
-    activeTransformBits = START_TRANSFORM_BITS;
+    VERIFY_SCOPED(pushedTransforms);
+    context->activeTransformBits = START_TRANSFORM_BITS;
 }
 
 
@@ -847,7 +893,7 @@ void pbrtCamera(const string &name, const ParamSet &params) {
     VERIFY_OPTIONS("Camera");
     renderOptions->CameraName = name;
     renderOptions->CameraParams = params;
-    renderOptions->CameraToWorld = Inverse(curTransform);
+    renderOptions->CameraToWorld = Inverse(context->curTransform);
     namedCoordinateSystems["camera"] = renderOptions->CameraToWorld;
 }
 
@@ -856,80 +902,83 @@ void pbrtWorldBegin() {
     VERIFY_OPTIONS("WorldBegin");
     currentApiState = STATE_WORLD_BLOCK;
     for (int i = 0; i < MAX_TRANSFORMS; ++i)
-        curTransform[i] = Transform();
-    activeTransformBits = ALL_TRANSFORMS_BITS;
-    namedCoordinateSystems["world"] = curTransform;
+        context->curTransform[i] = Transform();
+    context->activeTransformBits = ALL_TRANSFORMS_BITS;
+    namedCoordinateSystems["world"] = context->curTransform;
 }
 
 
 void pbrtAttributeBegin() {
     VERIFY_WORLD("AttributeBegin");
-    pushedGraphicsStates.push_back(graphicsState);
-    pushedTransforms.push_back(curTransform);
-    pushedActiveTransformBits.push_back(activeTransformBits);
+    context->pushedGraphicsStates.push_back(context->graphicsState);
+    context->pushedTransforms.push_back(context->curTransform);
+    context->pushedActiveTransformBits.push_back(context->activeTransformBits);
 }
 
 
 void pbrtAttributeEnd() {
     VERIFY_WORLD("AttributeEnd");
-    if (!pushedGraphicsStates.size()) {
+    VERIFY_SCOPED(pushedGraphicsStates);
+    if (!context->pushedGraphicsStates.size()) {
         Error("Unmatched pbrtAttributeEnd() encountered. "
               "Ignoring it.");
         return;
     }
-    graphicsState = pushedGraphicsStates.back();
-    pushedGraphicsStates.pop_back();
-    curTransform = pushedTransforms.back();
-    pushedTransforms.pop_back();
-    activeTransformBits = pushedActiveTransformBits.back();
-    pushedActiveTransformBits.pop_back();
+    context->graphicsState = context->pushedGraphicsStates.back();
+    context->pushedGraphicsStates.pop_back();
+    context->curTransform = context->pushedTransforms.back();
+    context->pushedTransforms.pop_back();
+    context->activeTransformBits = context->pushedActiveTransformBits.back();
+    context->pushedActiveTransformBits.pop_back();
 }
 
 
 void pbrtTransformBegin() {
     VERIFY_WORLD("TransformBegin");
-    pushedTransforms.push_back(curTransform);
-    pushedActiveTransformBits.push_back(activeTransformBits);
+    context->pushedTransforms.push_back(context->curTransform);
+    context->pushedActiveTransformBits.push_back(context->activeTransformBits);
 }
 
 
 void pbrtTransformEnd() {
     VERIFY_WORLD("TransformEnd");
-    if (!pushedTransforms.size()) {
+    VERIFY_SCOPED(pushedTransforms);
+    if (!context->pushedTransforms.size()) {
         Error("Unmatched pbrtTransformEnd() encountered. "
             "Ignoring it.");
         return;
     }
-    curTransform = pushedTransforms.back();
-    pushedTransforms.pop_back();
-    activeTransformBits = pushedActiveTransformBits.back();
-    pushedActiveTransformBits.pop_back();
+    context->curTransform = context->pushedTransforms.back();
+    context->pushedTransforms.pop_back();
+    context->activeTransformBits = context->pushedActiveTransformBits.back();
+    context->pushedActiveTransformBits.pop_back();
 }
 
 
 void pbrtTexture(const string &name, const string &type,
                  const string &texname, const ParamSet &params) {
     VERIFY_WORLD("Texture");
-    TextureParams tp(params, params, graphicsState.floatTextures,
-                     graphicsState.spectrumTextures);
+    VERIFY_SERIAL("Texture");
+    TextureParams tp(params, params, context->graphicsState.floatTextures,
+                     context->graphicsState.spectrumTextures);
     if (type == "float")  {
         // Create _float_ texture and store in _floatTextures_
-        if (graphicsState.floatTextures.find(name) !=
-            graphicsState.floatTextures.end())
+        if (context->graphicsState.floatTextures.find(name) !=
+            context->graphicsState.floatTextures.end())
             Info("Texture \"%s\" being redefined", name.c_str());
         WARN_IF_ANIMATED_TRANSFORM("Texture");
         Reference<Texture<float> > ft = MakeFloatTexture(texname,
-                                                         curTransform[0], tp);
-        if (ft) graphicsState.floatTextures[name] = ft;
+                                                         context->curTransform[0], tp);
+        if (ft) context->graphicsState.floatTextures[name] = ft;
     }
     else if (type == "color" || type == "spectrum")  {
         // Create _color_ texture and store in _spectrumTextures_
-        if (graphicsState.spectrumTextures.find(name) != graphicsState.spectrumTextures.end())
+        if (context->graphicsState.spectrumTextures.find(name) != context->graphicsState.spectrumTextures.end())
             Info("Texture \"%s\" being redefined", name.c_str());
         WARN_IF_ANIMATED_TRANSFORM("Texture");
         Reference<Texture<Spectrum> > st = MakeSpectrumTexture(texname,
-            curTransform[0], tp);
-        if (st) graphicsState.spectrumTextures[name] = st;
+            context->curTransform[0], tp);
+        if (st) context->graphicsState.spectrumTextures[name] = st;
     }
     else
         Error("Texture type \"%s\" unknown.", type.c_str());
@@ -938,25 +987,27 @@ void pbrtTexture(const string &name, const string &type,
 
 void pbrtMaterial(const string &name, const ParamSet &params) {
     VERIFY_WORLD("Material");
-    graphicsState.material = name;
-    graphicsState.materialParams = params;
-    graphicsState.currentNamedMaterial = "";
+    VERIFY_SCOPED(pushedGraphicsStates);
+    context->graphicsState.material = name;
+    context->graphicsState.materialParams = params;
+    context->graphicsState.currentNamedMaterial = "";
 }
 
 
 void pbrtMakeNamedMaterial(const string &name,
         const ParamSet &params) {
     VERIFY_WORLD("MakeNamedMaterial");
+    VERIFY_SCOPED(pushedGraphicsStates);
     // error checking, warning if replace, what to use for transform?
-    TextureParams mp(params, graphicsState.materialParams,
-                     graphicsState.floatTextures,
-                     graphicsState.spectrumTextures);
+    TextureParams mp(params, context->graphicsState.materialParams,
+                     context->graphicsState.floatTextures,
+                     context->graphicsState.spectrumTextures);
     string matName = mp.FindString("type");
     WARN_IF_ANIMATED_TRANSFORM("MakeNamedMaterial");
     if (matName == "") Error("No parameter string \"type\" found in MakeNamedMaterial");
     else {
-        Reference<Material> mtl = MakeMaterial(matName, curTransform[0], mp);
-        if (mtl) graphicsState.namedMaterials[name] = mtl;
+        Reference<Material> mtl = MakeMaterial(matName, context->curTransform[0], mp);
+        if (mtl) context->graphicsState.namedMaterials[name] = mtl;
     }
 }
 
@@ -964,26 +1015,29 @@ void pbrtMakeNamedMaterial(const string &name,
 
 void pbrtNamedMaterial(const string &name) {
     VERIFY_WORLD("NamedMaterial");
-    graphicsState.currentNamedMaterial = name;
+    VERIFY_SCOPED(pushedGraphicsStates);
+    context->graphicsState.currentNamedMaterial = name;
 }
 
 
 void pbrtLightSource(const string &name, const ParamSet &params) {
     VERIFY_WORLD("LightSource");
+    VERIFY_SERIAL("LightSource");
     WARN_IF_ANIMATED_TRANSFORM("LightSource");
-    Light *lt = MakeLight(name, curTransform[0], params);
+    Light *lt = MakeLight(name, context->curTransform[0], params);
     if (lt == NULL)
         Error("pbrtLightSource: light type \"%s\" unknown.", name.c_str());
     else
-        renderOptions->lights.push_back(lt);
+        AddLight(lt);
 }
 
 
 void pbrtAreaLightSource(const string &name,
                          const ParamSet &params) {
     VERIFY_WORLD("AreaLightSource");
-    graphicsState.areaLight = name;
-    graphicsState.areaLightParams = params;
+    VERIFY_SCOPED(pushedGraphicsStates);
+    context->graphicsState.areaLight = name;
+    context->graphicsState.areaLightParams = params;
 }
 
 
@@ -991,42 +1045,48 @@ void pbrtShape(const string &name, const ParamSet &params) {
     VERIFY_WORLD("Shape");
     Reference<Primitive> prim;
     AreaLight *area = NULL;
-    if (!curTransform.IsAnimated()) {
+    if (!context->curTransform.IsAnimated()) {
         // Create primitive for static shape
-        Transform *obj2world, *world2obj;
-        transformCache.Lookup(curTransform[0], &obj2world, &world2obj);
-        Reference<Shape> shape = MakeShape(name, obj2world, world2obj,
-            graphicsState.reverseOrientation, params);
+        const AffineTransform *obj2world =
+            transformStore.Lookup(context->curTransform[0], true);
+        Reference<Shape> shape = MakeShape(name, obj2world,
+            obj2world->GetInverse(),
+            context->graphicsState.reverseOrientation, params);
         if (!shape) return;
-        Reference<Material> mtl = graphicsState.CreateMaterial(params);
+        Reference<Material> mtl =
+            context->graphicsState.CreateMaterial(params, context->curTransform[0]);
         params.ReportUnused();
 
         // Possibly create area light for shape
-        if (graphicsState.areaLight != "") {
-            area = MakeAreaLight(graphicsState.areaLight, curTransform[0],
-                                 graphicsState.areaLightParams, shape);
+        if (context->graphicsState.areaLight != "") {
+            area = MakeAreaLight(context->graphicsState.areaLight,
+                                 context->curTransform[0],
+                                 context->graphicsState.areaLightParams, shape);
         }
         prim = new GeometricPrimitive(shape, mtl, area);
     } else {
         // Create primitive for animated shape
 
         // Create initial _Shape_ for animated shape
-        if (graphicsState.areaLight != "")
+        if (context->graphicsState.areaLight != "")
             Warning("Ignoring currently set area light when creating "
                     "animated shape");
-        Transform *identity;
-        transformCache.Lookup(Transform(), &identity, NULL);
+        const AffineTransform *identity =
+            transformStore.Lookup(Transform(), true);
         Reference<Shape> shape = MakeShape(name, identity, identity,
-            graphicsState.reverseOrientation, params);
+            context->graphicsState.reverseOrientation, params);
         if (!shape) return;
-        Reference<Material> mtl = graphicsState.CreateMaterial(params);
+        Reference<Material> mtl =
+            context->graphicsState.CreateMaterial(params, context->curTransform[0]);
         params.ReportUnused();
 
         // Get _animatedWorldToObject_ transform for shape
         Assert(MAX_TRANSFORMS == 2);
-        Transform *world2obj[2];
-        transformCache.Lookup(curTransform[0], NULL, &world2obj[0]);
-        transformCache.Lookup(curTransform[1], NULL, &world2obj[1]);
+        const AffineTransform *world2obj[2];
+        world2obj[0] = transformStore.Lookup(Inverse(context->curTransform[0]),
+                                             true);
+        world2obj[1] = transformStore.Lookup(Inverse(context->curTransform[1]),
+                                             true);
         AnimatedTransform
              animatedWorldToObject(world2obj[0], renderOptions->transformStartTime,
                                    world2obj[1], renderOptions->transformEndTime);
@@ -1044,33 +1104,34 @@ void pbrtShape(const string &name, const ParamSet &params) {
         prim = new TransformedPrimitive(baseprim, animatedWorldToObject);
     }
     // Add primitive to scene or current instance
-    if (renderOptions->currentInstance) {
+    if (context->currentInstance) {
         if (area)
             Warning("Area lights not supported with object instancing");
-        renderOptions->currentInstance->push_back(prim);
+        context->currentInstance->push_back(prim);
     }
     
     else {
-        renderOptions->primitives.push_back(prim);
+        AddPrimitive(prim);
         if (area != NULL) {
-            renderOptions->lights.push_back(area);
+            AddLight(area);
         }
     }
 }
 
 
-Reference<Material> GraphicsState::CreateMaterial(const ParamSet &params) {
+Reference<Material> GraphicsState::CreateMaterial(const ParamSet &params,
+        const Transform &mtl2world) {
     TextureParams mp(params, materialParams,
                      floatTextures,
                      spectrumTextures);
     Reference<Material> mtl;
     if (currentNamedMaterial != "" &&
         namedMaterials.find(currentNamedMaterial) != namedMaterials.end())
-        mtl = namedMaterials[graphicsState.currentNamedMaterial];
+        mtl = namedMaterials[currentNamedMaterial];
     if (!mtl)
-        mtl = MakeMaterial(material, curTransform[0], mp);
+        mtl = MakeMaterial(material, mtl2world, mp);
     if (!mtl)
-        mtl = MakeMaterial("matte", curTransform[0], mp);
+        mtl = MakeMaterial("matte", mtl2world, mp);
     if (!mtl)
         Severe("Unable to create \"matte\" material?!");
     return mtl;
@@ -1079,42 +1140,50 @@ Reference<Material> GraphicsState::CreateMaterial(const ParamSet &params) {
 
 void pbrtReverseOrientation() {
     VERIFY_WORLD("ReverseOrientation");
-    graphicsState.reverseOrientation =
-        !graphicsState.reverseOrientation;
+    VERIFY_SCOPED(pushedGraphicsStates);
+    context->graphicsState.reverseOrientation =
+        !context->graphicsState.reverseOrientation;
 }
 
 
 void pbrtVolume(const string &name, const ParamSet &params) {
     VERIFY_WORLD("Volume");
+    VERIFY_SERIAL("Volume");
     WARN_IF_ANIMATED_TRANSFORM("Volume");
-    VolumeRegion *vr = MakeVolumeRegion(name, curTransform[0], params);
-    if (vr) renderOptions->volumeRegions.push_back(vr);
+    VolumeRegion *vr = MakeVolumeRegion(name, context->curTransform[0], params);
+    if (vr) {
+        if (context->include) context->include->volumeRegions.push_back(vr);
+        else renderOptions->volumeRegions.push_back(vr);
+    }
 }
 
 
 void pbrtObjectBegin(const string &name) {
     VERIFY_WORLD("ObjectBegin");
+    VERIFY_SERIAL("ObjectBegin");
     pbrtAttributeBegin();
-    if (renderOptions->currentInstance)
+    if (context->currentInstance)
         Error("ObjectBegin called inside of instance definition");
     renderOptions->instances[name] = vector<Reference<Primitive> >();
-    renderOptions->currentInstance = &renderOptions->instances[name];
+    context->currentInstance = &renderOptions->instances[name];
 }
 
 
 void pbrtObjectEnd() {
     VERIFY_WORLD("ObjectEnd");
-    if (!renderOptions->currentInstance)
+    VERIFY_SERIAL("ObjectEnd");
+    if (!context->currentInstance)
         Error("ObjectEnd called outside of instance definition");
-    renderOptions->currentInstance = NULL;
+    context->currentInstance = NULL;
     pbrtAttributeEnd();
 }
 
 
 void pbrtObjectInstance(const string &name) {
     VERIFY_WORLD("ObjectInstance");
+    VERIFY_SERIAL("ObjectInstance");
     // Object instance error checking
-    if (renderOptions->currentInstance) {
+    if (context->currentInstance) {
         Error("ObjectInstance can't be called inside instance definition");
         return;
     }
@@ -1134,30 +1203,71 @@ void pbrtObjectInstance(const string &name) {
         in.erase(in.begin(), in.end());
         in.push_back(accel);
     }
+    if (!context->curTransform.IsAnimated()) {
+        // Record static instance for the scene's _InstanceAccel_
+        map<const Primitive *, uint32_t>::iterator iter =
+            renderOptions->instancePrototypeIndices.find(in[0].GetPtr());
+        uint32_t prototype;
+        if (iter != renderOptions->instancePrototypeIndices.end())
+            prototype = iter->second;
+        else {
+            prototype = renderOptions->instancePrototypes.size();
+            renderOptions->instancePrototypes.push_back(in[0]);
+            renderOptions->instancePrototypeIndices[in[0].GetPtr()] = prototype;
+        }
+        ObjectInstanceItem item;
+        if (MakeObjectInstanceItem(Inverse(context->curTransform[0]),
+                                   prototype, &item)) {
+            renderOptions->instanceItems.push_back(item);
+            return;
+        }
+    }
     Assert(MAX_TRANSFORMS == 2);
-    Transform *world2instance[2];
-    transformCache.Lookup(curTransform[0], NULL, &world2instance[0]);
-    transformCache.Lookup(curTransform[1], NULL, &world2instance[1]);
+    const AffineTransform *world2instance[2];
+    world2instance[0] = transformStore.Lookup(Inverse(context->curTransform[0]),
+                                              true);
+    world2instance[1] = transformStore.Lookup(Inverse(context->curTransform[1]),
+                                              true);
     AnimatedTransform animatedWorldToInstance(world2instance[0],
         renderOptions->transformStartTime,
         world2instance[1], renderOptions->transformEndTime);
     Reference<Primitive> prim =
         new TransformedPrimitive(in[0], animatedWorldToInstance);
-    renderOptions->primitives.push_back(prim);
+    AddPrimitive(prim);
 }
 
 
 void pbrtWorldEnd() {
     VERIFY_WORLD("WorldEnd");
+    VERIFY_SERIAL("WorldEnd");
+    if (context->include) {
+        Error("\"WorldEnd\" can't be used in an Include'd file that is "
+              "parsed in parallel. Ignoring.");
+        return;
+    }
     // Ensure there are no pushed graphics states
-    while (pushedGraphicsStates.size()) {
+    while (context->pushedGraphicsStates.size()) {
         Warning("Missing end to pbrtAttributeBegin()");
-        pushedGraphicsStates.pop_back();
-        pushedTransforms.pop_back();
+        context->pushedGraphicsStates.pop_back();
+        context->pushedTransforms.pop_back();
     }
-    while (pushedTransforms.size()) {
+    while (context->pushedTransforms.size()) {
         Warning("Missing end to pbrtTransformBegin()");
-        pushedTransforms.pop_back();
+        context->pushedTransforms.pop_back();
+    }
+
+    // Add static object instances to the scene in a single aggregate
+    if (renderOptions->instanceItems.size() > 0) {
+        renderOptions->primitives.push_back(new InstanceAccel(
+            renderOptions->instancePrototypes, renderOptions->instanceItems));
+        renderOptions->instancePrototypes.erase(
+            renderOptions->instancePrototypes.begin(),
+            renderOptions->instancePrototypes.end());
+        renderOptions->instancePrototypeIndices.erase(
+            renderOptions->instancePrototypeIndices.begin(),
+            renderOptions->instancePrototypeIndices.end());
+        renderOptions->instanceItems.erase(renderOptions->instanceItems.begin(),
+                                           renderOptions->instanceItems.end());
     }
 
     // Create scene and render
@@ -1169,13 +1279,19 @@ void pbrtWorldEnd() {
     delete scene;
 
     // Clean up after rendering
-    graphicsState = GraphicsState();
-    transformCache.Clear();
+    context->graphicsState = GraphicsState();
+    transformStore.Clear();
     currentApiState = STATE_OPTIONS_BLOCK;
-    ProbesPrint(stdout);
+
+    // Report statistics gathered while rendering
+    if (!PbrtOptions.quiet)
+        StatsPrint(stdout);
+    if (PbrtOptions.statsFile != "" && !StatsPrintJSON(PbrtOptions.statsFile))
+        Error("Unable to write statistics to \"%s\"", PbrtOptions.statsFile.c_str());
+    StatsReset();
     for (int i = 0; i < MAX_TRANSFORMS; ++i)
-        curTransform[i] = Transform();
-    activeTransformBits = ALL_TRANSFORMS_BITS;
+        context->curTransform[i] = Transform();
+    context->activeTransformBits = ALL_TRANSFORMS_BITS;
     namedCoordinateSystems.erase(namedCoordinateSystems.begin(),
                                  namedCoordinateSystems.end());
     ImageTexture<float, float>::ClearCache();
@@ -1183,6 +1299,121 @@ void pbrtWorldEnd() {
 }
 
 
+// Parallel Include Definitions
+DeferredInclude *pbrtDeferredIncludeBegin() {
+    if (currentApiState != STATE_WORLD_BLOCK || context->include)
+        return NULL;
+    DeferredInclude *include = new DeferredInclude;
+    // Snapshot the graphics state at the point of the _Include_
+    GraphicsContext &start = include->start;
+    start.curTransform = context->curTransform;
+    start.activeTransformBits = context->activeTransformBits;
+    start.graphicsState = context->graphicsState;
+    start.currentInstance = context->currentInstance ? &include->primitives : NULL;
+    start.include = include;
+    include->savedContext = NULL;
+    include->independent = true;
+    include->replaying = false;
+
+    // Record where the include's results are merged into the scene
+    include->target = context->currentInstance ? context->currentInstance :
+                                                 &renderOptions->primitives;
+    include->primitivesOffset = include->target->size();
+    include->lightsOffset = renderOptions->lights.size();
+    include->volumeRegionsOffset = renderOptions->volumeRegions.size();
+    return include;
+}
+
+
+void pbrtDeferredIncludeEnter(DeferredInclude *include, bool replay,
+                              const DeferredInclude *previous) {
+    include->replaying = replay;
+    if (replay) {
+        // Discard results of the parallel parse of the include
+        include->primitives.erase(include->primitives.begin(),
+                                  include->primitives.end());
+        for (uint32_t i = 0; i < include->lights.size(); ++i)
+            delete include->lights[i];
+        include->lights.erase(include->lights.begin(), include->lights.end());
+        for (uint32_t i = 0; i < include->volumeRegions.size(); ++i)
+            delete include->volumeRegions[i];
+        include->volumeRegions.erase(include->volumeRegions.begin(),
+                                     include->volumeRegions.end());
+    }
+
+    // Start from the snapshot or from where the _previous_ include left off
+    if (previous) {
+        include->context = previous->context;
+        include->context.currentInstance = include->start.currentInstance;
+        include->context.include = include;
+    }
+    else
+        include->context = include->start;
+    include->savedContext = context;
+    context = &include->context;
+}
+
+
+void pbrtDeferredIncludeExit(DeferredInclude *include) {
+    // Includes that leave attributes pushed affect the statements after them
+    if (!include->replaying &&
+        (include->context.pushedGraphicsStates.size() > 0 ||
+         include->context.pushedTransforms.size() > 0))
+        include->independent = false;
+    context = include->savedContext;
+    include->savedContext = NULL;
+}
+
+
+bool pbrtDeferredIncludeIndependent(const DeferredInclude *include) {
+    return include->independent;
+}
+
+
+void pbrtDeferredIncludeFail(DeferredInclude *include) {
+    include->independent = false;
+}
+
+
+void pbrtDeferredIncludesCommit(const vector<DeferredInclude *> &includes,
+                                bool adoptState) {
+    if (includes.size() == 0) return;
+    // Continue from the graphics state left by a serially parsed last include
+    const DeferredInclude *last = includes.back();
+    if (adoptState && last->replaying) {
+        const GraphicsContext &c = last->context;
+        context->curTransform = c.curTransform;
+        context->activeTransformBits = c.activeTransformBits;
+        context->graphicsState = c.graphicsState;
+        context->pushedGraphicsStates.insert(context->pushedGraphicsStates.end(),
+            c.pushedGraphicsStates.begin(), c.pushedGraphicsStates.end());
+        context->pushedTransforms.insert(context->pushedTransforms.end(),
+            c.pushedTransforms.begin(), c.pushedTransforms.end());
+        context->pushedActiveTransformBits.insert(
+            context->pushedActiveTransformBits.end(),
+            c.pushedActiveTransformBits.begin(),
+            c.pushedActiveTransformBits.end());
+    }
+
+    // Merge include results in reverse order so recorded offsets stay valid
+    for (int i = int(includes.size()) - 1; i >= 0; --i) {
+        DeferredInclude *include = includes[i];
+        include->target->insert(include->target->begin() +
+                                    include->primitivesOffset,
+                                include->primitives.begin(),
+                                include->primitives.end());
+        renderOptions->lights.insert(renderOptions->lights.begin() +
+                                         include->lightsOffset,
+                                     include->lights.begin(),
+                                     include->lights.end());
+        renderOptions->volumeRegions.insert(
+            renderOptions->volumeRegions.begin() + include->volumeRegionsOffset,
+            include->volumeRegions.begin(), include->volumeRegions.end());
+        delete include;
+    }
+}
+
+
 Scene *RenderOptions::MakeScene() {
     // Initialize _volumeRegion_ from volume region(s)
     VolumeRegion *volumeRegion;
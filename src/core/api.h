@@ -85,4 +85,15 @@ void pbrtObjectEnd();
 void pbrtObjectInstance(const string &name);
 void pbrtWorldEnd();
 
+// Parallel Include Declarations
+struct DeferredInclude;
+DeferredInclude *pbrtDeferredIncludeBegin();
+void pbrtDeferredIncludeEnter(DeferredInclude *include, bool replay,
+                              const DeferredInclude *previous);
+void pbrtDeferredIncludeExit(DeferredInclude *include);
+bool pbrtDeferredIncludeIndependent(const DeferredInclude *include);
+void pbrtDeferredIncludeFail(DeferredInclude *include);
+void pbrtDeferredIncludesCommit(const vector<DeferredInclude *> &includes,
+                                bool adoptState);
+
 #endif // PBRT_CORE_API_H
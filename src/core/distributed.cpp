@@ -0,0 +1,363 @@
+
+/*
+    pbrt source code Copyright(c) 1998-2012 Matt Pharr and Greg Humphreys.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+// core/distributed.cpp*
+#include "stdafx.h"
+#include "distributed.h"
+#include "film.h"
+#include "parallel.h"
+#include "progressreporter.h"
+#if !defined(PBRT_IS_WINDOWS)
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <deque>
+using std::deque;
+#endif // !PBRT_IS_WINDOWS
+
+// Distributed Rendering Local Declarations
+#define DISTRIBUTED_VERSION 1
+enum DistributedMessageType {
+    // Worker to coordinator messages
+    MESSAGE_HELLO,    // _data_: version, samples per pixel, tasks wanted
+    MESSAGE_REQUEST,  // last range of tasks is done; send more
+    MESSAGE_STATE,    // followed by worker's _Film_ state
+    // Coordinator to worker messages
+    MESSAGE_WORK,     // _data_: first task, one past last task, task count
+    MESSAGE_DONE      // no more work; send _Film_ state and exit
+};
+
+
+struct DistributedMessage {
+    uint32_t type;
+    int32_t data[3];
+};
+
+
+#if !defined(PBRT_IS_WINDOWS)
+struct TaskRange {
+    TaskRange(int f, int l) : first(f), last(l) { }
+    int first, last;
+};
+
+
+enum WorkerState { WAITING_FOR_HELLO, WORKING, IDLE, FINISHING };
+struct WorkerConnection {
+    WorkerConnection(int fd) {
+        in = fdopen(fd, "rb");
+        out = fdopen(dup(fd), "wb");
+        state = WAITING_FOR_HELLO;
+        tasksWanted = 1;
+    }
+    ~WorkerConnection() {
+        if (in) fclose(in);
+        if (out) fclose(out);
+    }
+    FILE *in, *out;
+    WorkerState state;
+    int tasksWanted;
+    // Task ranges assigned to worker whose results haven't been merged
+    vector<TaskRange> ranges;
+};
+
+
+static int OpenSocket(const string &address, bool listening) {
+    // Split _address_ into optional host name and port
+    string host, port = address;
+    size_t colon = address.rfind(':');
+    if (colon != string::npos) {
+        host = address.substr(0, colon);
+        port = address.substr(colon + 1);
+    }
+    struct addrinfo hints, *addrs;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (listening) hints.ai_flags = AI_PASSIVE;
+    if (getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(),
+                    &hints, &addrs) != 0)
+        return -1;
+
+    // Listen or connect on first address that works
+    int fd = -1;
+    for (struct addrinfo *a = addrs; a != NULL && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0) continue;
+        int one = 1;
+        bool ok;
+        if (listening) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            ok = bind(fd, a->ai_addr, a->ai_addrlen) == 0 &&
+                 listen(fd, 64) == 0;
+        }
+        else {
+            ok = connect(fd, a->ai_addr, a->ai_addrlen) == 0;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        if (!ok) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(addrs);
+    return fd;
+}
+
+
+static bool WriteMessage(FILE *f, DistributedMessageType type,
+                         int d0 = 0, int d1 = 0, int d2 = 0) {
+    DistributedMessage msg;
+    msg.type = type;
+    msg.data[0] = d0;
+    msg.data[1] = d1;
+    msg.data[2] = d2;
+    return fwrite(&msg, sizeof(msg), 1, f) == 1 && fflush(f) == 0;
+}
+
+
+static bool HandleWorkerMessage(WorkerConnection *w, int samplesPerPixel,
+                                Film *film, ProgressReporter &reporter,
+                                int *nMerged) {
+    DistributedMessage msg;
+    if (fread(&msg, sizeof(msg), 1, w->in) != 1)
+        return false;
+    if (msg.type == MESSAGE_HELLO && w->state == WAITING_FOR_HELLO) {
+        if (msg.data[0] != DISTRIBUTED_VERSION) {
+            Error("Worker uses protocol version %d, not %d.", (int)msg.data[0],
+                  DISTRIBUTED_VERSION);
+            return false;
+        }
+        if (msg.data[1] != samplesPerPixel) {
+            Error("Worker is rendering with %d samples per pixel, not %d.",
+                  (int)msg.data[1], samplesPerPixel);
+            return false;
+        }
+        w->tasksWanted = max(1, (int)msg.data[2]);
+        w->state = IDLE;
+        return true;
+    }
+    if (msg.type == MESSAGE_REQUEST && w->state == WORKING) {
+        reporter.Update(w->ranges.back().last - w->ranges.back().first);
+        w->state = IDLE;
+        return true;
+    }
+    if (msg.type == MESSAGE_STATE && w->state == FINISHING) {
+        // Merge worker's film state and retire its task ranges
+        if (!film->AddState(w->in)) {
+            Error("Unable to merge film from worker.");
+            return false;
+        }
+        for (uint32_t i = 0; i < w->ranges.size(); ++i)
+            *nMerged += w->ranges[i].last - w->ranges[i].first;
+        w->ranges.clear();
+        return false;
+    }
+    Error("Unexpected message %d from worker.", (int)msg.type);
+    return false;
+}
+
+
+static void DispatchWork(vector<WorkerConnection *> &workers,
+                         deque<TaskRange> &pending, int taskCount) {
+    bool anyWorking = false;
+    for (uint32_t i = 0; i < workers.size(); ++i)
+        if (workers[i]->state == WORKING) anyWorking = true;
+    for (uint32_t i = 0; i < workers.size(); ++i) {
+        WorkerConnection *w = workers[i];
+        if (w->state != IDLE) continue;
+        if (!pending.empty()) {
+            // Send next range of at most _tasksWanted_ tasks to worker
+            TaskRange &next = pending.front();
+            int first = next.first;
+            int last = min(next.last, first + w->tasksWanted);
+            next.first = last;
+            if (next.first == next.last) pending.pop_front();
+            w->ranges.push_back(TaskRange(first, last));
+            w->state = WORKING;
+            anyWorking = true;
+            WriteMessage(w->out, MESSAGE_WORK, first, last, taskCount);
+        }
+        else if (!anyWorking) {
+            // Ask worker for its film once all tasks have been rendered
+            w->state = FINISHING;
+            WriteMessage(w->out, MESSAGE_DONE);
+        }
+    }
+}
+
+
+#endif // !PBRT_IS_WINDOWS
+
+// Distributed Rendering Definitions
+DistributedTasks::~DistributedTasks() {
+}
+
+
+bool RunRenderCoordinator(const string &address, int nUnits, int taskCount,
+                          int samplesPerPixel, Film *film) {
+#if defined(PBRT_IS_WINDOWS)
+    Error("Distributed rendering isn't supported on Windows.");
+    return false;
+#else
+    signal(SIGPIPE, SIG_IGN);
+    int listenFd = OpenSocket(address, true);
+    if (listenFd < 0) {
+        Error("Unable to listen for workers at \"%s\".", address.c_str());
+        return false;
+    }
+    if (!PbrtOptions.quiet) {
+        printf("Waiting for workers at \"%s\".\n", address.c_str());
+        fflush(stdout);
+    }
+
+    // Hand out task ranges until all workers' films have been merged
+    deque<TaskRange> pending;
+    pending.push_back(TaskRange(0, nUnits));
+    vector<WorkerConnection *> workers;
+    int nMerged = 0;
+    bool ok = true;
+    ProgressReporter reporter(nUnits, "Rendering");
+    while (nMerged < nUnits) {
+        // Wait for new connections and messages from workers
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(listenFd, &fds);
+        int maxFd = listenFd;
+        for (uint32_t i = 0; i < workers.size(); ++i) {
+            int fd = fileno(workers[i]->in);
+            FD_SET(fd, &fds);
+            maxFd = max(maxFd, fd);
+        }
+        if (select(maxFd + 1, &fds, NULL, NULL, NULL) < 0) {
+            if (errno == EINTR) continue;
+            Error("Waiting for workers failed: %s", strerror(errno));
+            ok = false;
+            break;
+        }
+        if (FD_ISSET(listenFd, &fds)) {
+            int fd = accept(listenFd, NULL, NULL);
+            if (fd >= 0) {
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                workers.push_back(new WorkerConnection(fd));
+            }
+        }
+
+        // Handle worker messages and requeue work from lost workers
+        for (uint32_t i = 0; i < workers.size(); ) {
+            WorkerConnection *w = workers[i];
+            if (!FD_ISSET(fileno(w->in), &fds) ||
+                HandleWorkerMessage(w, samplesPerPixel, film, reporter,
+                                    &nMerged)) {
+                ++i;
+                continue;
+            }
+            if (!w->ranges.empty()) {
+                int nLost = 0;
+                for (uint32_t j = 0; j < w->ranges.size(); ++j) {
+                    pending.push_back(w->ranges[j]);
+                    nLost += w->ranges[j].last - w->ranges[j].first;
+                }
+                Warning("Lost worker; reassigning its %d task(s).", nLost);
+            }
+            delete w;
+            workers.erase(workers.begin() + i);
+        }
+        DispatchWork(workers, pending, taskCount);
+    }
+    reporter.Done();
+    for (uint32_t i = 0; i < workers.size(); ++i)
+        delete workers[i];
+    close(listenFd);
+    return ok;
+#endif // PBRT_IS_WINDOWS
+}
+
+
+bool RunRenderWorker(const string &address, int samplesPerPixel,
+                     DistributedTasks *tasks, Film *film) {
+#if defined(PBRT_IS_WINDOWS)
+    Error("Distributed rendering isn't supported on Windows.");
+    return false;
+#else
+    signal(SIGPIPE, SIG_IGN);
+    int fd = OpenSocket(address, false);
+    if (fd < 0) {
+        Error("Unable to connect to render coordinator at \"%s\".",
+              address.c_str());
+        return false;
+    }
+    FILE *in = fdopen(fd, "rb"), *out = fdopen(dup(fd), "wb");
+
+    // Render task ranges from coordinator until it asks for the film
+    bool ok = WriteMessage(out, MESSAGE_HELLO, DISTRIBUTED_VERSION,
+                           samplesPerPixel, 8 * NumSystemCores());
+    int nRendered = 0;
+    while (ok) {
+        DistributedMessage msg;
+        if (fread(&msg, sizeof(msg), 1, in) != 1)
+            ok = false;
+        else if (msg.type == MESSAGE_WORK && msg.data[0] >= 0 &&
+                 msg.data[0] < msg.data[1] && msg.data[2] > 0) {
+            tasks->Render(msg.data[0], msg.data[1], msg.data[2]);
+            nRendered += msg.data[1] - msg.data[0];
+            ok = WriteMessage(out, MESSAGE_REQUEST);
+        }
+        else if (msg.type == MESSAGE_DONE) {
+            ok = WriteMessage(out, MESSAGE_STATE) && film->WriteState(out) &&
+                 fflush(out) == 0;
+            break;
+        }
+        else
+            ok = false;
+    }
+    fclose(in);
+    fclose(out);
+    if (!ok) {
+        Error("Lost connection to render coordinator at \"%s\".",
+              address.c_str());
+        return false;
+    }
+    if (!PbrtOptions.quiet)
+        printf("\nRendered %d task(s) for coordinator at \"%s\".\n",
+               nRendered, address.c_str());
+    return true;
+#endif // PBRT_IS_WINDOWS
+}
+
+
@@ -33,6 +33,7 @@
 // core/error.cpp*
 #include "stdafx.h"
 #include "progressreporter.h"
+#include "parser.h"
 
 // Error Reporting Includes
 #include <stdarg.h>
@@ -41,6 +42,7 @@
 #define PBRT_ERROR_IGNORE 0
 #define PBRT_ERROR_CONTINUE 1
 #define PBRT_ERROR_ABORT 2
+static PBRT_THREAD_LOCAL bool diagnosticsSuppressed = false;
 
 const char *findWordEnd(const char *buf) {
     while (*buf != '\0' && !isspace(*buf))
@@ -52,7 +54,8 @@ const char *findWordEnd(const char *buf) {
 static void processError(const char *format, va_list args,
         const char *errorType, int disposition) {
     // Report error
-    if (disposition == PBRT_ERROR_IGNORE)
+    if (disposition == PBRT_ERROR_IGNORE ||
+        (diagnosticsSuppressed && disposition != PBRT_ERROR_ABORT))
         return;
 
     // Build up an entire formatted error string and print it all at once;
@@ -61,9 +64,7 @@ static void processError(const char *format, va_list args,
     std::string errorString;
 
     // Print line and position in input file, if available
-    extern int line_num;
-    if (line_num != 0) {
-        extern string current_file;
+    if (line_num != 0 && current_file) {
         errorString += current_file;
         char buf[16];
         sprintf(buf, "(%d): ", line_num);
@@ -157,3 +158,8 @@ void Severe(const char *format, ...) {
 }
 
 
+void SuppressDiagnostics(bool suppress) {
+    diagnosticsSuppressed = suppress;
+}
+
+
@@ -51,5 +51,6 @@ void Info(const char *, ...) PRINTF_FUNC;
 void Warning(const char *, ...) PRINTF_FUNC;
 void Error(const char *, ...) PRINTF_FUNC;
 void Severe(const char *, ...) PRINTF_FUNC;
+void SuppressDiagnostics(bool suppress);
 
 #endif // PBRT_CORE_ERROR_H
@@ -35,13 +35,46 @@
 #include "film.h"
 #include "paramset.h"
 
+// FilmTile Method Definitions
+FilmTile::~FilmTile() {
+}
+
+
+void FilmTile::AddSample(const CameraSample &sample, const Spectrum &L) {
+    film->AddSample(sample, L);
+}
+
+
+
 // Film Method Definitions
 Film::~Film() {
 }
 
 
+FilmTile *Film::GetFilmTile(int xstart, int xend, int ystart, int yend) {
+    return new FilmTile(this);
+}
+
+
+void Film::MergeFilmTile(FilmTile *tile) {
+    delete tile;
+}
+
+
 void Film::UpdateDisplay(int x0, int y0, int x1, int y1,
                          float splatScale) {
 }
 
 
+bool Film::WriteState(FILE *f) const {
+    Error("Film implementation doesn't support saving its state.");
+    return false;
+}
+
+
+bool Film::AddState(FILE *f) {
+    Error("Film implementation doesn't support restoring its state.");
+    return false;
+}
+
+
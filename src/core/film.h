@@ -40,6 +40,18 @@
 #include "pbrt.h"
 
 // Film Declarations
+class FilmTile {
+public:
+    // FilmTile Interface
+    FilmTile(Film *f) : film(f) { }
+    virtual ~FilmTile();
+    virtual void AddSample(const CameraSample &sample, const Spectrum &L);
+protected:
+    // FilmTile Protected Data
+    Film *film;
+};
+
+
 class Film {
 public:
     // Film Interface
@@ -49,12 +61,16 @@ public:
     virtual void AddSample(const CameraSample &sample,
                            const Spectrum &L) = 0;
     virtual void Splat(const CameraSample &sample, const Spectrum &L) = 0;
+    virtual FilmTile *GetFilmTile(int xstart, int xend, int ystart, int yend);
+    virtual void MergeFilmTile(FilmTile *tile);
     virtual void GetSampleExtent(int *xstart, int *xend,
                                  int *ystart, int *yend) const = 0;
     virtual void GetPixelExtent(int *xstart, int *xend,
                                 int *ystart, int *yend) const = 0;
     virtual void UpdateDisplay(int x0, int y0, int x1, int y1, float splatScale = 1.f);
     virtual void WriteImage(float splatScale = 1.f) = 0;
+    virtual bool WriteState(FILE *f) const;
+    virtual bool AddState(FILE *f);
 
     // Film Public Data
     const int xResolution, yResolution;
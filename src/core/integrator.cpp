@@ -37,6 +37,29 @@
 #include "intersection.h"
 #include "montecarlo.h"
 
+// Integrator Local Declarations
+struct DirectLightSample {
+    Spectrum Li, f;
+    Vector wi;
+    float lightPdf;
+    VisibilityTester visibility;
+    bool unoccluded;
+};
+
+
+static bool SampleLightDirect(const Light *light, const Point &p,
+    const Vector &wo, float rayEpsilon, float time, const BSDF *bsdf,
+    const LightSample &lightSample, BxDFType flags, DirectLightSample *ls);
+static Spectrum LightSampleContribution(const Scene *scene,
+    const Renderer *renderer, MemoryArena &arena, const Light *light,
+    const Normal &n, const Vector &wo, const BSDF *bsdf, RNG &rng,
+    BxDFType flags, const DirectLightSample &ls);
+static Spectrum BSDFSampleContribution(const Scene *scene,
+    const Renderer *renderer, MemoryArena &arena, const Light *light,
+    const Point &p, const Normal &n, const Vector &wo, float rayEpsilon,
+    float time, const BSDF *bsdf, RNG &rng, const BSDFSample &bsdfSample,
+    BxDFType flags);
+
 // Integrator Method Definitions
 Integrator::~Integrator() {
 }
@@ -50,28 +73,64 @@ Spectrum UniformSampleAllLights(const Scene *scene,
         float time, BSDF *bsdf, const Sample *sample, RNG &rng,
         const LightSampleOffsets *lightSampleOffsets,
         const BSDFSampleOffsets *bsdfSampleOffsets) {
-    Spectrum L(0.);
-    for (uint32_t i = 0; i < scene->lights.size(); ++i) {
-        Light *light = scene->lights[i];
+    // Allocate storage for light samples of all lights
+    uint32_t nLights = scene->lights.size();
+    int totalSamples = 0;
+    for (uint32_t i = 0; i < nLights; ++i)
+        totalSamples += lightSampleOffsets ? lightSampleOffsets[i].nSamples : 1;
+    DirectLightSample *lightSamples =
+        arena.Alloc<DirectLightSample>(totalSamples);
+    BSDFSample *bsdfSamples = arena.Alloc<BSDFSample>(totalSamples);
+    const Ray **shadowRays = arena.Alloc<const Ray *>(totalSamples);
+    int *shadowSamples = arena.Alloc<int>(totalSamples);
+    bool *occluded = arena.Alloc<bool>(totalSamples);
+    BxDFType flags = BxDFType(BSDF_ALL & ~BSDF_SPECULAR);
+
+    // Sample all lights and collect shadow rays to be traced
+    int nShadowRays = 0;
+    for (uint32_t i = 0, k = 0; i < nLights; ++i) {
         int nSamples = lightSampleOffsets ?
                        lightSampleOffsets[i].nSamples : 1;
-        // Estimate direct lighting from _light_ samples
-        Spectrum Ld(0.);
-        for (int j = 0; j < nSamples; ++j) {
+        for (int j = 0; j < nSamples; ++j, ++k) {
             // Find light and BSDF sample values for direct lighting estimate
             LightSample lightSample;
-            BSDFSample bsdfSample;
             if (lightSampleOffsets != NULL && bsdfSampleOffsets != NULL) {
                 lightSample = LightSample(sample, lightSampleOffsets[i], j);
-                bsdfSample = BSDFSample(sample, bsdfSampleOffsets[i], j);
+                bsdfSamples[k] = BSDFSample(sample, bsdfSampleOffsets[i], j);
             }
             else {
                 lightSample = LightSample(rng);
-                bsdfSample = BSDFSample(rng);
+                bsdfSamples[k] = BSDFSample(rng);
+            }
+            if (SampleLightDirect(scene->lights[i], p, wo, rayEpsilon, time,
+                                  bsdf, lightSample, flags, &lightSamples[k])) {
+                shadowSamples[nShadowRays] = k;
+                shadowRays[nShadowRays++] = &lightSamples[k].visibility.r;
             }
-            Ld += EstimateDirect(scene, renderer, arena, light, p, n, wo,
-                rayEpsilon, time, bsdf, rng, lightSample, bsdfSample,
-                BxDFType(BSDF_ALL & ~BSDF_SPECULAR));
+        }
+    }
+
+    // Trace shadow rays for light samples as a packet
+    scene->IntersectPPacket(shadowRays, nShadowRays, occluded);
+    for (int s = 0; s < nShadowRays; ++s)
+        lightSamples[shadowSamples[s]].unoccluded = !occluded[s];
+
+    // Compute direct lighting from light and BSDF samples
+    Spectrum L(0.);
+    for (uint32_t i = 0, k = 0; i < nLights; ++i) {
+        Light *light = scene->lights[i];
+        int nSamples = lightSampleOffsets ?
+                       lightSampleOffsets[i].nSamples : 1;
+        // Estimate direct lighting from _light_ samples
+        Spectrum Ld(0.);
+        for (int j = 0; j < nSamples; ++j, ++k) {
+            Spectrum Ls(0.);
+            if (lightSamples[k].unoccluded)
+                Ls += LightSampleContribution(scene, renderer, arena, light,
+                          n, wo, bsdf, rng, flags, lightSamples[k]);
+            Ls += BSDFSampleContribution(scene, renderer, arena, light, p, n,
+                      wo, rayEpsilon, time, bsdf, rng, bsdfSamples[k], flags);
+            Ld += Ls;
         }
         L += Ld / nSamples;
     }
@@ -121,59 +180,86 @@ Spectrum EstimateDirect(const Scene *scene, const Renderer *renderer,
         const BSDFSample &bsdfSample, BxDFType flags) {
     Spectrum Ld(0.);
     // Sample light source with multiple importance sampling
-    Vector wi;
-    float lightPdf, bsdfPdf;
-    VisibilityTester visibility;
-    Spectrum Li = light->Sample_L(p, rayEpsilon, lightSample, time,
-                                  &wi, &lightPdf, &visibility);
-    if (lightPdf > 0. && !Li.IsBlack()) {
-        Spectrum f = bsdf->f(wo, wi, flags);
-        if (!f.IsBlack() && visibility.Unoccluded(scene)) {
-            // Add light's contribution to reflected radiance
-            Li *= visibility.Transmittance(scene, renderer, NULL, rng, arena);
-            if (light->IsDeltaLight())
-                Ld += f * Li * (AbsDot(wi, n) / lightPdf);
-            else {
-                bsdfPdf = bsdf->Pdf(wo, wi, flags);
-                float weight = PowerHeuristic(1, lightPdf, 1, bsdfPdf);
-                Ld += f * Li * (AbsDot(wi, n) * weight / lightPdf);
-            }
-        }
-    }
+    DirectLightSample ls;
+    if (SampleLightDirect(light, p, wo, rayEpsilon, time, bsdf, lightSample,
+                          flags, &ls) && ls.visibility.Unoccluded(scene))
+        Ld += LightSampleContribution(scene, renderer, arena, light, n, wo,
+                                      bsdf, rng, flags, ls);
 
     // Sample BSDF with multiple importance sampling
-    if (!light->IsDeltaLight()) {
-        BxDFType sampledType;
-        Spectrum f = bsdf->Sample_f(wo, &wi, bsdfSample, &bsdfPdf, flags,
-                                    &sampledType);
-        if (!f.IsBlack() && bsdfPdf > 0.) {
-            float weight = 1.f;
-            if (!(sampledType & BSDF_SPECULAR)) {
-                lightPdf = light->Pdf(p, wi);
-                if (lightPdf == 0.)
-                    return Ld;
-                weight = PowerHeuristic(1, bsdfPdf, 1, lightPdf);
-            }
-            // Add light contribution from BSDF sampling
-            Intersection lightIsect;
-            Spectrum Li(0.f);
-            RayDifferential ray(p, wi, rayEpsilon, INFINITY, time);
-            if (scene->Intersect(ray, &lightIsect)) {
-                if (lightIsect.primitive->GetAreaLight() == light)
-                    Li = lightIsect.Le(-wi);
-            }
-            else
-                Li = light->Le(ray);
-            if (!Li.IsBlack()) {
-                Li *= renderer->Transmittance(scene, ray, NULL, rng, arena);
-                Ld += f * Li * AbsDot(wi, n) * weight / bsdfPdf;
-            }
-        }
-    }
+    Ld += BSDFSampleContribution(scene, renderer, arena, light, p, n, wo,
+                                 rayEpsilon, time, bsdf, rng, bsdfSample,
+                                 flags);
     return Ld;
 }
 
 
+static bool SampleLightDirect(const Light *light, const Point &p,
+        const Vector &wo, float rayEpsilon, float time, const BSDF *bsdf,
+        const LightSample &lightSample, BxDFType flags,
+        DirectLightSample *ls) {
+    // Sample light source and return whether a shadow ray is needed
+    ls->Li = light->Sample_L(p, rayEpsilon, lightSample, time,
+                             &ls->wi, &ls->lightPdf, &ls->visibility);
+    ls->unoccluded = false;
+    if (ls->lightPdf > 0. && !ls->Li.IsBlack()) {
+        ls->f = bsdf->f(wo, ls->wi, flags);
+        return !ls->f.IsBlack();
+    }
+    return false;
+}
+
+
+static Spectrum LightSampleContribution(const Scene *scene,
+        const Renderer *renderer, MemoryArena &arena, const Light *light,
+        const Normal &n, const Vector &wo, const BSDF *bsdf, RNG &rng,
+        BxDFType flags, const DirectLightSample &ls) {
+    // Add light's contribution to reflected radiance
+    Spectrum Li = ls.Li * ls.visibility.Transmittance(scene, renderer,
+                                                      NULL, rng, arena);
+    if (light->IsDeltaLight())
+        return ls.f * Li * (AbsDot(ls.wi, n) / ls.lightPdf);
+    float bsdfPdf = bsdf->Pdf(wo, ls.wi, flags);
+    float weight = PowerHeuristic(1, ls.lightPdf, 1, bsdfPdf);
+    return ls.f * Li * (AbsDot(ls.wi, n) * weight / ls.lightPdf);
+}
+
+
+static Spectrum BSDFSampleContribution(const Scene *scene,
+        const Renderer *renderer, MemoryArena &arena, const Light *light,
+        const Point &p, const Normal &n, const Vector &wo, float rayEpsilon,
+        float time, const BSDF *bsdf, RNG &rng, const BSDFSample &bsdfSample,
+        BxDFType flags) {
+    if (light->IsDeltaLight()) return Spectrum(0.);
+    Vector wi;
+    float bsdfPdf, lightPdf;
+    BxDFType sampledType;
+    Spectrum f = bsdf->Sample_f(wo, &wi, bsdfSample, &bsdfPdf, flags,
+                                &sampledType);
+    if (f.IsBlack() || bsdfPdf == 0.) return Spectrum(0.);
+    float weight = 1.f;
+    if (!(sampledType & BSDF_SPECULAR)) {
+        lightPdf = light->Pdf(p, wi);
+        if (lightPdf == 0.)
+            return Spectrum(0.);
+        weight = PowerHeuristic(1, bsdfPdf, 1, lightPdf);
+    }
+    // Add light contribution from BSDF sampling
+    Intersection lightIsect;
+    Spectrum Li(0.f);
+    RayDifferential ray(p, wi, rayEpsilon, INFINITY, time);
+    if (scene->Intersect(ray, &lightIsect)) {
+        if (lightIsect.primitive->GetAreaLight() == light)
+            Li = lightIsect.Le(-wi);
+    }
+    else
+        Li = light->Le(ray);
+    if (Li.IsBlack()) return Spectrum(0.);
+    Li *= renderer->Transmittance(scene, ray, NULL, rng, arena);
+    return f * Li * AbsDot(wi, n) * weight / bsdfPdf;
+}
+
+
 Spectrum SpecularReflect(const RayDifferential &ray, BSDF *bsdf,
         RNG &rng, const Intersection &isect, const Renderer *renderer,
         const Scene *scene, const Sample *sample, MemoryArena &arena) {
@@ -33,6 +33,12 @@
 // core/memory.cpp*
 #include "stdafx.h"
 #include "memory.h"
+#if !defined(PBRT_IS_WINDOWS)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 // Memory Allocation Functions
 void *AllocAligned(size_t size) {
@@ -69,3 +75,71 @@ void FreeAligned(void *ptr) {
 }
 
 
+
+// MappedFile Method Definitions
+MappedFile *MappedFile::Open(const string &filename) {
+#if defined(PBRT_IS_WINDOWS)
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        Error("Unable to open file \"%s\"", filename.c_str());
+        return NULL;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        Error("Unable to map empty file \"%s\"", filename.c_str());
+        CloseHandle(file);
+        return NULL;
+    }
+    HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    void *data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (!data) {
+        Error("Unable to map file \"%s\"", filename.c_str());
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        return NULL;
+    }
+    MappedFile *mf = new MappedFile;
+    mf->data = data;
+    mf->size = (size_t)fileSize.QuadPart;
+    mf->file = file;
+    mf->mapping = mapping;
+    return mf;
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        Error("Unable to open file \"%s\"", filename.c_str());
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        Error("Unable to map empty file \"%s\"", filename.c_str());
+        close(fd);
+        return NULL;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the file descriptor is closed
+    close(fd);
+    if (data == MAP_FAILED) {
+        Error("Unable to map file \"%s\"", filename.c_str());
+        return NULL;
+    }
+    MappedFile *mf = new MappedFile;
+    mf->data = data;
+    mf->size = (size_t)st.st_size;
+    return mf;
+#endif
+}
+
+
+MappedFile::~MappedFile() {
+#if defined(PBRT_IS_WINDOWS)
+    UnmapViewOfFile(data);
+    CloseHandle(mapping);
+    CloseHandle(file);
+#else
+    munmap(data, size);
+#endif
+}
+
+
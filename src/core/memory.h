@@ -206,5 +206,25 @@ private:
 };
 
 
+class MappedFile : public ReferenceCounted {
+public:
+    // MappedFile Public Methods
+    static MappedFile *Open(const string &filename);
+    ~MappedFile();
+    const void *Data() const { return data; }
+    size_t Size() const { return size; }
+private:
+    // MappedFile Private Methods
+    MappedFile() { data = NULL; size = 0; }
+
+    // MappedFile Private Data
+    void *data;
+    size_t size;
+#if defined(PBRT_IS_WINDOWS)
+    HANDLE file, mapping;
+#endif
+};
+
+
 
 #endif // PBRT_CORE_MEMORY_H
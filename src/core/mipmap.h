@@ -40,6 +40,12 @@
 #include "pbrt.h"
 #include "spectrum.h"
 #include "texture.h"
+#include "parallel.h"
+#include "stats.h"
+#include "texcache.h"
+#ifdef PBRT_HAS_SSE
+#include <emmintrin.h>
+#endif
 
 // MIPMap Declarations
 typedef enum {
@@ -47,17 +53,57 @@ typedef enum {
     TEXTURE_BLACK,
     TEXTURE_CLAMP
 } ImageWrap;
+typedef enum {
+    TEXEL_FLOAT,
+    TEXEL_HALF,
+    TEXEL_SRGB8
+} TexelFormat;
+#define MIPMAP_STATS_LEVELS 32
+struct MIPMapStats {
+    // MIPMapStats Public Methods
+    MIPMapStats(const string &filename, uint32_t id);
+    void Add(uint32_t fineLevel, uint32_t coarseLevel, float area, bool ewa,
+             bool clamped, bool magnified);
+
+    // MIPMapStats Public Data
+    // Lookups are counted per thread and merged when statistics are printed
+    uint32_t id;
+    StatsCounter lookups;
+    StatsPercentage ewaLookups, clampedLookups, magnifiedLookups;
+    StatsCounterType footprintCount, footprintSum, footprintMin, footprintMax;
+    StatsCounter *levelLookups[MIPMAP_STATS_LEVELS];
+};
+
+
+MIPMapStats *GetMIPMapStats(const string &filename);
 template <typename T> class MIPMap {
 public:
     // MIPMap Public Methods
-    MIPMap() { pyramid = NULL; width = height = nLevels = 0; }
+    MIPMap() {
+        pyramid = NULL;
+        halfPyramid = NULL;
+        srgb8Pyramid = NULL;
+        tileSource = NULL;
+        tileCache = NULL;
+        stats = NULL;
+        width = height = nLevels = 0;
+    }
     MIPMap(uint32_t xres, uint32_t yres, const T *data, bool doTri = false,
-           float maxAniso = 8.f, ImageWrap wrapMode = TEXTURE_REPEAT);
+           float maxAniso = 8.f, ImageWrap wrapMode = TEXTURE_REPEAT,
+           TexelFormat format = TEXEL_FLOAT);
+    MIPMap(const Reference<TiledMIPFile> &file, TextureTileSource *source,
+           TextureCache *cache, bool doTri = false, float maxAniso = 8.f,
+           ImageWrap wrapMode = TEXTURE_REPEAT);
     ~MIPMap();
     uint32_t Width() const { return width; }
     uint32_t Height() const { return height; }
     uint32_t Levels() const { return nLevels; }
-    const T &Texel(uint32_t level, int s, int t) const;
+    void SetStats(MIPMapStats *s) { stats = s; }
+    uint32_t LevelWidth(uint32_t level) const { return uSizes[level]; }
+    uint32_t LevelHeight(uint32_t level) const { return vSizes[level]; }
+    T Texel(uint32_t level, int s, int t) const;
+    bool WriteTiled(const string &filename, float scale = 1.f,
+                    float gamma = 1.f) const;
     T Lookup(float s, float t, float width = 0.f) const;
     T Lookup(float s, float t, float ds0, float dt0,
         float ds1, float dt1) const;
@@ -88,8 +134,57 @@ private:
     float clamp(float v) { return Clamp(v, 0.f, INFINITY); }
     RGBSpectrum clamp(const RGBSpectrum &v) { return v.Clamp(0.f, INFINITY); }
     SampledSpectrum clamp(const SampledSpectrum &v) { return v.Clamp(0.f, INFINITY); }
+    enum { nChannels = sizeof(T) / sizeof(float) };
+    struct HalfTexel { uint16_t c[nChannels]; };
+    struct SRGB8Texel { uint8_t c[nChannels]; };
+    static void pack(const T &v, HalfTexel *p) {
+        const float *c = (const float *)&v;
+        for (int i = 0; i < nChannels; ++i)
+            p->c[i] = FloatToHalf(c[i]);
+    }
+    static void pack(const T &v, SRGB8Texel *p) {
+        const float *c = (const float *)&v;
+        for (int i = 0; i < nChannels; ++i)
+            p->c[i] = LinearToSRGB8(c[i]);
+    }
+    static T unpack(const HalfTexel &p) {
+        T v;
+        float *c = (float *)&v;
+        for (int i = 0; i < nChannels; ++i)
+            c[i] = HalfToFloat(p.c[i]);
+        return v;
+    }
+    static T unpack(const SRGB8Texel &p) {
+        T v;
+        float *c = (float *)&v;
+        for (int i = 0; i < nChannels; ++i)
+            c[i] = SRGB8ToLinear(p.c[i]);
+        return v;
+    }
+    template <typename P> BlockedArray<P> **packPyramid();
+    int wrapCoordinate(int c, int size) const {
+        // Apply _wrapMode_ to texel coordinate, returning -1 for black texels
+        switch (wrapMode) {
+            case TEXTURE_REPEAT: return Mod(c, size);
+            case TEXTURE_CLAMP:  return Clamp(c, 0, size - 1);
+            default:             return (c < 0 || c >= size) ? -1 : c;
+        }
+    }
+    void wrapCoordinates(int c0, int count, int size, int *wrapped) const {
+        // Wrap _count_ consecutive coordinates, with one _Mod()_ for repeat
+        if (wrapMode != TEXTURE_REPEAT || count == 0) {
+            for (int i = 0; i < count; ++i)
+                wrapped[i] = wrapCoordinate(c0 + i, size);
+            return;
+        }
+        wrapped[0] = Mod(c0, size);
+        for (int i = 1; i < count; ++i)
+            wrapped[i] = (wrapped[i-1] + 1 == size) ? 0 : wrapped[i-1] + 1;
+    }
+    T texel(uint32_t level, int s, int t, TextureTilePins *pins = NULL) const;
     T triangle(uint32_t level, float s, float t) const;
     T EWA(uint32_t level, float s, float t, float ds0, float dt0, float ds1, float dt1) const;
+    static void initWeightLut();
 
     // MIPMap Private Data
     bool doTrilinear;
@@ -99,8 +194,26 @@ private:
         int firstTexel;
         float weight[4];
     };
+    struct ResampleSFunc;
+    struct ResampleTFunc;
+    struct DownsampleFunc;
+    struct LoadTileFunc;
+    template <typename P> struct PackLevelFunc;
+    // Only the pyramid for the MIP map's _TexelFormat_ is non-_NULL_
     BlockedArray<T> **pyramid;
+    BlockedArray<HalfTexel> **halfPyramid;
+    BlockedArray<SRGB8Texel> **srgb8Pyramid;
     uint32_t width, height, nLevels;
+    MIPMapStats *stats;
+    vector<uint32_t> uSizes, vSizes;
+    // Tiled MIP maps read their texels through the _TextureCache_, or
+    // from _levelTexels_ if they don't use it
+    Reference<TiledMIPFile> tiledFile;
+    TextureTileSource *tileSource;
+    TextureCache *tileCache;
+    uint32_t logTileSize;
+    vector<const T *> levelTexels;
+    T *loadedTexels;
 #define WEIGHT_LUT_SIZE 128
     static float *weightLut;
 };
@@ -108,12 +221,115 @@ private:
 
 
 // MIPMap Method Definitions
+template <typename T> struct MIPMap<T>::ResampleSFunc {
+    ResampleSFunc(const MIPMap<T> *m, const ResampleWeight *w, const T *i,
+                  uint32_t sr, uint32_t sp, T *r)
+        : mip(m), sWeights(w), img(i), sres(sr), sPow2(sp), resampledImage(r) { }
+    void operator()(int t) const {
+        for (uint32_t s = 0; s < sPow2; ++s) {
+            // Compute texel $(s,t)$ in $s$-zoomed image
+            resampledImage[t*sPow2+s] = 0.;
+            for (int j = 0; j < 4; ++j) {
+                int origS = sWeights[s].firstTexel + j;
+                if (mip->wrapMode == TEXTURE_REPEAT)
+                    origS = Mod(origS, sres);
+                else if (mip->wrapMode == TEXTURE_CLAMP)
+                    origS = Clamp(origS, 0, sres-1);
+                if (origS >= 0 && origS < (int)sres)
+                    resampledImage[t*sPow2+s] += sWeights[s].weight[j] *
+                                                 img[t*sres + origS];
+            }
+        }
+    }
+    const MIPMap<T> *mip;
+    const ResampleWeight *sWeights;
+    const T *img;
+    uint32_t sres, sPow2;
+    T *resampledImage;
+};
+
+
+template <typename T> struct MIPMap<T>::ResampleTFunc {
+    ResampleTFunc(MIPMap<T> *m, const ResampleWeight *w, uint32_t tr,
+                  uint32_t sp, uint32_t tp, T *r)
+        : mip(m), tWeights(w), tres(tr), sPow2(sp), tPow2(tp),
+          resampledImage(r) { }
+    void operator()(int s) const {
+        T *workData = new T[tPow2];
+        for (uint32_t t = 0; t < tPow2; ++t) {
+            workData[t] = 0.;
+            for (uint32_t j = 0; j < 4; ++j) {
+                int offset = tWeights[t].firstTexel + j;
+                if (mip->wrapMode == TEXTURE_REPEAT) offset = Mod(offset, tres);
+                else if (mip->wrapMode == TEXTURE_CLAMP) offset = Clamp(offset, 0, tres-1);
+                if (offset >= 0 && offset < (int)tres)
+                    workData[t] += tWeights[t].weight[j] *
+                        resampledImage[offset*sPow2 + s];
+            }
+        }
+        for (uint32_t t = 0; t < tPow2; ++t)
+            resampledImage[t*sPow2 + s] = mip->clamp(workData[t]);
+        delete[] workData;
+    }
+    MIPMap<T> *mip;
+    const ResampleWeight *tWeights;
+    uint32_t tres, sPow2, tPow2;
+    T *resampledImage;
+};
+
+
+template <typename T> struct MIPMap<T>::DownsampleFunc {
+    DownsampleFunc(MIPMap<T> *m, uint32_t l) : mip(m), level(l) { }
+    void operator()(int t) const {
+        BlockedArray<T> &l = *mip->pyramid[level];
+        for (uint32_t s = 0; s < l.uSize(); ++s)
+            l(s, t) = .25f *
+               (mip->Texel(level-1, 2*s, 2*t)   + mip->Texel(level-1, 2*s+1, 2*t) +
+                mip->Texel(level-1, 2*s, 2*t+1) + mip->Texel(level-1, 2*s+1, 2*t+1));
+    }
+    MIPMap<T> *mip;
+    uint32_t level;
+};
+
+
+template <typename T> struct MIPMap<T>::LoadTileFunc {
+    LoadTileFunc(const TextureTileSource *src, uint32_t l, uint32_t ut,
+                 uint32_t lts, T *t)
+        : source(src), level(l), uTiles(ut), logTileSize(lts), texels(t) { }
+    void operator()(int tile) const {
+        source->LoadTile(level, tile % uTiles, tile / uTiles,
+                         texels + (size_t(tile) << (2 * logTileSize)));
+    }
+    const TextureTileSource *source;
+    uint32_t level, uTiles, logTileSize;
+    T *texels;
+};
+
+
+template <typename T> template <typename P>
+struct MIPMap<T>::PackLevelFunc {
+    PackLevelFunc(const BlockedArray<T> *f, BlockedArray<P> *p)
+        : from(f), packed(p) { }
+    void operator()(int t) const {
+        for (uint32_t s = 0; s < from->uSize(); ++s)
+            pack((*from)(s, t), &(*packed)(s, t));
+    }
+    const BlockedArray<T> *from;
+    BlockedArray<P> *packed;
+};
+
+
 template <typename T>
 MIPMap<T>::MIPMap(uint32_t sres, uint32_t tres, const T *img, bool doTri,
-                  float maxAniso, ImageWrap wm) {
+                  float maxAniso, ImageWrap wm, TexelFormat format) {
     doTrilinear = doTri;
     maxAnisotropy = maxAniso;
     wrapMode = wm;
+    halfPyramid = NULL;
+    srgb8Pyramid = NULL;
+    tileSource = NULL;
+    tileCache = NULL;
+    stats = NULL;
     T *resampledImage = NULL;
     if (!IsPowerOf2(sres) || !IsPowerOf2(tres)) {
         // Resample image to power-of-two resolution
@@ -124,43 +340,14 @@ MIPMap<T>::MIPMap(uint32_t sres, uint32_t tres, const T *img, bool doTri,
         resampledImage = new T[sPow2 * tPow2];
 
         // Apply _sWeights_ to zoom in $s$ direction
-        for (uint32_t t = 0; t < tres; ++t) {
-            for (uint32_t s = 0; s < sPow2; ++s) {
-                // Compute texel $(s,t)$ in $s$-zoomed image
-                resampledImage[t*sPow2+s] = 0.;
-                for (int j = 0; j < 4; ++j) {
-                    int origS = sWeights[s].firstTexel + j;
-                    if (wrapMode == TEXTURE_REPEAT)
-                        origS = Mod(origS, sres);
-                    else if (wrapMode == TEXTURE_CLAMP)
-                        origS = Clamp(origS, 0, sres-1);
-                    if (origS >= 0 && origS < (int)sres)
-                        resampledImage[t*sPow2+s] += sWeights[s].weight[j] *
-                                                     img[t*sres + origS];
-                }
-            }
-        }
+        ParallelFor(0, tres, 16, ResampleSFunc(this, sWeights, img, sres,
+                                               sPow2, resampledImage));
         delete[] sWeights;
 
         // Resample image in $t$ direction
         ResampleWeight *tWeights = resampleWeights(tres, tPow2);
-        T *workData = new T[tPow2];
-        for (uint32_t s = 0; s < sPow2; ++s) {
-            for (uint32_t t = 0; t < tPow2; ++t) {
-                workData[t] = 0.;
-                for (uint32_t j = 0; j < 4; ++j) {
-                    int offset = tWeights[t].firstTexel + j;
-                    if (wrapMode == TEXTURE_REPEAT) offset = Mod(offset, tres);
-                    else if (wrapMode == TEXTURE_CLAMP) offset = Clamp(offset, 0, tres-1);
-                    if (offset >= 0 && offset < (int)tres)
-                        workData[t] += tWeights[t].weight[j] *
-                            resampledImage[offset*sPow2 + s];
-                }
-            }
-            for (uint32_t t = 0; t < tPow2; ++t)
-                resampledImage[t*sPow2 + s] = clamp(workData[t]);
-        }
-        delete[] workData;
+        ParallelFor(0, sPow2, 32, ResampleTFunc(this, tWeights, tres,
+                                                sPow2, tPow2, resampledImage));
         delete[] tWeights;
         img = resampledImage;
         sres = sPow2;
@@ -174,20 +361,115 @@ MIPMap<T>::MIPMap(uint32_t sres, uint32_t tres, const T *img, bool doTri,
 
     // Initialize most detailed level of MIPMap
     pyramid[0] = new BlockedArray<T>(sres, tres, img);
+    uSizes.push_back(sres);
+    vSizes.push_back(tres);
     for (uint32_t i = 1; i < nLevels; ++i) {
         // Initialize $i$th MIPMap level from $i-1$st level
         uint32_t sRes = max(1u, pyramid[i-1]->uSize()/2);
         uint32_t tRes = max(1u, pyramid[i-1]->vSize()/2);
         pyramid[i] = new BlockedArray<T>(sRes, tRes);
+        uSizes.push_back(sRes);
+        vSizes.push_back(tRes);
 
         // Filter four texels from finer level of pyramid
-        for (uint32_t t = 0; t < tRes; ++t)
-            for (uint32_t s = 0; s < sRes; ++s)
-                (*pyramid[i])(s, t) = .25f *
-                   (Texel(i-1, 2*s, 2*t)   + Texel(i-1, 2*s+1, 2*t) +
-                    Texel(i-1, 2*s, 2*t+1) + Texel(i-1, 2*s+1, 2*t+1));
+        ParallelFor(0, tRes, 32, DownsampleFunc(this, i));
     }
     if (resampledImage) delete[] resampledImage;
+
+    // Convert pyramid to _format_ texels if needed
+    size_t texelBytes = sizeof(T);
+    if (format == TEXEL_HALF) {
+        halfPyramid = packPyramid<HalfTexel>();
+        texelBytes = sizeof(HalfTexel);
+    }
+    else if (format == TEXEL_SRGB8) {
+        srgb8Pyramid = packPyramid<SRGB8Texel>();
+        texelBytes = sizeof(SRGB8Texel);
+    }
+    static StatsMemory mipmapBytes("Memory", "Texture MIP maps");
+    for (uint32_t i = 0; i < nLevels; ++i)
+        mipmapBytes += uSizes[i] * vSizes[i] * texelBytes;
+    initWeightLut();
+}
+
+
+template <typename T>
+MIPMap<T>::MIPMap(const Reference<TiledMIPFile> &file,
+                  TextureTileSource *source, TextureCache *cache, bool doTri,
+                  float maxAniso, ImageWrap wm)
+    : tiledFile(file) {
+    doTrilinear = doTri;
+    maxAnisotropy = maxAniso;
+    wrapMode = wm;
+    // Use pyramid levels of _file_, whose tiles _source_ loads through
+    // _cache_, or all at once if _cache_ is _NULL_
+    pyramid = NULL;
+    halfPyramid = NULL;
+    srgb8Pyramid = NULL;
+    tileSource = source;
+    stats = NULL;
+    tileCache = cache;
+    loadedTexels = NULL;
+    width = file->LevelWidth(0);
+    height = file->LevelHeight(0);
+    nLevels = file->Levels();
+    logTileSize = file->LogTileSize();
+    for (uint32_t i = 0; i < nLevels; ++i) {
+        uSizes.push_back(file->LevelWidth(i));
+        vSizes.push_back(file->LevelHeight(i));
+    }
+    if (!tileCache) {
+        // Use baked pyramid levels directly from the mapped file if possible
+        levelTexels.resize(nLevels);
+        bool mapped = true;
+        size_t nTexels = 0;
+        vector<uint32_t> uTiles(nLevels), vTiles(nLevels);
+        for (uint32_t i = 0; i < nLevels; ++i) {
+            levelTexels[i] = (const T *)source->MappedLevel(i);
+            if (!levelTexels[i]) mapped = false;
+            uTiles[i] = (LevelWidth(i) + (1 << logTileSize) - 1) >> logTileSize;
+            vTiles[i] = (LevelHeight(i) + (1 << logTileSize) - 1) >> logTileSize;
+            nTexels += size_t(uTiles[i] * vTiles[i]) << (2 * logTileSize);
+        }
+        if (mapped) {
+            static StatsMemory mappedBytes("Memory", "Mapped texture MIP maps");
+            mappedBytes += nTexels * sizeof(T);
+        }
+        else {
+            // Read all tiles of the pyramid into memory
+            loadedTexels = new T[nTexels];
+            T *texels = loadedTexels;
+            for (uint32_t i = 0; i < nLevels; ++i) {
+                levelTexels[i] = texels;
+                ParallelFor(0, uTiles[i] * vTiles[i], 4,
+                    LoadTileFunc(source, i, uTiles[i], logTileSize, texels));
+                texels += size_t(uTiles[i] * vTiles[i]) << (2 * logTileSize);
+            }
+            static StatsMemory mipmapBytes("Memory", "Texture MIP maps");
+            mipmapBytes += nTexels * sizeof(T);
+        }
+    }
+    initWeightLut();
+}
+
+
+template <typename T> template <typename P>
+BlockedArray<P> **MIPMap<T>::packPyramid() {
+    // Replace each level of _pyramid_ with a level of _P_ texels
+    BlockedArray<P> **packed = new BlockedArray<P> *[nLevels];
+    for (uint32_t i = 0; i < nLevels; ++i) {
+        packed[i] = new BlockedArray<P>(uSizes[i], vSizes[i]);
+        ParallelFor(0, vSizes[i], 32, PackLevelFunc<P>(pyramid[i], packed[i]));
+        delete pyramid[i];
+    }
+    delete[] pyramid;
+    pyramid = NULL;
+    return packed;
+}
+
+
+template <typename T>
+void MIPMap<T>::initWeightLut() {
     // Initialize EWA filter weights if needed
     if (!weightLut) {
         weightLut = AllocAligned<float>(WEIGHT_LUT_SIZE);
@@ -201,37 +483,105 @@ MIPMap<T>::MIPMap(uint32_t sres, uint32_t tres, const T *img, bool doTri,
 
 
 template <typename T>
-const T &MIPMap<T>::Texel(uint32_t level, int s, int t) const {
+T MIPMap<T>::Texel(uint32_t level, int s, int t) const {
     Assert(level < nLevels);
-    const BlockedArray<T> &l = *pyramid[level];
     // Compute texel $(s,t)$ accounting for boundary conditions
-    switch (wrapMode) {
-        case TEXTURE_REPEAT:
-            s = Mod(s, l.uSize());
-            t = Mod(t, l.vSize());
-            break;
-        case TEXTURE_CLAMP:
-            s = Clamp(s, 0, l.uSize() - 1);
-            t = Clamp(t, 0, l.vSize() - 1);
-            break;
-        case TEXTURE_BLACK: {
-            static const T black = 0.f;
-            if (s < 0 || s >= (int)l.uSize() ||
-                t < 0 || t >= (int)l.vSize())
-                return black;
-            break;
-        }
-    }
+    s = wrapCoordinate(s, LevelWidth(level));
+    t = wrapCoordinate(t, LevelHeight(level));
+    if (s < 0 || t < 0) return T(0.f);
+    return texel(level, s, t);
+}
+
+
+template <typename T>
+T MIPMap<T>::texel(uint32_t level, int s, int t, TextureTilePins *pins) const {
     PBRT_ACCESSED_TEXEL(const_cast<MIPMap<T> *>(this), level, s, t);
-    return l(s, t);
+    if (pyramid)
+        return (*pyramid[level])(s, t);
+    if (halfPyramid)
+        return unpack((*halfPyramid[level])(s, t));
+    if (srgb8Pyramid)
+        return unpack((*srgb8Pyramid[level])(s, t));
+
+    // Find texel in its tile of the tiled pyramid level
+    uint32_t uSize = LevelWidth(level);
+    int tileMask = (1 << logTileSize) - 1;
+    uint32_t tu = s >> logTileSize, tv = t >> logTileSize;
+    uint32_t offset = ((t & tileMask) << logTileSize) + (s & tileMask);
+    if (!tileCache) {
+        uint32_t uTiles = (uSize + tileMask) >> logTileSize;
+        return levelTexels[level][(size_t(tv * uTiles + tu) << (2 * logTileSize)) +
+                                  offset];
+    }
+    if (pins)
+        return ((const T *)pins->Texels(level, tu, tv))[offset];
+    TextureTilePins texelPins(tileCache, tileSource);
+    return ((const T *)texelPins.Texels(level, tu, tv))[offset];
 }
 
 
 template <typename T>
 MIPMap<T>::~MIPMap() {
-    for (uint32_t i = 0; i < nLevels; ++i)
-        delete pyramid[i];
+    if (tileSource) {
+        if (tileCache) tileCache->Evict(tileSource);
+        delete tileSource;
+        delete[] loadedTexels;
+    }
+    for (uint32_t i = 0; i < nLevels; ++i) {
+        if (pyramid) delete pyramid[i];
+        if (halfPyramid) delete halfPyramid[i];
+        if (srgb8Pyramid) delete srgb8Pyramid[i];
+    }
     delete[] pyramid;
+    delete[] halfPyramid;
+    delete[] srgb8Pyramid;
+}
+
+
+template <typename T>
+bool MIPMap<T>::WriteTiled(const string &filename, float scale,
+                           float gamma) const {
+    FILE *f = fopen(filename.c_str(), "wb");
+    if (!f) return false;
+    // Write _TiledMIPHeader_ and table of pyramid levels
+    TiledMIPHeader header;
+    memcpy(header.magic, TILEDMIP_MAGIC, 8);
+    header.version = TILEDMIP_VERSION;
+    header.nChannels = sizeof(T) / sizeof(float);
+    header.nLevels = nLevels;
+    header.logTileSize = TILEDMIP_LOG_TILE_SIZE;
+    header.scale = scale;
+    header.gamma = gamma;
+    uint32_t tileSize = 1 << header.logTileSize;
+    vector<TiledMIPLevel> levels(nLevels);
+    uint64_t offset = sizeof(header) + nLevels * sizeof(TiledMIPLevel);
+    for (uint32_t i = 0; i < nLevels; ++i) {
+        levels[i].width = LevelWidth(i);
+        levels[i].height = LevelHeight(i);
+        levels[i].offset = offset;
+        offset += uint64_t(levels[i].uTiles(header.logTileSize)) *
+            levels[i].vTiles(header.logTileSize) * tileSize * tileSize * sizeof(T);
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(&levels[0], sizeof(TiledMIPLevel), nLevels, f) == nLevels;
+
+    // Write each level's tiles, padding partial tiles with edge texels
+    vector<T> tile(tileSize * tileSize);
+    for (uint32_t i = 0; ok && i < nLevels; ++i) {
+        int uMax = levels[i].width - 1, vMax = levels[i].height - 1;
+        for (uint32_t tv = 0; tv < levels[i].vTiles(header.logTileSize); ++tv)
+            for (uint32_t tu = 0; tu < levels[i].uTiles(header.logTileSize); ++tu) {
+                for (uint32_t y = 0; y < tileSize; ++y)
+                    for (uint32_t x = 0; x < tileSize; ++x)
+                        tile[y * tileSize + x] = Texel(i,
+                            min(int(tu * tileSize + x), uMax),
+                            min(int(tv * tileSize + y), vMax));
+                if (ok && fwrite(&tile[0], sizeof(T), tile.size(), f) != tile.size())
+                    ok = false;
+            }
+    }
+    if (fclose(f) != 0) ok = false;
+    return ok;
 }
 
 
@@ -242,6 +592,13 @@ T MIPMap<T>::Lookup(float s, float t, float width) const {
 
     // Perform trilinear interpolation at appropriate MIPMap level
     PBRT_MIPMAP_TRILINEAR_FILTER(const_cast<MIPMap<T> *>(this), s, t, width, level, nLevels);
+    if (stats) {
+        // Record filter level and square footprint of trilinear lookup
+        uint32_t fine = Clamp(Floor2Int(level), 0, int(nLevels) - 1);
+        uint32_t coarse = (level > fine && fine + 1 < nLevels) ? fine + 1 : fine;
+        stats->Add(fine, coarse, width * width * this->width * this->height,
+                   false, false, level <= 0.f);
+    }
     if (level < 0)
         return triangle(0, s, t);
     else if (level >= nLevels - 1)
@@ -258,10 +615,23 @@ T MIPMap<T>::Lookup(float s, float t, float width) const {
 template <typename T>
 T MIPMap<T>::triangle(uint32_t level, float s, float t) const {
     level = Clamp(level, 0, nLevels-1);
-    s = s * pyramid[level]->uSize() - 0.5f;
-    t = t * pyramid[level]->vSize() - 0.5f;
+    s = s * LevelWidth(level) - 0.5f;
+    t = t * LevelHeight(level) - 0.5f;
     int s0 = Floor2Int(s), t0 = Floor2Int(t);
     float ds = s - s0, dt = t - t0;
+    if (tileCache) {
+        // Pin the footprint's tiles once for its four texels
+        TextureTilePins pins(tileCache, tileSource);
+        int sw[2], tw[2];
+        wrapCoordinates(s0, 2, LevelWidth(level), sw);
+        wrapCoordinates(t0, 2, LevelHeight(level), tw);
+        T v[4];
+        for (int i = 0; i < 4; ++i)
+            v[i] = (sw[i & 1] >= 0 && tw[i >> 1] >= 0) ?
+                texel(level, sw[i & 1], tw[i >> 1], &pins) : T(0.f);
+        return (1.f-ds) * (1.f-dt) * v[0] + (1.f-ds) * dt * v[2] +
+               ds * (1.f-dt) * v[1] + ds * dt * v[3];
+    }
     return (1.f-ds) * (1.f-dt) * Texel(level, s0, t0) +
            (1.f-ds) * dt       * Texel(level, s0, t0+1) +
            ds       * (1.f-dt) * Texel(level, s0+1, t0) +
@@ -290,13 +660,15 @@ T MIPMap<T>::Lookup(float s, float t, float ds0, float dt0,
     float minorLength = sqrtf(ds1*ds1 + dt1*dt1);
 
     // Clamp ellipse eccentricity if too large
-    if (minorLength * maxAnisotropy < majorLength && minorLength > 0.f) {
+    bool clamped = minorLength * maxAnisotropy < majorLength && minorLength > 0.f;
+    if (clamped) {
         float scale = majorLength / (minorLength * maxAnisotropy);
         ds1 *= scale;
         dt1 *= scale;
         minorLength *= scale;
     }
     if (minorLength == 0.f) {
+        if (stats) stats->Add(0, 0, 0.f, true, false, true);
         PBRT_FINISHED_EWA_TEXTURE_LOOKUP();
         PBRT_STARTED_TRILINEAR_TEXTURE_LOOKUP(s, t);
         T val = triangle(0, s, t);
@@ -309,6 +681,13 @@ T MIPMap<T>::Lookup(float s, float t, float ds0, float dt0,
     uint32_t ilod = Floor2Int(lod);
     PBRT_MIPMAP_EWA_FILTER(const_cast<MIPMap<T> *>(this), s, t, ds0, ds1, dt0, dt1, minorLength, majorLength, lod, nLevels);
     float d = lod - ilod;
+    if (stats) {
+        // Record filter levels and elliptical footprint of EWA lookup
+        uint32_t fine = min(ilod, nLevels - 1);
+        uint32_t coarse = (d > 0.f) ? min(ilod + 1, nLevels - 1) : fine;
+        stats->Add(fine, coarse, M_PI * majorLength * minorLength * width * height,
+                   true, clamped, lod == 0.f);
+    }
     T val = (1.f - d) * EWA(ilod,   s, t, ds0, dt0, ds1, dt1) +
                    d  * EWA(ilod+1, s, t, ds0, dt0, ds1, dt1);
     PBRT_FINISHED_EWA_TEXTURE_LOOKUP();
@@ -321,12 +700,13 @@ T MIPMap<T>::EWA(uint32_t level, float s, float t, float ds0, float dt0,
                  float ds1, float dt1) const {
     if (level >= nLevels) return Texel(nLevels-1, 0, 0);
     // Convert EWA coordinates to appropriate scale for level
-    s = s * pyramid[level]->uSize() - 0.5f;
-    t = t * pyramid[level]->vSize() - 0.5f;
-    ds0 *= pyramid[level]->uSize();
-    dt0 *= pyramid[level]->vSize();
-    ds1 *= pyramid[level]->uSize();
-    dt1 *= pyramid[level]->vSize();
+    float uSize = LevelWidth(level), vSize = LevelHeight(level);
+    s = s * uSize - 0.5f;
+    t = t * vSize - 0.5f;
+    ds0 *= uSize;
+    dt0 *= vSize;
+    ds1 *= uSize;
+    dt1 *= vSize;
 
     // Compute ellipse coefficients to bound EWA filter region
     float A = dt0*dt0 + dt1*dt1 + 1;
@@ -346,19 +726,77 @@ T MIPMap<T>::EWA(uint32_t level, float s, float t, float ds0, float dt0,
     int t0 = Ceil2Int (t - 2.f * invDet * vSqrt);
     int t1 = Floor2Int(t + 2.f * invDet * vSqrt);
 
-    // Scan over ellipse bound and compute quadratic equation
+    // Scan over ellipse bound in fixed-size chunks of columns
+    const int chunkSize = 64;
+    int sWrapped[chunkSize], offsets[chunkSize];
+    int nColumns = max(s1 - s0 + 1, 0);
+    const BlockedArray<T> *floatLevel = pyramid ? pyramid[level] : NULL;
+    TextureTilePins pins(tileCache, tileSource);
     T sum(0.);
     float sumWts = 0.f;
+#ifdef PBRT_HAS_SSE
+    __m128 sv = _mm_set1_ps(s), Av = _mm_set1_ps(A), Bv = _mm_set1_ps(B);
+    __m128 one = _mm_set1_ps(1.f);
+    __m128 lutSize = _mm_set1_ps(WEIGHT_LUT_SIZE);
+    __m128 maxOffset = _mm_set1_ps(WEIGHT_LUT_SIZE - 1);
+    __m128i outside = _mm_set1_epi32(-1);
+#endif // PBRT_HAS_SSE
     for (int it = t0; it <= t1; ++it) {
         float tt = it - t;
-        for (int is = s0; is <= s1; ++is) {
-            float ss = is - s;
-            // Compute squared radius and filter texel if inside ellipse
-            float r2 = A*ss*ss + B*ss*tt + C*tt*tt;
-            if (r2 < 1.) {
-                float weight = weightLut[min(Float2Int(r2 * WEIGHT_LUT_SIZE),
-                                             WEIGHT_LUT_SIZE-1)];
-                sum += Texel(level, is, it) * weight;
+        int tw = wrapCoordinate(it, LevelHeight(level));
+#ifdef PBRT_HAS_SSE
+        __m128 ttv = _mm_set1_ps(tt), Cttv = _mm_set1_ps(C*tt*tt);
+#endif // PBRT_HAS_SSE
+        for (int c0 = 0; c0 < nColumns; c0 += chunkSize) {
+            // Find weight offsets of the chunk's texels, -1 outside the ellipse
+            int n = min(chunkSize, nColumns - c0), cs0 = s0 + c0;
+            int first = n, last = -1, i = 0;
+#ifdef PBRT_HAS_SSE
+            for (; i + 3 < n; i += 4) {
+                // Compute squared radii and weight offsets four texels at a time
+                int is = cs0 + i;
+                __m128 ss = _mm_sub_ps(_mm_cvtepi32_ps(
+                    _mm_setr_epi32(is, is+1, is+2, is+3)), sv);
+                __m128 r2 = _mm_add_ps(_mm_add_ps(
+                    _mm_mul_ps(_mm_mul_ps(Av, ss), ss),
+                    _mm_mul_ps(_mm_mul_ps(Bv, ss), ttv)), Cttv);
+                __m128 inside = _mm_cmplt_ps(r2, one);
+                __m128i offset = _mm_cvttps_epi32(
+                    _mm_min_ps(_mm_mul_ps(r2, lutSize), maxOffset));
+                __m128i insideMask = _mm_castps_si128(inside);
+                _mm_storeu_si128((__m128i *)&offsets[i],
+                    _mm_or_si128(_mm_and_si128(insideMask, offset),
+                                 _mm_andnot_si128(insideMask, outside)));
+                if (_mm_movemask_ps(inside)) {
+                    first = min(first, i);
+                    last = i + 3;
+                }
+            }
+#endif // PBRT_HAS_SSE
+            for (; i < n; ++i) {
+                float ss = (cs0 + i) - s;
+                // Compute squared radius and weight offset if inside ellipse
+                float r2 = A*ss*ss + B*ss*tt + C*tt*tt;
+                offsets[i] = -1;
+                if (r2 < 1.) {
+                    offsets[i] = min(Float2Int(r2 * WEIGHT_LUT_SIZE),
+                                     WEIGHT_LUT_SIZE-1);
+                    first = min(first, i);
+                    last = i;
+                }
+            }
+            if (last < 0) continue;
+
+            // Filter the chunk's texels that are inside the ellipse
+            wrapCoordinates(cs0 + first, last - first + 1, LevelWidth(level),
+                            sWrapped + first);
+            for (i = first; i <= last; ++i) {
+                if (offsets[i] < 0) continue;
+                float weight = weightLut[offsets[i]];
+                int sw = sWrapped[i];
+                if (sw >= 0 && tw >= 0)
+                    sum += (floatLevel ? (*floatLevel)(sw, tw) :
+                            texel(level, sw, tw, &pins)) * weight;
                 sumWts += weight;
             }
         }
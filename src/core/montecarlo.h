@@ -182,14 +182,14 @@ void Shuffle(T *samp, uint32_t count, uint32_t dims, RNG &rng) {
 
 
 void LatinHypercube(float *samples, uint32_t nSamples, uint32_t nDim, RNG &rng);
-inline double RadicalInverse(int n, int base) {
+inline double RadicalInverse(uint64_t n, int base) {
     double val = 0;
     double invBase = 1. / base, invBi = invBase;
     while (n > 0) {
         // Compute next digit of radical inverse
-        int d_i = (n % base);
+        int d_i = int(n % base);
         val += d_i * invBi;
-        n *= invBase;
+        n /= base;
         invBi *= invBase;
     }
     return val;
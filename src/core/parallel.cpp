@@ -43,10 +43,14 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/param.h>
+#if !defined(PBRT_IS_LINUX)
 #include <sys/sysctl.h>
+#endif // !PBRT_IS_LINUX
 #include <errno.h>
+#include <sched.h>
 #endif 
 #include <list>
+#include <deque>
 
 // Parallel Local Declarations
 #if defined(PBRT_IS_WINDOWS)
@@ -58,8 +62,28 @@ static pthread_t *threads;
 static dispatch_queue_t gcdQueue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
 static dispatch_group_t gcdGroup = dispatch_group_create();
 #else
-static Mutex *taskQueueMutex = Mutex::Create();
-static std::vector<Task *> taskQueue;
+// A _WorkItem_ records a queued task along with the pending-children
+// counter of the task that spawned it (or NULL for top-level tasks).
+struct WorkItem {
+    WorkItem(Task *t = NULL, AtomicInt32 *p = NULL) : task(t), parentPending(p) { }
+    Task *task;
+    AtomicInt32 *parentPending;
+};
+
+
+// Each worker thread owns a _WorkerQueue_; the owner pushes and pops at
+// the back while idle workers steal from the front.
+struct WorkerQueue {
+    Mutex *mutex;
+    std::deque<WorkItem> items;
+};
+
+
+static WorkerQueue *workerQueues;
+static AtomicInt32 nextQueue;
+static volatile bool shutdownWorkers;
+static PBRT_THREAD_LOCAL int workerIndex = -1;
+static PBRT_THREAD_LOCAL AtomicInt32 *currentPending;
 #endif // PBRT_USE_GRAND_CENTRAL_DISPATCH
 #ifndef PBRT_USE_GRAND_CENTRAL_DISPATCH
 static Semaphore *workerSemaphore;
@@ -728,6 +752,10 @@ void TasksInit() {
     static const int nThreads = NumSystemCores();
     workerSemaphore = new Semaphore;
     tasksRunningCondition = new ConditionVariable;
+    workerQueues = new WorkerQueue[nThreads];
+    for (int i = 0; i < nThreads; ++i)
+        workerQueues[i].mutex = Mutex::Create();
+    shutdownWorkers = false;
 #if !defined(PBRT_IS_WINDOWS)
     threads = new pthread_t[nThreads];
     for (int i = 0; i < nThreads; ++i) {
@@ -753,13 +781,15 @@ void TasksCleanup() {
 #ifdef PBRT_USE_GRAND_CENTRAL_DISPATCH
     return;
 #else // // PBRT_USE_GRAND_CENTRAL_DISPATCH
-    if (!taskQueueMutex || !workerSemaphore)
+    if (!workerQueues || !workerSemaphore)
         return;
-    { MutexLock lock(*taskQueueMutex);
-    Assert(taskQueue.size() == 0);
+    static const int nThreads = NumSystemCores();
+    for (int i = 0; i < nThreads; ++i) {
+        MutexLock lock(*workerQueues[i].mutex);
+        Assert(workerQueues[i].items.size() == 0);
     }
 
-    static const int nThreads = NumSystemCores();
+    shutdownWorkers = true;
     if (workerSemaphore != NULL)
         workerSemaphore->Post(nThreads);
 
@@ -779,6 +809,10 @@ void TasksCleanup() {
         delete[] threads;
         threads = NULL;
     }
+    for (int i = 0; i < nThreads; ++i)
+        Mutex::Destroy(workerQueues[i].mutex);
+    delete[] workerQueues;
+    workerQueues = NULL;
 #endif // PBRT_USE_GRAND_CENTRAL_DISPATCH
 }
 
@@ -796,6 +830,72 @@ static void lRunTask(void *t) {
 }
 
 
+#else
+static bool lGetWork(WorkItem *item) {
+    static const int nThreads = NumSystemCores();
+    // Pop the most recently pushed item from this thread's own queue
+    if (workerIndex >= 0) {
+        WorkerQueue &q = workerQueues[workerIndex];
+        MutexLock lock(*q.mutex);
+        if (q.items.size() > 0) {
+            *item = q.items.back();
+            q.items.pop_back();
+            return true;
+        }
+    }
+
+    // Steal the oldest item from another thread's queue
+    int start = max(workerIndex, 0);
+    for (int i = 1; i <= nThreads; ++i) {
+        WorkerQueue &q = workerQueues[(start + i) % nThreads];
+        MutexLock lock(*q.mutex);
+        if (q.items.size() > 0) {
+            *item = q.items.front();
+            q.items.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+
+static void lRunWorkItem(const WorkItem &item);
+static void lWaitForChildren(AtomicInt32 *pending) {
+    // Run other queued tasks until all children of the current task finish
+    while (*pending > 0) {
+        WorkItem item;
+        if (lGetWork(&item))
+            lRunWorkItem(item);
+        else
+            YieldThread();
+    }
+}
+
+
+static void lRunWorkItem(const WorkItem &item) {
+    // Run _item.task_, tracking tasks that it spawns in _pending_
+    AtomicInt32 pending = 0;
+    AtomicInt32 *savedPending = currentPending;
+    currentPending = &pending;
+    PBRT_STARTED_TASK(item.task);
+    item.task->Run();
+    lWaitForChildren(&pending);
+    PBRT_FINISHED_TASK(item.task);
+    currentPending = savedPending;
+
+    // Notify parent task or _WaitForAllTasks()_ of task completion
+    if (item.parentPending)
+        AtomicAdd(item.parentPending, -1);
+    else {
+        tasksRunningCondition->Lock();
+        int unfinished = --numUnfinishedTasks;
+        if (unfinished == 0)
+            tasksRunningCondition->Signal();
+        tasksRunningCondition->Unlock();
+    }
+}
+
+
 #endif
 void EnqueueTasks(const vector<Task *> &tasks) {
     if (PbrtOptions.nCores == 1) {
@@ -809,15 +909,28 @@ void EnqueueTasks(const vector<Task *> &tasks) {
 #else
     if (!threads)
         TasksInit();
+    static const int nThreads = NumSystemCores();
 
-    { MutexLock lock(*taskQueueMutex);
-    for (unsigned int i = 0; i < tasks.size(); ++i)
-        taskQueue.push_back(tasks[i]);
+    if (workerIndex >= 0) {
+        // Push tasks spawned by a running task onto this worker's queue
+        AtomicAdd(currentPending, (int32_t)tasks.size());
+        WorkerQueue &q = workerQueues[workerIndex];
+        MutexLock lock(*q.mutex);
+        for (unsigned int i = 0; i < tasks.size(); ++i)
+            q.items.push_back(WorkItem(tasks[i], currentPending));
+    }
+    else {
+        // Distribute top-level tasks across worker queues
+        tasksRunningCondition->Lock();
+        numUnfinishedTasks += tasks.size();
+        tasksRunningCondition->Unlock();
+        for (unsigned int i = 0; i < tasks.size(); ++i) {
+            int index = (AtomicAdd(&nextQueue, 1) & 0x7fffffff) % nThreads;
+            WorkerQueue &q = workerQueues[index];
+            MutexLock lock(*q.mutex);
+            q.items.push_back(WorkItem(tasks[i], NULL));
+        }
     }
-    tasksRunningCondition->Lock();
-    numUnfinishedTasks += tasks.size();
-    tasksRunningCondition->Unlock();
-
     workerSemaphore->Post(tasks.size());
 #endif
 }
@@ -829,26 +942,15 @@ static DWORD WINAPI taskEntry(LPVOID arg) {
 #else
 static void *taskEntry(void *arg) {
 #endif
+    workerIndex = int(reinterpret_cast<intptr_t>(arg));
     while (true) {
         workerSemaphore->Wait();
-        // Try to get task from task queue
-        Task *myTask = NULL;
-        { MutexLock lock(*taskQueueMutex);
-        if (taskQueue.size() == 0)
+        // Run tasks until no worker has any left in its queue
+        WorkItem item;
+        while (lGetWork(&item))
+            lRunWorkItem(item);
+        if (shutdownWorkers)
             break;
-        myTask = taskQueue.back();
-        taskQueue.pop_back();
-        }
-
-        // Do work for _myTask_
-        PBRT_STARTED_TASK(myTask);
-        myTask->Run();
-        PBRT_FINISHED_TASK(myTask);
-        tasksRunningCondition->Lock();
-        int unfinished = --numUnfinishedTasks;
-        if (unfinished == 0)
-            tasksRunningCondition->Signal();
-        tasksRunningCondition->Unlock();
     }
     // Cleanup from task thread and exit
 #if !defined(PBRT_IS_WINDOWS)
@@ -865,6 +967,11 @@ void WaitForAllTasks() {
 #ifdef PBRT_USE_GRAND_CENTRAL_DISPATCH
     dispatch_group_wait(gcdGroup, DISPATCH_TIME_FOREVER);
 #else
+    if (workerIndex >= 0) {
+        // Wait for the tasks spawned by the currently running task
+        lWaitForChildren(currentPending);
+        return;
+    }
     if (!tasksRunningCondition)
         return;  // no tasks have been enqueued, so TasksInit() never called
     tasksRunningCondition->Lock();
@@ -875,6 +982,15 @@ void WaitForAllTasks() {
 }
 
 
+void YieldThread() {
+#if defined(PBRT_IS_WINDOWS)
+    SwitchToThread();
+#else
+    sched_yield();
+#endif // PBRT_IS_WINDOWS
+}
+
+
 int NumSystemCores() {
     if (PbrtOptions.nCores > 0) return PbrtOptions.nCores;
 #if defined(PBRT_IS_WINDOWS)
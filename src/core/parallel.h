@@ -64,11 +64,13 @@
 	#ifdef PBRT_HAS_64_BIT_ATOMICS
 		typedef volatile LONGLONG AtomicInt64;
 	#endif // 64-bit
+	#define PBRT_THREAD_LOCAL __declspec(thread)
 #else
 	typedef volatile int32_t AtomicInt32;
 	#ifdef PBRT_HAS_64_BIT_ATOMICS
 		typedef volatile int64_t AtomicInt64;
 	#endif
+	#define PBRT_THREAD_LOCAL __thread
 #endif // !PBRT_IS_WINDOWS
 inline int32_t AtomicAdd(AtomicInt32 *v, int32_t delta) {
     PBRT_ATOMIC_MEMORY_OP();
@@ -341,6 +343,44 @@ public:
 
 void EnqueueTasks(const vector<Task *> &tasks);
 void WaitForAllTasks();
+void YieldThread();
 int NumSystemCores();
+template <typename Func> class ParallelForTask : public Task {
+public:
+    // ParallelForTask Public Methods
+    ParallelForTask(const Func &f, int s, int e)
+        : func(f), start(s), end(e) { }
+    void Run() {
+        for (int i = start; i < end; ++i)
+            func(i);
+    }
+private:
+    // ParallelForTask Private Data
+    const Func &func;
+    int start, end;
+};
+
+
+template <typename Func>
+void ParallelFor(int start, int end, int grain, const Func &func) {
+    // Run loop serially if it is too small to be worth splitting up
+    grain = max(grain, 1);
+    if (PbrtOptions.nCores == 1 || end - start <= grain) {
+        for (int i = start; i < end; ++i)
+            func(i);
+        return;
+    }
+
+    // Launch a task for each _grain_-sized chunk of the loop
+    vector<Task *> tasks;
+    tasks.reserve((end - start + grain - 1) / grain);
+    for (int i = start; i < end; i += grain)
+        tasks.push_back(new ParallelForTask<Func>(func, i, min(i + grain, end)));
+    EnqueueTasks(tasks);
+    WaitForAllTasks();
+    for (uint32_t i = 0; i < tasks.size(); ++i)
+        delete tasks[i];
+}
+
 
 #endif // PBRT_CORE_PARALLEL_H
@@ -34,6 +34,7 @@
 #include "stdafx.h"
 #include "paramset.h"
 #include "floatfile.h"
+#include "parallel.h"
 #include "textures/constant.h"
 
 // ParamSet Macros
@@ -150,10 +151,12 @@ void ParamSet::AddSampledSpectrum(const string &name, const float *data,
 }
 
 
+static Mutex *cachedSpectraMutex = Mutex::Create();
 void ParamSet::AddSampledSpectrumFiles(const string &name, const char **names,
         int nItems) {
     EraseSpectrum(name);
     Spectrum *s = new Spectrum[nItems];
+    MutexLock lock(*cachedSpectraMutex);
     for (int i = 0; i < nItems; ++i) {
         string fn = AbsolutePath(ResolveFilename(names[i]));
         if (cachedSpectra.find(fn) != cachedSpectra.end()) {
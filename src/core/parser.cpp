@@ -30,39 +30,1189 @@
  */
 
 
+
 // core/parser.cpp*
 #include "stdafx.h"
 #include "parser.h"
+#include "api.h"
+#include "paramset.h"
 #include "fileutil.h"
+#include "memory.h"
+#include "stats.h"
+#include <set>
+#ifdef PBRT_HAS_ZLIB
+#include <zlib.h>
+#endif // PBRT_HAS_ZLIB
 
-// Parsing Global Interface
-bool ParseFile(const string &filename) {
-    extern FILE *yyin;
-    extern int yyparse(void);
-    extern string current_file;
-    extern int line_num;
-    extern int yydebug;
+// Parsing Global Variables
+PBRT_THREAD_LOCAL int line_num = 0;
+PBRT_THREAD_LOCAL const char *current_file = NULL;
+
+// Parsing Local Declarations
+static const size_t SCENE_READ_CHUNK = 256 * 1024;
+
+static inline bool IsDelimiter(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '[' ||
+           c == ']' || c == '"' || c == '#';
+}
+
+
+static inline bool IsIdentifierChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c >= '0' && c <= '9') || c == '_';
+}
+
+
+static inline bool IsNumberStart(int c) {
+    return (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.';
+}
+
+
+static void SyntaxError(int line, const char *expected, int found) {
+    line_num = line;
+    if (found == EOF)
+        Error("Parsing error: expected %s, found end of file", expected);
+    else
+        Error("Parsing error: expected %s, found '%c'", expected, char(found));
+    exit(1);
+}
+
+
+// SceneTokenizer Declarations
+class SceneTokenizer {
+public:
+    // SceneTokenizer Public Methods
+    static SceneTokenizer *Open(const string &filename);
+    ~SceneTokenizer();
+    int Peek();
+    void Skip() { ++pos; }
+    bool SkipOpenBracket() {
+        if (Peek() != '[') return false;
+        ++pos;
+        return true;
+    }
+    void ReadIdentifier(string *s);
+    void ReadString(string *s);
+    double ReadNumber();
+    int ReadInt();
+    void ReadNumbers(vector<float> *v, bool bracketed);
+    void ReadInts(vector<int> *v, bool bracketed);
+    void ReadStrings(vector<string> *v, bool bracketed);
+
+    // SceneTokenizer Public Data
+    int line;
+private:
+    // SceneTokenizer Private Methods
+    SceneTokenizer();
+    bool Refill();
+    size_t ScanToken(bool identifier);
+
+    // SceneTokenizer Private Data
+    const char *pos, *end;
+    Reference<MappedFile> mapped;
+    FILE *fp;
+#ifdef PBRT_HAS_ZLIB
+    gzFile gz;
+#endif // PBRT_HAS_ZLIB
+    char *buffer;
+    size_t bufferSize;
+};
+
+
+
+// SceneTokenizer Method Definitions
+SceneTokenizer::SceneTokenizer() {
+    line = 1;
+    pos = end = NULL;
+    fp = NULL;
+#ifdef PBRT_HAS_ZLIB
+    gz = NULL;
+#endif // PBRT_HAS_ZLIB
+    buffer = NULL;
+    bufferSize = 0;
+}
+
+
+SceneTokenizer *SceneTokenizer::Open(const string &filename) {
+    SceneTokenizer *t = new SceneTokenizer;
+    if (filename == "-") {
+        t->fp = stdin;
+        return t;
+    }
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f) {
+        delete t;
+        return NULL;
+    }
+    // Check for gzip-compressed scene files
+    unsigned char magic[2];
+    size_t nMagic = fread(magic, 1, 2, f);
+    if (nMagic == 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+        fclose(f);
+#ifdef PBRT_HAS_ZLIB
+        t->gz = gzopen(filename.c_str(), "rb");
+        if (!t->gz) {
+            delete t;
+            return NULL;
+        }
+        gzbuffer(t->gz, SCENE_READ_CHUNK);
+        return t;
+#else
+        Error("Scene file \"%s\" is gzip-compressed, but pbrt was built "
+              "without zlib support", filename.c_str());
+        delete t;
+        return NULL;
+#endif // PBRT_HAS_ZLIB
+    }
+
+    // Map regular files into memory, stream everything else
+    if (nMagic > 0 && fseek(f, 0, SEEK_END) == 0 && ftell(f) > 0) {
+        t->mapped = MappedFile::Open(filename);
+        if (t->mapped) {
+            fclose(f);
+            t->pos = (const char *)t->mapped->Data();
+            t->end = t->pos + t->mapped->Size();
+            return t;
+        }
+    }
+    rewind(f);
+    t->fp = f;
+    return t;
+}
+
+
+SceneTokenizer::~SceneTokenizer() {
+    if (fp && fp != stdin) fclose(fp);
+#ifdef PBRT_HAS_ZLIB
+    if (gz) gzclose(gz);
+#endif // PBRT_HAS_ZLIB
+    delete[] buffer;
+}
+
+
+bool SceneTokenizer::Refill() {
+    if (mapped) return false;
+    // Move unread characters to the start of the buffer, growing it if needed
+    size_t unread = end - pos;
+    if (unread + SCENE_READ_CHUNK > bufferSize) {
+        size_t newSize = max(2 * bufferSize, unread + SCENE_READ_CHUNK);
+        char *newBuffer = new char[newSize];
+        if (unread > 0) memcpy(newBuffer, pos, unread);
+        delete[] buffer;
+        buffer = newBuffer;
+        bufferSize = newSize;
+    }
+    else if (unread > 0)
+        memmove(buffer, pos, unread);
+    pos = buffer;
+    end = buffer + unread;
+
+    // Read the next chunk of the scene description
+    size_t nRead = 0;
+#ifdef PBRT_HAS_ZLIB
+    if (gz) {
+        int n = gzread(gz, buffer + unread, (unsigned int)(bufferSize - unread));
+        if (n < 0) Error("Error decompressing scene file \"%s\"",
+                         current_file);
+        nRead = n > 0 ? size_t(n) : 0;
+    }
+    else
+#endif // PBRT_HAS_ZLIB
+    if (fp)
+        nRead = fread(buffer + unread, 1, bufferSize - unread, fp);
+    end += nRead;
+    return nRead > 0;
+}
 
-    if (getenv("PBRT_YYDEBUG") != NULL)
-        yydebug = 1;
 
-    if (filename == "-")
-        yyin = stdin;
+int SceneTokenizer::Peek() {
+    // Skip whitespace and comments, returning the next unread character
+    for (;;) {
+        if (pos == end && !Refill()) return EOF;
+        char c = *pos;
+        if (c == ' ' || c == '\t' || c == '\r')
+            ++pos;
+        else if (c == '\n') {
+            ++line;
+            ++pos;
+        }
+        else if (c == '#') {
+            for (;;) {
+                const char *nl = (const char *)memchr(pos, '\n', end - pos);
+                if (nl) {
+                    pos = nl;
+                    break;
+                }
+                pos = end;
+                if (!Refill()) return EOF;
+            }
+        }
+        else
+            return (unsigned char)c;
+    }
+}
+
+
+size_t SceneTokenizer::ScanToken(bool identifier) {
+    // Return the length of the token at _pos_, refilling to keep it contiguous
+    size_t n = 0;
+    for (;;) {
+        if (identifier)
+            while (pos + n < end && IsIdentifierChar(pos[n])) ++n;
+        else
+            while (pos + n < end && !IsDelimiter(pos[n])) ++n;
+        if (pos + n < end || !Refill()) return n;
+    }
+}
+
+
+void SceneTokenizer::ReadIdentifier(string *s) {
+    size_t n = ScanToken(true);
+    s->assign(pos, n);
+    pos += n;
+}
+
+
+void SceneTokenizer::ReadString(string *s) {
+    int c = Peek();
+    if (c != '"') SyntaxError(line, "string", c);
+    ++pos;
+    s->clear();
+    for (;;) {
+        if (pos == end && !Refill()) {
+            line_num = line;
+            Error("Unterminated string!");
+            return;
+        }
+        // Append characters up to the next quote, escape, or newline
+        const char *start = pos;
+        while (pos < end && *pos != '"' && *pos != '\\' && *pos != '\n')
+            ++pos;
+        s->append(start, pos - start);
+        if (pos == end) continue;
+        char ch = *pos++;
+        if (ch == '"')
+            return;
+        else if (ch == '\n') {
+            line_num = line;
+            Error("Unterminated string!");
+            ++line;
+            return;
+        }
+
+        // Handle escape sequence in string
+        while (end - pos < 3 && Refill())
+            ;
+        if (pos == end) continue;
+        ch = *pos++;
+        switch (ch) {
+        case 'n': s->push_back('\n'); break;
+        case 't': s->push_back('\t'); break;
+        case 'r': s->push_back('\r'); break;
+        case 'b': s->push_back('\b'); break;
+        case 'f': s->push_back('\f'); break;
+        case '\n': ++line; break;
+        default:
+            if (end - pos >= 2 && isdigit(ch) && isdigit(pos[0]) &&
+                isdigit(pos[1])) {
+                int val = 100 * (ch - '0') + 10 * (pos[0] - '0') + (pos[1] - '0');
+                while (val > 256)
+                    val -= 256;
+                s->push_back(char(val));
+                pos += 2;
+            }
+            else
+                s->push_back(ch);
+            break;
+        }
+    }
+}
+
+
+static bool ParseNumber(const char *str, const char *strEnd, double *v) {
+    static const double powersOfTen[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    // Decompose number into sign, integer mantissa, and decimal exponent
+    const char *p = str;
+    bool negative = false;
+    if (p < strEnd && (*p == '-' || *p == '+'))
+        negative = (*p++ == '-');
+    uint64_t mantissa = 0;
+    int exponent = 0, nDigits = 0, nSignificant = 0;
+    while (p < strEnd && *p >= '0' && *p <= '9') {
+        if (mantissa != 0 || *p != '0') ++nSignificant;
+        mantissa = 10 * mantissa + (*p++ - '0');
+        ++nDigits;
+    }
+    if (p < strEnd && *p == '.') {
+        ++p;
+        while (p < strEnd && *p >= '0' && *p <= '9') {
+            if (mantissa != 0 || *p != '0') ++nSignificant;
+            mantissa = 10 * mantissa + (*p++ - '0');
+            --exponent;
+            ++nDigits;
+        }
+    }
+    if (nDigits == 0) return false;
+    if (p < strEnd && (*p == 'e' || *p == 'E')) {
+        ++p;
+        bool negativeExp = false;
+        if (p < strEnd && (*p == '-' || *p == '+'))
+            negativeExp = (*p++ == '-');
+        if (p == strEnd || *p < '0' || *p > '9') return false;
+        int e = 0;
+        while (p < strEnd && *p >= '0' && *p <= '9') {
+            if (e < 100000) e = 10 * e + (*p - '0');
+            ++p;
+        }
+        exponent += negativeExp ? -e : e;
+    }
+    if (p != strEnd) return false;
+
+    // Compute exactly rounded value when mantissa and power of ten are exact
+    if (nSignificant <= 15 && exponent >= -22 && exponent <= 22) {
+        double d = double(mantissa);
+        d = (exponent < 0) ? d / powersOfTen[-exponent] :
+                             d * powersOfTen[exponent];
+        *v = negative ? -d : d;
+        return true;
+    }
+    string s(str, strEnd);
+    *v = strtod(s.c_str(), NULL);
+    return true;
+}
+
+
+double SceneTokenizer::ReadNumber() {
+    int c = Peek();
+    if (!IsNumberStart(c)) SyntaxError(line, "number", c);
+    size_t n = ScanToken(false);
+    double v;
+    if (!ParseNumber(pos, pos + n, &v)) {
+        line_num = line;
+        Error("Parsing error: illegal number \"%s\"", string(pos, n).c_str());
+        exit(1);
+    }
+    pos += n;
+    return v;
+}
+
+
+int SceneTokenizer::ReadInt() {
+    int c = Peek();
+    if (!IsNumberStart(c)) SyntaxError(line, "number", c);
+    size_t n = ScanToken(false);
+    // Handle common case of small integer without fraction or exponent
+    const char *p = pos, *tokenEnd = pos + n;
+    bool negative = false;
+    if (p < tokenEnd && (*p == '-' || *p == '+'))
+        negative = (*p++ == '-');
+    if (p < tokenEnd && tokenEnd - p <= 9) {
+        int v = 0;
+        while (p < tokenEnd && *p >= '0' && *p <= '9')
+            v = 10 * v + (*p++ - '0');
+        if (p == tokenEnd) {
+            pos = tokenEnd;
+            return negative ? -v : v;
+        }
+    }
+    // Integer parameter values have always been converted from floats
+    return int(float(ReadNumber()));
+}
+
+
+void SceneTokenizer::ReadNumbers(vector<float> *v, bool bracketed) {
+    // Read single value or bracketed array of numbers into _v_
+    v->clear();
+    do {
+        v->push_back(float(ReadNumber()));
+    } while (bracketed && Peek() != ']');
+    if (bracketed) ++pos;
+}
+
+
+void SceneTokenizer::ReadInts(vector<int> *v, bool bracketed) {
+    v->clear();
+    do {
+        v->push_back(ReadInt());
+    } while (bracketed && Peek() != ']');
+    if (bracketed) ++pos;
+}
+
+
+void SceneTokenizer::ReadStrings(vector<string> *v, bool bracketed) {
+    v->clear();
+    do {
+        v->push_back(string());
+        ReadString(&v->back());
+    } while (bracketed && Peek() != ']');
+    if (bracketed) ++pos;
+}
+
+
+// Parameter List Declarations
+enum { PARAM_TYPE_INT, PARAM_TYPE_BOOL, PARAM_TYPE_FLOAT, PARAM_TYPE_POINT,
+    PARAM_TYPE_VECTOR, PARAM_TYPE_NORMAL, PARAM_TYPE_RGB, PARAM_TYPE_XYZ,
+    PARAM_TYPE_BLACKBODY, PARAM_TYPE_SPECTRUM,
+    PARAM_TYPE_STRING, PARAM_TYPE_TEXTURE, PARAM_TYPE_UNKNOWN };
+struct ParamListItem {
+    string declaration, name;
+    int type;
+    bool isString;
+    vector<float> floats;
+    vector<int> ints;
+    vector<string> strings;
+};
+
+
+static const char *paramTypeToName(int type) {
+    switch (type) {
+    case PARAM_TYPE_INT: return "int";
+    case PARAM_TYPE_BOOL: return "bool";
+    case PARAM_TYPE_FLOAT: return "float";
+    case PARAM_TYPE_POINT: return "point";
+    case PARAM_TYPE_VECTOR: return "vector";
+    case PARAM_TYPE_NORMAL: return "normal";
+    case PARAM_TYPE_RGB: return "rgb/color";
+    case PARAM_TYPE_XYZ: return "xyz";
+    case PARAM_TYPE_BLACKBODY: return "blackbody";
+    case PARAM_TYPE_SPECTRUM: return "spectrum";
+    case PARAM_TYPE_STRING: return "string";
+    case PARAM_TYPE_TEXTURE: return "texture";
+    default: Severe("Error in paramTypeToName"); return NULL;
+    }
+}
+
+
+static bool lookupType(const char *name, int *type, string &sname) {
+    Assert(name != NULL);
+    *type = 0;
+    const char *strp = name;
+    while (*strp && isspace(*strp))
+        ++strp;
+    if (!*strp) {
+        Error("Parameter \"%s\" doesn't have a type declaration?!", name);
+        return false;
+    }
+#define TRY_DECODING_TYPE(name, mask) \
+        if (strncmp(name, strp, strlen(name)) == 0) { \
+            *type = mask; strp += strlen(name); \
+        }
+         TRY_DECODING_TYPE("float",     PARAM_TYPE_FLOAT)
+    else TRY_DECODING_TYPE("integer",   PARAM_TYPE_INT)
+    else TRY_DECODING_TYPE("bool",      PARAM_TYPE_BOOL)
+    else TRY_DECODING_TYPE("point",     PARAM_TYPE_POINT)
+    else TRY_DECODING_TYPE("vector",    PARAM_TYPE_VECTOR)
+    else TRY_DECODING_TYPE("normal",    PARAM_TYPE_NORMAL)
+    else TRY_DECODING_TYPE("string",    PARAM_TYPE_STRING)
+    else TRY_DECODING_TYPE("texture",   PARAM_TYPE_TEXTURE)
+    else TRY_DECODING_TYPE("color",     PARAM_TYPE_RGB)
+    else TRY_DECODING_TYPE("rgb",       PARAM_TYPE_RGB)
+    else TRY_DECODING_TYPE("xyz",       PARAM_TYPE_XYZ)
+    else TRY_DECODING_TYPE("blackbody", PARAM_TYPE_BLACKBODY)
+    else TRY_DECODING_TYPE("spectrum",  PARAM_TYPE_SPECTRUM)
     else {
-        yyin = fopen(filename.c_str(), "r");
-        SetSearchDirectory(DirectoryContaining(filename));
+        Error("Unable to decode type for name \"%s\"", name);
+        return false;
+    }
+#undef TRY_DECODING_TYPE
+    while (*strp && isspace(*strp))
+        ++strp;
+    sname = string(strp);
+    return true;
+}
+
+
+// SceneParser Declarations
+class IncludeScheduler;
+struct IncludeStatements {
+    // IncludeStatements Public Methods
+    IncludeStatements() { count = completed = 0; quiet = false; }
+    void BeginReplay() {
+        // Re-parse statements of the parallel parse without reporting them
+        count = 0;
+        quiet = (completed > 0);
+        if (quiet) {
+            StatsSuppress(true);
+            SuppressDiagnostics(true);
+        }
+    }
+    void Next() {
+        if (quiet && count == completed) EndReplay();
+        ++count;
+    }
+    void EndReplay() {
+        if (!quiet) return;
+        StatsSuppress(false);
+        SuppressDiagnostics(false);
+        quiet = false;
+    }
+
+    // IncludeStatements Public Data
+    int count, completed;
+    bool quiet;
+};
+
+
+class SceneParser {
+public:
+    // SceneParser Public Methods
+    SceneParser(SceneTokenizer *t, int depth, IncludeScheduler *s,
+                DeferredInclude *di, IncludeStatements *st) {
+        in = t;
+        includeDepth = depth;
+        scheduler = s;
+        include = di;
+        statements = st;
+        nParams = 0;
+    }
+    void Parse();
+private:
+    // SceneParser Private Methods
+    void ReadParamList();
+    void ReadNameAndParams(string *name, ParamSet *ps, SpectrumType type) {
+        in->ReadString(name);
+        ReadParamList();
+        InitParamSet(*ps, type);
     }
+    void InitParamSet(ParamSet &ps, SpectrumType type);
+    void Include(const string &filename);
 
-    if (yyin != NULL) {
-        current_file = filename;
-        if (yyin == stdin) current_file = "<standard input>";
+    // SceneParser Private Data
+    SceneTokenizer *in;
+    int includeDepth;
+    IncludeScheduler *scheduler;
+    DeferredInclude *include;
+    IncludeStatements *statements;
+    vector<ParamListItem> params;
+    uint32_t nParams;
+};
+
+
+enum { KEYWORD_ACCELERATOR, KEYWORD_ACTIVETRANSFORM, KEYWORD_AREALIGHTSOURCE,
+    KEYWORD_ATTRIBUTEBEGIN, KEYWORD_ATTRIBUTEEND, KEYWORD_CAMERA,
+    KEYWORD_CONCATTRANSFORM, KEYWORD_COORDINATESYSTEM,
+    KEYWORD_COORDSYSTRANSFORM, KEYWORD_FILM, KEYWORD_IDENTITY,
+    KEYWORD_INCLUDE, KEYWORD_LIGHTSOURCE, KEYWORD_LOOKAT,
+    KEYWORD_MAKENAMEDMATERIAL, KEYWORD_MATERIAL, KEYWORD_NAMEDMATERIAL,
+    KEYWORD_OBJECTBEGIN, KEYWORD_OBJECTEND, KEYWORD_OBJECTINSTANCE,
+    KEYWORD_PIXELFILTER, KEYWORD_RENDERER, KEYWORD_REVERSEORIENTATION,
+    KEYWORD_ROTATE, KEYWORD_SAMPLER, KEYWORD_SCALE, KEYWORD_SHAPE,
+    KEYWORD_SURFACEINTEGRATOR, KEYWORD_TEXTURE, KEYWORD_TRANSFORMBEGIN,
+    KEYWORD_TRANSFORMEND, KEYWORD_TRANSFORMTIMES, KEYWORD_TRANSFORM,
+    KEYWORD_TRANSLATE, KEYWORD_VOLUME, KEYWORD_VOLUMEINTEGRATOR,
+    KEYWORD_WORLDBEGIN, KEYWORD_WORLDEND, KEYWORD_UNKNOWN };
+static const struct { const char *name; int keyword; } keywords[] = {
+    { "Accelerator", KEYWORD_ACCELERATOR },
+    { "ActiveTransform", KEYWORD_ACTIVETRANSFORM },
+    { "AreaLightSource", KEYWORD_AREALIGHTSOURCE },
+    { "AttributeBegin", KEYWORD_ATTRIBUTEBEGIN },
+    { "AttributeEnd", KEYWORD_ATTRIBUTEEND },
+    { "Camera", KEYWORD_CAMERA },
+    { "ConcatTransform", KEYWORD_CONCATTRANSFORM },
+    { "CoordinateSystem", KEYWORD_COORDINATESYSTEM },
+    { "CoordSysTransform", KEYWORD_COORDSYSTRANSFORM },
+    { "Film", KEYWORD_FILM },
+    { "Identity", KEYWORD_IDENTITY },
+    { "Include", KEYWORD_INCLUDE },
+    { "LightSource", KEYWORD_LIGHTSOURCE },
+    { "LookAt", KEYWORD_LOOKAT },
+    { "MakeNamedMaterial", KEYWORD_MAKENAMEDMATERIAL },
+    { "Material", KEYWORD_MATERIAL },
+    { "NamedMaterial", KEYWORD_NAMEDMATERIAL },
+    { "ObjectBegin", KEYWORD_OBJECTBEGIN },
+    { "ObjectEnd", KEYWORD_OBJECTEND },
+    { "ObjectInstance", KEYWORD_OBJECTINSTANCE },
+    { "PixelFilter", KEYWORD_PIXELFILTER },
+    { "Renderer", KEYWORD_RENDERER },
+    { "ReverseOrientation", KEYWORD_REVERSEORIENTATION },
+    { "Rotate", KEYWORD_ROTATE },
+    { "Sampler", KEYWORD_SAMPLER },
+    { "Scale", KEYWORD_SCALE },
+    { "Shape", KEYWORD_SHAPE },
+    { "SurfaceIntegrator", KEYWORD_SURFACEINTEGRATOR },
+    { "Texture", KEYWORD_TEXTURE },
+    { "TransformBegin", KEYWORD_TRANSFORMBEGIN },
+    { "TransformEnd", KEYWORD_TRANSFORMEND },
+    { "TransformTimes", KEYWORD_TRANSFORMTIMES },
+    { "Transform", KEYWORD_TRANSFORM },
+    { "Translate", KEYWORD_TRANSLATE },
+    { "Volume", KEYWORD_VOLUME },
+    { "VolumeIntegrator", KEYWORD_VOLUMEINTEGRATOR },
+    { "WorldBegin", KEYWORD_WORLDBEGIN },
+    { "WorldEnd", KEYWORD_WORLDEND },
+};
+
+
+static int lookupKeyword(const string &name) {
+    for (uint32_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); ++i)
+        if (name == keywords[i].name) return keywords[i].keyword;
+    return KEYWORD_UNKNOWN;
+}
+
+
+
+// Parallel Include Local Declarations
+static StatsCounter includesParallel("Scene", "Includes parsed in parallel");
+static StatsCounter includesReparsed("Scene", "Includes re-parsed serially");
+class IncludeTask : public Task {
+public:
+    // IncludeTask Public Methods
+    IncludeTask(const string &fn, DeferredInclude *di, int depth)
+        : filename(fn), include(di), includeDepth(depth) {
+        includeFile = current_file ? current_file : "";
+        includeLine = line_num;
+    }
+    void Run() { Parse(false, NULL); }
+    void Replay(const DeferredInclude *previous) { Parse(true, previous); }
+private:
+    // IncludeTask Private Methods
+    void Parse(bool replay, const DeferredInclude *previous);
+
+    // IncludeTask Private Data
+    string filename, includeFile;
+    int includeLine;
+    DeferredInclude *include;
+    int includeDepth;
+    IncludeStatements statements;
+};
+
+
+struct PendingInclude {
+    IncludeTask *task;
+    DeferredInclude *include;
+    bool continuesChain;
+};
+
+
+class IncludeScheduler {
+public:
+    // IncludeScheduler Public Methods
+    IncludeScheduler() {
+        blockDepth = 0;
+        openDepth = -1;
+    }
+    bool Defer(const string &filename, int includeDepth);
+    void Statement(int keyword);
+    void ObjectBegin(const string &name);
+    void Sync();
+private:
+    // IncludeScheduler Private Data
+    vector<PendingInclude> pending;
+    int blockDepth, openDepth;
+    std::set<string> pendingInstances;
+};
+
+
+
+// Parallel Include Method Definitions
+void IncludeTask::Parse(bool replay, const DeferredInclude *previous) {
+    const char *savedFile = current_file;
+    int savedLine = line_num;
+    pbrtDeferredIncludeEnter(include, replay, previous);
+    if (replay) statements.BeginReplay();
+    SceneTokenizer *t = SceneTokenizer::Open(filename);
+    if (!t) {
+        // Report missing files once, from the serial re-parse
+        if (replay) {
+            current_file = includeFile.c_str();
+            line_num = includeLine;
+            Error("Unable to open included scene file \"%s\"",
+                  filename.c_str());
+        }
+        else
+            pbrtDeferredIncludeFail(include);
+    }
+    else {
+        current_file = filename.c_str();
         line_num = 1;
-        yyparse();
-        if (yyin != stdin) fclose(yyin);
+        SceneParser parser(t, includeDepth, NULL, replay ? NULL : include,
+                           &statements);
+        parser.Parse();
+        delete t;
+    }
+    if (replay) statements.EndReplay();
+    pbrtDeferredIncludeExit(include);
+    current_file = savedFile;
+    line_num = savedLine;
+}
+
+
+bool IncludeScheduler::Defer(const string &filename, int includeDepth) {
+    // Only includes inside attribute or object blocks are self-contained
+    if (blockDepth == 0) return false;
+    DeferredInclude *include = pbrtDeferredIncludeBegin();
+    if (!include) return false;
+    PendingInclude p;
+    p.task = new IncludeTask(filename, include, includeDepth);
+    p.include = include;
+    p.continuesChain = (openDepth >= 0);
+    pending.push_back(p);
+    vector<Task *> tasks(1, p.task);
+    EnqueueTasks(tasks);
+    openDepth = blockDepth;
+    return true;
+}
+
+
+void IncludeScheduler::Statement(int keyword) {
+    switch (keyword) {
+    case KEYWORD_INCLUDE:
+    case KEYWORD_OBJECTBEGIN:
+        // Handled by _Defer()_ and _ObjectBegin()_
+        break;
+    case KEYWORD_ATTRIBUTEEND:
+    case KEYWORD_OBJECTEND:
+        // Closing the block of pending includes discards their state
+        if (blockDepth > 0) --blockDepth;
+        if (blockDepth < openDepth) openDepth = -1;
+        break;
+    case KEYWORD_ACTIVETRANSFORM: case KEYWORD_AREALIGHTSOURCE:
+    case KEYWORD_ATTRIBUTEBEGIN: case KEYWORD_CONCATTRANSFORM:
+    case KEYWORD_IDENTITY:
+    case KEYWORD_LOOKAT: case KEYWORD_MAKENAMEDMATERIAL:
+    case KEYWORD_MATERIAL: case KEYWORD_NAMEDMATERIAL:
+    case KEYWORD_REVERSEORIENTATION: case KEYWORD_ROTATE:
+    case KEYWORD_SCALE: case KEYWORD_SHAPE: case KEYWORD_TRANSFORMBEGIN:
+    case KEYWORD_TRANSFORMEND: case KEYWORD_TRANSFORM:
+    case KEYWORD_TRANSLATE:
+        // Local statements only see state left by includes in their block
+        if (openDepth >= 0) Sync();
+        if (keyword == KEYWORD_ATTRIBUTEBEGIN) ++blockDepth;
+        break;
+    default:
+        // Global statements, including _CoordSysTransform_, which reads
+        // coordinate systems that pending includes may still define
+        Sync();
+        if (keyword == KEYWORD_WORLDBEGIN || keyword == KEYWORD_WORLDEND)
+            blockDepth = 0;
+        break;
+    }
+}
+
+
+void IncludeScheduler::ObjectBegin(const string &name) {
+    if (openDepth >= 0 || pendingInstances.find(name) != pendingInstances.end())
+        Sync();
+    pendingInstances.insert(name);
+    ++blockDepth;
+}
+
+
+void IncludeScheduler::Sync() {
+    pendingInstances.clear();
+    if (pending.size() == 0) return;
+    WaitForAllTasks();
+    // Re-parse includes that depended on state outside of their block
+    vector<DeferredInclude *> includes;
+    bool replayChain = false;
+    for (uint32_t i = 0; i < pending.size(); ++i) {
+        const PendingInclude &p = pending[i];
+        if (!p.continuesChain) replayChain = false;
+        if (replayChain || !pbrtDeferredIncludeIndependent(p.include)) {
+            p.task->Replay(replayChain ? pending[i-1].include : NULL);
+            replayChain = true;
+            ++includesReparsed;
+        }
+        else
+            ++includesParallel;
+        includes.push_back(p.include);
+        delete p.task;
+    }
+    pbrtDeferredIncludesCommit(includes, openDepth >= 0);
+    pending.erase(pending.begin(), pending.end());
+    openDepth = -1;
+}
+
+
+
+// SceneParser Method Definitions
+void SceneParser::Parse() {
+    string keyword, name, type, texname;
+    vector<float> nums;
+    for (;;) {
+        // Stop parsing a deferred include once it must be re-parsed serially
+        if (include && !pbrtDeferredIncludeIndependent(include)) return;
+        int c = in->Peek();
+        if (c == EOF) return;
+        line_num = in->line;
+        if (statements) statements->Next();
+        if (!IsIdentifierChar(char(c)) || (c >= '0' && c <= '9')) {
+            if (c == '"' || c == '[' || c == ']' || IsNumberStart(c))
+                SyntaxError(in->line, "statement", c);
+            Error("Illegal character: %c (0x%x)", char(c), c);
+            in->Skip();
+            continue;
+        }
+        in->ReadIdentifier(&keyword);
+        int kw = lookupKeyword(keyword);
+        if (scheduler) scheduler->Statement(kw);
+        ParamSet ps;
+        switch (kw) {
+        case KEYWORD_ACCELERATOR:
+            ReadNameAndParams(&name, &ps, SPECTRUM_REFLECTANCE);
+            pbrtAccelerator(name, ps);
+            break;
+        case KEYWORD_ACTIVETRANSFORM:
+            in->Peek();
+            in->ReadIdentifier(&name);
+            if (name == "All") pbrtActiveTransformAll();
+            else if (name == "EndTime") pbrtActiveTransformEndTime();
+            else if (name == "StartTime") pbrtActiveTransformStartTime();
+            else {
+                Error("Parsing error: unknown ActiveTransform type \"%s\"",
+                      name.c_str());
+                exit(1);
+            }
+            break;
+        case KEYWORD_AREALIGHTSOURCE:
+            ReadNameAndParams(&name, &ps, SPECTRUM_ILLUMINANT);
+            pbrtAreaLightSource(name, ps);
+            break;
+        case KEYWORD_ATTRIBUTEBEGIN:
+            pbrtAttributeBegin();
+            break;
+        case KEYWORD_ATTRIBUTEEND:
+            pbrtAttributeEnd();
+            break;
+        case KEYWORD_CAMERA:
+            ReadNameAndParams(&name, &ps, SPECTRUM_REFLECTANCE);
+            pbrtCamera(name, ps);
+            break;
+        case KEYWORD_CONCATTRANSFORM:
+            in->ReadNumbers(&nums, in->SkipOpenBracket());
+            if (nums.size() != 16)
+                Error("\"ConcatTransform\" requires a 16 element array! (%d found)",
+                      int(nums.size()));
+            else
+                pbrtConcatTransform(&nums[0]);
+            break;
+        case KEYWORD_COORDINATESYSTEM:
+            in->ReadString(&name);
+            pbrtCoordinateSystem(name);
+            break;
+        case KEYWORD_COORDSYSTRANSFORM:
+            in->ReadString(&name);
+            pbrtCoordSysTransform(name);
+            break;
+        case KEYWORD_FILM:
+            ReadNameAndParams(&name, &ps, SPECTRUM_REFLECTANCE);
+            pbrtFilm(name, ps);
+            break;
+        case KEYWORD_IDENTITY:
+            pbrtIdentity();
+            break;
+        case KEYWORD_INCLUDE:
+            in->ReadString(&name);
+            Include(name);
+            break;
+        case KEYWORD_LIGHTSOURCE:
+            ReadNameAndParams(&name, &ps, SPECTRUM_ILLUMINANT);
+            pbrtLightSource(name, ps);
+            break;
+        case KEYWORD_LOOKAT: {
+            float v[9];
+            for (int i = 0; i < 9; ++i)
+                v[i] = float(in->ReadNumber());
+            pbrtLookAt(v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8]);
+            break;
+        }
+        case KEYWORD_MAKENAMEDMATERIAL:
+            ReadNameAndParams(&name, &ps, SPECTRUM_REFLECTANCE);
+            pbrtMakeNamedMaterial(name, ps);
+            break;
+        case KEYWORD_MATERIAL:
+            ReadNameAndParams(&name, &ps, SPECTRUM_REFLECTANCE);
+            pbrtMaterial(name, ps);
+            break;
+        case KEYWORD_NAMEDMATERIAL:
+            in->ReadString(&name);
+            pbrtNamedMaterial(name);
+            break;
+        case KEYWORD_OBJECTBEGIN:
+            in->ReadString(&name);
+            if (scheduler) scheduler->ObjectBegin(name);
+            pbrtObjectBegin(name);
+            break;
+        case KEYWORD_OBJECTEND:
+            pbrtObjectEnd();
+            break;
+        case KEYWORD_OBJECTINSTANCE:
+            in->ReadString(&name);
+            pbrtObjectInstance(name);
+            break;
+        case KEYWORD_PIXELFILTER:
+            ReadNameAndParams(&name, &ps, SPECTRUM_REFLECTANCE);
+            pbrtPixelFilter(name, ps);
+            break;
+        case KEYWORD_RENDERER:
+            ReadNameAndParams(&name, &ps, SPECTRUM_REFLECTANCE);
+            pbrtRenderer(name, ps);
+            break;
+        case KEYWORD_REVERSEORIENTATION:
+            pbrtReverseOrientation();
+            break;
+        case KEYWORD_ROTATE: {
+            float v[4];
+            for (int i = 0; i < 4; ++i)
+                v[i] = float(in->ReadNumber());
+            pbrtRotate(v[0], v[1], v[2], v[3]);
+            break;
+        }
+        case KEYWORD_SAMPLER:
+            ReadNameAndParams(&name, &ps, SPECTRUM_REFLECTANCE);
+            pbrtSampler(name, ps);
+            break;
+        case KEYWORD_SCALE: {
+            float v[3];
+            for (int i = 0; i < 3; ++i)
+                v[i] = float(in->ReadNumber());
+            pbrtScale(v[0], v[1], v[2]);
+            break;
+        }
+        case KEYWORD_SHAPE:
+            ReadNameAndParams(&name, &ps, SPECTRUM_REFLECTANCE);
+            pbrtShape(name, ps);
+            break;
+        case KEYWORD_SURFACEINTEGRATOR:
+            ReadNameAndParams(&name, &ps, SPECTRUM_REFLECTANCE);
+            pbrtSurfaceIntegrator(name, ps);
+            break;
+        case KEYWORD_TEXTURE:
+            in->ReadString(&texname);
+            in->ReadString(&type);
+            ReadNameAndParams(&name, &ps, SPECTRUM_REFLECTANCE);
+            pbrtTexture(texname, type, name, ps);
+            break;
+        case KEYWORD_TRANSFORMBEGIN:
+            pbrtTransformBegin();
+            break;
+        case KEYWORD_TRANSFORMEND:
+            pbrtTransformEnd();
+            break;
+        case KEYWORD_TRANSFORMTIMES: {
+            float start = float(in->ReadNumber());
+            float end = float(in->ReadNumber());
+            pbrtTransformTimes(start, end);
+            break;
+        }
+        case KEYWORD_TRANSFORM:
+            in->ReadNumbers(&nums, in->SkipOpenBracket());
+            if (nums.size() != 16)
+                Error("\"Transform\" requires a 16 element array! (%d found)",
+                      int(nums.size()));
+            else
+                pbrtTransform(&nums[0]);
+            break;
+        case KEYWORD_TRANSLATE: {
+            float v[3];
+            for (int i = 0; i < 3; ++i)
+                v[i] = float(in->ReadNumber());
+            pbrtTranslate(v[0], v[1], v[2]);
+            break;
+        }
+        case KEYWORD_VOLUMEINTEGRATOR:
+            ReadNameAndParams(&name, &ps, SPECTRUM_REFLECTANCE);
+            pbrtVolumeIntegrator(name, ps);
+            break;
+        case KEYWORD_VOLUME:
+            ReadNameAndParams(&name, &ps, SPECTRUM_REFLECTANCE);
+            pbrtVolume(name, ps);
+            break;
+        case KEYWORD_WORLDBEGIN:
+            pbrtWorldBegin();
+            break;
+        case KEYWORD_WORLDEND:
+            pbrtWorldEnd();
+            break;
+        default:
+            Error("Parsing error: unknown statement \"%s\"", keyword.c_str());
+            exit(1);
+        }
+        // Record statements that the parallel parse processed completely
+        if (include && pbrtDeferredIncludeIndependent(include))
+            statements->completed = statements->count;
+    }
+}
+
+
+void SceneParser::ReadParamList() {
+    // Read parameters directly into arrays of their declared types
+    nParams = 0;
+    while (in->Peek() == '"') {
+        if (nParams == params.size()) params.push_back(ParamListItem());
+        ParamListItem &item = params[nParams++];
+        in->ReadString(&item.declaration);
+        line_num = in->line;
+        if (!lookupType(item.declaration.c_str(), &item.type, item.name))
+            item.type = PARAM_TYPE_UNKNOWN;
+        bool bracketed = in->SkipOpenBracket();
+        item.isString = (in->Peek() == '"');
+        if (item.isString)
+            in->ReadStrings(&item.strings, bracketed);
+        else if (item.type == PARAM_TYPE_INT)
+            in->ReadInts(&item.ints, bracketed);
+        else
+            in->ReadNumbers(&item.floats, bracketed);
+    }
+}
+
+
+void SceneParser::InitParamSet(ParamSet &ps, SpectrumType spectrumType) {
+    ps.Clear();
+    for (uint32_t i = 0; i < nParams; ++i) {
+        const ParamListItem &item = params[i];
+        int type = item.type;
+        const string &name = item.name;
+        if (type == PARAM_TYPE_UNKNOWN) {
+            Warning("Type of parameter \"%s\" is unknown",
+                item.declaration.c_str());
+            continue;
+        }
+        if (type == PARAM_TYPE_TEXTURE || type == PARAM_TYPE_STRING ||
+            type == PARAM_TYPE_BOOL) {
+            if (!item.isString) {
+                Error("Expected string parameter value for parameter \"%s\" with type \"%s\". Ignoring.",
+                      name.c_str(), paramTypeToName(type));
+                continue;
+            }
+        }
+        else if (type != PARAM_TYPE_SPECTRUM) { /* spectrum can be either... */
+            if (item.isString) {
+                Error("Expected numeric parameter value for parameter \"%s\" with type \"%s\".  Ignoring.",
+                      name.c_str(), paramTypeToName(type));
+                continue;
+            }
+        }
+        const float *data = item.floats.empty() ? NULL : &item.floats[0];
+        int nItems = item.isString ? int(item.strings.size()) :
+                     (type == PARAM_TYPE_INT) ? int(item.ints.size()) :
+                     int(item.floats.size());
+        if (type == PARAM_TYPE_INT)
+            ps.AddInt(name, &item.ints[0], nItems);
+        else if (type == PARAM_TYPE_BOOL) {
+            // strings -> bools
+            bool *bdata = new bool[nItems];
+            for (int j = 0; j < nItems; ++j) {
+                const string &s = item.strings[j];
+                if (s == "true") bdata[j] = true;
+                else if (s == "false") bdata[j] = false;
+                else {
+                    Warning("Value \"%s\" unknown for boolean parameter \"%s\"."
+                        "Using \"false\".", s.c_str(), item.declaration.c_str());
+                    bdata[j] = false;
+                }
+            }
+            ps.AddBool(name, bdata, nItems);
+            delete[] bdata;
+        }
+        else if (type == PARAM_TYPE_FLOAT) {
+            ps.AddFloat(name, data, nItems);
+        } else if (type == PARAM_TYPE_POINT) {
+            if ((nItems % 3) != 0)
+                Warning("Excess values given with point parameter \"%s\". "
+                        "Ignoring last %d of them", item.declaration.c_str(), nItems % 3);
+            ps.AddPoint(name, (const Point *)data, nItems / 3);
+        } else if (type == PARAM_TYPE_VECTOR) {
+            if ((nItems % 3) != 0)
+                Warning("Excess values given with vector parameter \"%s\". "
+                        "Ignoring last %d of them", item.declaration.c_str(), nItems % 3);
+            ps.AddVector(name, (const Vector *)data, nItems / 3);
+        } else if (type == PARAM_TYPE_NORMAL) {
+            if ((nItems % 3) != 0)
+                Warning("Excess values given with normal parameter \"%s\". "
+                        "Ignoring last %d of them", item.declaration.c_str(), nItems % 3);
+            ps.AddNormal(name, (const Normal *)data, nItems / 3);
+        } else if (type == PARAM_TYPE_RGB) {
+            if ((nItems % 3) != 0)
+                Warning("Excess RGB values given with parameter \"%s\". "
+                        "Ignoring last %d of them", item.declaration.c_str(), nItems % 3);
+            ps.AddRGBSpectrum(name, data, nItems);
+        } else if (type == PARAM_TYPE_XYZ) {
+            if ((nItems % 3) != 0)
+                Warning("Excess XYZ values given with parameter \"%s\". "
+                        "Ignoring last %d of them", item.declaration.c_str(), nItems % 3);
+            ps.AddXYZSpectrum(name, data, nItems);
+        } else if (type == PARAM_TYPE_BLACKBODY) {
+            if ((nItems % 2) != 0)
+                Warning("Excess value given with blackbody parameter \"%s\". "
+                        "Ignoring extra one.", item.declaration.c_str());
+            ps.AddBlackbodySpectrum(name, data, nItems);
+        } else if (type == PARAM_TYPE_SPECTRUM) {
+            if (item.isString) {
+                vector<const char *> files(nItems);
+                for (int j = 0; j < nItems; ++j)
+                    files[j] = item.strings[j].c_str();
+                ps.AddSampledSpectrumFiles(name, &files[0], nItems);
+            }
+            else {
+                if ((nItems % 2) != 0)
+                    Warning("Non-even number of values given with sampled spectrum "
+                            "parameter \"%s\". Ignoring extra.", item.declaration.c_str());
+                ps.AddSampledSpectrum(name, data, nItems);
+            }
+        } else if (type == PARAM_TYPE_STRING) {
+            ps.AddString(name, &item.strings[0], nItems);
+        }
+        else if (type == PARAM_TYPE_TEXTURE) {
+            if (nItems == 1)
+                ps.AddTexture(name, item.strings[0]);
+            else
+                Error("Only one string allowed for \"texture\" parameter \"%s\"",
+                    name.c_str());
+        }
+    }
+}
+
+
+void SceneParser::Include(const string &filename) {
+    if (includeDepth >= 32) {
+        Error("Only 32 levels of nested Include allowed in scene files.");
+        exit(1);
+    }
+    string newFile = AbsolutePath(ResolveFilename(filename));
+    if (scheduler && scheduler->Defer(newFile, includeDepth + 1))
+        return;
+    SceneTokenizer *t = SceneTokenizer::Open(newFile);
+    if (!t) {
+        Error("Unable to open included scene file \"%s\"", newFile.c_str());
+        return;
+    }
+    const char *savedFile = current_file;
+    current_file = newFile.c_str();
+    line_num = 1;
+    SceneParser parser(t, includeDepth + 1, scheduler, include, statements);
+    parser.Parse();
+    delete t;
+    current_file = savedFile;
+    line_num = in->line;
+}
+
+
+
+// Parsing Global Interface
+bool ParseFile(const string &filename) {
+    if (filename != "-")
+        SetSearchDirectory(DirectoryContaining(filename));
+    SceneTokenizer *t = SceneTokenizer::Open(filename);
+    if (!t) return false;
+    current_file = (filename == "-") ? "<standard input>" : filename.c_str();
+    line_num = 1;
+    IncludeScheduler *scheduler = NULL;
+    if (PbrtOptions.parallelIncludes && NumSystemCores() > 1)
+        scheduler = new IncludeScheduler;
+    SceneParser parser(t, 0, scheduler, NULL, NULL);
+    parser.Parse();
+    delete t;
+    if (scheduler) {
+        scheduler->Sync();
+        delete scheduler;
     }
-    current_file = "";
+    current_file = NULL;
     line_num = 0;
-    return (yyin != NULL);
+    return true;
 }
 
 
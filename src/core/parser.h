@@ -38,6 +38,11 @@
 
 // core/parser.h*
 #include "pbrt.h"
+#include "parallel.h"
 bool ParseFile(const string &filename);
 
+// Parsing Global Declarations
+extern PBRT_THREAD_LOCAL int line_num;
+extern PBRT_THREAD_LOCAL const char *current_file;
+
 #endif // PBRT_CORE_PARSER_H
@@ -126,12 +126,28 @@ template <typename T> struct ParamSetItem;
 struct Options {
     Options() { nCores = 0;
                 quickRender = quiet = openWindow = verbose = false;
-                imageFile = ""; }
+                parallelIncludes = false;
+                nPasses = 0;
+                timeLimit = 0.f;
+                resume = false;
+                textureCacheMB = 1024;
+                textureStats = false;
+                imageFile = statsFile = checkpointFile = "";
+                coordinatorAddress = workerAddress = ""; }
     int nCores;
     bool quickRender;
+    bool parallelIncludes;
+    int nPasses;
+    float timeLimit;
+    bool resume;
+    string checkpointFile;
+    string coordinatorAddress, workerAddress;
+    int textureCacheMB;
+    bool textureStats;
     bool quiet, verbose;
     bool openWindow;
     string imageFile;
+    string statsFile;
 };
 
 
@@ -162,6 +178,7 @@ struct CameraSample;
 struct Sample;
 class Filter;
 class Film;
+class FilmTile;
 class BxDF;
 class BRDF;
 class BTDF;
@@ -213,6 +230,11 @@ class VolumeIntegrator;
 #define PBRT_HAS_64_BIT_ATOMICS
 #endif
 #endif // PBRT_HAS_64_BIT_ATOMICS
+#ifndef PBRT_HAS_SSE
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PBRT_HAS_SSE
+#endif
+#endif // PBRT_HAS_SSE
 
 // Global Inline Functions
 inline float Lerp(float t, float v1, float v2) {
@@ -37,7 +37,7 @@
 #include "intersection.h"
 
 // Primitive Method Definitions
-uint32_t Primitive::nextprimitiveId = 1;
+AtomicInt32 Primitive::nextprimitiveId = 1;
 Primitive::~Primitive() { }
 
 bool Primitive::CanIntersect() const {
@@ -45,6 +45,20 @@ bool Primitive::CanIntersect() const {
 }
 
 
+void Primitive::IntersectPacket(const Ray *const *rays, int nRays,
+        Intersection *isects, bool *hits) const {
+    for (int i = 0; i < nRays; ++i)
+        hits[i] = Intersect(*rays[i], &isects[i]);
+}
+
+
+void Primitive::IntersectPPacket(const Ray *const *rays, int nRays,
+        bool *occluded) const {
+    for (int i = 0; i < nRays; ++i)
+        occluded[i] = IntersectP(*rays[i]);
+}
+
+
 
 void Primitive::Refine(vector<Reference<Primitive> > &refined) const {
     Severe("Unimplemented Primitive::Refine() method called!");
@@ -166,8 +180,8 @@ bool GeometricPrimitive::Intersect(const Ray &r,
     if (!shape->Intersect(r, &thit, &rayEpsilon, &isect->dg))
         return false;
     isect->primitive = this;
-    isect->WorldToObject = *shape->WorldToObject;
-    isect->ObjectToWorld = *shape->ObjectToWorld;
+    isect->WorldToObject = shape->WorldToObject->ToTransform();
+    isect->ObjectToWorld = shape->ObjectToWorld->ToTransform();
     isect->shapeId = shape->shapeId;
     isect->primitiveId = primitiveId;
     isect->rayEpsilon = rayEpsilon;
@@ -42,15 +42,23 @@
 #include "material.h"
 
 // Primitive Declarations
+
+// Aggregates traverse ray packets in groups of at most _PBRT_PACKET_SIZE_
+// rays so that the active rays can be tracked with a _uint32_t_ mask
+#define PBRT_PACKET_SIZE 32
 class Primitive : public ReferenceCounted {
 public:
     // Primitive Interface
-    Primitive() : primitiveId(nextprimitiveId++) { }
+    Primitive() : primitiveId(AtomicAdd(&nextprimitiveId, 1) - 1) { }
     virtual ~Primitive();
     virtual BBox WorldBound() const = 0;
     virtual bool CanIntersect() const;
     virtual bool Intersect(const Ray &r, Intersection *in) const = 0;
     virtual bool IntersectP(const Ray &r) const = 0;
+    virtual void IntersectPacket(const Ray *const *rays, int nRays,
+                                 Intersection *isects, bool *hits) const;
+    virtual void IntersectPPacket(const Ray *const *rays, int nRays,
+                                  bool *occluded) const;
     virtual void Refine(vector<Reference<Primitive> > &refined) const;
     void FullyRefine(vector<Reference<Primitive> > &refined) const;
     virtual const AreaLight *GetAreaLight() const = 0;
@@ -63,7 +71,7 @@ public:
     const uint32_t primitiveId;
 protected:
     // Primitive Protected Data
-    static uint32_t nextprimitiveId;
+    static AtomicInt32 nextprimitiveId;
 };
 
 
@@ -84,6 +92,7 @@ public:
                   const Transform &ObjectToWorld, MemoryArena &arena) const;
     BSSRDF *GetBSSRDF(const DifferentialGeometry &dg,
                       const Transform &ObjectToWorld, MemoryArena &arena) const;
+    const Shape *GetShape() const { return shape.GetPtr(); }
 private:
     // GeometricPrimitive Private Data
     Reference<Shape> shape;
@@ -34,241 +34,7 @@
 #include "stdafx.h"
 #include "probes.h"
 #ifdef PBRT_PROBES_COUNTERS
-#include "parallel.h"
-#include <map>
-using std::map;
-
-// Statistics Counters Local Declarations
-#ifdef PBRT_HAS_64_BIT_ATOMICS
-typedef AtomicInt64 StatsCounterType;
-#else
-typedef AtomicInt32 StatsCounterType;
-#endif
-class StatsCounter {
-public:
-    // StatsCounter Public Methods
-    StatsCounter(const string &category, const string &name);
-    void operator++() {
-        AtomicAdd(&num, 1);
-    }
-    void operator++(int) {
-        AtomicAdd(&num, 1);
-    }
-#ifdef PBRT_HAS_64_BIT_ATOMICS
-    void Max(int64_t newval) {
-        int64_t oldval;
-        do {
-            oldval = num;
-            newval = max(oldval, newval);
-            if (newval == oldval) return;
-        } while(AtomicCompareAndSwap(&num, newval, oldval) != oldval);
-    }
-    void Min(int64_t newval) {
-        int64_t oldval;
-        do {
-            oldval = (uint32_t)num;
-            newval = min(oldval, newval);
-            if (newval == oldval) return;
-        } while(AtomicCompareAndSwap(&num, newval, oldval) != oldval);
-    }
-#else
-    void Max(int32_t newval) {
-        int32_t oldval;
-        do {
-            oldval = num;
-            newval = max(oldval, newval);
-            if (newval == oldval) return;
-        } while(AtomicCompareAndSwap(&num, newval, oldval) != oldval);
-    }
-    void Min(int32_t newval) {
-        int32_t oldval;
-        do {
-            oldval = (uint32_t)num;
-            newval = min(oldval, newval);
-            if (newval == oldval) return;
-        } while(AtomicCompareAndSwap(&num, newval, oldval) != oldval);
-    }
-#endif
-#ifdef PBRT_HAS_64_BIT_ATOMICS
-    operator int64_t() volatile { return (int64_t)num; }
-#else
-    operator int32_t() volatile { return (int32_t)num; }
-#endif
-private:
-    // StatsCounter Private Data
-    StatsCounterType num;
-};
-
-
-class StatsRatio {
-public:
-    // StatsRatio Public Methods
-    StatsRatio(const string &category, const string &name);
-    void Add(int a, int b) {
-        AtomicAdd(&na, a);
-        AtomicAdd(&nb, b);
-    }
-private:
-    // StatsRatio Private Data
-    StatsCounterType na, nb;
-};
-
-
-class StatsPercentage {
-public:
-    // StatsPercentage Public Methods
-    void Add(int a, int b) {
-        AtomicAdd(&na, a);
-        AtomicAdd(&nb, b);
-    }
-    StatsPercentage(const string &category, const string &name);
-private:
-    // StatsPercentage Private Data
-    StatsCounterType na, nb;
-};
-
-
-
-// Statistics Counters Definitions
-static void ProbesPrintVal(FILE *f, const StatsCounterType &v);
-static void ProbesPrintVal(FILE *f, const StatsCounterType &v1,
-    const StatsCounterType &v2);
-struct StatTracker {
-    StatTracker(const string &cat, const string &n,
-                StatsCounterType *pa, StatsCounterType *pb = NULL,
-            bool percentage = true);
-    string category, name;
-    StatsCounterType *ptra, *ptrb;
-    bool percentage;
-};
-
-
-typedef map<std::pair<string, string>, StatTracker *> TrackerMap;
-static TrackerMap trackers;
-static void addTracker(StatTracker *newTracker) {
-    static Mutex *mutex = Mutex::Create();
-    MutexLock lock(*mutex);
-    std::pair<string, string> s = std::make_pair(newTracker->category, newTracker->name);
-    if (trackers.find(s) != trackers.end()) {
-        newTracker->ptra = trackers[s]->ptra;
-        newTracker->ptrb = trackers[s]->ptrb;
-        return;
-    }
-    trackers[s] = newTracker;
-}
-
-
-
-// Statistics Counters Function Definitions
-void ProbesPrint(FILE *dest) {
-    fprintf(dest, "Statistics:\n");
-    TrackerMap::iterator iter = trackers.begin();
-    string lastCategory;
-    while (iter != trackers.end()) {
-        // Print statistic
-        StatTracker *tr = iter->second;
-        if (tr->category != lastCategory) {
-            fprintf(dest, "%s\n", tr->category.c_str());
-            lastCategory = tr->category;
-        }
-        fprintf(dest, "    %s", tr->name.c_str());
-
-        // Pad out to results column
-        int resultsColumn = 56;
-        int paddingSpaces = resultsColumn - (int) tr->name.size();
-        while (paddingSpaces-- > 0)
-            putc(' ', dest);
-        if (tr->ptrb == NULL)
-            ProbesPrintVal(dest, *tr->ptra);
-        else {
-            if ((int64_t)(*tr->ptrb) > 0) {
-                float ratio = double((int64_t)*tr->ptra) / double((int64_t)*tr->ptrb);
-                ProbesPrintVal(dest, *tr->ptra, *tr->ptrb);
-                if (tr->percentage)
-                    fprintf(dest, " (%3.2f%%)", 100. * ratio);
-                else
-                    fprintf(dest, " (%.2fx)", ratio);
-            }
-            else
-                ProbesPrintVal(dest, *tr->ptra, *tr->ptrb);
-        }
-        fprintf(dest, "\n");
-        ++iter;
-    }
-}
-
-
-static void ProbesPrintVal(FILE *f, const StatsCounterType &v) {
-#if defined(PBRT_IS_WINDOWS)
-    LONG vv = v;
-    fprintf(f, "%d", vv);
-#else
-#ifdef PBRT_HAS_64_BIT_ATOMICS
-    int64_t vv = v;
-    fprintf(f, "%lld", vv);
-#else
-    int32_t vv = v;
-    fprintf(f, "%d", vv);
-#endif
-#endif
-}
-
-
-static void ProbesPrintVal(FILE *f, const StatsCounterType &v1,
-        const StatsCounterType &v2) {
-#if defined(PBRT_IS_WINDOWS)
-    LONG vv1 = v1, vv2 = v2;
-    fprintf(f, "%d:%d", vv1, vv2);
-#else
-#ifdef PBRT_HAS_64_BIT_ATOMICS
-    int64_t vv1 = v1, vv2 = v2;
-    fprintf(f, "%lld:%lld", vv1, vv2);
-#else
-    int32_t vv1 = v1, vv2 = v2;
-    fprintf(f, "%d:%d", vv1, vv2);
-#endif
-#endif
-}
-
-
-void ProbesCleanup() {
-    TrackerMap::iterator iter = trackers.begin();
-    string lastCategory;
-    while (iter != trackers.end()) {
-        delete iter->second;
-        ++iter;
-    }
-    trackers.erase(trackers.begin(), trackers.end());
-}
-
-
-StatTracker::StatTracker(const string &cat, const string &n,
-                         StatsCounterType *pa, StatsCounterType *pb, bool p) {
-    category = cat;
-    name = n;
-    ptra = pa;
-    ptrb = pb;
-    percentage = p;
-}
-
-
-StatsCounter::StatsCounter(const string &category, const string &name) {
-    num = 0;
-    addTracker(new StatTracker(category, name, &num));
-}
-
-
-StatsRatio::StatsRatio(const string &category, const string &name) {
-    na = nb = 0;
-    addTracker(new StatTracker(category, name, &na, &nb, false));
-}
-
-
-StatsPercentage::StatsPercentage(const string &category, const string &name) {
-    addTracker(new StatTracker(category, name, &na, &nb, true));
-}
-
-
+#include "stats.h"
 
 // Statistics Counters Probe Declarations
 static StatsCounter shapesMade("Shapes", "Total Shapes Created");
@@ -279,11 +45,28 @@ static StatsCounter specularRefractionRays("Rays", "Specular Refraction Rays Tra
 static StatsCounter shadowRays("Rays", "Shadow Rays Traced");
 static StatsCounter nonShadowRays("Rays", "Total Non-Shadow Rays Traced");
 static StatsCounter kdTreeInteriorNodes("Kd-Tree", "Interior Nodes Created");
-static StatsCounter kdTreeLeafNodes("Kd-Tree", "Interior Nodes Created");
-static StatsCounter kdTreeMaxPrims("Kd-Tree", "Maximum Primitives in Leaf");
-static StatsCounter kdTreeMaxDepth("Kd-Tree", "Maximum Depth of Leaf Nodes");
+static StatsCounter kdTreeLeafNodes("Kd-Tree", "Leaf Nodes Created");
+static StatsDistribution kdTreeLeafPrims("Kd-Tree", "Primitives in Leaf Nodes");
+static StatsDistribution kdTreeLeafDepth("Kd-Tree", "Depth of Leaf Nodes");
+static StatsCounter kdTreeInteriorTraversals("Kd-Tree", "Interior Nodes Traversed");
+static StatsCounter kdTreeLeafTraversals("Kd-Tree", "Leaf Nodes Traversed");
+static StatsCounter bvhInteriorTraversals("BVH", "Interior Nodes Traversed");
+static StatsCounter bvhLeafTraversals("BVH", "Leaf Nodes Traversed");
+static StatsPercentage bvhPrimitiveHits("BVH", "Primitive Intersection Hits");
+static StatsCounter gridVoxelTraversals("Grid", "Voxels Traversed");
+static StatsDistribution gridVoxelPrims("Grid", "Primitives in Traversed Voxels");
 static StatsPercentage rayTriIntersections("Intersections", "Ray/Triangle Intersection Hits");
 static StatsPercentage rayTriIntersectionPs("Intersections", "Ray/Triangle IntersectionP Hits");
+static StatsCounter trilinearLookups("Texture", "Trilinear MIPMap Lookups");
+static StatsCounter ewaLookups("Texture", "EWA MIPMap Lookups");
+static StatsCounter imageMapsLoaded("Texture", "Image Maps Loaded");
+static StatsCounter directPhotons("Photon Map", "Direct Photons Deposited");
+static StatsCounter indirectPhotons("Photon Map", "Indirect Photons Deposited");
+static StatsCounter causticPhotons("Photon Map", "Caustic Photons Deposited");
+static StatsDistribution photonLookupFound("Photon Map", "Photons Found per Lookup");
+static StatsCounter irradianceSamples("Irradiance Cache", "Samples Added");
+static StatsPercentage mltAccepted("Metropolis", "Mutations Accepted");
+static StatsPercentage supersampledPixels("Sampler", "Adaptively Supersampled Pixels");
 
 // Statistics Counters Probe Definitions
 void PBRT_CREATED_SHAPE(Shape *) {
@@ -310,8 +93,8 @@ void PBRT_KDTREE_CREATED_INTERIOR_NODE(int axis, float split) {
 
 void PBRT_KDTREE_CREATED_LEAF(int nprims, int depth) {
     ++kdTreeLeafNodes;
-    kdTreeMaxPrims.Max(nprims);
-    kdTreeMaxDepth.Max(depth);
+    kdTreeLeafPrims.Add(nprims);
+    kdTreeLeafDepth.Add(depth);
 }
 
 
@@ -363,4 +146,151 @@ void PBRT_STARTED_SPECULAR_REFRACTION_RAY(const RayDifferential *) {
 }
 
 
+void PBRT_KDTREE_INTERSECTION_TRAVERSED_INTERIOR_NODE(const KdAccelNode *) {
+    ++kdTreeInteriorTraversals;
+}
+
+
+
+void PBRT_KDTREE_INTERSECTION_TRAVERSED_LEAF_NODE(const KdAccelNode *, int nprims) {
+    ++kdTreeLeafTraversals;
+}
+
+
+
+void PBRT_KDTREE_INTERSECTIONP_TRAVERSED_INTERIOR_NODE(const KdAccelNode *) {
+    ++kdTreeInteriorTraversals;
+}
+
+
+
+void PBRT_KDTREE_INTERSECTIONP_TRAVERSED_LEAF_NODE(const KdAccelNode *, int nprims) {
+    ++kdTreeLeafTraversals;
+}
+
+
+
+void PBRT_BVH_INTERSECTION_TRAVERSED_INTERIOR_NODE(const LinearBVHNode *) {
+    ++bvhInteriorTraversals;
+}
+
+
+
+void PBRT_BVH_INTERSECTION_TRAVERSED_LEAF_NODE(const LinearBVHNode *) {
+    ++bvhLeafTraversals;
+}
+
+
+
+void PBRT_BVH_INTERSECTIONP_TRAVERSED_INTERIOR_NODE(const LinearBVHNode *) {
+    ++bvhInteriorTraversals;
+}
+
+
+
+void PBRT_BVH_INTERSECTIONP_TRAVERSED_LEAF_NODE(const LinearBVHNode *) {
+    ++bvhLeafTraversals;
+}
+
+
+
+void PBRT_BVH_INTERSECTION_PRIMITIVE_TEST(const Primitive *) {
+    bvhPrimitiveHits.Add(0, 1);
+}
+
+
+
+void PBRT_BVH_INTERSECTION_PRIMITIVE_HIT(const Primitive *) {
+    bvhPrimitiveHits.Add(1, 0);
+}
+
+
+
+void PBRT_GRID_RAY_TRAVERSED_VOXEL(const int v[3], int nprims) {
+    ++gridVoxelTraversals;
+    gridVoxelPrims.Add(nprims);
+}
+
+
+
+void PBRT_STARTED_TRILINEAR_TEXTURE_LOOKUP(float s, float t) {
+    ++trilinearLookups;
+}
+
+
+
+void PBRT_STARTED_EWA_TEXTURE_LOOKUP(float s, float t) {
+    ++ewaLookups;
+}
+
+
+
+void PBRT_LOADED_IMAGE_MAP(const char *filename, int width, int height,
+                           int elementSize, void *mipPtr) {
+    ++imageMapsLoaded;
+}
+
+
+
+void PBRT_PHOTON_MAP_DEPOSITED_DIRECT_PHOTON(const DifferentialGeometry *,
+        const void *alpha, const Vector *wo) {
+    ++directPhotons;
+}
+
+
+
+void PBRT_PHOTON_MAP_DEPOSITED_INDIRECT_PHOTON(const DifferentialGeometry *,
+        const void *alpha, const Vector *wo) {
+    ++indirectPhotons;
+}
+
+
+
+void PBRT_PHOTON_MAP_DEPOSITED_CAUSTIC_PHOTON(const DifferentialGeometry *,
+        const void *alpha, const Vector *wo) {
+    ++causticPhotons;
+}
+
+
+
+void PBRT_PHOTON_MAP_FINISHED_LOOKUP(const DifferentialGeometry *, int nFound,
+                                     int nWanted, const void *L) {
+    photonLookupFound.Add(nFound);
+}
+
+
+
+void PBRT_IRRADIANCE_CACHE_ADDED_NEW_SAMPLE(const Point *, const Normal *,
+        float maxDist, const void *E, const Vector *primaryDir,
+        float pixelSpacing) {
+    ++irradianceSamples;
+}
+
+
+
+void PBRT_MLT_ACCEPTED_MUTATION(float a, const MLTSample *current,
+                                const MLTSample *proposed) {
+    mltAccepted.Add(1, 1);
+}
+
+
+
+void PBRT_MLT_REJECTED_MUTATION(float a, const MLTSample *current,
+                                const MLTSample *proposed) {
+    mltAccepted.Add(0, 1);
+}
+
+
+
+void PBRT_SUPERSAMPLE_PIXEL_YES(int xpos, int ypos) {
+    supersampledPixels.Add(1, 1);
+}
+
+
+
+void PBRT_SUPERSAMPLE_PIXEL_NO(int xpos, int ypos) {
+    supersampledPixels.Add(0, 1);
+}
+
+
 #endif // PBRT_PROBES_COUNTERS
@@ -40,14 +40,9 @@
 #include "pbrt.h"
 #ifdef PBRT_PROBES_DTRACE
 #include "core/dtrace.h"
-inline void ProbesCleanup() { }
-inline void ProbesPrint(FILE *) { }
 #endif // PBRT_PROBES_DTRACE
 
 #ifdef PBRT_PROBES_NONE
-inline void ProbesCleanup() { }
-inline void ProbesPrint(FILE *) { }
-
 // Statistics Disabled Declarations
 #define PBRT_STARTED_RAY_INTERSECTION(ray)
 #define PBRT_FINISHED_RAY_INTERSECTION(ray, isect, hit)
@@ -219,9 +214,10 @@ inline void ProbesPrint(FILE *) { }
 #ifdef PBRT_PROBES_COUNTERS
 
 // Statistics Counters Declarations
-void ProbesPrint(FILE *dest);
-void ProbesCleanup();
 class Triangle;
+struct KdAccelNode;
+struct LinearBVHNode;
+struct MLTSample;
 extern void PBRT_CREATED_SHAPE(Shape *);
 extern void PBRT_CREATED_TRIANGLE(Triangle *);
 extern void PBRT_STARTED_GENERATING_CAMERA_RAY(const struct CameraSample *);
@@ -242,6 +238,38 @@ extern void PBRT_FINISHED_RAY_INTERSECTION(const Ray *, const Intersection *, in
 extern void PBRT_FINISHED_RAY_INTERSECTIONP(const Ray *, int hit);
 extern void PBRT_STARTED_SPECULAR_REFLECTION_RAY(const RayDifferential *);
 extern void PBRT_STARTED_SPECULAR_REFRACTION_RAY(const RayDifferential *);
+extern void PBRT_KDTREE_INTERSECTION_TRAVERSED_INTERIOR_NODE(const KdAccelNode *);
+extern void PBRT_KDTREE_INTERSECTION_TRAVERSED_LEAF_NODE(const KdAccelNode *, int nprims);
+extern void PBRT_KDTREE_INTERSECTIONP_TRAVERSED_INTERIOR_NODE(const KdAccelNode *);
+extern void PBRT_KDTREE_INTERSECTIONP_TRAVERSED_LEAF_NODE(const KdAccelNode *, int nprims);
+extern void PBRT_BVH_INTERSECTION_TRAVERSED_INTERIOR_NODE(const LinearBVHNode *);
+extern void PBRT_BVH_INTERSECTION_TRAVERSED_LEAF_NODE(const LinearBVHNode *);
+extern void PBRT_BVH_INTERSECTIONP_TRAVERSED_INTERIOR_NODE(const LinearBVHNode *);
+extern void PBRT_BVH_INTERSECTIONP_TRAVERSED_LEAF_NODE(const LinearBVHNode *);
+extern void PBRT_BVH_INTERSECTION_PRIMITIVE_TEST(const Primitive *);
+extern void PBRT_BVH_INTERSECTION_PRIMITIVE_HIT(const Primitive *);
+extern void PBRT_GRID_RAY_TRAVERSED_VOXEL(const int v[3], int nprims);
+extern void PBRT_STARTED_TRILINEAR_TEXTURE_LOOKUP(float s, float t);
+extern void PBRT_STARTED_EWA_TEXTURE_LOOKUP(float s, float t);
+extern void PBRT_LOADED_IMAGE_MAP(const char *filename, int width, int height,
+                                  int elementSize, void *mipPtr);
+extern void PBRT_PHOTON_MAP_DEPOSITED_DIRECT_PHOTON(const DifferentialGeometry *,
+        const void *alpha, const Vector *wo);
+extern void PBRT_PHOTON_MAP_DEPOSITED_INDIRECT_PHOTON(const DifferentialGeometry *,
+        const void *alpha, const Vector *wo);
+extern void PBRT_PHOTON_MAP_DEPOSITED_CAUSTIC_PHOTON(const DifferentialGeometry *,
+        const void *alpha, const Vector *wo);
+extern void PBRT_PHOTON_MAP_FINISHED_LOOKUP(const DifferentialGeometry *,
+        int nFound, int nWanted, const void *L);
+extern void PBRT_IRRADIANCE_CACHE_ADDED_NEW_SAMPLE(const Point *, const Normal *,
+        float maxDist, const void *E, const Vector *primaryDir,
+        float pixelSpacing);
+extern void PBRT_MLT_ACCEPTED_MUTATION(float a, const MLTSample *current,
+                                       const MLTSample *proposed);
+extern void PBRT_MLT_REJECTED_MUTATION(float a, const MLTSample *current,
+                                       const MLTSample *proposed);
+extern void PBRT_SUPERSAMPLE_PIXEL_YES(int xpos, int ypos);
+extern void PBRT_SUPERSAMPLE_PIXEL_NO(int xpos, int ypos);
 #define PBRT_ACCESSED_TEXEL(arg0, arg1, arg2, arg3)
 #define PBRT_ALLOCATED_CACHED_TRANSFORM()
 #define PBRT_FOUND_CACHED_TRANSFORM()
@@ -249,15 +277,9 @@ extern void PBRT_STARTED_SPECULAR_REFRACTION_RAY(const RayDifferential *);
 #define PBRT_BVH_STARTED_CONSTRUCTION(arg0, arg1)
 #define PBRT_BVH_FINISHED_CONSTRUCTION(arg0)
 #define PBRT_BVH_INTERSECTION_STARTED(arg0, arg1)
-#define PBRT_BVH_INTERSECTION_TRAVERSED_INTERIOR_NODE(arg0)
-#define PBRT_BVH_INTERSECTION_TRAVERSED_LEAF_NODE(arg0)
-#define PBRT_BVH_INTERSECTION_PRIMITIVE_TEST(arg0)
-#define PBRT_BVH_INTERSECTION_PRIMITIVE_HIT(arg0)
 #define PBRT_BVH_INTERSECTION_PRIMITIVE_MISSED(arg0)
 #define PBRT_BVH_INTERSECTION_FINISHED()
 #define PBRT_BVH_INTERSECTIONP_STARTED(arg0, arg1)
-#define PBRT_BVH_INTERSECTIONP_TRAVERSED_INTERIOR_NODE(arg0)
-#define PBRT_BVH_INTERSECTIONP_TRAVERSED_LEAF_NODE(arg0)
 #define PBRT_BVH_INTERSECTIONP_PRIMITIVE_TEST(arg0)
 #define PBRT_BVH_INTERSECTIONP_PRIMITIVE_HIT(arg0)
 #define PBRT_BVH_INTERSECTIONP_PRIMITIVE_MISSED(arg0)
@@ -284,10 +306,8 @@ extern void PBRT_STARTED_SPECULAR_REFRACTION_RAY(const RayDifferential *);
 #define PBRT_GRID_RAY_PRIMITIVE_HIT(arg0)
 #define PBRT_GRID_RAY_PRIMITIVE_INTERSECTIONP_TEST(arg0)
 #define PBRT_GRID_RAY_PRIMITIVE_INTERSECTION_TEST(arg0)
-#define PBRT_GRID_RAY_TRAVERSED_VOXEL(arg0, arg1)
 #define PBRT_GRID_STARTED_CONSTRUCTION(arg0, arg1)
 #define PBRT_GRID_VOXELIZED_PRIMITIVE(arg0, arg1)
-#define PBRT_IRRADIANCE_CACHE_ADDED_NEW_SAMPLE(arg0, arg1, arg2, arg3, arg4, arg5)
 #define PBRT_IRRADIANCE_CACHE_CHECKED_SAMPLE(arg0, arg1, arg2)
 #define PBRT_IRRADIANCE_CACHE_FINISHED_COMPUTING_IRRADIANCE(arg0, arg1)
 #define PBRT_IRRADIANCE_CACHE_FINISHED_INTERPOLATION(arg0, arg1, arg2, arg3)
@@ -306,15 +326,8 @@ extern void PBRT_STARTED_SPECULAR_REFRACTION_RAY(const RayDifferential *);
 #define PBRT_KDTREE_INTERSECTION_TEST(arg0, arg1)
 #define PBRT_KDTREE_RAY_MISSED_BOUNDS()
 #define PBRT_KDTREE_STARTED_CONSTRUCTION(arg0, arg1)
-#define PBRT_KDTREE_INTERSECTION_TRAVERSED_INTERIOR_NODE(arg0)
-#define PBRT_KDTREE_INTERSECTION_TRAVERSED_LEAF_NODE(arg0, arg1)
-#define PBRT_KDTREE_INTERSECTIONP_TRAVERSED_INTERIOR_NODE(arg0)
-#define PBRT_KDTREE_INTERSECTIONP_TRAVERSED_LEAF_NODE(arg0, arg1)
-#define PBRT_LOADED_IMAGE_MAP(arg0, arg1, arg2, arg3, arg4)
 #define PBRT_MIPMAP_EWA_FILTER(arg0, arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8, arg9, arg10)
 #define PBRT_MIPMAP_TRILINEAR_FILTER(arg0, arg1, arg2, arg3, arg4, arg5)
-#define PBRT_MLT_ACCEPTED_MUTATION(arg0, arg1, arg2)
-#define PBRT_MLT_REJECTED_MUTATION(arg0, arg1, arg2)
 #define PBRT_MLT_STARTED_MLT_TASK(arg0)
 #define PBRT_MLT_FINISHED_MLT_TASK(arg0)
 #define PBRT_MLT_STARTED_RENDERING()
@@ -341,11 +354,7 @@ extern void PBRT_STARTED_SPECULAR_REFRACTION_RAY(const RayDifferential *);
 #define PBRT_MLT_FINISHED_DISPLAY_UPDATE()
 #define PBRT_MLT_STARTED_ESTIMATE_DIRECT()
 #define PBRT_MLT_FINISHED_ESTIMATE_DIRECT()
-#define PBRT_PHOTON_MAP_DEPOSITED_CAUSTIC_PHOTON(arg0, arg1, arg2)
-#define PBRT_PHOTON_MAP_DEPOSITED_DIRECT_PHOTON(arg0, arg1, arg2)
-#define PBRT_PHOTON_MAP_DEPOSITED_INDIRECT_PHOTON(arg0, arg1, arg2)
 #define PBRT_PHOTON_MAP_FINISHED_GATHER_RAY(arg0)
-#define PBRT_PHOTON_MAP_FINISHED_LOOKUP(arg0, arg1, arg2, arg3)
 #define PBRT_PHOTON_MAP_FINISHED_RAY_PATH(arg0, arg1)
 #define PBRT_PHOTON_MAP_STARTED_GATHER_RAY(arg0)
 #define PBRT_PHOTON_MAP_STARTED_LOOKUP(arg0)
@@ -353,7 +362,6 @@ extern void PBRT_STARTED_SPECULAR_REFRACTION_RAY(const RayDifferential *);
 #define PBRT_SAMPLE_OUTSIDE_IMAGE_EXTENT(arg0)
 #define PBRT_STARTED_ADDING_IMAGE_SAMPLE(arg0, arg1, arg2, arg3)
 #define PBRT_STARTED_CAMERA_RAY_INTEGRATION(arg0, arg1)
-#define PBRT_STARTED_EWA_TEXTURE_LOOKUP(arg0, arg1)
 #define PBRT_STARTED_PARSING()
 #define PBRT_STARTED_PREPROCESSING()
 #define PBRT_STARTED_RAY_INTERSECTION(arg0)
@@ -363,7 +371,6 @@ extern void PBRT_STARTED_SPECULAR_REFRACTION_RAY(const RayDifferential *);
 #define PBRT_STARTED_BSDF_SHADING(arg0)
 #define PBRT_STARTED_BSSRDF_SHADING(arg0)
 #define PBRT_STARTED_TASK(arg0)
-#define PBRT_STARTED_TRILINEAR_TEXTURE_LOOKUP(arg0, arg1)
 #define PBRT_SUBSURFACE_ADDED_INTERIOR_CONTRIBUTION(arg0)
 #define PBRT_SUBSURFACE_ADDED_POINT_CONTRIBUTION(arg0)
 #define PBRT_SUBSURFACE_ADDED_POINT_TO_OCTREE(arg0, arg1)
@@ -374,8 +381,6 @@ extern void PBRT_STARTED_SPECULAR_REFRACTION_RAY(const RayDifferential *);
 #define PBRT_SUBSURFACE_STARTED_COMPUTING_IRRADIANCE_VALUES()
 #define PBRT_SUBSURFACE_STARTED_OCTREE_LOOKUP(arg0)
 #define PBRT_SUBSURFACE_STARTED_RAYS_FOR_POINTS()
-#define PBRT_SUPERSAMPLE_PIXEL_NO(arg0, arg1)
-#define PBRT_SUPERSAMPLE_PIXEL_YES(arg0, arg1)
 #define PBRT_RNG_STARTED_RANDOM_FLOAT()
 #define PBRT_RNG_FINISHED_RANDOM_FLOAT()
 #define PBRT_RNG_FINISHED_TABLEGEN()
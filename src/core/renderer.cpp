@@ -33,9 +33,19 @@
 // core/renderer.cpp*
 #include "stdafx.h"
 #include "renderer.h"
+#include "spectrum.h"
 
 // Renderer Method Definitions
 Renderer::~Renderer() {
 }
 
 
+Spectrum Renderer::LiIntersected(const Scene *scene,
+        const RayDifferential &ray, const Sample *sample, RNG &rng,
+        MemoryArena &arena, const Intersection &isect, bool hit,
+        Spectrum *T) const {
+    Severe("Unimplemented Renderer::LiIntersected() method called!");
+    return Spectrum(0.f);
+}
+
+
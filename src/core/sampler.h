@@ -55,6 +55,7 @@ public:
         const Spectrum *Ls, const Intersection *isects, int count);
     virtual Sampler *GetSubSampler(int num, int count) = 0;
     virtual int RoundSize(int size) const = 0;
+    virtual void SetPass(int pass) { }
 
     // Sampler Public Data
     const int xPixelStart, xPixelEnd, yPixelStart, yPixelEnd;
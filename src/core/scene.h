@@ -40,6 +40,7 @@
 #include "pbrt.h"
 #include "primitive.h"
 #include "integrator.h"
+#include "intersection.h"
 
 // Scene Declarations
 class Scene {
@@ -59,6 +60,24 @@ public:
         PBRT_FINISHED_RAY_INTERSECTIONP(const_cast<Ray *>(&ray), int(hit));
         return hit;
     }
+    void IntersectPacket(const Ray *const *rays, int nRays,
+                         Intersection *isects, bool *hits) const {
+        for (int i = 0; i < nRays; ++i)
+            PBRT_STARTED_RAY_INTERSECTION(const_cast<Ray *>(rays[i]));
+        aggregate->IntersectPacket(rays, nRays, isects, hits);
+        for (int i = 0; i < nRays; ++i)
+            PBRT_FINISHED_RAY_INTERSECTION(const_cast<Ray *>(rays[i]),
+                                           &isects[i], int(hits[i]));
+    }
+    void IntersectPPacket(const Ray *const *rays, int nRays,
+                          bool *occluded) const {
+        for (int i = 0; i < nRays; ++i)
+            PBRT_STARTED_RAY_INTERSECTIONP(const_cast<Ray *>(rays[i]));
+        aggregate->IntersectPPacket(rays, nRays, occluded);
+        for (int i = 0; i < nRays; ++i)
+            PBRT_FINISHED_RAY_INTERSECTIONP(const_cast<Ray *>(rays[i]),
+                                            int(occluded[i]));
+    }
     const BBox &WorldBound() const;
 
     // Scene Public Data
@@ -39,16 +39,16 @@ Shape::~Shape() {
 }
 
 
-Shape::Shape(const Transform *o2w, const Transform *w2o, bool ro)
+Shape::Shape(const AffineTransform *o2w, const AffineTransform *w2o, bool ro)
     : ObjectToWorld(o2w), WorldToObject(w2o), ReverseOrientation(ro),
       TransformSwapsHandedness(o2w->SwapsHandedness()),
-      shapeId(nextshapeId++) {
+      shapeId(AtomicAdd(&nextshapeId, 1) - 1) {
     // Update shape creation statistics
     PBRT_CREATED_SHAPE(this);
 }
 
 
-uint32_t Shape::nextshapeId = 1;
+AtomicInt32 Shape::nextshapeId = 1;
 BBox Shape::WorldBound() const {
     return (*ObjectToWorld)(ObjectBound());
 }
@@ -47,7 +47,7 @@
 class Shape : public ReferenceCounted {
 public:
     // Shape Interface
-    Shape(const Transform *o2w, const Transform *w2o, bool ro);
+    Shape(const AffineTransform *o2w, const AffineTransform *w2o, bool ro);
     virtual ~Shape();
     virtual BBox ObjectBound() const = 0;
     virtual BBox WorldBound() const;
@@ -76,10 +76,10 @@ public:
     virtual float Pdf(const Point &p, const Vector &wi) const;
 
     // Shape Public Data
-    const Transform *ObjectToWorld, *WorldToObject;
+    const AffineTransform *ObjectToWorld, *WorldToObject;
     const bool ReverseOrientation, TransformSwapsHandedness;
     const uint32_t shapeId;
-    static uint32_t nextshapeId;
+    static AtomicInt32 nextshapeId;
 };
 
 
@@ -0,0 +1,348 @@
+
+/*
+    pbrt source code Copyright(c) 1998-2012 Matt Pharr and Greg Humphreys.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+
+// core/stats.cpp*
+#include "stdafx.h"
+#include "stats.h"
+#include <map>
+#if !defined(PBRT_IS_WINDOWS)
+#include <sys/resource.h>
+#endif
+using std::map;
+
+// Statistics Local Declarations
+PBRT_THREAD_LOCAL bool statsSuppressed = false;
+struct StatsTracker {
+    StatsTracker(const string &cat, const string &n, StatsKind k)
+        : category(cat), name(n), kind(k) {
+        v[0] = v[1] = v[2] = v[3] = NULL;
+    }
+    string category, name;
+    StatsKind kind;
+    StatsCounterType *v[4];
+};
+
+
+struct StatsValue {
+    StatsValue() {
+        kind = STATS_COUNTER;
+        count = sum = 0;
+        minValue = std::numeric_limits<StatsValueType>::max();
+        maxValue = std::numeric_limits<StatsValueType>::min();
+    }
+    StatsKind kind;
+    int64_t count, sum, minValue, maxValue;
+};
+
+
+typedef map<std::pair<string, string>, StatsValue> StatsValueMap;
+static vector<StatsTracker> &statsTrackers() {
+    static vector<StatsTracker> trackers;
+    return trackers;
+}
+
+
+static Mutex &statsMutex() {
+    static Mutex *mutex = Mutex::Create();
+    return *mutex;
+}
+
+
+static vector<void (*)()> &statsFlushes() {
+    static vector<void (*)()> flushes;
+    return flushes;
+}
+
+
+static void statsFlush() {
+    // Merge statistics that are accumulated outside of the trackers
+    vector<void (*)()> flushes;
+    {
+        MutexLock lock(statsMutex());
+        flushes = statsFlushes();
+    }
+    for (uint32_t i = 0; i < flushes.size(); ++i)
+        flushes[i]();
+}
+
+
+static int64_t peakResidentSetSize() {
+#if defined(PBRT_IS_WINDOWS)
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#if defined(PBRT_IS_APPLE)
+    return (int64_t)usage.ru_maxrss;
+#else
+    return (int64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+
+static void statsGather(StatsValueMap *values) {
+    statsFlush();
+    MutexLock lock(statsMutex());
+    const vector<StatsTracker> &trackers = statsTrackers();
+    for (uint32_t i = 0; i < trackers.size(); ++i) {
+        // Merge values of _trackers[i]_ with other trackers of the same name
+        const StatsTracker &tr = trackers[i];
+        StatsValue &sv = (*values)[std::make_pair(tr.category, tr.name)];
+        sv.kind = tr.kind;
+        switch (tr.kind) {
+        case STATS_COUNTER:
+        case STATS_MEMORY:
+            sv.count += *tr.v[0];
+            break;
+        case STATS_RATIO:
+        case STATS_PERCENTAGE:
+            sv.count += *tr.v[0];
+            sv.sum += *tr.v[1];
+            break;
+        case STATS_DISTRIBUTION:
+        case STATS_FIXED_DISTRIBUTION:
+            if (*tr.v[0] == 0) break;
+            sv.count += *tr.v[0];
+            sv.sum += *tr.v[1];
+            sv.minValue = min(sv.minValue, (int64_t)*tr.v[2]);
+            sv.maxValue = max(sv.maxValue, (int64_t)*tr.v[3]);
+            break;
+        }
+    }
+
+    // Add process-wide memory statistics
+    int64_t peakRSS = peakResidentSetSize();
+    if (peakRSS > 0) {
+        StatsValue &sv = (*values)[std::make_pair(string("Memory"),
+                                   string("Peak resident set size"))];
+        sv.kind = STATS_MEMORY;
+        sv.count = peakRSS;
+    }
+}
+
+
+static void statsPrintMemory(FILE *dest, int64_t bytes) {
+    if (bytes >= 1024 * 1024)
+        fprintf(dest, "%.2f MB", bytes / (1024. * 1024.));
+    else if (bytes >= 1024)
+        fprintf(dest, "%.2f kB", bytes / 1024.);
+    else
+        fprintf(dest, "%lld B", (long long)bytes);
+}
+
+
+static void statsPrintJSONString(FILE *f, const string &s) {
+    putc('"', f);
+    for (uint32_t i = 0; i < s.size(); ++i) {
+        if (s[i] == '"' || s[i] == '\\') putc('\\', f);
+        putc(s[i], f);
+    }
+    putc('"', f);
+}
+
+
+
+// Statistics Function Definitions
+void StatsRegister(const string &category, const string &name,
+                   StatsKind kind, StatsCounterType *v0,
+                   StatsCounterType *v1, StatsCounterType *v2,
+                   StatsCounterType *v3) {
+    MutexLock lock(statsMutex());
+    StatsTracker tr(category, name, kind);
+    tr.v[0] = v0;
+    tr.v[1] = v1;
+    tr.v[2] = v2;
+    tr.v[3] = v3;
+    statsTrackers().push_back(tr);
+}
+
+
+void StatsRegisterFlush(void (*flush)()) {
+    MutexLock lock(statsMutex());
+    statsFlushes().push_back(flush);
+}
+
+
+void StatsPrint(FILE *dest) {
+    StatsValueMap values;
+    statsGather(&values);
+    fprintf(dest, "Statistics:\n");
+    string lastCategory;
+    for (StatsValueMap::iterator iter = values.begin();
+         iter != values.end(); ++iter) {
+        // Skip statistics that never recorded a value
+        const StatsValue &sv = iter->second;
+        if (sv.count == 0 && sv.sum == 0) continue;
+
+        // Print statistic
+        const string &category = iter->first.first;
+        const string &name = iter->first.second;
+        if (category != lastCategory) {
+            fprintf(dest, "%s\n", category.c_str());
+            lastCategory = category;
+        }
+        fprintf(dest, "    %s", name.c_str());
+
+        // Pad out to results column
+        int resultsColumn = 56;
+        int paddingSpaces = max(resultsColumn - (int)name.size(), 1);
+        while (paddingSpaces-- > 0)
+            putc(' ', dest);
+        switch (sv.kind) {
+        case STATS_COUNTER:
+            fprintf(dest, "%lld", (long long)sv.count);
+            break;
+        case STATS_MEMORY:
+            statsPrintMemory(dest, sv.count);
+            break;
+        case STATS_RATIO:
+        case STATS_PERCENTAGE:
+            fprintf(dest, "%lld:%lld", (long long)sv.count, (long long)sv.sum);
+            if (sv.sum > 0) {
+                double ratio = double(sv.count) / double(sv.sum);
+                if (sv.kind == STATS_PERCENTAGE)
+                    fprintf(dest, " (%3.2f%%)", 100. * ratio);
+                else
+                    fprintf(dest, " (%.2fx)", ratio);
+            }
+            break;
+        case STATS_DISTRIBUTION:
+            fprintf(dest, "%.3f avg [range %lld - %lld]",
+                    double(sv.sum) / double(sv.count),
+                    (long long)sv.minValue, (long long)sv.maxValue);
+            break;
+        case STATS_FIXED_DISTRIBUTION:
+            fprintf(dest, "%.3f avg [range %.3f - %.3f]",
+                    double(sv.sum) / (double(sv.count) * STATS_FIXED_SCALE),
+                    double(sv.minValue) / STATS_FIXED_SCALE,
+                    double(sv.maxValue) / STATS_FIXED_SCALE);
+            break;
+        }
+        fprintf(dest, "\n");
+    }
+}
+
+
+bool StatsPrintJSON(const string &filename) {
+    FILE *f = fopen(filename.c_str(), "w");
+    if (!f) return false;
+    StatsValueMap values;
+    statsGather(&values);
+    fprintf(f, "{");
+    string lastCategory;
+    bool firstCategory = true;
+    for (StatsValueMap::iterator iter = values.begin();
+         iter != values.end(); ++iter) {
+        // Open JSON object for statistic's category, if needed
+        const string &category = iter->first.first;
+        const string &name = iter->first.second;
+        const StatsValue &sv = iter->second;
+        if (firstCategory || category != lastCategory) {
+            fprintf(f, firstCategory ? "\n  " : "\n  },\n  ");
+            statsPrintJSONString(f, category);
+            fprintf(f, ": {\n");
+            lastCategory = category;
+            firstCategory = false;
+        }
+        else
+            fprintf(f, ",\n");
+
+        // Write statistic's value
+        fprintf(f, "    ");
+        statsPrintJSONString(f, name);
+        switch (sv.kind) {
+        case STATS_COUNTER:
+            fprintf(f, ": %lld", (long long)sv.count);
+            break;
+        case STATS_MEMORY:
+            fprintf(f, ": { \"bytes\": %lld }", (long long)sv.count);
+            break;
+        case STATS_RATIO:
+        case STATS_PERCENTAGE:
+            fprintf(f, ": { \"numerator\": %lld, \"denominator\": %lld }",
+                    (long long)sv.count, (long long)sv.sum);
+            break;
+        case STATS_DISTRIBUTION:
+            if (sv.count == 0)
+                fprintf(f, ": { \"count\": 0 }");
+            else
+                fprintf(f, ": { \"count\": %lld, \"sum\": %lld, \"min\": %lld, "
+                        "\"max\": %lld, \"mean\": %g }", (long long)sv.count,
+                        (long long)sv.sum, (long long)sv.minValue,
+                        (long long)sv.maxValue,
+                        double(sv.sum) / double(sv.count));
+            break;
+        case STATS_FIXED_DISTRIBUTION:
+            if (sv.count == 0)
+                fprintf(f, ": { \"count\": 0 }");
+            else
+                fprintf(f, ": { \"count\": %lld, \"sum\": %g, \"min\": %g, "
+                        "\"max\": %g, \"mean\": %g }", (long long)sv.count,
+                        double(sv.sum) / STATS_FIXED_SCALE,
+                        double(sv.minValue) / STATS_FIXED_SCALE,
+                        double(sv.maxValue) / STATS_FIXED_SCALE,
+                        double(sv.sum) / (double(sv.count) * STATS_FIXED_SCALE));
+            break;
+        }
+    }
+    fprintf(f, firstCategory ? "}\n" : "\n  }\n}\n");
+    bool ok = !ferror(f);
+    if (fclose(f) != 0) ok = false;
+    return ok;
+}
+
+
+void StatsSuppress(bool suppress) {
+    statsSuppressed = suppress;
+}
+
+
+void StatsReset() {
+    statsFlush();
+    MutexLock lock(statsMutex());
+    vector<StatsTracker> &trackers = statsTrackers();
+    for (uint32_t i = 0; i < trackers.size(); ++i) {
+        StatsTracker &tr = trackers[i];
+        *tr.v[0] = 0;
+        if (tr.v[1]) *tr.v[1] = 0;
+        if (tr.kind == STATS_DISTRIBUTION ||
+            tr.kind == STATS_FIXED_DISTRIBUTION) {
+            *tr.v[2] = std::numeric_limits<StatsValueType>::max();
+            *tr.v[3] = std::numeric_limits<StatsValueType>::min();
+        }
+    }
+}
+
+
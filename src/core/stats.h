@@ -0,0 +1,183 @@
+
+/*
+    pbrt source code Copyright(c) 1998-2012 Matt Pharr and Greg Humphreys.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef PBRT_CORE_STATS_H
+#define PBRT_CORE_STATS_H
+
+// core/stats.h*
+#include "pbrt.h"
+#include "parallel.h"
+#include <limits>
+
+// Statistics Declarations
+#ifdef PBRT_HAS_64_BIT_ATOMICS
+typedef AtomicInt64 StatsCounterType;
+typedef int64_t StatsValueType;
+#else
+typedef AtomicInt32 StatsCounterType;
+typedef int32_t StatsValueType;
+#endif
+enum StatsKind { STATS_COUNTER, STATS_RATIO, STATS_PERCENTAGE,
+                 STATS_MEMORY, STATS_DISTRIBUTION, STATS_FIXED_DISTRIBUTION };
+// _STATS_FIXED_DISTRIBUTION_ values are stored in units of 1/_STATS_FIXED_SCALE_
+#define STATS_FIXED_SCALE 1000
+void StatsRegister(const string &category, const string &name,
+                   StatsKind kind, StatsCounterType *v0,
+                   StatsCounterType *v1 = NULL, StatsCounterType *v2 = NULL,
+                   StatsCounterType *v3 = NULL);
+void StatsRegisterFlush(void (*flush)());
+void StatsPrint(FILE *dest);
+bool StatsPrintJSON(const string &filename);
+void StatsReset();
+void StatsSuppress(bool suppress);
+extern PBRT_THREAD_LOCAL bool statsSuppressed;
+inline void StatsAtomicMax(StatsCounterType *v, StatsValueType newval) {
+    StatsValueType oldval;
+    if (statsSuppressed) return;
+    do {
+        oldval = *v;
+        if (newval <= oldval) return;
+    } while (AtomicCompareAndSwap(v, newval, oldval) != oldval);
+}
+
+
+inline void StatsAtomicMin(StatsCounterType *v, StatsValueType newval) {
+    StatsValueType oldval;
+    if (statsSuppressed) return;
+    do {
+        oldval = *v;
+        if (newval >= oldval) return;
+    } while (AtomicCompareAndSwap(v, newval, oldval) != oldval);
+}
+
+
+class StatsCounter {
+public:
+    // StatsCounter Public Methods
+    StatsCounter(const string &category, const string &name) {
+        num = 0;
+        StatsRegister(category, name, STATS_COUNTER, &num);
+    }
+    void operator++() { if (!statsSuppressed) AtomicAdd(&num, 1); }
+    void operator++(int) { if (!statsSuppressed) AtomicAdd(&num, 1); }
+    void operator+=(StatsValueType v) {
+        if (!statsSuppressed) AtomicAdd(&num, v);
+    }
+    void Max(StatsValueType v) { StatsAtomicMax(&num, v); }
+    operator StatsValueType() const { return num; }
+private:
+    // StatsCounter Private Data
+    StatsCounterType num;
+};
+
+
+class StatsRatio {
+public:
+    // StatsRatio Public Methods
+    StatsRatio(const string &category, const string &name) {
+        na = nb = 0;
+        StatsRegister(category, name, STATS_RATIO, &na, &nb);
+    }
+    void Add(StatsValueType a, StatsValueType b) {
+        if (statsSuppressed) return;
+        if (a) AtomicAdd(&na, a);
+        if (b) AtomicAdd(&nb, b);
+    }
+private:
+    // StatsRatio Private Data
+    StatsCounterType na, nb;
+};
+
+
+class StatsPercentage {
+public:
+    // StatsPercentage Public Methods
+    StatsPercentage(const string &category, const string &name) {
+        na = nb = 0;
+        StatsRegister(category, name, STATS_PERCENTAGE, &na, &nb);
+    }
+    void Add(StatsValueType a, StatsValueType b) {
+        if (statsSuppressed) return;
+        if (a) AtomicAdd(&na, a);
+        if (b) AtomicAdd(&nb, b);
+    }
+private:
+    // StatsPercentage Private Data
+    StatsCounterType na, nb;
+};
+
+
+class StatsMemory {
+public:
+    // StatsMemory Public Methods
+    StatsMemory(const string &category, const string &name) {
+        bytes = 0;
+        StatsRegister(category, name, STATS_MEMORY, &bytes);
+    }
+    void operator+=(size_t nBytes) {
+        if (!statsSuppressed) AtomicAdd(&bytes, (StatsValueType)nBytes);
+    }
+private:
+    // StatsMemory Private Data
+    StatsCounterType bytes;
+};
+
+
+class StatsDistribution {
+public:
+    // StatsDistribution Public Methods
+    StatsDistribution(const string &category, const string &name) {
+        count = sum = 0;
+        minValue = std::numeric_limits<StatsValueType>::max();
+        maxValue = std::numeric_limits<StatsValueType>::min();
+        StatsRegister(category, name, STATS_DISTRIBUTION, &count, &sum,
+                      &minValue, &maxValue);
+    }
+    void Add(StatsValueType v) {
+        if (statsSuppressed) return;
+        AtomicAdd(&count, 1);
+        AtomicAdd(&sum, v);
+        StatsAtomicMin(&minValue, v);
+        StatsAtomicMax(&maxValue, v);
+    }
+private:
+    // StatsDistribution Private Data
+    StatsCounterType count, sum, minValue, maxValue;
+};
+
+
+
+#endif // PBRT_CORE_STATS_H
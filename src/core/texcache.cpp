@@ -0,0 +1,364 @@
+
+/*
+    pbrt source code Copyright(c) 1998-2012 Matt Pharr and Greg Humphreys.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+// core/texcache.cpp*
+#include "stdafx.h"
+#include "texcache.h"
+#include "parallel.h"
+#include "stats.h"
+#if !defined(PBRT_IS_WINDOWS)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// TiledMIPFile Method Definitions
+bool IsTiledMIPFilename(const string &filename) {
+    return filename.size() >= 6 &&
+        (!strcmp(filename.c_str() + filename.size() - 5, ".tmip") ||
+         !strcmp(filename.c_str() + filename.size() - 5, ".TMIP"));
+}
+
+
+TiledMIPFile *TiledMIPFile::Open(const string &filename) {
+#if defined(PBRT_IS_WINDOWS)
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f) {
+        Error("Unable to open tiled texture \"%s\"", filename.c_str());
+        return NULL;
+    }
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        Error("Unable to open tiled texture \"%s\"", filename.c_str());
+        return NULL;
+    }
+    FILE *f = fdopen(dup(fd), "rb");
+#endif
+    // Read and validate _TiledMIPHeader_ and level table
+    TiledMIPFile *tf = new TiledMIPFile;
+    tf->filename = filename;
+    bool ok = f && fread(&tf->header, sizeof(tf->header), 1, f) == 1 &&
+        memcmp(tf->header.magic, TILEDMIP_MAGIC, 8) == 0 &&
+        tf->header.version == TILEDMIP_VERSION &&
+        (tf->header.nChannels == 1 || tf->header.nChannels == 3) &&
+        tf->header.nLevels > 0 && tf->header.nLevels <= 32 &&
+        tf->header.logTileSize >= 2 && tf->header.logTileSize <= 12 &&
+        tf->header.scale > 0.f && tf->header.gamma > 0.f;
+    if (ok) {
+        tf->levels.resize(tf->header.nLevels);
+        ok = fread(&tf->levels[0], sizeof(TiledMIPLevel), tf->levels.size(),
+                   f) == tf->levels.size();
+    }
+    for (uint32_t i = 0; ok && i < tf->levels.size(); ++i)
+        ok = tf->levels[i].width > 0 && tf->levels[i].height > 0;
+#if defined(PBRT_IS_WINDOWS)
+    tf->file = f;
+    tf->mutex = Mutex::Create();
+#else
+    if (f) fclose(f);
+    tf->fd = fd;
+#endif
+    if (!ok) {
+        Error("\"%s\" is not a valid tiled texture file.", filename.c_str());
+        delete tf;
+        return NULL;
+    }
+    return tf;
+}
+
+
+TiledMIPFile::~TiledMIPFile() {
+#if defined(PBRT_IS_WINDOWS)
+    if (file) fclose(file);
+    Mutex::Destroy(mutex);
+#else
+    close(fd);
+#endif
+}
+
+
+uint64_t TiledMIPFile::PyramidBytes() const {
+    uint64_t tileBytes = uint64_t(header.nChannels * sizeof(float)) <<
+        (2 * header.logTileSize);
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; i < header.nLevels; ++i)
+        bytes += uint64_t(levels[i].uTiles(header.logTileSize)) *
+            levels[i].vTiles(header.logTileSize) * tileBytes;
+    return bytes;
+}
+
+
+bool TiledMIPFile::ReadTile(uint32_t level, uint32_t tu, uint32_t tv,
+                            float *texels) const {
+    // Compute file offset of tile $(tu,tv)$ in _level_
+    const TiledMIPLevel &l = levels[level];
+    uint32_t tileFloats = header.nChannels << (2 * header.logTileSize);
+    uint64_t tileIndex = uint64_t(tv) * l.uTiles(header.logTileSize) + tu;
+    uint64_t offset = l.offset + tileIndex * tileFloats * sizeof(float);
+    size_t nBytes = tileFloats * sizeof(float);
+#if defined(PBRT_IS_WINDOWS)
+    MutexLock lock(*mutex);
+    bool ok = _fseeki64(file, (__int64)offset, SEEK_SET) == 0 &&
+        fread(texels, 1, nBytes, file) == nBytes;
+#else
+    // Use _pread()_ so that threads can read tiles concurrently
+    bool ok = true;
+    for (size_t done = 0; ok && done < nBytes; ) {
+        ssize_t n = pread(fd, (char *)texels + done, nBytes - done,
+                          (off_t)(offset + done));
+        ok = n > 0;
+        if (ok) done += n;
+    }
+#endif
+    if (!ok) {
+        Error("Unable to read tile (%d,%d) of level %d of \"%s\". Using "
+              "black instead.", tu, tv, level, filename.c_str());
+        memset(texels, 0, nBytes);
+    }
+    return ok;
+}
+
+
+
+const float *TiledMIPFile::MappedLevel(uint32_t level) const {
+    // Map file on first use and check that it holds all of _level_
+    if (!mapped) {
+        mapped = MappedFile::Open(filename);
+        if (!mapped) return NULL;
+    }
+    const TiledMIPLevel &l = levels[level];
+    uint64_t levelBytes = uint64_t(l.uTiles(header.logTileSize)) *
+        l.vTiles(header.logTileSize) * (header.nChannels * sizeof(float)) <<
+        (2 * header.logTileSize);
+    if (l.offset + levelBytes > mapped->Size()) {
+        Error("Tiled texture \"%s\" is truncated.", filename.c_str());
+        return NULL;
+    }
+    return (const float *)((const char *)mapped->Data() + l.offset);
+}
+
+
+// TextureCache Local Declarations
+#define TEXTURE_CACHE_BUCKETS 4096
+struct TextureCache::Tile {
+    const TextureTileSource *source;
+    uint32_t level, tu, tv;
+    // Pinned tiles, with a non-zero _pins_ count, are never evicted
+    AtomicInt32 pins;
+    Tile *hashNext, *lruPrev, *lruNext;
+    char *texels;
+};
+
+
+struct TextureCache::Shard {
+    Mutex *mutex;
+    Tile *buckets[TEXTURE_CACHE_BUCKETS];
+    // Sentinel of the shard's LRU list; _lru.lruNext_ is most recently used
+    Tile lru;
+    size_t bytes;
+    StatsCounterType lookups, hits, tilesRead, tilesEvicted, bytesRead;
+};
+
+
+static inline uint32_t hashTile(const TextureTileSource *source,
+        uint32_t level, uint32_t tu, uint32_t tv) {
+    uint64_t h = (uint64_t)(size_t)source;
+    h ^= (uint64_t(level) << 56) ^ (uint64_t(tv) << 28) ^ uint64_t(tu);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return uint32_t(h);
+}
+
+
+static inline TextureCache::Tile *findTile(TextureCache::Tile *tile,
+        const TextureTileSource *source, uint32_t level, uint32_t tu,
+        uint32_t tv) {
+    while (tile && (tile->source != source || tile->level != level ||
+                    tile->tu != tu || tile->tv != tv))
+        tile = tile->hashNext;
+    return tile;
+}
+
+
+// TextureCache Method Definitions
+TextureTileSource::~TextureTileSource() {
+}
+
+
+TextureCache::TextureCache(size_t maxBytes) {
+    // Split _maxBytes_ evenly between shards, each with its own lock
+    maxShardBytes = maxBytes / TEXTURE_CACHE_SHARDS;
+    shards = new Shard[TEXTURE_CACHE_SHARDS];
+    for (int i = 0; i < TEXTURE_CACHE_SHARDS; ++i) {
+        Shard &shard = shards[i];
+        shard.mutex = Mutex::Create();
+        memset(shard.buckets, 0, sizeof(shard.buckets));
+        shard.lru.lruPrev = shard.lru.lruNext = &shard.lru;
+        shard.bytes = 0;
+        shard.lookups = shard.hits = shard.tilesRead = 0;
+        shard.tilesEvicted = shard.bytesRead = 0;
+        StatsRegister("Texture cache", "Tile lookups of resident tiles",
+                      STATS_PERCENTAGE, &shard.hits, &shard.lookups);
+        StatsRegister("Texture cache", "Tiles read", STATS_COUNTER,
+                      &shard.tilesRead);
+        StatsRegister("Texture cache", "Tiles evicted", STATS_COUNTER,
+                      &shard.tilesEvicted);
+        StatsRegister("Texture cache", "Tile data read", STATS_MEMORY,
+                      &shard.bytesRead);
+    }
+}
+
+
+const void *TextureCache::Pin(const TextureTileSource *source,
+        uint32_t level, uint32_t tu, uint32_t tv, Tile **pinned) {
+    uint32_t h = hashTile(source, level, tu, tv);
+    Shard &shard = shards[h % TEXTURE_CACHE_SHARDS];
+    Tile **bucket = &shard.buckets[(h / TEXTURE_CACHE_SHARDS) %
+                                   TEXTURE_CACHE_BUCKETS];
+    {
+        // Pin tile if it is already resident
+        MutexLock lock(*shard.mutex);
+        ++shard.lookups;
+        Tile *tile = findTile(*bucket, source, level, tu, tv);
+        if (tile) {
+            ++shard.hits;
+            tile->lruPrev->lruNext = tile->lruNext;
+            tile->lruNext->lruPrev = tile->lruPrev;
+            pinTile(shard, tile);
+            *pinned = tile;
+            return tile->texels;
+        }
+    }
+
+    // Read missing tile from its source without holding the shard's lock
+    uint32_t tileBytes = source->TileBytes();
+    char *texels = AllocAligned<char>(tileBytes);
+    source->LoadTile(level, tu, tv, texels);
+
+    // Add tile to the shard unless another thread has added it meanwhile
+    MutexLock lock(*shard.mutex);
+    Tile *tile = findTile(*bucket, source, level, tu, tv);
+    if (tile) {
+        FreeAligned(texels);
+        tile->lruPrev->lruNext = tile->lruNext;
+        tile->lruNext->lruPrev = tile->lruPrev;
+    }
+    else {
+        tile = new Tile;
+        tile->source = source;
+        tile->level = level;
+        tile->tu = tu;
+        tile->tv = tv;
+        tile->pins = 0;
+        tile->texels = texels;
+        tile->hashNext = *bucket;
+        *bucket = tile;
+        shard.bytes += tileBytes;
+        ++shard.tilesRead;
+        shard.bytesRead += tileBytes;
+
+        // Evict least recently used unpinned tiles while shard is over budget
+        Tile *victim = shard.lru.lruPrev;
+        while (shard.bytes > maxShardBytes && victim != &shard.lru) {
+            Tile *prev = victim->lruPrev;
+            if (victim->pins == 0) {
+                removeTile(shard, victim);
+                ++shard.tilesEvicted;
+            }
+            victim = prev;
+        }
+    }
+    pinTile(shard, tile);
+    *pinned = tile;
+    return tile->texels;
+}
+
+
+void TextureCache::Unpin(Tile *tile) {
+    AtomicAdd(&tile->pins, -1);
+}
+
+
+void TextureCache::Evict(const TextureTileSource *source) {
+    for (int i = 0; i < TEXTURE_CACHE_SHARDS; ++i) {
+        Shard &shard = shards[i];
+        MutexLock lock(*shard.mutex);
+        Tile *tile = shard.lru.lruNext;
+        while (tile != &shard.lru) {
+            Tile *next = tile->lruNext;
+            if (tile->source == source) removeTile(shard, tile);
+            tile = next;
+        }
+    }
+}
+
+
+void TextureCache::pinTile(Shard &shard, Tile *tile) {
+    // Put unlinked _tile_ at front of shard's LRU list and pin it
+    tile->lruNext = shard.lru.lruNext;
+    tile->lruPrev = &shard.lru;
+    shard.lru.lruNext->lruPrev = tile;
+    shard.lru.lruNext = tile;
+    AtomicAdd(&tile->pins, 1);
+}
+
+
+void TextureCache::removeTile(Shard &shard, Tile *tile) {
+    // Unlink _tile_ from its hash bucket and the shard's LRU list
+    uint32_t h = hashTile(tile->source, tile->level, tile->tu, tile->tv);
+    Tile **prev = &shard.buckets[(h / TEXTURE_CACHE_SHARDS) %
+                                 TEXTURE_CACHE_BUCKETS];
+    while (*prev != tile)
+        prev = &(*prev)->hashNext;
+    *prev = tile->hashNext;
+    tile->lruPrev->lruNext = tile->lruNext;
+    tile->lruNext->lruPrev = tile->lruPrev;
+    shard.bytes -= tile->source->TileBytes();
+    FreeAligned(tile->texels);
+    delete tile;
+}
+
+
+TextureCache *GetTextureCache() {
+    // Create the texture cache on first use, sized by _--texturecache_
+    static TextureCache *cache = NULL;
+    if (PbrtOptions.textureCacheMB <= 0)
+        return NULL;
+    if (!cache)
+        cache = new TextureCache(size_t(PbrtOptions.textureCacheMB) << 20);
+    return cache;
+}
+
+
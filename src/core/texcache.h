@@ -0,0 +1,197 @@
+
+/*
+    pbrt source code Copyright(c) 1998-2012 Matt Pharr and Greg Humphreys.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef PBRT_CORE_TEXCACHE_H
+#define PBRT_CORE_TEXCACHE_H
+
+// core/texcache.h*
+#include "pbrt.h"
+#include "memory.h"
+
+// Tiled MIP Map File Declarations
+#define TILEDMIP_MAGIC "PBRTTMIP"
+#define TILEDMIP_VERSION 3
+#define TILEDMIP_LOG_TILE_SIZE 6
+struct TiledMIPHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nChannels, nLevels, logTileSize;
+    float scale, gamma;
+};
+
+
+struct TiledMIPLevel {
+    uint32_t width, height;
+    uint64_t offset;
+    uint32_t uTiles(uint32_t logTileSize) const {
+        return (width + (1 << logTileSize) - 1) >> logTileSize;
+    }
+    uint32_t vTiles(uint32_t logTileSize) const {
+        return (height + (1 << logTileSize) - 1) >> logTileSize;
+    }
+};
+
+
+typedef enum {
+    TILE_ACCESS_AUTO,
+    TILE_ACCESS_CACHE,
+    TILE_ACCESS_MAP
+} TileAccess;
+bool IsTiledMIPFilename(const string &filename);
+class TiledMIPFile : public ReferenceCounted {
+public:
+    // TiledMIPFile Public Methods
+    static TiledMIPFile *Open(const string &filename);
+    ~TiledMIPFile();
+    uint32_t Channels() const { return header.nChannels; }
+    uint32_t Levels() const { return header.nLevels; }
+    uint32_t LogTileSize() const { return header.logTileSize; }
+    float Scale() const { return header.scale; }
+    float Gamma() const { return header.gamma; }
+    uint32_t LevelWidth(uint32_t level) const { return levels[level].width; }
+    uint32_t LevelHeight(uint32_t level) const { return levels[level].height; }
+    uint64_t PyramidBytes() const;
+    bool ReadTile(uint32_t level, uint32_t tu, uint32_t tv, float *texels) const;
+    const float *MappedLevel(uint32_t level) const;
+    const string &Filename() const { return filename; }
+private:
+    // TiledMIPFile Private Methods
+    TiledMIPFile() { }
+
+    // TiledMIPFile Private Data
+    string filename;
+    TiledMIPHeader header;
+    vector<TiledMIPLevel> levels;
+    mutable Reference<MappedFile> mapped;
+#if defined(PBRT_IS_WINDOWS)
+    FILE *file;
+    Mutex *mutex;
+#else
+    int fd;
+#endif
+};
+
+
+
+// TextureCache Declarations
+class TextureTileSource {
+public:
+    // TextureTileSource Interface
+    TextureTileSource(uint32_t nBytes) { tileBytes = nBytes; }
+    virtual ~TextureTileSource();
+    uint32_t TileBytes() const { return tileBytes; }
+    virtual void LoadTile(uint32_t level, uint32_t tu, uint32_t tv,
+                          void *texels) const = 0;
+    virtual const void *MappedLevel(uint32_t level) const { return NULL; }
+private:
+    uint32_t tileBytes;
+};
+
+
+// _TextureCache_ instances are never freed, since their statistics are
+// registered with the statistics registry
+#define TEXTURE_CACHE_SHARDS 16
+class TextureCache {
+public:
+    // TextureCache Public Types
+    struct Tile;
+
+    // TextureCache Public Methods
+    TextureCache(size_t maxBytes);
+    const void *Pin(const TextureTileSource *source, uint32_t level,
+                    uint32_t tu, uint32_t tv, Tile **tile);
+    void Unpin(Tile *tile);
+    void Evict(const TextureTileSource *source);
+private:
+    // TextureCache Private Methods
+    struct Shard;
+    void pinTile(Shard &shard, Tile *tile);
+    void removeTile(Shard &shard, Tile *tile);
+
+    // TextureCache Private Data
+    Shard *shards;
+    size_t maxShardBytes;
+};
+
+
+#define TEXTURE_TILE_PINS 4
+class TextureTilePins {
+public:
+    // TextureTilePins Public Methods
+    TextureTilePins(TextureCache *c, const TextureTileSource *s) {
+        cache = c;
+        source = s;
+        nPinned = nextPin = 0;
+    }
+    ~TextureTilePins() {
+        for (int i = 0; i < nPinned; ++i)
+            cache->Unpin(pins[i].tile);
+    }
+    const void *Texels(uint32_t level, uint32_t tu, uint32_t tv) {
+        for (int i = 0; i < nPinned; ++i)
+            if (pins[i].tu == tu && pins[i].tv == tv && pins[i].level == level)
+                return pins[i].texels;
+        // Pin tile, replacing the oldest pinned tile if needed
+        int i;
+        if (nPinned < TEXTURE_TILE_PINS)
+            i = nPinned++;
+        else {
+            i = nextPin;
+            nextPin = (nextPin + 1) % TEXTURE_TILE_PINS;
+            cache->Unpin(pins[i].tile);
+        }
+        pins[i].level = level;
+        pins[i].tu = tu;
+        pins[i].tv = tv;
+        pins[i].texels = cache->Pin(source, level, tu, tv, &pins[i].tile);
+        return pins[i].texels;
+    }
+private:
+    // TextureTilePins Private Data
+    TextureCache *cache;
+    const TextureTileSource *source;
+    struct PinnedTile {
+        uint32_t level, tu, tv;
+        TextureCache::Tile *tile;
+        const void *texels;
+    };
+    PinnedTile pins[TEXTURE_TILE_PINS];
+    int nPinned, nextPin;
+};
+
+
+TextureCache *GetTextureCache();
+
+#endif // PBRT_CORE_TEXCACHE_H
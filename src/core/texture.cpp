@@ -33,7 +33,10 @@
 // core/texture.cpp*
 #include "stdafx.h"
 #include "texture.h"
+#include "mipmap.h"
 #include "shape.h"
+#include <map>
+using std::map;
 
 // Texture Inline Functions
 inline float SmoothStep(float min, float max, float value) {
@@ -274,3 +277,181 @@ float Lanczos(float x, float tau) {
 }
 
 
+uint16_t FloatToHalf(float f) {
+    union { uint32_t u; float f; } in, denormMagic;
+    const uint32_t f32Infinity = 255 << 23, f16Max = (127 + 16) << 23;
+    denormMagic.u = ((127 - 15) + (23 - 10) + 1) << 23;
+    in.f = f;
+    uint32_t sign = in.u & 0x80000000u;
+    in.u ^= sign;
+    uint16_t h;
+    if (in.u >= f16Max)
+        // Map overflow to infinity and keep NaNs
+        h = (in.u > f32Infinity) ? 0x7e00 : 0x7c00;
+    else if (in.u < (113u << 23)) {
+        // Compute denormalized half with rounding by float addition
+        in.f += denormMagic.f;
+        h = uint16_t(in.u - denormMagic.u);
+    }
+    else {
+        // Rebias exponent and round mantissa to nearest even
+        uint32_t mantissaOdd = (in.u >> 13) & 1;
+        in.u += (uint32_t(15 - 127) << 23) + 0xfff;
+        in.u += mantissaOdd;
+        h = uint16_t(in.u >> 13);
+    }
+    return h | uint16_t(sign >> 16);
+}
+
+
+uint8_t LinearToSRGB8(float v) {
+    if (!(v > 0.f)) return 0;
+    if (v >= 1.f) return 255;
+    float s = (v <= 0.0031308f) ? 12.92f * v :
+        1.055f * powf(v, 1.f / 2.4f) - 0.055f;
+    return uint8_t(Clamp(Round2Int(255.f * s), 0, 255));
+}
+
+
+float SRGB8ToLinearTable[256];
+static struct SRGB8TableInit {
+    SRGB8TableInit() {
+        for (int i = 0; i < 256; ++i) {
+            float s = i / 255.f;
+            SRGB8ToLinearTable[i] = (s <= 0.04045f) ? s / 12.92f :
+                powf((s + 0.055f) / 1.055f, 2.4f);
+        }
+    }
+} srgb8TableInit;
+
+
+
+// MIPMapStats Local Declarations
+struct MIPMapThreadStats {
+    MIPMapThreadStats() {
+        lookups = ewaLookups = clampedLookups = magnifiedLookups = 0;
+        footprintSum = footprintMax = 0.;
+        footprintMin = INFINITY;
+        memset(levelLookups, 0, sizeof(levelLookups));
+    }
+    int64_t lookups, ewaLookups, clampedLookups, magnifiedLookups;
+    double footprintSum, footprintMin, footprintMax;
+    int64_t levelLookups[MIPMAP_STATS_LEVELS];
+};
+
+
+static PBRT_THREAD_LOCAL vector<MIPMapThreadStats> *threadMIPMapStats = NULL;
+static Mutex &mipmapStatsMutex() {
+    static Mutex *mutex = Mutex::Create();
+    return *mutex;
+}
+
+
+static vector<MIPMapStats *> &allMIPMapStats() {
+    static vector<MIPMapStats *> stats;
+    return stats;
+}
+
+
+static vector<vector<MIPMapThreadStats> *> &allThreadMIPMapStats() {
+    static vector<vector<MIPMapThreadStats> *> threadStats;
+    return threadStats;
+}
+
+
+static void flushMIPMapStats() {
+    // Merge each thread's lookups into the shared statistics
+    MutexLock lock(mipmapStatsMutex());
+    const vector<MIPMapStats *> &stats = allMIPMapStats();
+    vector<vector<MIPMapThreadStats> *> &threadStats = allThreadMIPMapStats();
+    for (uint32_t i = 0; i < threadStats.size(); ++i) {
+        vector<MIPMapThreadStats> &ts = *threadStats[i];
+        for (uint32_t j = 0; j < ts.size(); ++j) {
+            MIPMapThreadStats &t = ts[j];
+            if (t.lookups == 0) continue;
+            MIPMapStats &ms = *stats[j];
+            ms.lookups += t.lookups;
+            ms.ewaLookups.Add(t.ewaLookups, t.lookups);
+            ms.clampedLookups.Add(t.clampedLookups, t.ewaLookups);
+            ms.magnifiedLookups.Add(t.magnifiedLookups, t.lookups);
+            AtomicAdd(&ms.footprintCount, t.lookups);
+            AtomicAdd(&ms.footprintSum,
+                      StatsValueType(t.footprintSum * STATS_FIXED_SCALE));
+            StatsAtomicMin(&ms.footprintMin,
+                StatsValueType(t.footprintMin * STATS_FIXED_SCALE));
+            StatsAtomicMax(&ms.footprintMax,
+                StatsValueType(t.footprintMax * STATS_FIXED_SCALE));
+            for (int k = 0; k < MIPMAP_STATS_LEVELS; ++k)
+                if (t.levelLookups[k]) *ms.levelLookups[k] += t.levelLookups[k];
+            t = MIPMapThreadStats();
+        }
+    }
+}
+
+
+
+// MIPMapStats Method Definitions
+MIPMapStats::MIPMapStats(const string &filename, uint32_t i)
+    : id(i), lookups("Texture filtering", filename + ": lookups"),
+      ewaLookups("Texture filtering", filename + ": EWA lookups"),
+      clampedLookups("Texture filtering",
+                     filename + ": EWA clamped to maxanisotropy"),
+      magnifiedLookups("Texture filtering",
+                       filename + ": magnified at finest level") {
+    footprintCount = footprintSum = 0;
+    footprintMin = std::numeric_limits<StatsValueType>::max();
+    footprintMax = std::numeric_limits<StatsValueType>::min();
+    StatsRegister("Texture filtering", filename + ": footprint (texels)",
+                  STATS_FIXED_DISTRIBUTION, &footprintCount, &footprintSum,
+                  &footprintMin, &footprintMax);
+    for (int i = 0; i < MIPMAP_STATS_LEVELS; ++i) {
+        char name[32];
+        sprintf(name, ": level %2d lookups", i);
+        levelLookups[i] = new StatsCounter("Texture filtering", filename + name);
+    }
+}
+
+
+void MIPMapStats::Add(uint32_t fineLevel, uint32_t coarseLevel, float area,
+                      bool ewa, bool clamped, bool magnified) {
+    // Get this thread's statistics for the MIP map
+    vector<MIPMapThreadStats> *ts = threadMIPMapStats;
+    if (!ts) {
+        ts = threadMIPMapStats = new vector<MIPMapThreadStats>;
+        MutexLock lock(mipmapStatsMutex());
+        allThreadMIPMapStats().push_back(ts);
+    }
+    if (id >= ts->size()) ts->resize(id + 1);
+    MIPMapThreadStats &t = (*ts)[id];
+
+    // Record lookup in thread's statistics
+    ++t.lookups;
+    if (ewa) ++t.ewaLookups;
+    if (ewa && clamped) ++t.clampedLookups;
+    if (magnified) ++t.magnifiedLookups;
+    double a = min(area, 1e9f);
+    t.footprintSum += a;
+    t.footprintMin = min(t.footprintMin, a);
+    t.footprintMax = max(t.footprintMax, a);
+    // Count lookups that read each level of the pyramid
+    ++t.levelLookups[min(fineLevel, MIPMAP_STATS_LEVELS - 1u)];
+    if (coarseLevel != fineLevel)
+        ++t.levelLookups[min(coarseLevel, MIPMAP_STATS_LEVELS - 1u)];
+}
+
+
+MIPMapStats *GetMIPMapStats(const string &filename) {
+    // Share one _MIPMapStats_ among all textures that use _filename_
+    static map<string, MIPMapStats *> namedStats;
+    MutexLock lock(mipmapStatsMutex());
+    MIPMapStats *&stats = namedStats[filename];
+    if (!stats) {
+        vector<MIPMapStats *> &all = allMIPMapStats();
+        if (all.size() == 0) StatsRegisterFlush(flushMIPMapStats);
+        stats = new MIPMapStats(filename, all.size());
+        all.push_back(stats);
+    }
+    return stats;
+}
+
+
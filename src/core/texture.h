@@ -148,5 +148,33 @@ float FBm(const Point &P, const Vector &dpdx, const Vector &dpdy,
     float omega, int octaves);
 float Turbulence(const Point &P, const Vector &dpdx, const Vector &dpdy,
     float omega, int octaves);
+uint16_t FloatToHalf(float f);
+inline float HalfToFloat(uint16_t h) {
+    union { uint32_t u; float f; } o, magic;
+    // Move exponent and mantissa into place and rebias exponent
+    const uint32_t shiftedExp = 0x7c00 << 13;
+    o.u = (h & 0x7fff) << 13;
+    uint32_t exp = o.u & shiftedExp;
+    o.u += (127 - 15) << 23;
+    if (exp == shiftedExp)
+        o.u += (128 - 16) << 23;
+    else if (exp == 0) {
+        // Renormalize denormalized half value
+        magic.u = 113 << 23;
+        o.u += 1 << 23;
+        o.f -= magic.f;
+    }
+    o.u |= (h & 0x8000) << 16;
+    return o.f;
+}
+
+
+uint8_t LinearToSRGB8(float v);
+extern float SRGB8ToLinearTable[256];
+inline float SRGB8ToLinear(uint8_t v) {
+    return SRGB8ToLinearTable[v];
+}
+
+
 
 #endif // PBRT_CORE_TEXTURE_H
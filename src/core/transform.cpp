@@ -34,6 +34,7 @@
 #include "stdafx.h"
 #include "transform.h"
 #include "shape.h"
+#include "stats.h"
 
 // Matrix4x4 Method Definitions
 bool SolveLinearSystem2x2(const float A[2][2],
@@ -304,6 +305,43 @@ bool Transform::SwapsHandedness() const {
 }
 
 
+BBox AffineTransform::operator()(const BBox &b) const {
+    const AffineTransform &M = *this;
+    BBox ret(        M(Point(b.pMin.x, b.pMin.y, b.pMin.z)));
+    ret = Union(ret, M(Point(b.pMax.x, b.pMin.y, b.pMin.z)));
+    ret = Union(ret, M(Point(b.pMin.x, b.pMax.y, b.pMin.z)));
+    ret = Union(ret, M(Point(b.pMin.x, b.pMin.y, b.pMax.z)));
+    ret = Union(ret, M(Point(b.pMin.x, b.pMax.y, b.pMax.z)));
+    ret = Union(ret, M(Point(b.pMax.x, b.pMax.y, b.pMin.z)));
+    ret = Union(ret, M(Point(b.pMax.x, b.pMin.y, b.pMax.z)));
+    ret = Union(ret, M(Point(b.pMax.x, b.pMax.y, b.pMax.z)));
+    return ret;
+}
+
+
+bool AffineTransform::SwapsHandedness() const {
+    float det = ((m[0][0] *
+                  (m[1][1] * m[2][2] -
+                   m[1][2] * m[2][1])) -
+                 (m[0][1] *
+                  (m[1][0] * m[2][2] -
+                   m[1][2] * m[2][0])) +
+                 (m[0][2] *
+                  (m[1][0] * m[2][1] -
+                   m[1][1] * m[2][0])));
+    return det < 0.f;
+}
+
+
+void AffineTransformPair(const Transform &t, AffineTransform *at,
+                         AffineTransform *atInv) {
+    *at = AffineTransform(t.GetMatrix());
+    *atInv = AffineTransform(t.GetInverseMatrix());
+    at->inverse = atInv;
+    atInv->inverse = at;
+}
+
+
 Transform Orthographic(float znear, float zfar) {
     return Scale(1.f, 1.f, 1.f / (zfar-znear)) *
            Translate(Vector(0.f, 0.f, -znear));
@@ -371,21 +409,24 @@ void AnimatedTransform::Decompose(const Matrix4x4 &m, Vector *T,
 void AnimatedTransform::Interpolate(float time, Transform *t) const {
     // Handle boundary conditions for matrix interpolation
     if (!actuallyAnimated || time <= startTime) {
-        *t = *startTransform;
+        *t = startTransform->ToTransform();
         return;
     }
     if (time >= endTime) {
-        *t = *endTransform;
+        *t = endTransform->ToTransform();
         return;
     }
     float dt = (time - startTime) / (endTime - startTime);
     // Interpolate translation at _dt_
+    const Vector *T = components->T;
     Vector trans = (1.f - dt) * T[0] + dt * T[1];
 
     // Interpolate rotation at _dt_
+    const Quaternion *R = components->R;
     Quaternion rotate = Slerp(dt, R[0], R[1]);
 
     // Interpolate scale at _dt_
+    const Matrix4x4 *S = components->S;
     Matrix4x4 scale;
     for (int i = 0; i < 3; ++i)
         for (int j = 0; j < 3; ++j)
@@ -399,7 +440,8 @@ void AnimatedTransform::Interpolate(float time, Transform *t) const {
 BBox AnimatedTransform::MotionBounds(const BBox &b,
                                      bool useInverse) const {
     if (!actuallyAnimated) 
-      return useInverse ? Inverse(*startTransform)(b) : (*startTransform)(b);
+      return useInverse ? Inverse(startTransform->ToTransform())(b) :
+                          (*startTransform)(b);
     BBox ret;
     const int nSteps = 128;
     for (int i = 0; i < nSteps; ++i) {
@@ -471,3 +513,120 @@ Ray AnimatedTransform::operator()(const Ray &r) const {
 }
 
 
+
+// TransformStore Local Declarations
+struct TransformStore::Entry {
+    AffineTransform t;
+    uint32_t hash;
+    Entry *next;
+};
+
+
+static StatsMemory transformBytes("Memory", "Transform store");
+static StatsCounter transformsStored("Scene", "Unique transformations");
+static StatsPercentage transformHits("Scene", "Transformation lookups shared");
+
+
+static uint32_t HashMatrix(const Matrix4x4 &m) {
+    // Compute FNV-1a hash of the affine matrix elements, treating $-0$ as $0$
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 4; ++j) {
+            uint32_t bits = 0;
+            if (m.m[i][j] != 0.f)
+                memcpy(&bits, &m.m[i][j], sizeof(float));
+            for (int k = 0; k < 4; ++k) {
+                hash ^= (bits >> (8 * k)) & 0xff;
+                hash *= 16777619u;
+            }
+        }
+    return hash;
+}
+
+
+
+// TransformStore Method Definitions
+TransformStore::TransformStore() {
+    mutex = Mutex::Create();
+    buckets.resize(1024, NULL);
+    nEntries = 0;
+}
+
+
+TransformStore::~TransformStore() {
+    Mutex::Destroy(mutex);
+}
+
+
+const AffineTransform *TransformStore::Lookup(const Transform &t,
+                                             bool needInverse) {
+    const Matrix4x4 &m = t.GetMatrix();
+    if (m.m[3][0] != 0.f || m.m[3][1] != 0.f || m.m[3][2] != 0.f ||
+        m.m[3][3] != 1.f)
+        Warning("Projective transformation can't be stored as an affine "
+                "transformation. Ignoring its last row.");
+    MutexLock lock(*mutex);
+    AffineTransform *at = Insert(m);
+    if (needInverse && !at->inverse) {
+        // Store the inverse transformation the first time it is requested
+        AffineTransform *atInv = Insert(t.GetInverseMatrix());
+        at->inverse = atInv;
+        if (!atInv->inverse) atInv->inverse = at;
+    }
+    return at;
+}
+
+
+AffineTransform *TransformStore::Insert(const Matrix4x4 &m) {
+    // Look for a stored _AffineTransform_ with the same matrix as _m_
+    AffineTransform t(m);
+    uint32_t hash = HashMatrix(m);
+    uint32_t bucket = hash & (buckets.size() - 1);
+    for (Entry *entry = buckets[bucket]; entry; entry = entry->next)
+        if (entry->hash == hash && entry->t == t) {
+            PBRT_FOUND_CACHED_TRANSFORM();
+            transformHits.Add(1, 1);
+            return &entry->t;
+        }
+
+    // Grow hash table if it has become too heavily loaded
+    if (nEntries >= buckets.size()) {
+        vector<Entry *> newBuckets(2 * buckets.size(), NULL);
+        for (uint32_t i = 0; i < buckets.size(); ++i) {
+            Entry *entry = buckets[i];
+            while (entry) {
+                Entry *next = entry->next;
+                uint32_t b = entry->hash & (newBuckets.size() - 1);
+                entry->next = newBuckets[b];
+                newBuckets[b] = entry;
+                entry = next;
+            }
+        }
+        buckets.swap(newBuckets);
+        bucket = hash & (buckets.size() - 1);
+    }
+
+    // Add new _Entry_ for _t_ to the store
+    Entry *entry = arena.Alloc<Entry>();
+    entry->t = t;
+    entry->hash = hash;
+    entry->next = buckets[bucket];
+    buckets[bucket] = entry;
+    ++nEntries;
+    PBRT_ALLOCATED_CACHED_TRANSFORM();
+    transformBytes += sizeof(Entry);
+    ++transformsStored;
+    transformHits.Add(0, 1);
+    return &entry->t;
+}
+
+
+void TransformStore::Clear() {
+    MutexLock lock(*mutex);
+    arena.FreeAll();
+    vector<Entry *> emptyBuckets(1024, NULL);
+    buckets.swap(emptyBuckets);
+    nEntries = 0;
+}
+
+
@@ -40,6 +40,7 @@
 #include "pbrt.h"
 #include "geometry.h"
 #include "quaternion.h"
+#include "memory.h"
 
 // Matrix4x4 Declarations
 struct Matrix4x4 {
@@ -295,17 +296,176 @@ inline RayDifferential Transform::operator()(const RayDifferential &r) const {
 
 
 
+// AffineTransform Declarations
+class AffineTransform {
+public:
+    // AffineTransform Public Methods
+    AffineTransform() : inverse(NULL) {
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 4; ++j)
+                m[i][j] = (i == j) ? 1.f : 0.f;
+    }
+    explicit AffineTransform(const Matrix4x4 &mat) : inverse(NULL) {
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 4; ++j)
+                m[i][j] = mat.m[i][j];
+    }
+    friend void AffineTransformPair(const Transform &t, AffineTransform *at,
+                                    AffineTransform *atInv);
+    bool operator==(const AffineTransform &t) const {
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 4; ++j)
+                if (m[i][j] != t.m[i][j]) return false;
+        return true;
+    }
+    bool operator!=(const AffineTransform &t) const {
+        return !(*this == t);
+    }
+    bool IsIdentity() const {
+        for (int i = 0; i < 3; ++i)
+            for (int j = 0; j < 4; ++j)
+                if (m[i][j] != ((i == j) ? 1.f : 0.f)) return false;
+        return true;
+    }
+    const AffineTransform *GetInverse() const { return inverse; }
+    Matrix4x4 GetMatrix() const {
+        return Matrix4x4(m[0][0], m[0][1], m[0][2], m[0][3],
+                         m[1][0], m[1][1], m[1][2], m[1][3],
+                         m[2][0], m[2][1], m[2][2], m[2][3],
+                         0.f, 0.f, 0.f, 1.f);
+    }
+    Transform ToTransform() const {
+        if (inverse) return Transform(GetMatrix(), inverse->GetMatrix());
+        return Transform(GetMatrix());
+    }
+    bool HasScale() const {
+        float la2 = (*this)(Vector(1,0,0)).LengthSquared();
+        float lb2 = (*this)(Vector(0,1,0)).LengthSquared();
+        float lc2 = (*this)(Vector(0,0,1)).LengthSquared();
+#define NOT_ONE(x) ((x) < .999f || (x) > 1.001f)
+        return (NOT_ONE(la2) || NOT_ONE(lb2) || NOT_ONE(lc2));
+#undef NOT_ONE
+    }
+    inline Point operator()(const Point &pt) const;
+    inline void operator()(const Point &pt, Point *ptrans) const;
+    inline Vector operator()(const Vector &v) const;
+    inline void operator()(const Vector &v, Vector *vt) const;
+    inline Normal operator()(const Normal &) const;
+    inline void operator()(const Normal &, Normal *nt) const;
+    inline Ray operator()(const Ray &r) const;
+    inline void operator()(const Ray &r, Ray *rt) const;
+    inline void operator()(const RayDifferential &r, RayDifferential *rt) const;
+    BBox operator()(const BBox &b) const;
+    bool SwapsHandedness() const;
+private:
+    // AffineTransform Private Data
+    float m[3][4];
+    const AffineTransform *inverse;
+    friend class TransformStore;
+};
+
+
+// AffineTransform Inline Functions
+inline Point AffineTransform::operator()(const Point &pt) const {
+    float x = pt.x, y = pt.y, z = pt.z;
+    return Point(m[0][0]*x + m[0][1]*y + m[0][2]*z + m[0][3],
+                 m[1][0]*x + m[1][1]*y + m[1][2]*z + m[1][3],
+                 m[2][0]*x + m[2][1]*y + m[2][2]*z + m[2][3]);
+}
+
+
+inline void AffineTransform::operator()(const Point &pt,
+                                        Point *ptrans) const {
+    float x = pt.x, y = pt.y, z = pt.z;
+    ptrans->x = m[0][0]*x + m[0][1]*y + m[0][2]*z + m[0][3];
+    ptrans->y = m[1][0]*x + m[1][1]*y + m[1][2]*z + m[1][3];
+    ptrans->z = m[2][0]*x + m[2][1]*y + m[2][2]*z + m[2][3];
+}
+
+
+inline Vector AffineTransform::operator()(const Vector &v) const {
+    float x = v.x, y = v.y, z = v.z;
+    return Vector(m[0][0]*x + m[0][1]*y + m[0][2]*z,
+                  m[1][0]*x + m[1][1]*y + m[1][2]*z,
+                  m[2][0]*x + m[2][1]*y + m[2][2]*z);
+}
+
+
+inline void AffineTransform::operator()(const Vector &v,
+                                        Vector *vt) const {
+    float x = v.x, y = v.y, z = v.z;
+    vt->x = m[0][0]*x + m[0][1]*y + m[0][2]*z;
+    vt->y = m[1][0]*x + m[1][1]*y + m[1][2]*z;
+    vt->z = m[2][0]*x + m[2][1]*y + m[2][2]*z;
+}
+
+
+inline Normal AffineTransform::operator()(const Normal &n) const {
+    // Transform normal with the transpose of the stored inverse
+    Assert(inverse != NULL);
+    const float (*mInv)[4] = inverse->m;
+    float x = n.x, y = n.y, z = n.z;
+    return Normal(mInv[0][0]*x + mInv[1][0]*y + mInv[2][0]*z,
+                  mInv[0][1]*x + mInv[1][1]*y + mInv[2][1]*z,
+                  mInv[0][2]*x + mInv[1][2]*y + mInv[2][2]*z);
+}
+
+
+inline void AffineTransform::operator()(const Normal &n,
+                                        Normal *nt) const {
+    *nt = (*this)(n);
+}
+
+
+inline Ray AffineTransform::operator()(const Ray &r) const {
+    Ray ret = r;
+    (*this)(ret.o, &ret.o);
+    (*this)(ret.d, &ret.d);
+    return ret;
+}
+
+
+inline void AffineTransform::operator()(const Ray &r, Ray *rt) const {
+    (*this)(r.o, &rt->o);
+    (*this)(r.d, &rt->d);
+    if (rt != &r) {
+        rt->mint = r.mint;
+        rt->maxt = r.maxt;
+        rt->time = r.time;
+        rt->depth = r.depth;
+    }
+}
+
+
+inline void AffineTransform::operator()(const RayDifferential &r,
+                                        RayDifferential *rt) const {
+    (*this)(Ray(r), rt);
+    rt->hasDifferentials = r.hasDifferentials;
+    (*this)(r.rxOrigin, &rt->rxOrigin);
+    (*this)(r.ryOrigin, &rt->ryOrigin);
+    (*this)(r.rxDirection, &rt->rxDirection);
+    (*this)(r.ryDirection, &rt->ryDirection);
+}
+
+
+
 // AnimatedTransform Declarations
 class AnimatedTransform {
 public:
     // AnimatedTransform Public Methods
-    AnimatedTransform(const Transform *transform1, float time1,
-                      const Transform *transform2, float time2)
+    AnimatedTransform(const AffineTransform *transform1, float time1,
+                      const AffineTransform *transform2, float time2)
         : startTime(time1), endTime(time2),
           startTransform(transform1), endTransform(transform2),
           actuallyAnimated(*startTransform != *endTransform) {
-        Decompose(startTransform->m, &T[0], &R[0], &S[0]);
-        Decompose(endTransform->m, &T[1], &R[1], &S[1]);
+        // Decompose transformations only if they need to be interpolated
+        if (actuallyAnimated) {
+            components = new Components;
+            Decompose(startTransform->GetMatrix(), &components->T[0],
+                      &components->R[0], &components->S[0]);
+            Decompose(endTransform->GetMatrix(), &components->T[1],
+                      &components->R[1], &components->S[1]);
+        }
     }
     static void Decompose(const Matrix4x4 &m, Vector *T, Quaternion *R, Matrix4x4 *S);
     void Interpolate(float time, Transform *t) const;
@@ -319,11 +479,35 @@ public:
 private:
     // AnimatedTransform Private Data
     const float startTime, endTime;
-    const Transform *startTransform, *endTransform;
+    const AffineTransform *startTransform, *endTransform;
     const bool actuallyAnimated;
-    Vector T[2];
-    Quaternion R[2];
-    Matrix4x4 S[2];
+    struct Components : public ReferenceCounted {
+        Vector T[2];
+        Quaternion R[2];
+        Matrix4x4 S[2];
+    };
+    Reference<Components> components;
+};
+
+
+// TransformStore Declarations
+class TransformStore {
+public:
+    // TransformStore Public Methods
+    TransformStore();
+    ~TransformStore();
+    const AffineTransform *Lookup(const Transform &t, bool needInverse);
+    void Clear();
+private:
+    // TransformStore Private Methods
+    AffineTransform *Insert(const Matrix4x4 &m);
+
+    // TransformStore Private Data
+    struct Entry;
+    Mutex *mutex;
+    MemoryArena arena;
+    vector<Entry *> buckets;
+    uint32_t nEntries;
 };
 
 
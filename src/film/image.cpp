@@ -36,6 +36,22 @@
 #include "spectrum.h"
 #include "parallel.h"
 #include "imageio.h"
+#include "stats.h"
+#ifdef PBRT_HAS_SSE
+#include <emmintrin.h>
+#endif
+
+// ImageFilm Local Declarations
+static StatsMemory filmBytes("Memory", "Film pixels");
+#define FILMSTATE_MAGIC "PBRTFILM"
+#define FILMSTATE_VERSION 1
+#define FILMSTATE_PIXEL_FLOATS 7
+struct FilmStateHeader {
+    char magic[8];
+    uint32_t version;
+    int32_t xResolution, yResolution;
+    int32_t xPixelStart, yPixelStart, xPixelCount, yPixelCount;
+};
 
 // ImageFilm Method Definitions
 ImageFilm::ImageFilm(int xres, int yres, Filter *filt, const float crop[4],
@@ -52,6 +68,7 @@ ImageFilm::ImageFilm(int xres, int yres, Filter *filt, const float crop[4],
 
     // Allocate film image storage
     pixels = new BlockedArray<Pixel>(xPixelCount, yPixelCount);
+    filmBytes += xPixelCount * yPixelCount * sizeof(Pixel);
 
     // Precompute filter weight table
 #define FILTER_TABLE_SIZE 16
@@ -74,20 +91,58 @@ ImageFilm::ImageFilm(int xres, int yres, Filter *filt, const float crop[4],
 }
 
 
-void ImageFilm::AddSample(const CameraSample &sample,
-                          const Spectrum &L) {
+bool ImageFilm::SampleFootprint(const CameraSample &sample, int *x0,
+                                int *x1, int *y0, int *y1) const {
     // Compute sample's raster extent
     float dimageX = sample.imageX - 0.5f;
     float dimageY = sample.imageY - 0.5f;
-    int x0 = Ceil2Int (dimageX - filter->xWidth);
-    int x1 = Floor2Int(dimageX + filter->xWidth);
-    int y0 = Ceil2Int (dimageY - filter->yWidth);
-    int y1 = Floor2Int(dimageY + filter->yWidth);
-    x0 = max(x0, xPixelStart);
-    x1 = min(x1, xPixelStart + xPixelCount - 1);
-    y0 = max(y0, yPixelStart);
-    y1 = min(y1, yPixelStart + yPixelCount - 1);
-    if ((x1-x0) < 0 || (y1-y0) < 0)
+    *x0 = max(Ceil2Int (dimageX - filter->xWidth), xPixelStart);
+    *x1 = min(Floor2Int(dimageX + filter->xWidth),
+              xPixelStart + xPixelCount - 1);
+    *y0 = max(Ceil2Int (dimageY - filter->yWidth), yPixelStart);
+    *y1 = min(Floor2Int(dimageY + filter->yWidth),
+              yPixelStart + yPixelCount - 1);
+    return (*x1 - *x0) >= 0 && (*y1 - *y0) >= 0;
+}
+
+
+void ImageFilm::FilterOffsets(const CameraSample &sample, int x0, int x1,
+                              int y0, int y1, int *ifx, int *ify) const {
+    float dimageX = sample.imageX - 0.5f;
+    float dimageY = sample.imageY - 0.5f;
+    int x = x0;
+#ifdef PBRT_HAS_SSE
+    // Compute $x$ offsets four pixels at a time
+    __m128 dx = _mm_set1_ps(dimageX);
+    __m128 xScale = _mm_set1_ps(filter->invXWidth);
+    __m128 tableSize = _mm_set1_ps(FILTER_TABLE_SIZE);
+    __m128 maxOffset = _mm_set1_ps(FILTER_TABLE_SIZE - 1);
+    __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    for (; x + 3 <= x1; x += 4) {
+        __m128 px = _mm_cvtepi32_ps(_mm_setr_epi32(x, x+1, x+2, x+3));
+        __m128 fx = _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(px, dx), xScale),
+                               tableSize);
+        fx = _mm_min_ps(_mm_and_ps(fx, absMask), maxOffset);
+        _mm_storeu_si128((__m128i *)&ifx[x-x0], _mm_cvttps_epi32(fx));
+    }
+#endif // PBRT_HAS_SSE
+    for (; x <= x1; ++x) {
+        float fx = fabsf((x - dimageX) *
+                         filter->invXWidth * FILTER_TABLE_SIZE);
+        ifx[x-x0] = min(Floor2Int(fx), FILTER_TABLE_SIZE-1);
+    }
+    for (int y = y0; y <= y1; ++y) {
+        float fy = fabsf((y - dimageY) *
+                         filter->invYWidth * FILTER_TABLE_SIZE);
+        ify[y-y0] = min(Floor2Int(fy), FILTER_TABLE_SIZE-1);
+    }
+}
+
+
+void ImageFilm::AddSample(const CameraSample &sample,
+                          const Spectrum &L) {
+    int x0, x1, y0, y1;
+    if (!SampleFootprint(sample, &x0, &x1, &y0, &y1))
     {
         PBRT_SAMPLE_OUTSIDE_IMAGE_EXTENT(const_cast<CameraSample *>(&sample));
         return;
@@ -99,17 +154,8 @@ void ImageFilm::AddSample(const CameraSample &sample,
 
     // Precompute $x$ and $y$ filter table offsets
     int *ifx = ALLOCA(int, x1 - x0 + 1);
-    for (int x = x0; x <= x1; ++x) {
-        float fx = fabsf((x - dimageX) *
-                         filter->invXWidth * FILTER_TABLE_SIZE);
-        ifx[x-x0] = min(Floor2Int(fx), FILTER_TABLE_SIZE-1);
-    }
     int *ify = ALLOCA(int, y1 - y0 + 1);
-    for (int y = y0; y <= y1; ++y) {
-        float fy = fabsf((y - dimageY) *
-                         filter->invYWidth * FILTER_TABLE_SIZE);
-        ify[y-y0] = min(Floor2Int(fy), FILTER_TABLE_SIZE-1);
-    }
+    FilterOffsets(sample, x0, x1, y0, y1, ifx, ify);
     bool syncNeeded = (filter->xWidth > 0.5f || filter->yWidth > 0.5f);
     for (int y = y0; y <= y1; ++y) {
         for (int x = x0; x <= x1; ++x) {
@@ -175,18 +221,151 @@ void ImageFilm::GetPixelExtent(int *xstart, int *xend,
 }
 
 
-void ImageFilm::WriteImage(float splatScale) {
-    // Convert image to RGB and compute final pixel values
-    int nPix = xPixelCount * yPixelCount;
-    float *rgb = new float[3*nPix];
-    int offset = 0;
-    for (int y = 0; y < yPixelCount; ++y) {
-        for (int x = 0; x < xPixelCount; ++x) {
+class ImageFilm::Tile : public FilmTile {
+public:
+    // ImageFilm::Tile Public Methods
+    Tile(ImageFilm *f, int x0, int x1, int y0, int y1);
+    ~Tile() { FreeAligned(Lxyz[0]); }
+    void AddSample(const CameraSample &sample, const Spectrum &L);
+
+    // ImageFilm::Tile Public Data
+    ImageFilm *imageFilm;
+    int xStart, xEnd, yStart, yEnd;
+    int rowStride;
+    float *Lxyz[3], *weightSum;
+};
+
+
+ImageFilm::Tile::Tile(ImageFilm *f, int x0, int x1, int y0, int y1)
+    : FilmTile(f), imageFilm(f), xStart(x0), xEnd(x1),
+      yStart(y0), yEnd(y1) {
+    // Allocate structure-of-arrays tile storage
+    rowStride = xEnd - xStart;
+    int nValues = rowStride * max(1, yEnd - yStart);
+    Lxyz[0] = AllocAligned<float>(4 * nValues);
+    memset(Lxyz[0], 0, 4 * nValues * sizeof(float));
+    Lxyz[1] = Lxyz[0] + nValues;
+    Lxyz[2] = Lxyz[1] + nValues;
+    weightSum = Lxyz[2] + nValues;
+}
+
+
+void ImageFilm::Tile::AddSample(const CameraSample &sample,
+                                const Spectrum &L) {
+    int x0, x1, y0, y1;
+    if (!imageFilm->SampleFootprint(sample, &x0, &x1, &y0, &y1))
+    {
+        PBRT_SAMPLE_OUTSIDE_IMAGE_EXTENT(const_cast<CameraSample *>(&sample));
+        return;
+    }
+    if (x0 < xStart || x1 >= xEnd || y0 < yStart || y1 >= yEnd) {
+        // Add sample that reaches past the tile directly to the film
+        imageFilm->AddSample(sample, L);
+        return;
+    }
+
+    // Loop over filter support and add sample to tile pixels
+    float xyz[3];
+    L.ToXYZ(xyz);
+    int nx = x1 - x0 + 1;
+    int *ifx = ALLOCA(int, nx);
+    int *ify = ALLOCA(int, y1 - y0 + 1);
+    imageFilm->FilterOffsets(sample, x0, x1, y0, y1, ifx, ify);
+    float *rowWeights = ALLOCA(float, nx);
+#ifdef PBRT_HAS_SSE
+    __m128 X = _mm_set1_ps(xyz[0]);
+    __m128 Y = _mm_set1_ps(xyz[1]);
+    __m128 Z = _mm_set1_ps(xyz[2]);
+#endif // PBRT_HAS_SSE
+    const float *filterTable = imageFilm->filterTable;
+    for (int y = y0; y <= y1; ++y) {
+        // Look up filter weights for the footprint's pixels in row _y_
+        const float *filterRow = &filterTable[ify[y-y0]*FILTER_TABLE_SIZE];
+        for (int i = 0; i < nx; ++i)
+            rowWeights[i] = filterRow[ifx[i]];
+
+        // Accumulate weighted sample into row _y_ of the tile
+        int offset = (y - yStart) * rowStride + (x0 - xStart);
+        float *Lx = Lxyz[0] + offset, *Ly = Lxyz[1] + offset;
+        float *Lz = Lxyz[2] + offset, *wt = weightSum + offset;
+        int i = 0;
+#ifdef PBRT_HAS_SSE
+        for (; i + 3 < nx; i += 4) {
+            __m128 w = _mm_loadu_ps(&rowWeights[i]);
+            _mm_storeu_ps(&Lx[i], _mm_add_ps(_mm_loadu_ps(&Lx[i]),
+                                             _mm_mul_ps(w, X)));
+            _mm_storeu_ps(&Ly[i], _mm_add_ps(_mm_loadu_ps(&Ly[i]),
+                                             _mm_mul_ps(w, Y)));
+            _mm_storeu_ps(&Lz[i], _mm_add_ps(_mm_loadu_ps(&Lz[i]),
+                                             _mm_mul_ps(w, Z)));
+            _mm_storeu_ps(&wt[i], _mm_add_ps(_mm_loadu_ps(&wt[i]), w));
+        }
+#endif // PBRT_HAS_SSE
+        for (; i < nx; ++i) {
+            float w = rowWeights[i];
+            Lx[i] += w * xyz[0];
+            Ly[i] += w * xyz[1];
+            Lz[i] += w * xyz[2];
+            wt[i] += w;
+        }
+    }
+}
+
+
+FilmTile *ImageFilm::GetFilmTile(int xstart, int xend,
+                                 int ystart, int yend) {
+    // Add samples directly to the film if they never need synchronization
+    if (filter->xWidth <= 0.5f && filter->yWidth <= 0.5f)
+        return Film::GetFilmTile(xstart, xend, ystart, yend);
+
+    // Find pixels that samples in $[xstart,xend) \times [ystart,yend)$ reach
+    int x0 = max(Ceil2Int(xstart - 0.5f - filter->xWidth), xPixelStart);
+    int x1 = min(Floor2Int(xend - 0.5f + filter->xWidth),
+                 xPixelStart + xPixelCount - 1);
+    int y0 = max(Ceil2Int(ystart - 0.5f - filter->yWidth), yPixelStart);
+    int y1 = min(Floor2Int(yend - 0.5f + filter->yWidth),
+                 yPixelStart + yPixelCount - 1);
+    return new Tile(this, x0, max(x0, x1 + 1), y0, max(y0, y1 + 1));
+}
+
+
+void ImageFilm::MergeFilmTile(FilmTile *filmTile) {
+    if (filter->xWidth <= 0.5f && filter->yWidth <= 0.5f) {
+        Film::MergeFilmTile(filmTile);
+        return;
+    }
+    // Add tile's pixel values to the film; neighboring tiles overlap
+    Tile *tile = (Tile *)filmTile;
+    for (int y = tile->yStart; y < tile->yEnd; ++y) {
+        int offset = (y - tile->yStart) * tile->rowStride;
+        for (int x = tile->xStart; x < tile->xEnd; ++x, ++offset) {
+            float Lx = tile->Lxyz[0][offset], Ly = tile->Lxyz[1][offset];
+            float Lz = tile->Lxyz[2][offset], wt = tile->weightSum[offset];
+            if (wt == 0.f && Lx == 0.f && Ly == 0.f && Lz == 0.f)
+                continue;
+            Pixel &pixel = (*pixels)(x - xPixelStart, y - yPixelStart);
+            AtomicAdd(&pixel.Lxyz[0], Lx);
+            AtomicAdd(&pixel.Lxyz[1], Ly);
+            AtomicAdd(&pixel.Lxyz[2], Lz);
+            AtomicAdd(&pixel.weightSum, wt);
+        }
+    }
+    delete tile;
+}
+
+
+struct ImageFilm::ConvertRowFunc {
+    ConvertRowFunc(const ImageFilm *f, float ss, float *r)
+        : film(f), splatScale(ss), rgb(r) { }
+    void operator()(int y) const {
+        int offset = y * film->xPixelCount;
+        for (int x = 0; x < film->xPixelCount; ++x) {
+            const Pixel &pixel = (*film->pixels)(x, y);
             // Convert pixel XYZ color to RGB
-            XYZToRGB((*pixels)(x, y).Lxyz, &rgb[3*offset]);
+            XYZToRGB(pixel.Lxyz, &rgb[3*offset]);
 
             // Normalize pixel with weight sum
-            float weightSum = (*pixels)(x, y).weightSum;
+            float weightSum = pixel.weightSum;
             if (weightSum != 0.f) {
                 float invWt = 1.f / weightSum;
                 rgb[3*offset  ] = max(0.f, rgb[3*offset  ] * invWt);
@@ -196,13 +375,24 @@ void ImageFilm::WriteImage(float splatScale) {
 
             // Add splat value at pixel
             float splatRGB[3];
-            XYZToRGB((*pixels)(x, y).splatXYZ, splatRGB);
+            XYZToRGB(pixel.splatXYZ, splatRGB);
             rgb[3*offset  ] += splatScale * splatRGB[0];
             rgb[3*offset+1] += splatScale * splatRGB[1];
             rgb[3*offset+2] += splatScale * splatRGB[2];
             ++offset;
         }
     }
+    const ImageFilm *film;
+    float splatScale;
+    float *rgb;
+};
+
+
+void ImageFilm::WriteImage(float splatScale) {
+    // Convert image to RGB and compute final pixel values
+    int nPix = xPixelCount * yPixelCount;
+    float *rgb = new float[3*nPix];
+    ParallelFor(0, yPixelCount, 16, ConvertRowFunc(this, splatScale, rgb));
 
     // Write RGB image
     ::WriteImage(filename, rgb, NULL, xPixelCount, yPixelCount,
@@ -218,6 +408,92 @@ void ImageFilm::UpdateDisplay(int x0, int y0, int x1, int y1,
 }
 
 
+bool ImageFilm::WriteState(FILE *f) const {
+    // Write _FilmStateHeader_ describing film's pixel extent
+    FilmStateHeader header;
+    memcpy(header.magic, FILMSTATE_MAGIC, 8);
+    header.version = FILMSTATE_VERSION;
+    header.xResolution = xResolution;
+    header.yResolution = yResolution;
+    header.xPixelStart = xPixelStart;
+    header.yPixelStart = yPixelStart;
+    header.xPixelCount = xPixelCount;
+    header.yPixelCount = yPixelCount;
+    if (fwrite(&header, sizeof(header), 1, f) != 1)
+        return false;
+
+    // Write unnormalized pixel sums one row at a time
+    vector<float> row(FILMSTATE_PIXEL_FLOATS * xPixelCount);
+    for (int y = 0; y < yPixelCount; ++y) {
+        float *p = &row[0];
+        for (int x = 0; x < xPixelCount; ++x) {
+            const Pixel &pixel = (*pixels)(x, y);
+            *p++ = pixel.Lxyz[0];
+            *p++ = pixel.Lxyz[1];
+            *p++ = pixel.Lxyz[2];
+            *p++ = pixel.weightSum;
+            *p++ = pixel.splatXYZ[0];
+            *p++ = pixel.splatXYZ[1];
+            *p++ = pixel.splatXYZ[2];
+        }
+        if (fwrite(&row[0], sizeof(float), row.size(), f) != row.size())
+            return false;
+    }
+    return true;
+}
+
+
+bool ImageFilm::AddState(FILE *f) {
+    // Read and validate _FilmStateHeader_
+    FilmStateHeader header;
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        memcmp(header.magic, FILMSTATE_MAGIC, 8) != 0) {
+        Error("Film state is missing or corrupt.");
+        return false;
+    }
+    if (header.version != FILMSTATE_VERSION) {
+        Error("Film state has unsupported version %d.", (int)header.version);
+        return false;
+    }
+    if (header.xResolution != xResolution ||
+        header.yResolution != yResolution ||
+        header.xPixelStart != xPixelStart ||
+        header.yPixelStart != yPixelStart ||
+        header.xPixelCount != xPixelCount ||
+        header.yPixelCount != yPixelCount) {
+        Error("Film state for %dx%d image with pixels [%d,%d)x[%d,%d) doesn't "
+              "match film.", (int)header.xResolution, (int)header.yResolution,
+              (int)header.xPixelStart,
+              (int)(header.xPixelStart + header.xPixelCount),
+              (int)header.yPixelStart,
+              (int)(header.yPixelStart + header.yPixelCount));
+        return false;
+    }
+
+    // Read all pixel sums before modifying the film
+    vector<float> sums(FILMSTATE_PIXEL_FLOATS * xPixelCount * yPixelCount);
+    if (fread(&sums[0], sizeof(float), sums.size(), f) != sums.size()) {
+        Error("Film state is truncated.");
+        return false;
+    }
+
+    // Add pixel sums to film's pixels
+    const float *p = &sums[0];
+    for (int y = 0; y < yPixelCount; ++y)
+        for (int x = 0; x < xPixelCount; ++x) {
+            Pixel &pixel = (*pixels)(x, y);
+            pixel.Lxyz[0] += *p++;
+            pixel.Lxyz[1] += *p++;
+            pixel.Lxyz[2] += *p++;
+            pixel.weightSum += *p++;
+            pixel.splatXYZ[0] += *p++;
+            pixel.splatXYZ[1] += *p++;
+            pixel.splatXYZ[2] += *p++;
+        }
+    return true;
+}
+
+
 ImageFilm *CreateImageFilm(const ParamSet &params, Filter *filter) {
     // Intentionally use FindOneString() rather than FindOneFilename() here
     // so that the rendered image is left in the working directory, rather
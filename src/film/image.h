@@ -56,11 +56,21 @@ public:
     }
     void AddSample(const CameraSample &sample, const Spectrum &L);
     void Splat(const CameraSample &sample, const Spectrum &L);
+    FilmTile *GetFilmTile(int xstart, int xend, int ystart, int yend);
+    void MergeFilmTile(FilmTile *tile);
     void GetSampleExtent(int *xstart, int *xend, int *ystart, int *yend) const;
     void GetPixelExtent(int *xstart, int *xend, int *ystart, int *yend) const;
     void WriteImage(float splatScale);
     void UpdateDisplay(int x0, int y0, int x1, int y1, float splatScale);
+    bool WriteState(FILE *f) const;
+    bool AddState(FILE *f);
 private:
+    // ImageFilm Private Methods
+    bool SampleFootprint(const CameraSample &sample, int *x0, int *x1,
+                         int *y0, int *y1) const;
+    void FilterOffsets(const CameraSample &sample, int x0, int x1,
+                       int y0, int y1, int *ifx, int *ify) const;
+
     // ImageFilm Private Data
     Filter *filter;
     float cropWindow[4];
@@ -78,6 +88,8 @@ private:
     };
     BlockedArray<Pixel> *pixels;
     float *filterTable;
+    struct ConvertRowFunc;
+    class Tile;
 };
 
 
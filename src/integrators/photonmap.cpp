@@ -40,9 +40,11 @@
 #include "intersection.h"
 #include "paramset.h"
 #include "camera.h"
+#include "stats.h"
 
 
 // PhotonIntegrator Local Declarations
+static StatsMemory photonMapBytes("Memory", "Photon maps");
 struct Photon {
     Photon(const Point &pp, const Spectrum &wt, const Vector &w)
         : p(pp), alpha(wt), wi(w) { }
@@ -372,6 +374,9 @@ void PhotonIntegrator::Preprocess(const Scene *scene,
 
     // Build kd-trees for indirect and caustic photons
     KdTree<Photon> *directMap = NULL;
+    photonMapBytes += (directPhotons.size() + causticPhotons.size() +
+                       indirectPhotons.size()) *
+                      (sizeof(KdNode) + sizeof(Photon));
     if (directPhotons.size() > 0)
         directMap = new KdTree<Photon>(directPhotons);
     if (causticPhotons.size() > 0)
@@ -397,6 +402,8 @@ void PhotonIntegrator::Preprocess(const Scene *scene,
             delete radianceTasks[i];
         progRadiance.Done();
         radianceMap = new KdTree<RadiancePhoton>(radiancePhotons);
+        photonMapBytes += radiancePhotons.size() *
+                          (sizeof(KdNode) + sizeof(RadiancePhoton));
     }
     delete directMap;
 }
@@ -37,6 +37,29 @@
 #include "montecarlo.h"
 #include "paramset.h"
 #include "imageio.h"
+#include "parallel.h"
+
+// InfiniteAreaLight Local Definitions
+struct SampleEnvMapRowFunc {
+    SampleEnvMapRowFunc(const MIPMap<RGBSpectrum> *m, int w, int h,
+                        float f, float *i)
+        : radianceMap(m), width(w), height(h), filter(f), img(i) { }
+    void operator()(int v) const {
+        float vp = (float)v / (float)height;
+        float sinTheta = sinf(M_PI * float(v+.5f)/float(height));
+        for (int u = 0; u < width; ++u) {
+            float up = (float)u / (float)width;
+            img[u+v*width] = radianceMap->Lookup(up, vp, filter).y();
+            img[u+v*width] *= sinTheta;
+        }
+    }
+    const MIPMap<RGBSpectrum> *radianceMap;
+    int width, height;
+    float filter;
+    float *img;
+};
+
+
 
 // InfiniteAreaLight Utility Classes
 struct InfiniteAreaCube {
@@ -89,15 +112,8 @@ InfiniteAreaLight::InfiniteAreaLight(const Transform &light2world,
     // Compute scalar-valued image _img_ from environment map
     float filter = 1.f / max(width, height);
     float *img = new float[width*height];
-    for (int v = 0; v < height; ++v) {
-        float vp = (float)v / (float)height;
-        float sinTheta = sinf(M_PI * float(v+.5f)/float(height));
-        for (int u = 0; u < width; ++u) {
-            float up = (float)u / (float)width;
-            img[u+v*width] = radianceMap->Lookup(up, vp, filter).y();
-            img[u+v*width] *= sinTheta;
-        }
-    }
+    ParallelFor(0, height, 16, SampleEnvMapRowFunc(radianceMap, width, height,
+                                                   filter, img));
 
     // Compute sampling distributions for rows and columns of image
     distribution = new Distribution2D(img, width, height);
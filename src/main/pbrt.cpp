@@ -45,12 +45,26 @@ int main(int argc, char *argv[]) {
     for (int i = 1; i < argc; ++i) {
         if (!strcmp(argv[i], "--ncores")) options.nCores = atoi(argv[++i]);
         else if (!strcmp(argv[i], "--outfile")) options.imageFile = argv[++i];
+        else if (!strcmp(argv[i], "--statsfile")) options.statsFile = argv[++i];
         else if (!strcmp(argv[i], "--quick")) options.quickRender = true;
         else if (!strcmp(argv[i], "--quiet")) options.quiet = true;
         else if (!strcmp(argv[i], "--verbose")) options.verbose = true;
+        else if (!strcmp(argv[i], "--parallelincludes")) options.parallelIncludes = true;
+        else if (!strcmp(argv[i], "--passes")) options.nPasses = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--time-limit")) options.timeLimit = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--checkpoint")) options.checkpointFile = argv[++i];
+        else if (!strcmp(argv[i], "--resume")) options.resume = true;
+        else if (!strcmp(argv[i], "--coordinator")) options.coordinatorAddress = argv[++i];
+        else if (!strcmp(argv[i], "--worker")) options.workerAddress = argv[++i];
+        else if (!strcmp(argv[i], "--texturecache")) options.textureCacheMB = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--texstats")) options.textureStats = true;
         else if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h")) {
-            printf("usage: pbrt [--ncores n] [--outfile filename] [--quick] [--quiet] "
-                   "[--verbose] [--help] <filename.pbrt> ...\n");
+            printf("usage: pbrt [--ncores n] [--outfile filename] [--statsfile filename] "
+                   "[--quick] [--quiet] [--verbose] [--parallelincludes] "
+                   "[--passes n] [--time-limit seconds] [--checkpoint filename] "
+                   "[--resume] [--coordinator [host:]port] "
+                   "[--worker host:port] [--texturecache MB] [--texstats] [--help] "
+                   "<filename.pbrt> ...\n");
             return 0;
         }
         else filenames.push_back(argv[i]);
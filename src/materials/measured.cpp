@@ -35,6 +35,7 @@
 #include "materials/measured.h"
 #include "paramset.h"
 #include "floatfile.h"
+#include "parallel.h"
 
 /*
   File format descriptions:
@@ -82,8 +83,11 @@
 // MeasuredMaterial Method Definitions
 static map<string, float *> loadedRegularHalfangle;
 static map<string, KdTree<IrregIsotropicBRDFSample> *> loadedThetaPhi;
+static Mutex *loadedMutex = Mutex::Create();
 MeasuredMaterial::MeasuredMaterial(const string &filename,
       Reference<Texture<float> > bump) {
+    // Materials may be created while includes are parsed in parallel
+    MutexLock lock(*loadedMutex);
     bumpMap = bump;
     const char *suffix = strrchr(filename.c_str(), '.');
     regularHalfangleData = NULL;
@@ -1,3 +1,2 @@
-nmake prebuild.makefile
 cd ..\3rdparty\ilmbase-1.0.2
 buildLUTS.cmd
\ No newline at end of file
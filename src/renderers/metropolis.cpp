@@ -787,9 +787,18 @@ Spectrum MetropolisRenderer::Li(const Scene *scene, const RayDifferential &ray,
         Spectrum *T) const {
     Intersection localIsect;
     if (!isect) isect = &localIsect;
+    bool hit = scene->Intersect(ray, isect);
+    return LiIntersected(scene, ray, sample, rng, arena, *isect, hit, T);
+}
+
+
+Spectrum MetropolisRenderer::LiIntersected(const Scene *scene,
+        const RayDifferential &ray, const Sample *sample, RNG &rng,
+        MemoryArena &arena, const Intersection &isect, bool hit,
+        Spectrum *T) const {
     Spectrum Lo = 0.f;
-    if (scene->Intersect(ray, isect))
-        Lo = directLighting->Li(scene, this, ray, *isect, sample,
+    if (hit)
+        Lo = directLighting->Li(scene, this, ray, isect, sample,
                                 rng, arena);
     else {
         // Handle ray that doesn't intersect any geometry
@@ -41,6 +41,20 @@
 #include "progressreporter.h"
 #include "camera.h"
 #include "intersection.h"
+#include "timer.h"
+#include "distributed.h"
+#include <limits.h>
+
+// SamplerRenderer Local Declarations
+#define CHECKPOINT_MAGIC "PBRTCKPT"
+#define CHECKPOINT_VERSION 2
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    int32_t passesDone, taskCount, samplesPerPixel;
+    int64_t samplesTaken;
+};
+
 
 static uint32_t hash(char *key, uint32_t len)
 {
@@ -56,6 +70,41 @@ static uint32_t hash(char *key, uint32_t len)
     return hash;
 } 
 
+class SamplerRendererWorkerTasks : public DistributedTasks {
+public:
+    // SamplerRendererWorkerTasks Public Methods
+    SamplerRendererWorkerTasks(const Scene *sc, Renderer *ren, Camera *c,
+                               Sampler *ms, Sample *sam, bool visIds) {
+        scene = sc; renderer = ren; camera = c; mainSampler = ms;
+        origSample = sam; visualizeObjectIds = visIds;
+    }
+    void Render(int first, int last, int taskCount) {
+        // Render tasks _first_ through _last_-1 of all passes' tasks
+        char title[64];
+        sprintf(title, "Rendering tasks %d-%d", first, last - 1);
+        ProgressReporter reporter(last - first, title);
+        vector<Task *> renderTasks;
+        for (int i = last - 1; i >= first; --i)
+            renderTasks.push_back(new SamplerRendererTask(scene, renderer,
+                camera, reporter, mainSampler, origSample, visualizeObjectIds,
+                i % taskCount, taskCount, i / taskCount));
+        EnqueueTasks(renderTasks);
+        WaitForAllTasks();
+        for (uint32_t i = 0; i < renderTasks.size(); ++i)
+            delete renderTasks[i];
+    }
+private:
+    // SamplerRendererWorkerTasks Private Data
+    const Scene *scene;
+    Renderer *renderer;
+    Camera *camera;
+    Sampler *mainSampler;
+    Sample *origSample;
+    bool visualizeObjectIds;
+};
+
+
+
 // SamplerRendererTask Definitions
 void SamplerRendererTask::Run() {
     PBRT_STARTED_RENDERTASK(taskNum);
@@ -67,10 +116,13 @@ void SamplerRendererTask::Run() {
         PBRT_FINISHED_RENDERTASK(taskNum);
         return;
     }
+    sampler->SetPass(pass);
 
     // Declare local variables used for rendering loop
     MemoryArena arena;
-    RNG rng(taskNum);
+    RNG rng(pass * taskCount + taskNum);
+    FilmTile *filmTile = camera->film->GetFilmTile(sampler->xPixelStart,
+        sampler->xPixelEnd, sampler->yPixelStart, sampler->yPixelEnd);
 
     // Allocate space for samples and intersections
     int maxSamples = sampler->MaximumSampleCount();
@@ -79,22 +131,48 @@ void SamplerRendererTask::Run() {
     Spectrum *Ls = new Spectrum[maxSamples];
     Spectrum *Ts = new Spectrum[maxSamples];
     Intersection *isects = new Intersection[maxSamples];
+    float *rayWeights = new float[maxSamples];
+    bool *hits = new bool[maxSamples];
+    const Ray **packetRays = new const Ray *[maxSamples];
+    int *packetSamples = new int[maxSamples];
+    Intersection *packetIsects = new Intersection[maxSamples];
+    bool *packetHits = new bool[maxSamples];
 
     // Get samples from _Sampler_ and update image
     int sampleCount;
     while ((sampleCount = sampler->GetMoreSamples(samples, rng)) > 0) {
-        // Generate camera rays and compute radiance along rays
+        samplesTaken += sampleCount;
+        // Generate camera rays for samples
+        int nPacketRays = 0;
         for (int i = 0; i < sampleCount; ++i) {
             // Find camera ray for _sample[i]_
             PBRT_STARTED_GENERATING_CAMERA_RAY(&samples[i]);
-            float rayWeight = camera->GenerateRayDifferential(samples[i], &rays[i]);
+            rayWeights[i] = camera->GenerateRayDifferential(samples[i], &rays[i]);
             rays[i].ScaleDifferentials(1.f / sqrtf(sampler->samplesPerPixel));
-            PBRT_FINISHED_GENERATING_CAMERA_RAY(&samples[i], &rays[i], rayWeight);
+            PBRT_FINISHED_GENERATING_CAMERA_RAY(&samples[i], &rays[i], rayWeights[i]);
+            hits[i] = false;
+            if (rayWeights[i] > 0.f) {
+                packetSamples[nPacketRays] = i;
+                packetRays[nPacketRays++] = &rays[i];
+            }
+        }
+
+        // Trace camera rays as a packet
+        scene->IntersectPacket(packetRays, nPacketRays, packetIsects,
+                               packetHits);
+        for (int j = 0; j < nPacketRays; ++j) {
+            int i = packetSamples[j];
+            hits[i] = packetHits[j];
+            if (hits[i]) isects[i] = packetIsects[j];
+        }
 
+        // Compute radiance along camera rays
+        for (int i = 0; i < sampleCount; ++i) {
+            float rayWeight = rayWeights[i];
             // Evaluate radiance along camera ray
             PBRT_STARTED_CAMERA_RAY_INTEGRATION(&rays[i], &samples[i]);
             if (visualizeObjectIds) {
-                if (rayWeight > 0.f && scene->Intersect(rays[i], &isects[i])) {
+                if (hits[i]) {
                     // random shading based on shape id...
                     uint32_t ids[2] = { isects[i].shapeId, isects[i].primitiveId };
                     uint32_t h = hash((char *)ids, sizeof(ids));
@@ -108,8 +186,8 @@ void SamplerRendererTask::Run() {
             }
             else {
             if (rayWeight > 0.f)
-                Ls[i] = rayWeight * renderer->Li(scene, rays[i], &samples[i], rng,
-                                                 arena, &isects[i], &Ts[i]);
+                Ls[i] = rayWeight * renderer->LiIntersected(scene, rays[i],
+                    &samples[i], rng, arena, isects[i], hits[i], &Ts[i]);
             else {
                 Ls[i] = 0.f;
                 Ts[i] = 1.f;
@@ -141,7 +219,7 @@ void SamplerRendererTask::Run() {
             for (int i = 0; i < sampleCount; ++i)
             {
                 PBRT_STARTED_ADDING_IMAGE_SAMPLE(&samples[i], &rays[i], &Ls[i], &Ts[i]);
-                camera->film->AddSample(samples[i], Ls[i]);
+                filmTile->AddSample(samples[i], Ls[i]);
                 PBRT_FINISHED_ADDING_IMAGE_SAMPLE();
             }
         }
@@ -151,6 +229,7 @@ void SamplerRendererTask::Run() {
     }
 
     // Clean up after _SamplerRendererTask_ is done with its image region
+    camera->film->MergeFilmTile(filmTile);
     camera->film->UpdateDisplay(sampler->xPixelStart,
         sampler->yPixelStart, sampler->xPixelEnd+1, sampler->yPixelEnd+1);
     delete sampler;
@@ -159,6 +238,12 @@ void SamplerRendererTask::Run() {
     delete[] Ls;
     delete[] Ts;
     delete[] isects;
+    delete[] rayWeights;
+    delete[] hits;
+    delete[] packetRays;
+    delete[] packetSamples;
+    delete[] packetIsects;
+    delete[] packetHits;
     reporter.Update();
     PBRT_FINISHED_RENDERTASK(taskNum);
 }
@@ -187,10 +272,14 @@ SamplerRenderer::~SamplerRenderer() {
 
 void SamplerRenderer::Render(const Scene *scene) {
     PBRT_FINISHED_PARSING();
+    Timer timer;
+    timer.Start();
     // Allow integrators to do preprocessing for the scene
     PBRT_STARTED_PREPROCESSING();
-    surfaceIntegrator->Preprocess(scene, camera, this);
-    volumeIntegrator->Preprocess(scene, camera, this);
+    if (PbrtOptions.coordinatorAddress == "") {
+        surfaceIntegrator->Preprocess(scene, camera, this);
+        volumeIntegrator->Preprocess(scene, camera, this);
+    }
     PBRT_FINISHED_PREPROCESSING();
     PBRT_STARTED_RENDERING();
     // Allocate and initialize _sample_
@@ -203,18 +292,83 @@ void SamplerRenderer::Render(const Scene *scene) {
     int nPixels = camera->film->xResolution * camera->film->yResolution;
     int nTasks = max(32 * NumSystemCores(), nPixels / (16*16));
     nTasks = RoundUpPow2(nTasks);
-    ProgressReporter reporter(nTasks, "Rendering");
-    vector<Task *> renderTasks;
-    for (int i = 0; i < nTasks; ++i)
-        renderTasks.push_back(new SamplerRendererTask(scene, this, camera,
-                                                      reporter, sampler, sample, 
-                                                      visualizeObjectIds, 
-                                                      nTasks-1-i, nTasks));
-    EnqueueTasks(renderTasks);
-    WaitForAllTasks();
-    for (uint32_t i = 0; i < renderTasks.size(); ++i)
-        delete renderTasks[i];
-    reporter.Done();
+
+    // Render with worker processes if distributed rendering was requested
+    if (PbrtOptions.coordinatorAddress != "" ||
+        PbrtOptions.workerAddress != "") {
+        RenderDistributed(scene, sample, nTasks);
+        PBRT_FINISHED_RENDERING();
+        delete sample;
+        return;
+    }
+
+    // Determine passes to render, possibly resuming from a checkpoint
+    float timeLimit = PbrtOptions.timeLimit;
+    int nPasses = PbrtOptions.nPasses;
+    if (nPasses <= 0) nPasses = (timeLimit > 0.f) ? INT_MAX : 1;
+    int firstPass = 0;
+    int64_t samplesTaken = 0;
+    const string &checkpointFile = PbrtOptions.checkpointFile;
+    if (PbrtOptions.resume) {
+        if (checkpointFile == "")
+            Warning("No checkpoint file given to resume from. Rendering "
+                    "from the start.");
+        else if (ReadCheckpoint(checkpointFile, &firstPass, &nTasks,
+                                &samplesTaken) &&
+                 firstPass >= nPasses)
+            Info("All %d passes were already rendered in checkpoint \"%s\".",
+                 firstPass, checkpointFile.c_str());
+    }
+
+    // Render passes until done or until another pass would pass _timeLimit_
+    int passesDone = firstPass;
+    double maxPassTime = 0.;
+    while (passesDone < nPasses) {
+        int pass = passesDone;
+        double passStart = timer.Time();
+        char title[64];
+        if (nPasses == 1)
+            strcpy(title, "Rendering");
+        else if (nPasses == INT_MAX)
+            sprintf(title, "Rendering pass %d", pass + 1);
+        else
+            sprintf(title, "Rendering pass %d/%d", pass + 1, nPasses);
+        ProgressReporter reporter(nTasks, title);
+        vector<Task *> renderTasks;
+        for (int i = 0; i < nTasks; ++i)
+            renderTasks.push_back(new SamplerRendererTask(scene, this, camera,
+                                                          reporter, sampler, sample, 
+                                                          visualizeObjectIds, 
+                                                          nTasks-1-i, nTasks, pass));
+        EnqueueTasks(renderTasks);
+        WaitForAllTasks();
+        for (uint32_t i = 0; i < renderTasks.size(); ++i) {
+            samplesTaken +=
+                ((SamplerRendererTask *)renderTasks[i])->SamplesTaken();
+            delete renderTasks[i];
+        }
+        reporter.Done();
+        ++passesDone;
+        maxPassTime = max(maxPassTime, timer.Time() - passStart);
+        if (timeLimit > 0.f && timer.Time() + maxPassTime > timeLimit)
+            nPasses = passesDone;
+
+        // Save image and checkpoint after each pass of progressive rendering
+        if (passesDone < nPasses)
+            camera->film->WriteImage();
+        if (checkpointFile != "")
+            WriteCheckpoint(checkpointFile, passesDone, nTasks, samplesTaken);
+    }
+    if ((PbrtOptions.nPasses > 1 || timeLimit > 0.f) && !PbrtOptions.quiet) {
+        // Report average number of samples actually taken in each pixel
+        int64_t nSampledPixels =
+            int64_t(sampler->xPixelEnd - sampler->xPixelStart) *
+            int64_t(sampler->yPixelEnd - sampler->yPixelStart);
+        printf("Rendered %d pass(es), %.1f samples per pixel, in %.1fs.\n",
+               passesDone, double(samplesTaken) / max(nSampledPixels,
+                                                      (int64_t)1),
+               (float)timer.Time());
+    }
     PBRT_FINISHED_RENDERING();
     // Clean up after rendering and store final image
     delete sample;
@@ -222,19 +376,132 @@ void SamplerRenderer::Render(const Scene *scene) {
 }
 
 
+void SamplerRenderer::RenderDistributed(const Scene *scene, Sample *sample,
+                                        int nTasks) {
+    if (PbrtOptions.timeLimit > 0.f || PbrtOptions.checkpointFile != "" ||
+        PbrtOptions.resume)
+        Warning("Time limits and checkpoints are ignored for distributed "
+                "rendering.");
+    int nPasses = max(1, PbrtOptions.nPasses);
+    if (PbrtOptions.coordinatorAddress != "") {
+        // Hand out all passes' tasks to workers and merge their films
+        if (RunRenderCoordinator(PbrtOptions.coordinatorAddress,
+                                 nPasses * nTasks, nTasks,
+                                 sampler->samplesPerPixel, camera->film))
+            camera->film->WriteImage();
+    }
+    else {
+        // Render tasks for coordinator and send it the film's contents
+        SamplerRendererWorkerTasks tasks(scene, this, camera, sampler, sample,
+                                         visualizeObjectIds);
+        RunRenderWorker(PbrtOptions.workerAddress, sampler->samplesPerPixel,
+                        &tasks, camera->film);
+    }
+}
+
+
+bool SamplerRenderer::ReadCheckpoint(const string &filename, int *passesDone,
+                                     int *taskCount,
+                                     int64_t *samplesTaken) const {
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f) {
+        Warning("Unable to open checkpoint file \"%s\". Rendering from the "
+                "start.", filename.c_str());
+        return false;
+    }
+    // Read and validate _CheckpointHeader_
+    CheckpointHeader header;
+    bool ok = true;
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        memcmp(header.magic, CHECKPOINT_MAGIC, 8) != 0 ||
+        header.version != CHECKPOINT_VERSION || header.passesDone < 0 ||
+        header.taskCount <= 0 || header.samplesTaken < 0) {
+        Error("\"%s\" is not a valid checkpoint file.", filename.c_str());
+        ok = false;
+    }
+    else if (header.samplesPerPixel != sampler->samplesPerPixel) {
+        Error("Checkpoint \"%s\" was rendered with %d samples per pixel, "
+              "not %d.", filename.c_str(), (int)header.samplesPerPixel,
+              sampler->samplesPerPixel);
+        ok = false;
+    }
+
+    // Restore film contents from checkpoint
+    else if (!camera->film->AddState(f)) {
+        Error("Unable to restore film from checkpoint \"%s\".",
+              filename.c_str());
+        ok = false;
+    }
+    fclose(f);
+    if (!ok) {
+        Warning("Rendering from the start.");
+        return false;
+    }
+    *passesDone = header.passesDone;
+    *taskCount = header.taskCount;
+    *samplesTaken = header.samplesTaken;
+    if (!PbrtOptions.quiet)
+        printf("Resuming from checkpoint \"%s\" after %d pass(es).\n",
+               filename.c_str(), *passesDone);
+    return true;
+}
+
+
+bool SamplerRenderer::WriteCheckpoint(const string &filename, int passesDone,
+                                      int taskCount,
+                                      int64_t samplesTaken) const {
+    // Write checkpoint to temporary file and then replace _filename_
+    string tmpFilename = filename + ".tmp";
+    FILE *f = fopen(tmpFilename.c_str(), "wb");
+    if (!f) {
+        Error("Unable to create checkpoint file \"%s\".",
+              tmpFilename.c_str());
+        return false;
+    }
+    CheckpointHeader header;
+    memcpy(header.magic, CHECKPOINT_MAGIC, 8);
+    header.version = CHECKPOINT_VERSION;
+    header.passesDone = passesDone;
+    header.taskCount = taskCount;
+    header.samplesPerPixel = sampler->samplesPerPixel;
+    header.samplesTaken = samplesTaken;
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              camera->film->WriteState(f);
+    if (fclose(f) != 0) ok = false;
+#if defined(PBRT_IS_WINDOWS)
+    if (ok) remove(filename.c_str());
+#endif
+    if (!ok || rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+        Error("Unable to write checkpoint file \"%s\".", filename.c_str());
+        remove(tmpFilename.c_str());
+        return false;
+    }
+    return true;
+}
+
+
 Spectrum SamplerRenderer::Li(const Scene *scene,
         const RayDifferential &ray, const Sample *sample, RNG &rng,
         MemoryArena &arena, Intersection *isect, Spectrum *T) const {
     Assert(ray.time == sample->time);
     Assert(!ray.HasNaNs());
-    // Allocate local variables for _isect_ and _T_ if needed
-    Spectrum localT;
-    if (!T) T = &localT;
+    // Allocate local variable for _isect_ if needed
     Intersection localIsect;
     if (!isect) isect = &localIsect;
+    bool hit = scene->Intersect(ray, isect);
+    return LiIntersected(scene, ray, sample, rng, arena, *isect, hit, T);
+}
+
+
+Spectrum SamplerRenderer::LiIntersected(const Scene *scene,
+        const RayDifferential &ray, const Sample *sample, RNG &rng,
+        MemoryArena &arena, const Intersection &isect, bool hit,
+        Spectrum *T) const {
+    Spectrum localT;
+    if (!T) T = &localT;
     Spectrum Li = 0.f;
-    if (scene->Intersect(ray, isect))
-        Li = surfaceIntegrator->Li(scene, this, ray, *isect, sample,
+    if (hit)
+        Li = surfaceIntegrator->Li(scene, this, ray, isect, sample,
                                    rng, arena);
     else {
         // Handle ray that doesn't intersect any geometry
@@ -52,9 +52,19 @@ public:
     Spectrum Li(const Scene *scene, const RayDifferential &ray,
         const Sample *sample, RNG &rng, MemoryArena &arena,
         Intersection *isect = NULL, Spectrum *T = NULL) const;
+    Spectrum LiIntersected(const Scene *scene, const RayDifferential &ray,
+        const Sample *sample, RNG &rng, MemoryArena &arena,
+        const Intersection &isect, bool hit, Spectrum *T = NULL) const;
     Spectrum Transmittance(const Scene *scene, const RayDifferential &ray,
         const Sample *sample, RNG &rng, MemoryArena &arena) const;
 private:
+    // SamplerRenderer Private Methods
+    void RenderDistributed(const Scene *scene, Sample *sample, int nTasks);
+    bool ReadCheckpoint(const string &filename, int *passesDone,
+                        int *taskCount, int64_t *samplesTaken) const;
+    bool WriteCheckpoint(const string &filename, int passesDone,
+                         int taskCount, int64_t samplesTaken) const;
+
     // SamplerRenderer Private Data
     bool visualizeObjectIds;
     Sampler *sampler;
@@ -71,13 +81,16 @@ public:
     // SamplerRendererTask Public Methods
     SamplerRendererTask(const Scene *sc, Renderer *ren, Camera *c,
                         ProgressReporter &pr, Sampler *ms, Sample *sam, 
-                        bool visIds, int tn, int tc)
+                        bool visIds, int tn, int tc, int p = 0)
       : reporter(pr)
     {
         scene = sc; renderer = ren; camera = c; mainSampler = ms;
         origSample = sam; visualizeObjectIds = visIds; taskNum = tn; taskCount = tc;
+        pass = p;
+        samplesTaken = 0;
     }
     void Run();
+    int64_t SamplesTaken() const { return samplesTaken; }
 private:
     // SamplerRendererTask Private Data
     const Scene *scene;
@@ -87,7 +100,8 @@ private:
     ProgressReporter &reporter;
     Sample *origSample;
     bool visualizeObjectIds;
-    int taskNum, taskCount;
+    int taskNum, taskCount, pass;
+    int64_t samplesTaken;
 };
 
 
@@ -121,8 +121,9 @@ void SurfacePointsRenderer::Render(const Scene *scene) {
     Point sceneCenter;
     float sceneRadius;
     scene->WorldBound().BoundingSphere(&sceneCenter, &sceneRadius);
-    Transform ObjectToWorld(Translate(sceneCenter - Point(0,0,0)));
-    Transform WorldToObject(Inverse(ObjectToWorld));
+    AffineTransform ObjectToWorld, WorldToObject;
+    AffineTransformPair(Translate(sceneCenter - Point(0,0,0)),
+                        &ObjectToWorld, &WorldToObject);
     Reference<Shape> sph = new Sphere(&ObjectToWorld, &WorldToObject,
         true, sceneRadius, -sceneRadius, sceneRadius, 360.f);
     Reference<Material> nullMaterial = Reference<Material>(NULL);
@@ -47,6 +47,16 @@ Sampler *BestCandidateSampler::GetSubSampler(int num, int count) {
 }
 
 
+void BestCandidateSampler::SetPass(int p) {
+    // Shift sample table toroidally so that each pass has new image samples
+    pass = p;
+    RNG passRng(pass);
+    for (int i = 0; i < 2; ++i)
+        imageOffsets[i] = pass ? passRng.RandomFloat() : 0.f;
+    computeSampleOffsets();
+}
+
+
 int BestCandidateSampler::GetMoreSamples(Sample *sample, RNG &rng) {
 again:
     if (tableOffset == SAMPLE_TABLE_SIZE) {
@@ -58,15 +68,14 @@ again:
                 return 0;
         }
 
-        // Update sample shifts
-        RNG tileRng(xTile + (yTile<<8));
-        for (int i = 0; i < 3; ++i)
-            sampleOffsets[i] = tileRng.RandomFloat();
+        computeSampleOffsets();
     }
     // Compute raster sample from table
 #define WRAP(x) ((x) >= 1 ? ((x)-1) : (x))
-    sample->imageX = (xTile + sampleTable[tableOffset][0]) * tableWidth;
-    sample->imageY = (yTile + sampleTable[tableOffset][1]) * tableWidth;
+    sample->imageX = (xTile + WRAP(imageOffsets[0] +
+                                   sampleTable[tableOffset][0])) * tableWidth;
+    sample->imageY = (yTile + WRAP(imageOffsets[1] +
+                                   sampleTable[tableOffset][1])) * tableWidth;
     sample->time  = Lerp(WRAP(sampleOffsets[0] + sampleTable[tableOffset][2]),
                               shutterOpen, shutterClose);
     sample->lensU = WRAP(sampleOffsets[1] +
@@ -62,19 +62,29 @@ public:
         xTile = xTileStart;
         yTile = yTileStart;
         tableOffset = 0;
-      // Update sample shifts
-      RNG tileRng(xTile + (yTile<<8));
-      for (int i = 0; i < 3; ++i)
-          sampleOffsets[i] = tileRng.RandomFloat();
+        pass = 0;
+        imageOffsets[0] = imageOffsets[1] = 0.f;
+        computeSampleOffsets();
     }
     Sampler *GetSubSampler(int num, int count);
+    void SetPass(int pass);
     int RoundSize(int size) const {
         return RoundUpPow2(size);
     }
     int MaximumSampleCount() { return 1; }
     int GetMoreSamples(Sample *sample, RNG &rng);
 private:
+    // BestCandidateSampler Private Methods
+    void computeSampleOffsets() {
+        // Update sample shifts for current tile
+        RNG tileRng(xTile + (yTile<<8) + (pass<<16));
+        for (int i = 0; i < 3; ++i)
+            sampleOffsets[i] = tileRng.RandomFloat();
+    }
+
     // BestCandidateSampler Private Data
+    int pass;
+    float imageOffsets[2];
     float tableWidth;
     int tableOffset;
     int xTileStart, xTileEnd, yTileStart, yTileEnd;
@@ -52,11 +52,21 @@ HaltonSampler::HaltonSampler(int xs, int xe, int ys, int ye, int ps,
     : Sampler(xs, xe, ys, ye, ps, sopen, sclose) {
     int delta = max(xPixelEnd - xPixelStart,
                     yPixelEnd - yPixelStart);
-    wantedSamples = samplesPerPixel * delta * delta;
+    wantedSamples = uint64_t(samplesPerPixel) * delta * delta;
     currentSample = 0;
 }
 
 
+void HaltonSampler::SetPass(int pass) {
+    // Continue Halton sequence after the samples of earlier passes
+    int delta = max(xPixelEnd - xPixelStart,
+                    yPixelEnd - yPixelStart);
+    uint64_t passSamples = uint64_t(samplesPerPixel) * delta * delta;
+    currentSample = uint64_t(pass) * passSamples;
+    wantedSamples = currentSample + passSamples;
+}
+
+
 int HaltonSampler::GetMoreSamples(Sample *samples, RNG &rng) {
 retry:
     if (currentSample >= wantedSamples) return 0;
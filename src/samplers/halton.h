@@ -48,10 +48,11 @@ public:
     int GetMoreSamples(Sample *sample, RNG &rng);
     Sampler *GetSubSampler(int num, int count);
     int RoundSize(int size) const { return size; }
+    void SetPass(int pass);
 
 private:
     // HaltonSampler Private Data
-    int wantedSamples, currentSample;
+    uint64_t wantedSamples, currentSample;
 };
 
 
@@ -48,6 +48,25 @@ RandomSampler::RandomSampler(int xstart, int xend,
     timeSamples = lensSamples + 2 * nSamples;
 
     RNG rng(xstart + ystart * (xend-xstart));
+    generatePixelSamples(rng);
+}
+
+
+void RandomSampler::SetPass(int pass) {
+    // Regenerate first pixel's samples from a seed that depends on _pass_
+    uint32_t seed = xPixelStart + yPixelStart * (xPixelEnd-xPixelStart);
+    if (pass > 0) {
+        RNG passRng(pass);
+        seed ^= passRng.RandomUInt();
+    }
+    RNG rng(seed);
+    xPos = xPixelStart;
+    yPos = yPixelStart;
+    generatePixelSamples(rng);
+}
+
+
+void RandomSampler::generatePixelSamples(RNG &rng) {
     for (int i = 0; i < 5 * nSamples; ++i)
         imageSamples[i] = rng.RandomFloat();
 
@@ -81,16 +100,7 @@ int RandomSampler::GetMoreSamples(Sample *sample, RNG &rng) {
         }
         if (yPos == yPixelEnd)
             return 0;
-
-        for (int i = 0; i < 5 * nSamples; ++i)
-            imageSamples[i] = rng.RandomFloat();
-
-        // Shift image samples to pixel coordinates
-        for (int o = 0; o < 2 * nSamples; o += 2) {
-            imageSamples[o]   += xPos;
-            imageSamples[o+1] += yPos;
-        }
-        samplePos = 0;
+        generatePixelSamples(rng);
     }
     // Return next \mono{RandomSampler} sample point
     sample->imageX = imageSamples[2*samplePos];
@@ -51,7 +51,11 @@ public:
     int GetMoreSamples(Sample *sample, RNG &rng);
     int RoundSize(int sz) const { return sz; }
     Sampler *GetSubSampler(int num, int count);
+    void SetPass(int pass);
 private:
+    // RandomSampler Private Methods
+    void generatePixelSamples(RNG &rng);
+
     // RandomSampler Private Data
     int xPos, yPos, nSamples;
     float *imageSamples, *lensSamples, *timeSamples;
@@ -0,0 +1,119 @@
+
+/*
+    pbrt source code Copyright(c) 1998-2012 Matt Pharr and Greg Humphreys.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+
+// shapes/binarymesh.cpp*
+#include "stdafx.h"
+#include "shapes/binarymesh.h"
+#include "paramset.h"
+#include "stats.h"
+
+// BinaryMesh Local Declarations
+static StatsMemory mappedMeshBytes("Memory", "Mapped binary meshes");
+
+// BinaryMesh Function Definitions
+TriangleMesh *CreateBinaryMeshShape(const AffineTransform *o2w,
+        const AffineTransform *w2o,
+        bool reverseOrientation, const ParamSet &params,
+        map<string, Reference<Texture<float> > > *floatTextures) {
+    string filename = params.FindOneFilename("filename", "");
+    if (filename == "") {
+        Error("No \"filename\" provided for binarymesh shape.");
+        return NULL;
+    }
+    Reference<MappedFile> file = MappedFile::Open(filename);
+    if (!file) return NULL;
+
+    // Validate binary mesh header
+    const char *data = (const char *)file->Data();
+    BinaryMeshHeader header;
+    if (file->Size() < sizeof(header)) {
+        Error("Binary mesh file \"%s\" is truncated.", filename.c_str());
+        return NULL;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, BINARYMESH_MAGIC, 8) != 0) {
+        Error("\"%s\" is not a binary mesh file.", filename.c_str());
+        return NULL;
+    }
+    if (header.version != BINARYMESH_VERSION) {
+        Error("Binary mesh file \"%s\" has unsupported version %d.",
+              filename.c_str(), (int)header.version);
+        return NULL;
+    }
+    uint32_t nv = header.nVertices, nt = header.nTriangles;
+    uint64_t expectedSize = sizeof(header) + uint64_t(nv) * 3 * sizeof(float) +
+        ((header.flags & BINARYMESH_HAS_N) ? uint64_t(nv) * 3 * sizeof(float) : 0) +
+        ((header.flags & BINARYMESH_HAS_S) ? uint64_t(nv) * 3 * sizeof(float) : 0) +
+        ((header.flags & BINARYMESH_HAS_UV) ? uint64_t(nv) * 2 * sizeof(float) : 0) +
+        uint64_t(nt) * 3 * sizeof(int32_t);
+    if (nv == 0 || nt == 0 || nv > 0x7fffffffu || nt > 0x7fffffffu / 3 ||
+        file->Size() != expectedSize) {
+        Error("Binary mesh file \"%s\" has inconsistent size.", filename.c_str());
+        return NULL;
+    }
+
+    // Find vertex and index arrays in mapped file
+    const char *ptr = data + sizeof(header);
+    const Point *P = (const Point *)ptr;
+    ptr += nv * sizeof(Point);
+    const Normal *N = NULL;
+    if (header.flags & BINARYMESH_HAS_N) {
+        N = (const Normal *)ptr;
+        ptr += nv * sizeof(Normal);
+    }
+    const Vector *S = NULL;
+    if (header.flags & BINARYMESH_HAS_S) {
+        S = (const Vector *)ptr;
+        ptr += nv * sizeof(Vector);
+    }
+    const float *uvs = NULL;
+    if (header.flags & BINARYMESH_HAS_UV) {
+        uvs = (const float *)ptr;
+        ptr += nv * 2 * sizeof(float);
+    }
+    const int *vi = (const int *)ptr;
+    for (uint32_t i = 0; i < 3 * nt; ++i)
+        if (vi[i] < 0 || uint32_t(vi[i]) >= nv) {
+            Error("Binary mesh file \"%s\" has out-of-bounds vertex index %d "
+                  "(%d vertices)", filename.c_str(), vi[i], (int)nv);
+            return NULL;
+        }
+    mappedMeshBytes += file->Size();
+
+    Reference<Texture<float> > alphaTex =
+        FindTriangleMeshAlphaTexture(params, floatTextures);
+    return new TriangleMesh(o2w, w2o, reverseOrientation, nt, nv, vi, P,
+        N, S, uvs, alphaTex, file);
+}
+
+
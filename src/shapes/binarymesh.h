@@ -0,0 +1,67 @@
+
+/*
+    pbrt source code Copyright(c) 1998-2012 Matt Pharr and Greg Humphreys.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef PBRT_SHAPES_BINARYMESH_H
+#define PBRT_SHAPES_BINARYMESH_H
+
+// shapes/binarymesh.h*
+#include "shapes/trianglemesh.h"
+
+// BinaryMesh Declarations
+
+// A binary mesh file starts with a _BinaryMeshHeader_, followed by the
+// little-endian arrays P[3*nVertices], N[3*nVertices], S[3*nVertices],
+// uv[2*nVertices] and indices[3*nTriangles]; the N, S and uv arrays are
+// only present when the corresponding flag is set.
+#define BINARYMESH_MAGIC "PBRTMESH"
+#define BINARYMESH_VERSION 1
+#define BINARYMESH_HAS_N  0x1
+#define BINARYMESH_HAS_S  0x2
+#define BINARYMESH_HAS_UV 0x4
+struct BinaryMeshHeader {
+    char magic[8];
+    uint32_t version, flags;
+    uint32_t nVertices, nTriangles;
+    uint32_t reserved[2];
+};
+
+
+TriangleMesh *CreateBinaryMeshShape(const AffineTransform *o2w,
+    const AffineTransform *w2o,
+    bool reverseOrientation, const ParamSet &params,
+    map<string, Reference<Texture<float> > > *floatTextures = NULL);
+
+#endif // PBRT_SHAPES_BINARYMESH_H
@@ -36,7 +36,7 @@
 #include "paramset.h"
 
 // Cone Method Definitions
-Cone::Cone(const Transform *o2w, const Transform *w2o, bool ro,
+Cone::Cone(const AffineTransform *o2w, const AffineTransform *w2o, bool ro,
            float ht, float rad, float tm)
     : Shape(o2w, w2o, ro) {
     radius = rad;
@@ -135,7 +135,7 @@ bool Cone::Intersect(const Ray &r, float *tHit, float *rayEpsilon,
                          (f*F - g*E) * invEGF2 * dpdv);
 
     // Initialize _DifferentialGeometry_ from parametric information
-    const Transform &o2w = *ObjectToWorld;
+    const AffineTransform &o2w = *ObjectToWorld;
     *dg = DifferentialGeometry(o2w(phit), o2w(dpdu), o2w(dpdv),
                                o2w(dndu), o2w(dndv), u, v, this);
 
@@ -207,7 +207,7 @@ float Cone::Area() const {
 }
 
 
-Cone *CreateConeShape(const Transform *o2w, const Transform *w2o,
+Cone *CreateConeShape(const AffineTransform *o2w, const AffineTransform *w2o,
         bool reverseOrientation, const ParamSet &params) {
     float radius = params.FindOneFloat("radius", 1);
     float height = params.FindOneFloat("height", 1);
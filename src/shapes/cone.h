@@ -43,7 +43,7 @@
 class Cone : public Shape {
 public:
     // Cone Public Methods
-    Cone(const Transform *o2w, const Transform *w2o, bool ro,
+    Cone(const AffineTransform *o2w, const AffineTransform *w2o, bool ro,
          float height, float rad, float tm);
     BBox ObjectBound() const;
     bool Intersect(const Ray &ray, float *tHit, float *rayEpsilon,
@@ -56,7 +56,7 @@ protected:
 };
 
 
-Cone *CreateConeShape(const Transform *o2w, const Transform *w2o,
+Cone *CreateConeShape(const AffineTransform *o2w, const AffineTransform *w2o,
         bool reverseOrientation, const ParamSet &params);
 
 #endif // PBRT_SHAPES_CONE_H
@@ -36,7 +36,8 @@
 #include "paramset.h"
 
 // Cylinder Method Definitions
-Cylinder::Cylinder(const Transform *o2w, const Transform *w2o, bool ro,
+Cylinder::Cylinder(const AffineTransform *o2w,
+                   const AffineTransform *w2o, bool ro,
                    float rad, float z0, float z1, float pm)
     : Shape(o2w, w2o, ro) {
     radius = rad;
@@ -127,7 +128,7 @@ bool Cylinder::Intersect(const Ray &r, float *tHit, float *rayEpsilon,
                          (f*F - g*E) * invEGF2 * dpdv);
 
     // Initialize _DifferentialGeometry_ from parametric information
-    const Transform &o2w = *ObjectToWorld;
+    const AffineTransform &o2w = *ObjectToWorld;
     *dg = DifferentialGeometry(o2w(phit), o2w(dpdu), o2w(dpdv),
                                o2w(dndu), o2w(dndv), u, v, this);
 
@@ -192,7 +193,8 @@ float Cylinder::Area() const {
 }
 
 
-Cylinder *CreateCylinderShape(const Transform *o2w, const Transform *w2o,
+Cylinder *CreateCylinderShape(const AffineTransform *o2w,
+        const AffineTransform *w2o,
         bool reverseOrientation, const ParamSet &params) {
     float radius = params.FindOneFloat("radius", 1);
     float zmin = params.FindOneFloat("zmin", -1);
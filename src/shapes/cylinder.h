@@ -43,7 +43,8 @@
 class Cylinder : public Shape {
 public:
     // Cylinder Public Methods
-    Cylinder(const Transform *o2w, const Transform *w2o, bool ro, float rad,
+    Cylinder(const AffineTransform *o2w,
+             const AffineTransform *w2o, bool ro, float rad,
              float zmin, float zmax, float phiMax);
     BBox ObjectBound() const;
     bool Intersect(const Ray &ray, float *tHit, float *rayEpsilon,
@@ -57,7 +58,8 @@ protected:
 };
 
 
-Cylinder *CreateCylinderShape(const Transform *o2w, const Transform *w2o,
+Cylinder *CreateCylinderShape(const AffineTransform *o2w,
+        const AffineTransform *w2o,
         bool reverseOrientation, const ParamSet &params);
 
 #endif // PBRT_SHAPES_CYLINDER_H
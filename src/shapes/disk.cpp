@@ -37,7 +37,7 @@
 #include "montecarlo.h"
 
 // Disk Method Definitions
-Disk::Disk(const Transform *o2w, const Transform *w2o, bool ro,
+Disk::Disk(const AffineTransform *o2w, const AffineTransform *w2o, bool ro,
            float ht, float r, float ri, float tmax)
     : Shape(o2w, w2o, ro) {
     height = ht;
@@ -89,7 +89,7 @@ bool Disk::Intersect(const Ray &r, float *tHit, float *rayEpsilon,
     Normal dndu(0,0,0), dndv(0,0,0);
 
     // Initialize _DifferentialGeometry_ from parametric information
-    const Transform &o2w = *ObjectToWorld;
+    const AffineTransform &o2w = *ObjectToWorld;
     *dg = DifferentialGeometry(o2w(phit), o2w(dpdu), o2w(dpdv),
                                o2w(dndu), o2w(dndv), u, v, this);
 
@@ -134,7 +134,7 @@ float Disk::Area() const {
 }
 
 
-Disk *CreateDiskShape(const Transform *o2w, const Transform *w2o,
+Disk *CreateDiskShape(const AffineTransform *o2w, const AffineTransform *w2o,
         bool reverseOrientation, const ParamSet &params) {
     float height = params.FindOneFloat("height", 0.);
     float radius = params.FindOneFloat("radius", 1);
@@ -43,7 +43,8 @@
 class Disk : public Shape {
 public:
     // Disk Public Methods
-    Disk(const Transform *o2w, const Transform *w2o, bool ro, float height,
+    Disk(const AffineTransform *o2w,
+         const AffineTransform *w2o, bool ro, float height,
          float radius, float innerRadius, float phiMax);
     BBox ObjectBound() const;
     bool Intersect(const Ray &ray, float *tHit, float *rayEpsilon,
@@ -57,7 +58,7 @@ private:
 };
 
 
-Disk *CreateDiskShape(const Transform *o2w, const Transform *w2o,
+Disk *CreateDiskShape(const AffineTransform *o2w, const AffineTransform *w2o,
         bool reverseOrientation, const ParamSet &params);
 
 #endif // PBRT_SHAPES_DISK_H
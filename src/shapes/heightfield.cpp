@@ -37,7 +37,7 @@
 #include "paramset.h"
 
 // Heightfield Method Definitions
-Heightfield::Heightfield(const Transform *o2w, const Transform *w2o,
+Heightfield::Heightfield(const AffineTransform *o2w, const AffineTransform *w2o,
         bool ro, int x, int y, const float *zs)
     : Shape(o2w, w2o, ro) {
     nx = x;
@@ -112,7 +112,8 @@ void Heightfield::Refine(vector<Reference<Shape> > &refined) const {
 }
 
 
-Heightfield *CreateHeightfieldShape(const Transform *o2w, const Transform *w2o,
+Heightfield *CreateHeightfieldShape(const AffineTransform *o2w,
+        const AffineTransform *w2o,
         bool reverseOrientation, const ParamSet &params) {
     int nu = params.FindOneInt("nu", -1);
     int nv = params.FindOneInt("nv", -1);
@@ -43,7 +43,8 @@
 class Heightfield : public Shape {
 public:
     // Heightfield Public Methods
-    Heightfield(const Transform *o2, const Transform *w2o, bool ro, int nu, int nv, const float *zs);
+    Heightfield(const AffineTransform *o2, const AffineTransform *w2o,
+                bool ro, int nu, int nv, const float *zs);
     ~Heightfield();
     bool CanIntersect() const;
     void Refine(vector<Reference<Shape> > &refined) const;
@@ -55,7 +56,8 @@ private:
 };
 
 
-Heightfield *CreateHeightfieldShape(const Transform *o2w, const Transform *w2o,
+Heightfield *CreateHeightfieldShape(const AffineTransform *o2w,
+        const AffineTransform *w2o,
         bool reverseOrientation, const ParamSet &params);
 
 #endif // PBRT_SHAPES_HEIGHTFIELD_H
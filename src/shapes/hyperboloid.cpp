@@ -36,7 +36,8 @@
 #include "paramset.h"
 
 // Hyperboloid Method Definitions
-Hyperboloid::Hyperboloid(const Transform *o2w, const Transform *w2o, bool ro,
+Hyperboloid::Hyperboloid(const AffineTransform *o2w,
+        const AffineTransform *w2o, bool ro,
         const Point &point1, const Point &point2, float tm)
     : Shape(o2w, w2o, ro) {
     p1 = point1;
@@ -162,7 +163,7 @@ bool Hyperboloid::Intersect(const Ray &r, float *tHit,
                          (f*F - g*E) * invEGF2 * dpdv);
 
     // Initialize _DifferentialGeometry_ from parametric information
-    const Transform &o2w = *ObjectToWorld;
+    const AffineTransform &o2w = *ObjectToWorld;
     *dg = DifferentialGeometry(o2w(phit), o2w(dpdu), o2w(dpdv),
                                o2w(dndu), o2w(dndv), u, v, this);
 
@@ -256,7 +257,8 @@ float Hyperboloid::Area() const {
 
 #undef SQR
 #undef QUAD
-Shape *CreateHyperboloidShape(const Transform *o2w, const Transform *w2o,
+Shape *CreateHyperboloidShape(const AffineTransform *o2w,
+        const AffineTransform *w2o,
         bool reverseOrientation, const ParamSet &params) {
     Point p1 = params.FindOnePoint("p1", Point(0,0,0));
     Point p2 = params.FindOnePoint("p2", Point(1,1,1));
@@ -43,7 +43,7 @@
 class Hyperboloid : public Shape {
 public:
     // Hyperboloid Public Methods
-    Hyperboloid(const Transform *o2w, const Transform *w2o, bool ro,
+    Hyperboloid(const AffineTransform *o2w, const AffineTransform *w2o, bool ro,
                 const Point &point1, const Point &point2,
                 float tm);
     BBox ObjectBound() const;
@@ -61,7 +61,8 @@ protected:
 };
 
 
-Shape *CreateHyperboloidShape(const Transform *o2w, const Transform *w2o,
+Shape *CreateHyperboloidShape(const AffineTransform *o2w,
+        const AffineTransform *w2o,
         bool reverseOrientation, const ParamSet &params);
 
 #endif // PBRT_SHAPES_HYPERBOLOID_H
@@ -153,7 +153,7 @@ inline int SDVertex::valence() {
 
 
 // LoopSubdiv Method Definitions
-LoopSubdiv::LoopSubdiv(const Transform *o2w, const Transform *w2o,
+LoopSubdiv::LoopSubdiv(const AffineTransform *o2w, const AffineTransform *w2o,
                        bool ro, int nfaces, int nvertices,
                        const int *vertexIndices, const Point *P, int nl)
     : Shape(o2w, w2o, ro) {
@@ -492,7 +492,8 @@ Point LoopSubdiv::weightBoundary(SDVertex *vert, float beta) {
 }
 
 
-LoopSubdiv *CreateLoopSubdivShape(const Transform *o2w, const Transform *w2o,
+LoopSubdiv *CreateLoopSubdivShape(const AffineTransform *o2w,
+        const AffineTransform *w2o,
         bool reverseOrientation, const ParamSet &params) {
     int nlevels = params.FindOneInt("nlevels", 3);
     int nps, nIndices;
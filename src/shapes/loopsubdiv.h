@@ -45,7 +45,7 @@ struct SDFace;
 class LoopSubdiv : public Shape {
 public:
     // LoopSubdiv Public Methods
-    LoopSubdiv(const Transform *o2w, const Transform *w2o, bool ro,
+    LoopSubdiv(const AffineTransform *o2w, const AffineTransform *w2o, bool ro,
                int nt, int nv, const int *vi,
                const Point *P, int nlevels);
     ~LoopSubdiv();
@@ -72,7 +72,8 @@ private:
 };
 
 
-LoopSubdiv *CreateLoopSubdivShape(const Transform *o2w, const Transform *w2o,
+LoopSubdiv *CreateLoopSubdivShape(const AffineTransform *o2w,
+        const AffineTransform *w2o,
         bool reverseOrientation, const ParamSet &params);
 
 #endif // PBRT_SHAPES_LOOPSUBDIV_H
@@ -151,7 +151,7 @@ NURBSEvaluateSurface(int uOrder, const float *uKnot, int ucp, float u,
 
 
 // NURBS Method Definitions
-NURBS::NURBS(const Transform *o2w, const Transform *w2o,
+NURBS::NURBS(const AffineTransform *o2w, const AffineTransform *w2o,
         bool ro, int numu, int uo, const float *uk,
         float u0, float u1, int numv, int vo, const float *vk,
         float v0, float v1, const float *p, bool homogeneous)
@@ -305,7 +305,7 @@ void NURBS::Refine(vector<Reference<Shape> > &refined) const {
 
 
 
-NURBS *CreateNURBSShape(const Transform *o2w, const Transform *w2o,
+NURBS *CreateNURBSShape(const AffineTransform *o2w, const AffineTransform *w2o,
         bool ReverseOrientation, const ParamSet &params) {
     int nu = params.FindOneInt("nu", -1);
     int uorder = params.FindOneInt("uorder", -1);
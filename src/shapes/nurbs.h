@@ -46,7 +46,7 @@
 class NURBS : public Shape {
 public:
     // NURBS Methods
-    NURBS(const Transform *o2w, const Transform *w2o,
+    NURBS(const AffineTransform *o2w, const AffineTransform *w2o,
         bool ReverseOrientation, int nu, int uorder,
         const float *uknot, float umin, float umax,
         int nv, int vorder, const float *vknot, float vmin, float vmax,
@@ -68,7 +68,8 @@ private:
 
 
 
-extern NURBS *CreateNURBSShape(const Transform *o2w, const Transform *w2o,
+extern NURBS *CreateNURBSShape(const AffineTransform *o2w,
+    const AffineTransform *w2o,
     bool ReverseOrientation, const ParamSet &params);
 
 
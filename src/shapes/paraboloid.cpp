@@ -36,7 +36,8 @@
 #include "paramset.h"
 
 // Paraboloid Method Definitions
-Paraboloid::Paraboloid(const Transform *o2w, const Transform *w2o, bool ro,
+Paraboloid::Paraboloid(const AffineTransform *o2w,
+                       const AffineTransform *w2o, bool ro,
                        float rad, float z0, float z1,
                        float tm)
     : Shape(o2w, w2o, ro) {
@@ -140,7 +141,7 @@ bool Paraboloid::Intersect(const Ray &r, float *tHit,
                          (f*F - g*E) * invEGF2 * dpdv);
 
     // Initialize _DifferentialGeometry_ from parametric information
-    const Transform &o2w = *ObjectToWorld;
+    const AffineTransform &o2w = *ObjectToWorld;
     *dg = DifferentialGeometry(o2w(phit), o2w(dpdu), o2w(dpdv),
                                o2w(dndu), o2w(dndv), u, v, this);
 
@@ -212,7 +213,8 @@ float Paraboloid::Area() const {
 }
 
 
-Paraboloid *CreateParaboloidShape(const Transform *o2w, const Transform *w2o,
+Paraboloid *CreateParaboloidShape(const AffineTransform *o2w,
+        const AffineTransform *w2o,
         bool reverseOrientation, const ParamSet &params) {
     float radius = params.FindOneFloat("radius", 1);
     float zmin = params.FindOneFloat("zmin", 0);
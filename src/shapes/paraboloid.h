@@ -43,7 +43,8 @@
 class Paraboloid : public Shape {
 public:
     // Paraboloid Public Methods
-    Paraboloid(const Transform *o2w, const Transform *w2o, bool ro, float rad,
+    Paraboloid(const AffineTransform *o2w,
+               const AffineTransform *w2o, bool ro, float rad,
                float z0, float z1, float tm );
     BBox ObjectBound() const;
     bool Intersect(const Ray &ray, float *tHit, float *rayEpsilon,
@@ -58,7 +59,8 @@ protected:
 };
 
 
-Paraboloid *CreateParaboloidShape(const Transform *o2w, const Transform *w2o,
+Paraboloid *CreateParaboloidShape(const AffineTransform *o2w,
+        const AffineTransform *w2o,
         bool reverseOrientation, const ParamSet &params);
 
 #endif // PBRT_SHAPES_PARABOLOID_H
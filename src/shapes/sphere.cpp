@@ -37,7 +37,7 @@
 #include "paramset.h"
 
 // Sphere Method Definitions
-Sphere::Sphere(const Transform *o2w, const Transform *w2o, bool ro,
+Sphere::Sphere(const AffineTransform *o2w, const AffineTransform *w2o, bool ro,
                float rad, float z0, float z1, float pm)
     : Shape(o2w, w2o, ro) {
     radius = rad;
@@ -144,7 +144,7 @@ bool Sphere::Intersect(const Ray &r, float *tHit, float *rayEpsilon,
                          (f*F - g*E) * invEGF2 * dpdv);
 
     // Initialize _DifferentialGeometry_ from parametric information
-    const Transform &o2w = *ObjectToWorld;
+    const AffineTransform &o2w = *ObjectToWorld;
     *dg = DifferentialGeometry(o2w(phit), o2w(dpdu), o2w(dpdv),
                                o2w(dndu), o2w(dndv), u, v, this);
 
@@ -214,7 +214,8 @@ float Sphere::Area() const {
 }
 
 
-Sphere *CreateSphereShape(const Transform *o2w, const Transform *w2o,
+Sphere *CreateSphereShape(const AffineTransform *o2w,
+        const AffineTransform *w2o,
         bool reverseOrientation, const ParamSet &params) {
     float radius = params.FindOneFloat("radius", 1.f);
     float zmin = params.FindOneFloat("zmin", -radius);
@@ -43,7 +43,8 @@
 class Sphere : public Shape {
 public:
     // Sphere Public Methods
-    Sphere(const Transform *o2w, const Transform *w2o, bool ro, float rad,
+    Sphere(const AffineTransform *o2w,
+           const AffineTransform *w2o, bool ro, float rad,
            float zmin, float zmax, float phiMax);
     BBox ObjectBound() const;
     bool Intersect(const Ray &ray, float *tHit, float *rayEpsilon,
@@ -62,7 +63,8 @@ private:
 };
 
 
-Sphere *CreateSphereShape(const Transform *o2w, const Transform *w2o,
+Sphere *CreateSphereShape(const AffineTransform *o2w,
+        const AffineTransform *w2o,
         bool reverseOrientation, const ParamSet &params);
 
 #endif // PBRT_SHAPES_SPHERE_H
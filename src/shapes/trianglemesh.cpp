@@ -37,47 +37,105 @@
 #include "textures/constant.h"
 #include "paramset.h"
 #include "montecarlo.h"
+#include "parallel.h"
+#include "stats.h"
+
+// TriangleMesh Local Definitions
+static StatsMemory triMeshBytes("Memory", "Triangle meshes");
+static StatsMemory triangleBytes("Memory", "Refined triangles");
+struct TransformVerticesFunc {
+    TransformVerticesFunc(const AffineTransform *t, const Point *P, Point *p)
+        : ObjectToWorld(t), P(P), p(p) { }
+    void operator()(int i) const {
+        p[i] = (*ObjectToWorld)(P[i]);
+    }
+    const AffineTransform *ObjectToWorld;
+    const Point *P;
+    Point *p;
+};
+
+
+struct RefineTrianglesFunc {
+    RefineTrianglesFunc(const TriangleMesh *m, Reference<Shape> *r)
+        : mesh(m), refined(r) { }
+    void operator()(int i) const {
+        refined[i] = new Triangle(mesh->ObjectToWorld, mesh->WorldToObject,
+                                  mesh->ReverseOrientation,
+                                  const_cast<TriangleMesh *>(mesh), i);
+    }
+    const TriangleMesh *mesh;
+    Reference<Shape> *refined;
+};
+
+
 
 // TriangleMesh Method Definitions
-TriangleMesh::TriangleMesh(const Transform *o2w, const Transform *w2o,
+TriangleMesh::TriangleMesh(const AffineTransform *o2w,
+        const AffineTransform *w2o,
         bool ro, int nt, int nv, const int *vi, const Point *P,
         const Normal *N, const Vector *S, const float *uv,
-        const Reference<Texture<float> > &atex)
-    : Shape(o2w, w2o, ro), alphaTexture(atex) {
+        const Reference<Texture<float> > &atex,
+        const Reference<MappedFile> &mapped)
+    : Shape(o2w, w2o, ro), alphaTexture(atex), mappedFile(mapped) {
     ntris = nt;
     nverts = nv;
-    vertexIndex = new int[3 * ntris];
-    memcpy(vertexIndex, vi, 3 * ntris * sizeof(int));
-    // Copy _uv_, _N_, and _S_ vertex data, if present
-    if (uv) {
-        uvs = new float[2*nverts];
-        memcpy(uvs, uv, 2*nverts*sizeof(float));
-    }
-    else uvs = NULL;
-    p = new Point[nverts];
-    if (N) {
-        n = new Normal[nverts];
-        memcpy(n, N, nverts*sizeof(Normal));
+    if (mappedFile) {
+        // Reference vertex data in mapped file directly
+        vertexIndex = vi;
+        uvs = uv;
+        n = N;
+        s = S;
     }
-    else n = NULL;
-    if (S) {
-        s = new Vector[nverts];
-        memcpy(s, S, nverts*sizeof(Vector));
+    else {
+        int *indices = new int[3 * ntris];
+        memcpy(indices, vi, 3 * ntris * sizeof(int));
+        vertexIndex = indices;
+        // Copy _uv_, _N_, and _S_ vertex data, if present
+        if (uv) {
+            float *uvCopy = new float[2*nverts];
+            memcpy(uvCopy, uv, 2*nverts*sizeof(float));
+            uvs = uvCopy;
+        }
+        else uvs = NULL;
+        if (N) {
+            Normal *nCopy = new Normal[nverts];
+            memcpy(nCopy, N, nverts*sizeof(Normal));
+            n = nCopy;
+        }
+        else n = NULL;
+        if (S) {
+            Vector *sCopy = new Vector[nverts];
+            memcpy(sCopy, S, nverts*sizeof(Vector));
+            s = sCopy;
+        }
+        else s = NULL;
+        triMeshBytes += 3 * ntris * sizeof(int) + nverts * (
+            (uvs ? 2 * sizeof(float) : 0) + (n ? sizeof(Normal) : 0) +
+            (s ? sizeof(Vector) : 0));
     }
-    else s = NULL;
 
     // Transform mesh vertices to world space
-    for (int i = 0; i < nverts; ++i)
-        p[i] = (*ObjectToWorld)(P[i]);
+    ownsPositions = !mappedFile || !ObjectToWorld->IsIdentity();
+    if (ownsPositions) {
+        Point *pWorld = new Point[nverts];
+        ParallelFor(0, nverts, 4096,
+                    TransformVerticesFunc(ObjectToWorld, P, pWorld));
+        p = pWorld;
+        triMeshBytes += nverts * sizeof(Point);
+    }
+    else
+        p = P;
 }
 
 
 TriangleMesh::~TriangleMesh() {
-    delete[] vertexIndex;
-    delete[] p;
-    delete[] s;
-    delete[] n;
-    delete[] uvs;
+    if (!mappedFile) {
+        delete[] vertexIndex;
+        delete[] s;
+        delete[] n;
+        delete[] uvs;
+    }
+    if (ownsPositions) delete[] p;
 }
 
 
@@ -98,10 +156,11 @@ BBox TriangleMesh::WorldBound() const {
 
 
 void TriangleMesh::Refine(vector<Reference<Shape> > &refined) const {
-    for (int i = 0; i < ntris; ++i)
-        refined.push_back(new Triangle(ObjectToWorld,
-                          WorldToObject, ReverseOrientation,
-                          (TriangleMesh *)this, i));
+    if (ntris == 0) return;
+    uint32_t start = refined.size();
+    refined.resize(start + ntris);
+    triangleBytes += ntris * sizeof(Triangle);
+    ParallelFor(0, ntris, 4096, RefineTrianglesFunc(this, &refined[start]));
 }
 
 
@@ -124,56 +183,48 @@ BBox Triangle::WorldBound() const {
 }
 
 
-bool Triangle::Intersect(const Ray &ray, float *tHit, float *rayEpsilon,
-                         DifferentialGeometry *dg) const {
-    PBRT_RAY_TRIANGLE_INTERSECTION_TEST(const_cast<Ray *>(&ray), const_cast<Triangle *>(this));
-    // Compute $\VEC{s}_1$
-
-    // Get triangle vertices in _p1_, _p2_, and _p3_
-    const Point &p1 = mesh->p[v[0]];
-    const Point &p2 = mesh->p[v[1]];
-    const Point &p3 = mesh->p[v[2]];
-    Vector e1 = p2 - p1;
-    Vector e2 = p3 - p1;
-    Vector s1 = Cross(ray.d, e2);
-    float divisor = Dot(s1, e1);
-    
-    if (divisor == 0.)
-        return false;
-    float invDivisor = 1.f / divisor;
-
-    // Compute first barycentric coordinate
-    Vector s = ray.o - p1;
-    float b1 = Dot(s, s1) * invDivisor;
-    if (b1 < 0. || b1 > 1.)
-        return false;
+void TriangleMesh::GetTriangleUVs(int face, float uv[3][2]) const {
+    const int *v = &vertexIndex[3*face];
+    if (uvs) {
+        uv[0][0] = uvs[2*v[0]];
+        uv[0][1] = uvs[2*v[0]+1];
+        uv[1][0] = uvs[2*v[1]];
+        uv[1][1] = uvs[2*v[1]+1];
+        uv[2][0] = uvs[2*v[2]];
+        uv[2][1] = uvs[2*v[2]+1];
+    }
+    else {
+        uv[0][0] = 0.; uv[0][1] = 0.;
+        uv[1][0] = 1.; uv[1][1] = 0.;
+        uv[2][0] = 1.; uv[2][1] = 1.;
+    }
+}
 
-    // Compute second barycentric coordinate
-    Vector s2 = Cross(s, e1);
-    float b2 = Dot(ray.d, s2) * invDivisor;
-    if (b2 < 0. || b1 + b2 > 1.)
-        return false;
 
-    // Compute _t_ to intersection point
-    float t = Dot(e2, s2) * invDivisor;
-    if (t < ray.mint || t > ray.maxt)
-        return false;
+bool TriangleMesh::ComputeTriangleHit(int face, const Ray &ray, float t,
+        float b1, float b2, const Shape *shape,
+        DifferentialGeometry *dg) const {
+    // Get triangle vertices in _p1_, _p2_, and _p3_
+    const int *v = &vertexIndex[3*face];
+    const Point &p1 = p[v[0]];
+    const Point &p2 = p[v[1]];
+    const Point &p3 = p[v[2]];
 
     // Compute triangle partial derivatives
     Vector dpdu, dpdv;
-    float uvs[3][2];
-    GetUVs(uvs);
+    float uv[3][2];
+    GetTriangleUVs(face, uv);
 
     // Compute deltas for triangle partial derivatives
-    float du1 = uvs[0][0] - uvs[2][0];
-    float du2 = uvs[1][0] - uvs[2][0];
-    float dv1 = uvs[0][1] - uvs[2][1];
-    float dv2 = uvs[1][1] - uvs[2][1];
+    float du1 = uv[0][0] - uv[2][0];
+    float du2 = uv[1][0] - uv[2][0];
+    float dv1 = uv[0][1] - uv[2][1];
+    float dv2 = uv[1][1] - uv[2][1];
     Vector dp1 = p1 - p3, dp2 = p2 - p3;
     float determinant = du1 * dv2 - dv1 * du2;
     if (determinant == 0.f) {
         // Handle zero determinant for triangle partial derivative matrix
-        CoordinateSystem(Normalize(Cross(e2, e1)), &dpdu, &dpdv);
+        CoordinateSystem(Normalize(Cross(p3 - p1, p2 - p1)), &dpdu, &dpdv);
     }
     else {
         float invdet = 1.f / determinant;
@@ -183,97 +234,70 @@ bool Triangle::Intersect(const Ray &ray, float *tHit, float *rayEpsilon,
 
     // Interpolate $(u,v)$ triangle parametric coordinates
     float b0 = 1 - b1 - b2;
-    float tu = b0*uvs[0][0] + b1*uvs[1][0] + b2*uvs[2][0];
-    float tv = b0*uvs[0][1] + b1*uvs[1][1] + b2*uvs[2][1];
+    float tu = b0*uv[0][0] + b1*uv[1][0] + b2*uv[2][0];
+    float tv = b0*uv[0][1] + b1*uv[1][1] + b2*uv[2][1];
 
     // Test intersection against alpha texture, if present
-    if (ray.depth != -1) {
-    if (mesh->alphaTexture) {
+    if (ray.depth != -1 && alphaTexture) {
         DifferentialGeometry dgLocal(ray(t), dpdu, dpdv,
                                      Normal(0,0,0), Normal(0,0,0),
-                                     tu, tv, this);
-        if (mesh->alphaTexture->Evaluate(dgLocal) == 0.f)
+                                     tu, tv, shape);
+        dgLocal.faceIndex = face;
+        if (alphaTexture->Evaluate(dgLocal) == 0.f)
             return false;
     }
-    }
 
     // Fill in _DifferentialGeometry_ from triangle hit
     *dg = DifferentialGeometry(ray(t), dpdu, dpdv,
                                Normal(0,0,0), Normal(0,0,0),
-                               tu, tv, this);
-    *tHit = t;
-    *rayEpsilon = 1e-3f * *tHit;
-    PBRT_RAY_TRIANGLE_INTERSECTION_HIT(const_cast<Ray *>(&ray), t);
+                               tu, tv, shape);
+    dg->faceIndex = face;
     return true;
 }
 
 
-bool Triangle::IntersectP(const Ray &ray) const {
-    PBRT_RAY_TRIANGLE_INTERSECTIONP_TEST(const_cast<Ray *>(&ray), const_cast<Triangle *>(this));
-    // Compute $\VEC{s}_1$
+void TriangleMesh::GetShadingGeometry(const Transform &obj2world,
+        const DifferentialGeometry &dg,
+        DifferentialGeometry *dgShading) const {
+    GetTriangleShadingGeometry(dg.faceIndex, obj2world, dg, dgShading);
+}
 
-    // Get triangle vertices in _p1_, _p2_, and _p3_
-    const Point &p1 = mesh->p[v[0]];
-    const Point &p2 = mesh->p[v[1]];
-    const Point &p3 = mesh->p[v[2]];
-    Vector e1 = p2 - p1;
-    Vector e2 = p3 - p1;
-    Vector s1 = Cross(ray.d, e2);
-    float divisor = Dot(s1, e1);
-    
-    if (divisor == 0.)
-        return false;
-    float invDivisor = 1.f / divisor;
 
-    // Compute first barycentric coordinate
-    Vector d = ray.o - p1;
-    float b1 = Dot(d, s1) * invDivisor;
-    if (b1 < 0. || b1 > 1.)
+bool Triangle::Intersect(const Ray &ray, float *tHit, float *rayEpsilon,
+                         DifferentialGeometry *dg) const {
+    PBRT_RAY_TRIANGLE_INTERSECTION_TEST(const_cast<Ray *>(&ray), const_cast<Triangle *>(this));
+    // Get triangle vertex and edges in _p1_, _e1_, and _e2_
+    Point p1;
+    Vector e1, e2;
+    mesh->GetTriangleEdges(Face(), &p1, &e1, &e2);
+
+    // Compute ray--triangle intersection and fill in _dg_
+    float t, b1, b2;
+    if (!IntersectTriangle(ray, p1, e1, e2, &t, &b1, &b2))
         return false;
-
-    // Compute second barycentric coordinate
-    Vector s2 = Cross(d, e1);
-    float b2 = Dot(ray.d, s2) * invDivisor;
-    if (b2 < 0. || b1 + b2 > 1.)
+    if (!mesh->ComputeTriangleHit(Face(), ray, t, b1, b2, this, dg))
         return false;
+    *tHit = t;
+    *rayEpsilon = 1e-3f * *tHit;
+    PBRT_RAY_TRIANGLE_INTERSECTION_HIT(const_cast<Ray *>(&ray), t);
+    return true;
+}
+
 
-    // Compute _t_ to intersection point
-    float t = Dot(e2, s2) * invDivisor;
-    if (t < ray.mint || t > ray.maxt)
+bool Triangle::IntersectP(const Ray &ray) const {
+    PBRT_RAY_TRIANGLE_INTERSECTIONP_TEST(const_cast<Ray *>(&ray), const_cast<Triangle *>(this));
+    // Get triangle vertex and edges in _p1_, _e1_, and _e2_
+    Point p1;
+    Vector e1, e2;
+    mesh->GetTriangleEdges(Face(), &p1, &e1, &e2);
+    float t, b1, b2;
+    if (!IntersectTriangle(ray, p1, e1, e2, &t, &b1, &b2))
         return false;
 
     // Test shadow ray intersection against alpha texture, if present
     if (ray.depth != -1 && mesh->alphaTexture) {
-        // Compute triangle partial derivatives
-        Vector dpdu, dpdv;
-        float uvs[3][2];
-        GetUVs(uvs);
-
-        // Compute deltas for triangle partial derivatives
-        float du1 = uvs[0][0] - uvs[2][0];
-        float du2 = uvs[1][0] - uvs[2][0];
-        float dv1 = uvs[0][1] - uvs[2][1];
-        float dv2 = uvs[1][1] - uvs[2][1];
-        Vector dp1 = p1 - p3, dp2 = p2 - p3;
-        float determinant = du1 * dv2 - dv1 * du2;
-        if (determinant == 0.f) {
-            // Handle zero determinant for triangle partial derivative matrix
-            CoordinateSystem(Normalize(Cross(e2, e1)), &dpdu, &dpdv);
-        }
-        else {
-            float invdet = 1.f / determinant;
-            dpdu = ( dv2 * dp1 - dv1 * dp2) * invdet;
-            dpdv = (-du2 * dp1 + du1 * dp2) * invdet;
-        }
-
-        // Interpolate $(u,v)$ triangle parametric coordinates
-        float b0 = 1 - b1 - b2;
-        float tu = b0*uvs[0][0] + b1*uvs[1][0] + b2*uvs[2][0];
-        float tv = b0*uvs[0][1] + b1*uvs[1][1] + b2*uvs[2][1];
-        DifferentialGeometry dgLocal(ray(t), dpdu, dpdv,
-                                     Normal(0,0,0), Normal(0,0,0),
-                                     tu, tv, this);
-        if (mesh->alphaTexture->Evaluate(dgLocal) == 0.f)
+        DifferentialGeometry dgLocal;
+        if (!mesh->ComputeTriangleHit(Face(), ray, t, b1, b2, this, &dgLocal))
             return false;
     }
     PBRT_RAY_TRIANGLE_INTERSECTIONP_HIT(const_cast<Ray *>(&ray), t);
@@ -293,18 +317,26 @@ float Triangle::Area() const {
 void Triangle::GetShadingGeometry(const Transform &obj2world,
         const DifferentialGeometry &dg,
         DifferentialGeometry *dgShading) const {
-    if (!mesh->n && !mesh->s) {
+    mesh->GetTriangleShadingGeometry(Face(), obj2world, dg, dgShading);
+}
+
+
+void TriangleMesh::GetTriangleShadingGeometry(int face,
+        const Transform &obj2world, const DifferentialGeometry &dg,
+        DifferentialGeometry *dgShading) const {
+    if (!n && !s) {
         *dgShading = dg;
         return;
     }
     // Initialize _Triangle_ shading geometry with _n_ and _s_
+    const int *v = &vertexIndex[3*face];
 
     // Compute barycentric coordinates for point
     float b[3];
 
     // Initialize _A_ and _C_ matrices for barycentrics
     float uv[3][2];
-    GetUVs(uv);
+    GetTriangleUVs(face, uv);
     float A[2][2] =
         { { uv[1][0] - uv[0][0], uv[2][0] - uv[0][0] },
           { uv[1][1] - uv[0][1], uv[2][1] - uv[0][1] } };
@@ -319,13 +351,13 @@ void Triangle::GetShadingGeometry(const Transform &obj2world,
     // Use _n_ and _s_ to compute shading tangents for triangle, _ss_ and _ts_
     Normal ns;
     Vector ss, ts;
-    if (mesh->n) ns = Normalize(obj2world(b[0] * mesh->n[v[0]] +
-                                          b[1] * mesh->n[v[1]] +
-                                          b[2] * mesh->n[v[2]]));
+    if (n) ns = Normalize(obj2world(b[0] * n[v[0]] +
+                                    b[1] * n[v[1]] +
+                                    b[2] * n[v[2]]));
     else   ns = dg.nn;
-    if (mesh->s) ss = Normalize(obj2world(b[0] * mesh->s[v[0]] +
-                                          b[1] * mesh->s[v[1]] +
-                                          b[2] * mesh->s[v[2]]));
+    if (s) ss = Normalize(obj2world(b[0] * s[v[0]] +
+                                    b[1] * s[v[1]] +
+                                    b[2] * s[v[2]]));
     else   ss = Normalize(dg.dpdu);
     
     ts = Cross(ss, ns);
@@ -338,16 +370,14 @@ void Triangle::GetShadingGeometry(const Transform &obj2world,
     Normal dndu, dndv;
 
     // Compute $\dndu$ and $\dndv$ for triangle shading geometry
-    if (mesh->n) {
-        float uvs[3][2];
-        GetUVs(uvs);
+    if (n) {
         // Compute deltas for triangle partial derivatives of normal
-        float du1 = uvs[0][0] - uvs[2][0];
-        float du2 = uvs[1][0] - uvs[2][0];
-        float dv1 = uvs[0][1] - uvs[2][1];
-        float dv2 = uvs[1][1] - uvs[2][1];
-        Normal dn1 = mesh->n[v[0]] - mesh->n[v[2]];
-        Normal dn2 = mesh->n[v[1]] - mesh->n[v[2]];
+        float du1 = uv[0][0] - uv[2][0];
+        float du2 = uv[1][0] - uv[2][0];
+        float dv1 = uv[0][1] - uv[2][1];
+        float dv2 = uv[1][1] - uv[2][1];
+        Normal dn1 = n[v[0]] - n[v[2]];
+        Normal dn2 = n[v[1]] - n[v[2]];
         float determinant = du1 * dv2 - dv1 * du2;
         if (determinant == 0.f)
             dndu = dndv = Normal(0,0,0);
@@ -362,13 +392,15 @@ void Triangle::GetShadingGeometry(const Transform &obj2world,
     *dgShading = DifferentialGeometry(dg.p, ss, ts,
         obj2world(dndu), obj2world(dndv),
         dg.u, dg.v, dg.shape);
+    dgShading->faceIndex = dg.faceIndex;
     dgShading->dudx = dg.dudx;  dgShading->dvdx = dg.dvdx;
     dgShading->dudy = dg.dudy;  dgShading->dvdy = dg.dvdy;
     dgShading->dpdx = dg.dpdx;  dgShading->dpdy = dg.dpdy;
 }
 
 
-TriangleMesh *CreateTriangleMeshShape(const Transform *o2w, const Transform *w2o,
+TriangleMesh *CreateTriangleMeshShape(const AffineTransform *o2w,
+        const AffineTransform *w2o,
         bool reverseOrientation, const ParamSet &params,
         map<string, Reference<Texture<float> > > *floatTextures) {
     int nvi, npi, nuvi, nsi, nni;
@@ -425,6 +457,15 @@ TriangleMesh *CreateTriangleMeshShape(const Transform *o2w, const Transform *w2o
             return NULL;
         }
 
+    Reference<Texture<float> > alphaTex =
+        FindTriangleMeshAlphaTexture(params, floatTextures);
+    return new TriangleMesh(o2w, w2o, reverseOrientation, nvi/3, npi, vi, P,
+        N, S, uvs, alphaTex);
+}
+
+
+Reference<Texture<float> > FindTriangleMeshAlphaTexture(const ParamSet &params,
+        map<string, Reference<Texture<float> > > *floatTextures) {
     Reference<Texture<float> > alphaTex = NULL;
     string alphaTexName = params.FindTexture("alpha");
     if (alphaTexName != "") {
@@ -436,8 +477,7 @@ TriangleMesh *CreateTriangleMeshShape(const Transform *o2w, const Transform *w2o
     }
     else if (params.FindOneFloat("alpha", 1.f) == 0.f)
         alphaTex = new ConstantTexture<float>(0.f);
-    return new TriangleMesh(o2w, w2o, reverseOrientation, nvi/3, npi, vi, P,
-        N, S, uvs, alphaTex);
+    return alphaTex;
 }
 
 
@@ -45,33 +45,58 @@ using std::map;
 class TriangleMesh : public Shape {
 public:
     // TriangleMesh Public Methods
-    TriangleMesh(const Transform *o2w, const Transform *w2o, bool ro,
+    TriangleMesh(const AffineTransform *o2w,
+                 const AffineTransform *w2o, bool ro,
                  int ntris, int nverts, const int *vptr,
                  const Point *P, const Normal *N, const Vector *S,
-                 const float *uv, const Reference<Texture<float> > &atex);
+                 const float *uv, const Reference<Texture<float> > &atex,
+                 const Reference<MappedFile> &mapped = Reference<MappedFile>());
     ~TriangleMesh();
     BBox ObjectBound() const;
     BBox WorldBound() const;
     bool CanIntersect() const { return false; }
     void Refine(vector<Reference<Shape> > &refined) const;
+    void GetShadingGeometry(const Transform &obj2world,
+            const DifferentialGeometry &dg,
+            DifferentialGeometry *dgShading) const;
+    int NumTriangles() const { return ntris; }
+    bool HasAlphaTexture() const { return alphaTexture.GetPtr() != NULL; }
+    BBox TriangleWorldBound(int face) const {
+        const int *v = &vertexIndex[3*face];
+        return Union(BBox(p[v[0]], p[v[1]]), p[v[2]]);
+    }
+    void GetTriangleEdges(int face, Point *p1, Vector *e1, Vector *e2) const {
+        const int *v = &vertexIndex[3*face];
+        *p1 = p[v[0]];
+        *e1 = p[v[1]] - p[v[0]];
+        *e2 = p[v[2]] - p[v[0]];
+    }
+    void GetTriangleUVs(int face, float uv[3][2]) const;
+    bool ComputeTriangleHit(int face, const Ray &ray, float t, float b1,
+        float b2, const Shape *shape, DifferentialGeometry *dg) const;
+    void GetTriangleShadingGeometry(int face, const Transform &obj2world,
+            const DifferentialGeometry &dg,
+            DifferentialGeometry *dgShading) const;
     friend class Triangle;
     template <typename T> friend class VertexTexture;
 protected:
     // TriangleMesh Protected Data
     int ntris, nverts;
-    int *vertexIndex;
-    Point *p;
-    Normal *n;
-    Vector *s;
-    float *uvs;
+    const int *vertexIndex;
+    const Point *p;
+    const Normal *n;
+    const Vector *s;
+    const float *uvs;
     Reference<Texture<float> > alphaTexture;
+    Reference<MappedFile> mappedFile;
+    bool ownsPositions;
 };
 
 
 class Triangle : public Shape {
 public:
     // Triangle Public Methods
-    Triangle(const Transform *o2w, const Transform *w2o, bool ro,
+    Triangle(const AffineTransform *o2w, const AffineTransform *w2o, bool ro,
              TriangleMesh *m, int n)
         : Shape(o2w, w2o, ro) {
         mesh = m;
@@ -84,19 +109,12 @@ public:
                    DifferentialGeometry *dg) const;
     bool IntersectP(const Ray &ray) const;
     void GetUVs(float uv[3][2]) const {
-        if (mesh->uvs) {
-            uv[0][0] = mesh->uvs[2*v[0]];
-            uv[0][1] = mesh->uvs[2*v[0]+1];
-            uv[1][0] = mesh->uvs[2*v[1]];
-            uv[1][1] = mesh->uvs[2*v[1]+1];
-            uv[2][0] = mesh->uvs[2*v[2]];
-            uv[2][1] = mesh->uvs[2*v[2]+1];
-        }
-        else {
-            uv[0][0] = 0.; uv[0][1] = 0.;
-            uv[1][0] = 1.; uv[1][1] = 0.;
-            uv[2][0] = 1.; uv[2][1] = 1.;
-        }
+        mesh->GetTriangleUVs(Face(), uv);
+    }
+    void GetVertices(Point p[3]) const {
+        p[0] = mesh->p[v[0]];
+        p[1] = mesh->p[v[1]];
+        p[2] = mesh->p[v[2]];
     }
     float Area() const;
     virtual void GetShadingGeometry(const Transform &obj2world,
@@ -104,14 +122,50 @@ public:
             DifferentialGeometry *dgShading) const;
     Point Sample(float u1, float u2, Normal *Ns) const;
 private:
+    // Triangle Private Methods
+    int Face() const { return int(v - mesh->vertexIndex) / 3; }
+
     // Triangle Private Data
     Reference<TriangleMesh> mesh;
-    int *v;
+    const int *v;
 };
 
 
-TriangleMesh *CreateTriangleMeshShape(const Transform *o2w, const Transform *w2o,
+inline bool IntersectTriangle(const Ray &ray, const Point &p1,
+        const Vector &e1, const Vector &e2, float *tHit, float *b1,
+        float *b2) {
+    // Compute $\VEC{s}_1$
+    Vector s1 = Cross(ray.d, e2);
+    float divisor = Dot(s1, e1);
+    if (divisor == 0.)
+        return false;
+    float invDivisor = 1.f / divisor;
+
+    // Compute first barycentric coordinate
+    Vector s = ray.o - p1;
+    *b1 = Dot(s, s1) * invDivisor;
+    if (*b1 < 0. || *b1 > 1.)
+        return false;
+
+    // Compute second barycentric coordinate
+    Vector s2 = Cross(s, e1);
+    *b2 = Dot(ray.d, s2) * invDivisor;
+    if (*b2 < 0. || *b1 + *b2 > 1.)
+        return false;
+
+    // Compute _t_ to intersection point
+    *tHit = Dot(e2, s2) * invDivisor;
+    if (*tHit < ray.mint || *tHit > ray.maxt)
+        return false;
+    return true;
+}
+
+
+TriangleMesh *CreateTriangleMeshShape(const AffineTransform *o2w,
+    const AffineTransform *w2o,
     bool reverseOrientation, const ParamSet &params,
     map<string, Reference<Texture<float> > > *floatTextures = NULL);
+Reference<Texture<float> > FindTriangleMeshAlphaTexture(const ParamSet &params,
+    map<string, Reference<Texture<float> > > *floatTextures);
 
 #endif // PBRT_SHAPES_TRIANGLEMESH_H
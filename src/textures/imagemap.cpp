@@ -35,14 +35,60 @@
 #include "textures/imagemap.h"
 #include "imageio.h"
 
+// ImageTexture Local Declarations
+template <typename Tmemory, typename Treturn>
+class ImageTexture<Tmemory, Treturn>::TileSource : public TextureTileSource {
+public:
+    // ImageTexture::TileSource Public Methods
+    TileSource(const Reference<TiledMIPFile> &f, float sc)
+        : TextureTileSource(sizeof(Tmemory) << (2 * f->LogTileSize())),
+          file(f), scale(sc) { }
+    void LoadTile(uint32_t level, uint32_t tu, uint32_t tv,
+                  void *texels) const {
+        // Read tile directly if its texels need no conversion
+        uint32_t nChannels = file->Channels();
+        if (scale == 1.f &&
+            nChannels * sizeof(float) == sizeof(Tmemory)) {
+            file->ReadTile(level, tu, tv, (float *)texels);
+            return;
+        }
+
+        // Read tile's channels and convert them to _Tmemory_ texels
+        uint32_t nTexels = 1 << (2 * file->LogTileSize());
+        float *channels = new float[nTexels * nChannels];
+        file->ReadTile(level, tu, tv, channels);
+        Tmemory *tile = (Tmemory *)texels;
+        for (uint32_t i = 0; i < nTexels; ++i) {
+            RGBSpectrum rgb = (nChannels == 3) ?
+                RGBSpectrum::FromRGB(&channels[3*i]) : RGBSpectrum(channels[i]);
+            convertIn(rgb, &tile[i], scale, 1.f);
+        }
+        delete[] channels;
+    }
+    const void *MappedLevel(uint32_t level) const {
+        // Use mapped texels in place if they need no conversion
+        if (scale != 1.f ||
+            file->Channels() * sizeof(float) != sizeof(Tmemory))
+            return NULL;
+        return file->MappedLevel(level);
+    }
+private:
+    // ImageTexture::TileSource Private Data
+    Reference<TiledMIPFile> file;
+    float scale;
+};
+
+
+
 // ImageTexture Method Definitions
 template <typename Tmemory, typename Treturn>
 ImageTexture<Tmemory, Treturn>::ImageTexture(TextureMapping2D *m,
         const string &filename, bool doTrilinear, float maxAniso,
-        ImageWrap wrapMode, float scale, float gamma) {
+        ImageWrap wrapMode, float scale, float gamma, TexelFormat format,
+        TileAccess tileAccess) {
     mapping = m;
     mipmap = GetTexture(filename, doTrilinear, maxAniso,
-                        wrapMode, scale, gamma);
+                        wrapMode, scale, gamma, format, tileAccess);
 }
 
 
@@ -55,31 +101,70 @@ template <typename Tmemory, typename Treturn>
 template <typename Tmemory, typename Treturn> MIPMap<Tmemory> *
 ImageTexture<Tmemory, Treturn>::GetTexture(const string &filename,
         bool doTrilinear, float maxAniso, ImageWrap wrap,
-        float scale, float gamma) {
+        float scale, float gamma, TexelFormat format, TileAccess tileAccess) {
     // Look for texture in texture cache
-    TexInfo texInfo(filename, doTrilinear, maxAniso, wrap, scale, gamma);
+    TexInfo texInfo(filename, doTrilinear, maxAniso, wrap, scale, gamma,
+                    format, tileAccess);
     if (textures.find(texInfo) != textures.end())
         return textures[texInfo];
-    int width, height;
-    RGBSpectrum *texels = ReadImage(filename, &width, &height);
+    int width = 0, height = 0;
     MIPMap<Tmemory> *ret = NULL;
-    if (texels) {
-        // Convert texels to type _Tmemory_ and create _MIPMap_
-        Tmemory *convertedTexels = new Tmemory[width*height];
-        for (int i = 0; i < width*height; ++i)
-            convertIn(texels[i], &convertedTexels[i], scale, gamma);
-        ret = new MIPMap<Tmemory>(width, height, convertedTexels, doTrilinear,
-                                  maxAniso, wrap);
-        delete[] texels;
-        delete[] convertedTexels;
+    if (IsTiledMIPFilename(filename)) {
+        // Create _MIPMap_ that reads tiles of _filename_ on demand
+        Reference<TiledMIPFile> file = TiledMIPFile::Open(filename);
+        if (file) {
+            if (format != TEXEL_FLOAT)
+                Warning("Tiled texture \"%s\" is stored with float texels; "
+                        "ignoring \"storage\" parameter.", filename.c_str());
+            // Use the pyramid's baked gamma and scale only by the ratio
+            // of the requested scale to the baked one, so that textures
+            // created with matching values are used in place
+            if (gamma != file->Gamma())
+                Warning("Tiled texture \"%s\" was created with gamma %g; "
+                        "ignoring \"gamma\" value %g. Use \"tiletex --gamma\" "
+                        "to change it.", filename.c_str(), file->Gamma(), gamma);
+            float levelScale = powf(scale / file->Scale(), file->Gamma());
+
+            // Read tiles through the texture cache unless the pyramid is
+            // small enough to map or load as a whole
+            TileSource *source = new TileSource(file, levelScale);
+            TextureCache *cache = GetTextureCache();
+            if (tileAccess == TILE_ACCESS_CACHE && !cache)
+                Warning("Texture cache is disabled with \"--texturecache 0\"; "
+                        "not using it for \"%s\".", filename.c_str());
+            if (tileAccess == TILE_ACCESS_MAP ||
+                (tileAccess == TILE_ACCESS_AUTO &&
+                 file->PyramidBytes() <=
+                     (uint64_t(PbrtOptions.textureCacheMB) << 20) / 8))
+                cache = NULL;
+            ret = new MIPMap<Tmemory>(file, source, cache, doTrilinear,
+                                      maxAniso, wrap);
+            width = file->LevelWidth(0);
+            height = file->LevelHeight(0);
+        }
     }
     else {
+        RGBSpectrum *texels = ReadImage(filename, &width, &height);
+        if (texels) {
+            // Convert texels to type _Tmemory_ and create _MIPMap_
+            Tmemory *convertedTexels = new Tmemory[width*height];
+            for (int i = 0; i < width*height; ++i)
+                convertIn(texels[i], &convertedTexels[i], scale, gamma);
+            ret = new MIPMap<Tmemory>(width, height, convertedTexels,
+                                      doTrilinear, maxAniso, wrap, format);
+            delete[] texels;
+            delete[] convertedTexels;
+        }
+    }
+    if (!ret) {
         // Create one-valued _MIPMap_
         Tmemory *oneVal = new Tmemory[1];
         oneVal[0] = powf(scale, gamma);
         ret = new MIPMap<Tmemory>(1, 1, oneVal);
         delete[] oneVal;
     }
+    if (PbrtOptions.textureStats)
+        ret->SetStats(GetMIPMapStats(filename));
     textures[texInfo] = ret;
     PBRT_LOADED_IMAGE_MAP(const_cast<char *>(filename.c_str()), width, height, sizeof(Tmemory), ret);
     return ret;
@@ -133,8 +218,22 @@ ImageTexture<float, float> *CreateImageFloatTexture(const Transform &tex2world,
     else if (wrap == "clamp") wrapMode = TEXTURE_CLAMP;
     float scale = tp.FindFloat("scale", 1.f);
     float gamma = tp.FindFloat("gamma", 1.f);
+    string storage = tp.FindString("storage", "float");
+    TexelFormat format = TEXEL_FLOAT;
+    if (storage == "half") format = TEXEL_HALF;
+    else if (storage == "srgb8") format = TEXEL_SRGB8;
+    else if (storage != "float")
+        Error("Texel storage \"%s\" unknown. Using \"float\".",
+              storage.c_str());
+    string access = tp.FindString("tileaccess", "auto");
+    TileAccess tileAccess = TILE_ACCESS_AUTO;
+    if (access == "cache") tileAccess = TILE_ACCESS_CACHE;
+    else if (access == "map") tileAccess = TILE_ACCESS_MAP;
+    else if (access != "auto")
+        Error("Tile access \"%s\" unknown. Using \"auto\".",
+              access.c_str());
     return new ImageTexture<float, float>(map, tp.FindFilename("filename"),
-        trilerp, maxAniso, wrapMode, scale, gamma);
+        trilerp, maxAniso, wrapMode, scale, gamma, format, tileAccess);
 }
 
 
@@ -171,8 +270,22 @@ ImageTexture<RGBSpectrum, Spectrum> *CreateImageSpectrumTexture(const Transform
     else if (wrap == "clamp") wrapMode = TEXTURE_CLAMP;
     float scale = tp.FindFloat("scale", 1.f);
     float gamma = tp.FindFloat("gamma", 1.f);
+    string storage = tp.FindString("storage", "float");
+    TexelFormat format = TEXEL_FLOAT;
+    if (storage == "half") format = TEXEL_HALF;
+    else if (storage == "srgb8") format = TEXEL_SRGB8;
+    else if (storage != "float")
+        Error("Texel storage \"%s\" unknown. Using \"float\".",
+              storage.c_str());
+    string access = tp.FindString("tileaccess", "auto");
+    TileAccess tileAccess = TILE_ACCESS_AUTO;
+    if (access == "cache") tileAccess = TILE_ACCESS_CACHE;
+    else if (access == "map") tileAccess = TILE_ACCESS_MAP;
+    else if (access != "auto")
+        Error("Tile access \"%s\" unknown. Using \"auto\".",
+              access.c_str());
     return new ImageTexture<RGBSpectrum, Spectrum>(map, tp.FindFilename("filename"),
-        trilerp, maxAniso, wrapMode, scale, gamma);
+        trilerp, maxAniso, wrapMode, scale, gamma, format, tileAccess);
 }
 
 
@@ -45,19 +45,25 @@
 
 // TexInfo Declarations
 struct TexInfo {
-    TexInfo(const string &f, bool dt, float ma, ImageWrap wm, float sc, float ga)
-        : filename(f), doTrilinear(dt), maxAniso(ma), wrapMode(wm), scale(sc), gamma(ga) { }
+    TexInfo(const string &f, bool dt, float ma, ImageWrap wm, float sc, float ga,
+            TexelFormat tf, TileAccess ta)
+        : filename(f), doTrilinear(dt), maxAniso(ma), wrapMode(wm), scale(sc),
+          gamma(ga), format(tf), tileAccess(ta) { }
     string filename;
     bool doTrilinear;
     float maxAniso;
     ImageWrap wrapMode;
     float scale, gamma;
+    TexelFormat format;
+    TileAccess tileAccess;
     bool operator<(const TexInfo &t2) const {
         if (filename != t2.filename) return filename < t2.filename;
         if (doTrilinear != t2.doTrilinear) return doTrilinear < t2.doTrilinear;
         if (maxAniso != t2.maxAniso) return maxAniso < t2.maxAniso;
         if (scale != t2.scale) return scale < t2.scale;
         if (gamma != t2.gamma) return gamma < t2.gamma;
+        if (format != t2.format) return format < t2.format;
+        if (tileAccess != t2.tileAccess) return tileAccess < t2.tileAccess;
         return wrapMode < t2.wrapMode;
     }
 };
@@ -70,7 +76,9 @@ template <typename Tmemory, typename Treturn>
 public:
     // ImageTexture Public Methods
     ImageTexture(TextureMapping2D *m, const string &filename, bool doTri,
-                 float maxAniso, ImageWrap wm, float scale, float gamma);
+                 float maxAniso, ImageWrap wm, float scale, float gamma,
+                 TexelFormat format = TEXEL_FLOAT,
+                 TileAccess tileAccess = TILE_ACCESS_AUTO);
     Treturn Evaluate(const DifferentialGeometry &) const;
     ~ImageTexture();
     static void ClearCache() {
@@ -85,7 +93,8 @@ public:
 private:
     // ImageTexture Private Methods
     static MIPMap<Tmemory> *GetTexture(const string &filename,
-        bool doTrilinear, float maxAniso, ImageWrap wm, float scale, float gamma);
+        bool doTrilinear, float maxAniso, ImageWrap wm, float scale, float gamma,
+        TexelFormat format, TileAccess tileAccess);
     static void convertIn(const RGBSpectrum &from, RGBSpectrum *to,
                           float scale, float gamma) {
         *to = Pow(scale * from, gamma);
@@ -102,6 +111,7 @@ private:
     static void convertOut(float from, float *to) {
         *to = from;
     }
+    class TileSource;
 
     // ImageTexture Private Data
     MIPMap<Tmemory> *mipmap;
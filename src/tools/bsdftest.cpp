@@ -145,7 +145,9 @@ int main(int argc, char *argv[])
             bool reverseOrientation = false;
             ParamSet p;
 
-            Reference<Shape> disk = new Disk(new Transform(t), new Transform(Inverse(t)),
+            AffineTransform *diskTransforms = new AffineTransform[2];
+            AffineTransformPair(t, &diskTransforms[0], &diskTransforms[1]);
+            Reference<Shape> disk = new Disk(&diskTransforms[0], &diskTransforms[1],
                                              reverseOrientation, 0., 1., 0, 360.);
             if (!disk) {
                 fprintf(stderr, "Could not load disk plugin\n"
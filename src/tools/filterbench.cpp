@@ -0,0 +1,140 @@
+
+/*
+    pbrt source code Copyright(c) 1998-2012 Matt Pharr and Greg Humphreys.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+// tools/filterbench.cpp*
+#include "pbrt.h"
+#include "film/image.h"
+#include "filters/box.h"
+#include "filters/gaussian.h"
+#include "filters/mitchell.h"
+#include "filters/sinc.h"
+#include "rng.h"
+#include "spectrum.h"
+#include "timer.h"
+
+// Filter Benchmark Declarations
+#define BENCH_RESOLUTION 256
+#define BENCH_TILE_SIZE 16
+#define BENCH_FILTERS 4
+static const char *filterNames[BENCH_FILTERS] = {
+    "box", "gaussian", "mitchell", "sinc"
+};
+static Filter *MakeBenchFilter(int which) {
+    // Create filter with the default parameters of the scene description
+    switch (which) {
+    case 0:  return new BoxFilter(0.5f, 0.5f);
+    case 1:  return new GaussianFilter(2.f, 2.f, 2.f);
+    case 2:  return new MitchellFilter(1.f/3.f, 1.f/3.f, 2.f, 2.f);
+    default: return new LanczosSincFilter(4.f, 4.f, 3.f);
+    }
+}
+
+
+static double SplatSamples(ImageFilm *film, const CameraSample *samples,
+                           const Spectrum *L, int spp, bool tiled) {
+    // Add samples to _film_ one _BENCH_TILE_SIZE_ square tile at a time
+    Timer timer;
+    timer.Start();
+    int nTilePixels = BENCH_TILE_SIZE * BENCH_TILE_SIZE;
+    for (int y = 0; y < BENCH_RESOLUTION; y += BENCH_TILE_SIZE)
+        for (int x = 0; x < BENCH_RESOLUTION; x += BENCH_TILE_SIZE) {
+            int tile = (y / BENCH_TILE_SIZE) *
+                (BENCH_RESOLUTION / BENCH_TILE_SIZE) + x / BENCH_TILE_SIZE;
+            int first = tile * nTilePixels * spp, count = nTilePixels * spp;
+            if (tiled) {
+                FilmTile *filmTile = film->GetFilmTile(x, x + BENCH_TILE_SIZE,
+                                                       y, y + BENCH_TILE_SIZE);
+                for (int i = first; i < first + count; ++i)
+                    filmTile->AddSample(samples[i], L[i]);
+                film->MergeFilmTile(filmTile);
+            }
+            else
+                for (int i = first; i < first + count; ++i)
+                    film->AddSample(samples[i], L[i]);
+        }
+    timer.Stop();
+    return timer.Time();
+}
+
+
+
+// Filter Benchmark Main Program
+int main(int argc, char *argv[]) {
+    int spp = (argc > 1) ? atoi(argv[1]) : 16;
+    if (spp <= 0) {
+        fprintf(stderr, "usage: filterbench [samples per pixel]\n");
+        return 1;
+    }
+
+    // Generate random samples and radiance values tile by tile
+    int nSamples = BENCH_RESOLUTION * BENCH_RESOLUTION * spp;
+    CameraSample *samples = new CameraSample[nSamples];
+    Spectrum *L = new Spectrum[nSamples];
+    RNG rng(7);
+    int nTiles = BENCH_RESOLUTION / BENCH_TILE_SIZE;
+    for (int i = 0; i < nSamples; ++i) {
+        int tile = i / (BENCH_TILE_SIZE * BENCH_TILE_SIZE * spp);
+        int pixel = (i / spp) % (BENCH_TILE_SIZE * BENCH_TILE_SIZE);
+        samples[i].imageX = (tile % nTiles) * BENCH_TILE_SIZE +
+            pixel % BENCH_TILE_SIZE + rng.RandomFloat();
+        samples[i].imageY = (tile / nTiles) * BENCH_TILE_SIZE +
+            pixel / BENCH_TILE_SIZE + rng.RandomFloat();
+        samples[i].lensU = samples[i].lensV = samples[i].time = 0.f;
+        float rgb[3] = { rng.RandomFloat(), rng.RandomFloat(),
+                         rng.RandomFloat() };
+        L[i] = Spectrum::FromRGB(rgb);
+    }
+
+    // Time direct and tiled splatting for each filter
+    printf("%d x %d image, %d samples per pixel\n", BENCH_RESOLUTION,
+           BENCH_RESOLUTION, spp);
+    printf("%-10s %16s %16s %9s\n", "filter", "direct ns/sample",
+           "tiled ns/sample", "speedup");
+    const float crop[4] = { 0.f, 1.f, 0.f, 1.f };
+    for (int which = 0; which < BENCH_FILTERS; ++which) {
+        double time[2];
+        for (int tiled = 0; tiled < 2; ++tiled) {
+            ImageFilm film(BENCH_RESOLUTION, BENCH_RESOLUTION,
+                           MakeBenchFilter(which), crop,
+                           "filterbench.tga", false);
+            time[tiled] = SplatSamples(&film, samples, L, spp, tiled != 0);
+        }
+        printf("%-10s %16.2f %16.2f %8.2fx\n", filterNames[which],
+               1e9 * time[0] / nSamples, 1e9 * time[1] / nSamples,
+               time[0] / time[1]);
+    }
+    delete[] samples;
+    delete[] L;
+    return 0;
+}
+
+
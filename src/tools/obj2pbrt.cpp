@@ -896,10 +896,62 @@ LoadObj(
 
 using namespace tinyobj;
 
+static void WriteUInt32(FILE *f, unsigned int v) {
+  putc(v & 0xff, f);
+  putc((v >> 8) & 0xff, f);
+  putc((v >> 16) & 0xff, f);
+  putc((v >> 24) & 0xff, f);
+}
+
+static void WriteFloats(FILE *f, const std::vector<float> &v) {
+  for (size_t i = 0; i < v.size(); ++i) {
+    unsigned int bits;
+    memcpy(&bits, &v[i], sizeof(float));
+    WriteUInt32(f, bits);
+  }
+}
+
+// Writes _mesh_ in the little-endian layout read by pbrt's "binarymesh"
+// shape.
+static bool WriteBinaryMesh(const char *filename, const mesh_t &mesh) {
+  FILE *f = fopen(filename, "wb");
+  if (!f) {
+    perror(filename);
+    return false;
+  }
+  unsigned int flags = 0;
+  if (mesh.normals.size()) flags |= 0x1;
+  if (mesh.texcoords.size()) flags |= 0x4;
+  fwrite("PBRTMESH", 1, 8, f);
+  WriteUInt32(f, 1);
+  WriteUInt32(f, flags);
+  WriteUInt32(f, mesh.positions.size() / 3);
+  WriteUInt32(f, mesh.indices.size() / 3);
+  WriteUInt32(f, 0);
+  WriteUInt32(f, 0);
+  WriteFloats(f, mesh.positions);
+  WriteFloats(f, mesh.normals);
+  WriteFloats(f, mesh.texcoords);
+  for (size_t i = 0; i < mesh.indices.size(); ++i)
+    WriteUInt32(f, mesh.indices[i]);
+  if (fclose(f) != 0) {
+    perror(filename);
+    return false;
+  }
+  return true;
+}
+
 int main(int argc, char *argv[]) {
+  bool binary = (argc > 1 && strcmp(argv[1], "--binary") == 0);
+  if (binary) {
+    --argc;
+    ++argv;
+  }
   if (argc != 3 || strcmp(argv[1], "--help") == 0 ||
-      strcmp(argv[1], "-h") == 0) {
-    fprintf(stderr, "usage: obj2pbrt [OBJ filename] [pbrt output filename]\n");
+      strcmp(argv[1], "-h") == 0 || (binary && strcmp(argv[2], "-") == 0)) {
+    fprintf(stderr, "usage: obj2pbrt [--binary] [OBJ filename] [pbrt output filename]\n");
+    fprintf(stderr, "  --binary  write each mesh to a binary mesh file next to the\n"
+                    "            output file and emit \"binarymesh\" shapes\n");
     return 1;
   }
 
@@ -1010,6 +1062,28 @@ int main(int argc, char *argv[]) {
     fprintf(f, "\n\n");
 
     const mesh_t &mesh = shape.mesh;
+    if (binary) {
+      // Write mesh to file alongside the pbrt output
+      std::string outName(argv[2]), baseName = outName;
+      size_t slash = outName.find_last_of("/\\");
+      if (slash != std::string::npos)
+        baseName = outName.substr(slash + 1);
+      size_t dot = baseName.find_last_of('.');
+      if (dot != std::string::npos && dot > 0)
+        baseName = baseName.substr(0, dot);
+      char suffix[32];
+      sprintf(suffix, "-%d.pbrtmesh", (int)i);
+      std::string meshName = baseName + suffix;
+      std::string meshPath = (slash != std::string::npos) ?
+          outName.substr(0, slash + 1) + meshName : meshName;
+      if (!WriteBinaryMesh(meshPath.c_str(), mesh))
+        return 1;
+      numTriangles += mesh.indices.size() / 3;
+      fprintf(f, "Shape \"binarymesh\" \"string filename\" \"%s\"\n",
+              meshName.c_str());
+      fprintf(f, "AttributeEnd\n\n\n");
+      continue;
+    }
     fprintf(f, "Shape \"trianglemesh\"\n");
     fprintf(f, "  \"point P\" [\n    ");
     for (size_t i = 0; i < mesh.positions.size(); ++i) {
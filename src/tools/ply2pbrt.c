@@ -76,9 +76,12 @@ static PlyOtherProp *vert_other,*face_other;
 static int per_vertex_color = 0;
 static int has_normals = 0;
 
+static char *binary_filename = NULL;
+
 void usage(char *progname);
 void read_file(void);
 void write_lrt(void);
+void write_binary(void);
 
 
 /******************************************************************************
@@ -96,6 +99,14 @@ main(int argc, char *argv[])
   while (--argc > 0 && (*++argv)[0]=='-') {
     for (s = argv[0]+1; *s; s++)
       switch (*s) {
+        case 'b':
+          if (--argc == 0) {
+            usage (progname);
+            exit (-1);
+          }
+          binary_filename = *++argv;
+          s = " ";  /* stop scanning this argument's flags */
+          break;
         default:
           usage (progname);
           exit (-1);
@@ -104,7 +115,10 @@ main(int argc, char *argv[])
   }
 
   read_file();
-  write_lrt();
+  if (binary_filename)
+    write_binary();
+  else
+    write_lrt();
   return 0;
 }
 
@@ -116,7 +130,9 @@ Print out usage information.
 void
 usage(char *progname)
 {
-  fprintf (stderr, "usage: %s [flags] <in.ply >out.iv\n", progname);
+  fprintf (stderr, "usage: %s [flags] <in.ply >out.pbrt\n", progname);
+  fprintf (stderr, "       -b mesh.bin  write geometry to a binary mesh file and\n");
+  fprintf (stderr, "                    emit a \"binarymesh\" shape that refers to it\n");
 }
 
 
@@ -258,3 +274,78 @@ write_lrt(void)
   printf ("\n");
 }
 
+
+/******************************************************************************
+Write out a binary mesh file, in the little-endian layout read by pbrt's
+"binarymesh" shape, and a shape that refers to it.
+******************************************************************************/
+
+static void
+write_uint32(FILE *f, unsigned int v)
+{
+  putc (v & 0xff, f);
+  putc ((v >> 8) & 0xff, f);
+  putc ((v >> 16) & 0xff, f);
+  putc ((v >> 24) & 0xff, f);
+}
+
+static void
+write_float(FILE *f, float v)
+{
+  unsigned int bits;
+  memcpy (&bits, &v, sizeof(float));
+  write_uint32 (f, bits);
+}
+
+void
+write_binary(void)
+{
+  int i,j;
+  unsigned int ntris = 0;
+  FILE *f;
+
+  f = fopen (binary_filename, "wb");
+  if (!f) {
+    fprintf (stderr, "Unable to open \"%s\" for writing\n", binary_filename);
+    exit (-1);
+  }
+  for (i = 0; i < nfaces; i++)
+    if (flist[i]->nverts > 2)
+      ntris += flist[i]->nverts - 2;
+
+  /* header: magic, version, flags, vertex and triangle counts */
+  fwrite ("PBRTMESH", 1, 8, f);
+  write_uint32 (f, 1);
+  write_uint32 (f, has_normals ? 0x1 : 0);
+  write_uint32 (f, nverts);
+  write_uint32 (f, ntris);
+  write_uint32 (f, 0);
+  write_uint32 (f, 0);
+
+  for (i = 0; i < nverts; i++) {
+    write_float (f, vlist[i]->x);
+    write_float (f, vlist[i]->y);
+    write_float (f, vlist[i]->z);
+  }
+  if (has_normals)
+    for (i = 0; i < nverts; i++) {
+      write_float (f, vlist[i]->nx);
+      write_float (f, vlist[i]->ny);
+      write_float (f, vlist[i]->nz);
+    }
+  for (i = 0; i < nfaces; i++) {
+    /* triangulate the faces... */
+    int nv = flist[i]->nverts;
+    for (j = 0; j < nv-2; ++j) {
+      write_uint32 (f, flist[i]->verts[0]);
+      write_uint32 (f, flist[i]->verts[j+1]);
+      write_uint32 (f, flist[i]->verts[j+2]);
+    }
+  }
+  if (fclose (f) != 0) {
+    fprintf (stderr, "Error writing \"%s\"\n", binary_filename);
+    exit (-1);
+  }
+
+  printf ("Shape \"binarymesh\" \"string filename\" \"%s\"\n", binary_filename);
+}
@@ -35,6 +35,7 @@
 #include "sampler.h"
 #include "progressreporter.h"
 #include "montecarlo.h"
+#include "parser.h"
 
 // BestCandidate Sampling Constants
 #define SQRT_SAMPLE_TABLE_SIZE 64
@@ -47,8 +48,8 @@ typedef vector<int> SampleGrid[BC_GRID_SIZE][BC_GRID_SIZE];
 #define GRID(v) (int((v) * BC_GRID_SIZE))
 
 // Sample Pattern Precomputation
-int line_num = 0; // make this link!
-string current_file; // ditto.
+PBRT_THREAD_LOCAL int line_num = 0; // make this link!
+PBRT_THREAD_LOCAL const char *current_file = NULL; // ditto.
 
 // Pattern Precomputation Local Data
 static float imageSamples[SAMPLE_TABLE_SIZE][2];
@@ -0,0 +1,135 @@
+
+/*
+    pbrt source code Copyright(c) 1998-2012 Matt Pharr and Greg Humphreys.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+// tools/texbench.cpp*
+#include "pbrt.h"
+#include "mipmap.h"
+#include "parallel.h"
+#include "rng.h"
+#include "spectrum.h"
+#include "timer.h"
+
+// Texture Filtering Benchmark Declarations
+#define BENCH_RESOLUTION 1024
+#define BENCH_SCANLINE 512
+#define BENCH_ANISOTROPIES 5
+static const float anisotropies[BENCH_ANISOTROPIES] = { 1.f, 2.f, 4.f, 8.f, 16.f };
+struct BenchLookup {
+    float s, t, ds0, dt0, ds1, dt1;
+};
+
+
+static double LookupTexels(const MIPMap<RGBSpectrum> &mipmap,
+                           const BenchLookup *lookups, int nLookups,
+                           float *checksum) {
+    // Filter all _lookups_ with _mipmap_ and time them
+    Timer timer;
+    timer.Start();
+    RGBSpectrum sum(0.f);
+    for (int i = 0; i < nLookups; ++i) {
+        const BenchLookup &l = lookups[i];
+        sum += mipmap.Lookup(l.s, l.t, l.ds0, l.dt0, l.ds1, l.dt1);
+    }
+    timer.Stop();
+    *checksum = sum.y();
+    return timer.Time();
+}
+
+
+
+// Texture Filtering Benchmark Main Program
+int main(int argc, char *argv[]) {
+    int nLookups = (argc > 1) ? atoi(argv[1]) : 200000;
+    if (nLookups <= 0) {
+        fprintf(stderr, "usage: texbench [lookups]\n");
+        return 1;
+    }
+
+    // Create random checkered texture with trilinear and EWA MIP maps
+    RGBSpectrum *texels = new RGBSpectrum[BENCH_RESOLUTION * BENCH_RESOLUTION];
+    RNG rng(7);
+    for (int t = 0; t < BENCH_RESOLUTION; ++t)
+        for (int s = 0; s < BENCH_RESOLUTION; ++s) {
+            float rgb[3] = { rng.RandomFloat(), rng.RandomFloat(),
+                             rng.RandomFloat() };
+            if (((s >> 4) + (t >> 4)) & 1)
+                rgb[0] = rgb[1] = rgb[2] = 0.1f * rgb[0];
+            texels[t * BENCH_RESOLUTION + s] = RGBSpectrum::FromRGB(rgb);
+        }
+    float maxAniso = anisotropies[BENCH_ANISOTROPIES - 1];
+    MIPMap<RGBSpectrum> trilinear(BENCH_RESOLUTION, BENCH_RESOLUTION, texels,
+                                  true, maxAniso);
+    MIPMap<RGBSpectrum> ewa(BENCH_RESOLUTION, BENCH_RESOLUTION, texels,
+                            false, maxAniso);
+    delete[] texels;
+
+    // Time lookups at each anisotropy in scanline order, like a camera
+    // viewing the texture, with footprints whose orientation varies smoothly
+    printf("%d x %d texture, %d lookups\n", BENCH_RESOLUTION,
+           BENCH_RESOLUTION, nLookups);
+    // Checksums are the summed luminance of all lookups; they should match
+    // between builds that only change how filtering is computed
+    printf("%-10s %18s %18s %9s %16s %16s\n", "aniso", "trilinear ns/lookup",
+           "EWA ns/lookup", "ratio", "trilinear sum", "EWA sum");
+    BenchLookup *lookups = new BenchLookup[nLookups];
+    for (int a = 0; a < BENCH_ANISOTROPIES; ++a) {
+        // Footprints span about four texels along their minor axis
+        float minorLength = 4.f / BENCH_RESOLUTION;
+        float majorLength = anisotropies[a] * minorLength;
+        for (int i = 0; i < nLookups; ++i) {
+            lookups[i].s = ((i % BENCH_SCANLINE) + rng.RandomFloat()) /
+                BENCH_SCANLINE;
+            lookups[i].t = ((i / BENCH_SCANLINE) + rng.RandomFloat()) /
+                BENCH_SCANLINE;
+            float phi = M_PI * (lookups[i].s + lookups[i].t);
+            float c = cosf(phi), s = sinf(phi);
+            lookups[i].ds0 = majorLength * c;
+            lookups[i].dt0 = majorLength * s;
+            lookups[i].ds1 = -minorLength * s;
+            lookups[i].dt1 = minorLength * c;
+        }
+        float checksum[2];
+        double time[2];
+        time[0] = LookupTexels(trilinear, lookups, nLookups, &checksum[0]);
+        time[1] = LookupTexels(ewa, lookups, nLookups, &checksum[1]);
+        printf("%-10g %18.1f %18.1f %8.2fx %16.9g %16.9g\n", anisotropies[a],
+               1e9 * time[0] / nLookups, 1e9 * time[1] / nLookups,
+               time[1] / time[0], checksum[0], checksum[1]);
+        if (checksum[0] != checksum[0] || checksum[1] != checksum[1])
+            fprintf(stderr, "texbench: NaN filter result\n");
+    }
+    delete[] lookups;
+    TasksCleanup();
+    return 0;
+}
+
+
@@ -0,0 +1,102 @@
+
+/*
+    pbrt source code Copyright(c) 1998-2012 Matt Pharr and Greg Humphreys.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+// tools/tiletex.cpp*
+#include "pbrt.h"
+#include "imageio.h"
+#include "mipmap.h"
+#include "parallel.h"
+#include "spectrum.h"
+
+static void usage() {
+    fprintf(stderr, "usage: tiletex [--gray] [--wrap repeat|black|clamp] "
+            "[--scale s] [--gamma g] <image> <output.tmip>\n");
+    exit(1);
+}
+
+
+// Tiled Texture Conversion Main Program
+int main(int argc, char *argv[]) {
+    bool gray = false;
+    ImageWrap wrapMode = TEXTURE_REPEAT;
+    float scale = 1.f, gamma = 1.f;
+    int i;
+    for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+        if (!strcmp(argv[i], "--gray")) gray = true;
+        else if (!strcmp(argv[i], "--wrap") && i + 1 < argc) {
+            ++i;
+            if (!strcmp(argv[i], "repeat")) wrapMode = TEXTURE_REPEAT;
+            else if (!strcmp(argv[i], "black")) wrapMode = TEXTURE_BLACK;
+            else if (!strcmp(argv[i], "clamp")) wrapMode = TEXTURE_CLAMP;
+            else usage();
+        }
+        else if (!strcmp(argv[i], "--scale") && i + 1 < argc) {
+            scale = atof(argv[++i]);
+            if (scale <= 0.f) usage();
+        }
+        else if (!strcmp(argv[i], "--gamma") && i + 1 < argc) {
+            gamma = atof(argv[++i]);
+            if (gamma <= 0.f) usage();
+        }
+        else usage();
+    }
+    if (i + 2 != argc || !IsTiledMIPFilename(argv[i + 1])) usage();
+    const char *inFilename = argv[i], *outFilename = argv[i + 1];
+
+    // Read image, apply _scale_ and _gamma_, and build its MIP map pyramid
+    int width, height;
+    RGBSpectrum *texels = ReadImage(inFilename, &width, &height);
+    if (!texels) return 1;
+    bool ok;
+    if (gray) {
+        // Store luminance for use by float textures
+        float *y = new float[width * height];
+        for (int j = 0; j < width * height; ++j)
+            y[j] = powf(scale * texels[j].y(), gamma);
+        MIPMap<float> mipmap(width, height, y, false, 8.f, wrapMode);
+        ok = mipmap.WriteTiled(outFilename, scale, gamma);
+        delete[] y;
+    }
+    else {
+        for (int j = 0; j < width * height; ++j)
+            texels[j] = Pow(scale * texels[j], gamma);
+        MIPMap<RGBSpectrum> mipmap(width, height, texels, false, 8.f, wrapMode);
+        ok = mipmap.WriteTiled(outFilename, scale, gamma);
+    }
+    delete[] texels;
+    TasksCleanup();
+    if (!ok) {
+        fprintf(stderr, "tiletex: unable to write \"%s\"\n", outFilename);
+        return 1;
+    }
+    return 0;
+}